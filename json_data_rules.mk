@@ -1,15 +1,23 @@
 # JSON files are run through jsonproc, which is a tool that converts JSON data to an output file
 # based on an Inja template. https://github.com/pantor/inja
 
-AUTO_GEN_TARGETS += $(DATA_C_SUBDIR)/items.h
+# Every header is rendered by one jsonproc run, which parses each template once
+# and only rewrites outputs whose contents changed. Each job is the JSON file,
+# the template and the output, which are found next to each other.
+JSONPROC_OUTPUTS := $(DATA_C_SUBDIR)/items.h $(DATA_C_SUBDIR)/wild_encounters.h
+JSONPROC_JOBS := $(foreach out,$(JSONPROC_OUTPUTS),$(out:.h=.json) $(out:.h=.json.txt) $(out))
+JSONPROC_STAMP := $(OBJ_DIR)/jsonproc_stamp
+JSONPROC_ALL = printf '%s %s %s\n' $(JSONPROC_JOBS) | $(JSONPROC) -batch
 
-$(DATA_C_SUBDIR)/items.h: $(DATA_C_SUBDIR)/items.json $(DATA_C_SUBDIR)/items.json.txt
-	$(JSONPROC) $^ $@
+AUTO_GEN_TARGETS += $(JSONPROC_OUTPUTS)
 
-$(C_BUILDDIR)/item.o: c_dep += $(DATA_C_SUBDIR)/items.h
+$(JSONPROC_STAMP): $(JSONPROC_OUTPUTS:.h=.json) $(JSONPROC_OUTPUTS:.h=.json.txt)
+	$(JSONPROC_ALL)
+	@touch $@
 
-AUTO_GEN_TARGETS += $(DATA_C_SUBDIR)/wild_encounters.h
-$(DATA_C_SUBDIR)/wild_encounters.h: $(DATA_C_SUBDIR)/wild_encounters.json $(DATA_C_SUBDIR)/wild_encounters.json.txt
-	$(JSONPROC) $^ $@
+$(JSONPROC_OUTPUTS): $(JSONPROC_STAMP)
+	$(if $(wildcard $@),,$(JSONPROC_ALL))
 
-$(C_BUILDDIR)/wild_encounter.o: c_dep += $(DATA_C_SUBDIR)/wild_encounters.h
+$(C_BUILDDIR)/item.o: $(DATA_C_SUBDIR)/items.h
+
+$(C_BUILDDIR)/wild_encounter.o: $(DATA_C_SUBDIR)/wild_encounters.h
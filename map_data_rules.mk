@@ -8,22 +8,24 @@ MAP_CONNECTIONS := $(patsubst $(MAPS_DIR)/%/,$(MAPS_DIR)/%/connections.inc,$(MAP
 MAP_EVENTS := $(patsubst $(MAPS_DIR)/%/,$(MAPS_DIR)/%/events.inc,$(MAP_DIRS))
 MAP_HEADERS := $(patsubst $(MAPS_DIR)/%/,$(MAPS_DIR)/%/header.inc,$(MAP_DIRS))
 
-$(MAPS_DIR)/%/header.inc: $(MAPS_DIR)/%/map.json
-	$(MAPJSON) map firered $< $(LAYOUTS_DIR)/layouts.json
-$(MAPS_DIR)/%/events.inc: $(MAPS_DIR)/%/header.inc ;
-$(MAPS_DIR)/%/connections.inc: $(MAPS_DIR)/%/events.inc ;
-
-$(MAPS_DIR)/groups.inc: $(MAPS_DIR)/map_groups.json
-	$(MAPJSON) groups firered $<
-$(MAPS_DIR)/connections.inc: $(MAPS_DIR)/groups.inc ;
-$(MAPS_DIR)/events.inc: $(MAPS_DIR)/connections.inc ;
-$(MAPS_DIR)/headers.inc: $(MAPS_DIR)/events.inc ;
-include/constants/map_groups.h: $(MAPS_DIR)/headers.inc ;
-
-$(LAYOUTS_DIR)/layouts.inc: $(LAYOUTS_DIR)/layouts.json
-	$(MAPJSON) layouts firered $<
-$(LAYOUTS_DIR)/layouts_table.inc: $(LAYOUTS_DIR)/layouts.inc ;
-include/constants/layouts.h: $(LAYOUTS_DIR)/layouts_table.inc ;
+MAP_JSONS := $(wildcard $(MAPS_DIR)/*/map.json)
+
+# All the map data is generated by one mapjson run, which only rewrites files
+# whose contents changed, so that only the objects that use those are rebuilt.
+# The stamp records when it last ran. A generated file that has gone missing
+# since then is brought back by running it again; otherwise the files' own
+# rule does nothing, without even starting a shell.
+MAPJSON_STAMP := $(OBJ_DIR)/mapjson_stamp
+MAPJSON_ALL = $(MAPJSON) all firered $(MAPS_DIR)/map_groups.json $(LAYOUTS_DIR)/layouts.json
+
+$(MAPJSON_STAMP): $(MAPS_DIR)/map_groups.json $(LAYOUTS_DIR)/layouts.json $(MAP_JSONS)
+	$(MAPJSON_ALL)
+	@touch $@
+
+$(MAP_HEADERS) $(MAP_EVENTS) $(MAP_CONNECTIONS) \
+$(MAPS_DIR)/groups.inc $(MAPS_DIR)/connections.inc $(MAPS_DIR)/events.inc $(MAPS_DIR)/headers.inc include/constants/map_groups.h \
+$(LAYOUTS_DIR)/layouts.inc $(LAYOUTS_DIR)/layouts_table.inc include/constants/layouts.h: $(MAPJSON_STAMP)
+	$(if $(wildcard $@),,$(MAPJSON_ALL))
 
 $(DATA_ASM_BUILDDIR)/maps.o: $(DATA_ASM_SUBDIR)/maps.s $(LAYOUTS_DIR)/layouts.inc $(LAYOUTS_DIR)/layouts_table.inc $(MAPS_DIR)/headers.inc $(MAPS_DIR)/groups.inc $(MAPS_DIR)/connections.inc $(MAP_CONNECTIONS) $(MAP_HEADERS)
 	$(PREPROC) $< charmap.txt | $(CPP) -I include -nostdinc -undef -Wno-unicode - | $(AS) $(ASFLAGS) -o $@
@@ -24,6 +24,15 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <limits.h>
+#include <ctype.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 /* extended.c */
 void ieee754_write_extended (double, uint8_t*);
@@ -98,8 +107,11 @@ void write_bytearray(const char *filename, struct Bytes *bytes)
 	{
 		FATAL_ERROR("Failed to open '%s' for writing!\n", filename);
 	}
-	fwrite(bytes->data, bytes->length, 1, f);
-	fclose(f);
+	bool written = bytes->length == 0 || fwrite(bytes->data, bytes->length, 1, f) == 1;
+	if (fclose(f) != 0 || !written)
+	{
+		FATAL_ERROR("Failed to write '%s'!\n", filename);
+	}
 }
 
 void free_bytearray(struct Bytes *bytes)
@@ -438,73 +450,239 @@ int get_delta_index(uint8_t sample, uint8_t prev_sample)
 	return best_index;
 }
 
-struct Bytes *delta_compress(struct Bytes *pcm)
-{
-	struct Bytes *delta = malloc(sizeof(struct Bytes));
-	// estimate the length so we can malloc
-	int num_blocks = pcm->length / 64;
-	delta->length = num_blocks * 33;
+// Compressed samples come in blocks of 64: a raw sample, then a delta for
+// each of the other 63.
+#define DELTA_BLOCK_SIZE 64
 
-	int extra = pcm->length % 64;
-	if (extra)
-	{
-		delta->length += 1;
-		extra -= 1;
-	}
-	if (extra)
+// The number of decoded values the trellis encoder follows from one sample
+// to the next.
+#define TRELLIS_BEAM_WIDTH 64
+
+// get_delta_index() for every sample and previous sample, filled in the
+// first time it's needed.
+static uint8_t delta_index_lut[256][256];
+static bool delta_index_lut_ready = false;
+
+static void init_delta_index_lut(void)
+{
+	for (int prev_sample = 0; prev_sample < 256; prev_sample++)
 	{
-		delta->length += 1;
-		extra -= 1;
+		uint8_t values[16];
+		int order[16];
+
+		// Sort the deltas by the value they lead to, so that the closest
+		// one to each sample is found by sweeping through the samples.
+		for (int i = 0; i < 16; i++)
+		{
+			int j = i;
+
+			values[i] = prev_sample + gDeltaEncodingTable[i];
+
+			for (; j > 0 && values[order[j - 1]] > values[i]; j--)
+				order[j] = order[j - 1];
+
+			order[j] = i;
+		}
+
+		int k = 0;
+
+		for (int sample = 0; sample < 256; sample++)
+		{
+			while (k < 15 && values[order[k + 1]] <= sample)
+				k++;
+
+			int best_index = order[k];
+
+			// Like get_delta_index(), prefer the lower index on a tie.
+			if (k < 15 && values[order[k]] <= sample)
+			{
+				int below = sample - values[order[k]];
+				int above = values[order[k + 1]] - sample;
+
+				if (above < below || (above == below && order[k + 1] < order[k]))
+					best_index = order[k + 1];
+			}
+
+			delta_index_lut[sample][prev_sample] = best_index;
+		}
 	}
-	if (extra)
+
+	delta_index_lut_ready = true;
+}
+
+// Picks each delta to land as close as it can to the next sample.
+static void encode_block_greedy(const uint8_t *samples, int num_samples, uint8_t *base, uint8_t *indexes)
+{
+	uint8_t value = samples[0];
+
+	*base = value;
+
+	for (int i = 1; i < num_samples; i++)
 	{
-		delta->length += (extra + 1) / 2;
+		int index = delta_index_lut[samples[i]][value];
+		indexes[i - 1] = index;
+		value += gDeltaEncodingTable[index];
 	}
+}
 
-	delta->data = malloc(delta->length + 33);
+static uint32_t squared_error(uint8_t value, uint8_t sample)
+{
+	int error = (int8_t)value - (int8_t)sample;
+	return error * error;
+}
 
-	unsigned int i = 0;
-	unsigned int j = 0;
-	int k;
-	uint8_t base;
-	int delta_index;
+// Reorders values so that the count cheapest come first.
+static void select_cheapest(uint8_t *values, int num_values, int count, const uint32_t *costs)
+{
+	int lo = 0;
+	int hi = num_values - 1;
 
-	while (i < pcm->length)
+	while (lo < hi)
 	{
-		base = pcm->data[i++];
-		delta->data[j++] = base;
+		uint32_t pivot = costs[values[(lo + hi) / 2]];
+		int i = lo;
+		int j = hi;
 
-		if (i >= pcm->length)
+		while (i <= j)
 		{
+			while (costs[values[i]] < pivot)
+				i++;
+			while (costs[values[j]] > pivot)
+				j--;
+			if (i <= j)
+			{
+				uint8_t temp = values[i];
+				values[i++] = values[j];
+				values[j--] = temp;
+			}
+		}
+
+		if (count - 1 <= j)
+			hi = j;
+		else if (count - 1 >= i)
+			lo = i;
+		else
 			break;
+	}
+}
+
+// Picks the raw sample and deltas that give the smallest total squared
+// error over the block. This is a Viterbi search over the decoded value,
+// following only the TRELLIS_BEAM_WIDTH cheapest values at each sample.
+// A block that the greedy encoder reproduces exactly comes out the same.
+static void encode_block_trellis(const uint8_t *samples, int num_samples, uint8_t *base, uint8_t *indexes)
+{
+	uint8_t prev_values[DELTA_BLOCK_SIZE][256];
+	uint8_t prev_indexes[DELTA_BLOCK_SIZE][256];
+	uint32_t costs[256];
+	uint32_t new_costs[256];
+	uint8_t beam[256];
+	int beam_size = 0;
+
+	for (int value = 0; value < 256; value++)
+	{
+		costs[value] = squared_error(value, samples[0]);
+		beam[beam_size++] = value;
+	}
+
+	for (int i = 1; i < num_samples; i++)
+	{
+		if (beam_size > TRELLIS_BEAM_WIDTH)
+		{
+			select_cheapest(beam, beam_size, TRELLIS_BEAM_WIDTH, costs);
+			beam_size = TRELLIS_BEAM_WIDTH;
 		}
-		delta_index = get_delta_index(pcm->data[i++], base);
-		base += gDeltaEncodingTable[delta_index];
-		delta->data[j++] = delta_index;
 
-		for (k = 0; k < 31; k++)
+		for (int value = 0; value < 256; value++)
+			new_costs[value] = UINT32_MAX;
+
+		for (int j = 0; j < beam_size; j++)
 		{
-			if (i >= pcm->length)
-			{
-				break;
-			}
-			delta_index = get_delta_index(pcm->data[i++], base);
-			base += gDeltaEncodingTable[delta_index];
-			delta->data[j] = (delta_index << 4);
+			uint8_t prev_value = beam[j];
 
-			if (i >= pcm->length)
+			for (int index = 0; index < 16; index++)
 			{
-				break;
+				uint8_t value = prev_value + gDeltaEncodingTable[index];
+				uint32_t cost = costs[prev_value] + squared_error(value, samples[i]);
+
+				if (cost < new_costs[value])
+				{
+					new_costs[value] = cost;
+					prev_values[i][value] = prev_value;
+					prev_indexes[i][value] = index;
+				}
 			}
-			delta_index = get_delta_index(pcm->data[i++], base);
-			base += gDeltaEncodingTable[delta_index];
-			delta->data[j++] |= delta_index;
 		}
+
+		beam_size = 0;
+
+		for (int value = 0; value < 256; value++)
+		{
+			costs[value] = new_costs[value];
+			if (costs[value] != UINT32_MAX)
+				beam[beam_size++] = value;
+		}
+	}
+
+	int best_value = 0;
+
+	for (int value = 1; value < 256; value++)
+	{
+		if (costs[value] < costs[best_value])
+			best_value = value;
 	}
 
-	delta->length = j;
+	for (int i = num_samples - 1; i > 0; i--)
+	{
+		indexes[i - 1] = prev_indexes[i][best_value];
+		best_value = prev_values[i][best_value];
+	}
 
-	return delta;
+	*base = best_value;
+}
+
+// Writes the compressed samples to dest and returns their length, which is
+// never more than num_samples.
+unsigned long delta_compress(const uint8_t *samples, unsigned long num_samples, bool trellis, uint8_t *dest)
+{
+	if (!delta_index_lut_ready)
+		init_delta_index_lut();
+
+	unsigned long i = 0;
+	unsigned long j = 0;
+	uint8_t base;
+	uint8_t indexes[DELTA_BLOCK_SIZE - 1];
+
+	while (i < num_samples)
+	{
+		const uint8_t *block = &samples[i];
+		int block_size = num_samples - i < DELTA_BLOCK_SIZE ? num_samples - i : DELTA_BLOCK_SIZE;
+
+		i += block_size;
+
+		// The deltas after the first are packed in pairs, and a last one
+		// without a partner is left out.
+		if (block_size > 2 && block_size % 2 == 1)
+			block_size--;
+
+		if (trellis)
+			encode_block_trellis(block, block_size, &base, indexes);
+		else
+			encode_block_greedy(block, block_size, &base, indexes);
+
+		dest[j++] = base;
+
+		if (block_size < 2)
+		{
+			break;
+		}
+		dest[j++] = indexes[0];
+
+		for (int k = 1; k < block_size - 1; k += 2)
+			dest[j++] = (indexes[k] << 4) | indexes[k + 1];
+	}
+
+	return j;
 }
 
 #define STORE_U32_LE(dest, value) \
@@ -523,33 +701,16 @@ do { \
 	(var) |= (*((src) + 3) << 24); \
 } while (0)
 
-// Reads an .aif file and produces a .pcm file containing an array of 8-bit samples.
-void aif2pcm(const char *aif_filename, const char *pcm_filename, bool compress)
+// Converts the contents of an .aif file to a .bin file: a 16-byte header
+// followed by the samples. The whole output is built in one buffer.
+void convert_aif(struct Bytes *aif, bool compress, bool trellis, struct Bytes *output)
 {
-	struct Bytes *aif = read_bytearray(aif_filename);
 	AifData aif_data = {0,0,0,0,0,0,0};
 	read_aif(aif, &aif_data);
 
 	int header_size = 0x10;
-	struct Bytes *pcm;
-	struct Bytes output = {0,0};
 
-	if (compress)
-	{
-		struct Bytes *input = malloc(sizeof(struct Bytes));
-		input->data = aif_data.samples;
-		input->length = aif_data.real_num_samples;
-		pcm = delta_compress(input);
-		free(input);
-	}
-	else
-	{
-		pcm = malloc(sizeof(struct Bytes));
-		pcm->data = aif_data.samples;
-		pcm->length = aif_data.real_num_samples;
-	}
-	output.length = header_size + pcm->length;
-	output.data = malloc(output.length);
+	output->data = malloc(header_size + aif_data.real_num_samples);
 
 	uint32_t pitch_adjust = (uint32_t)(aif_data.sample_rate * 1024);
 	uint32_t loop_offset = (uint32_t)(aif_data.loop_offset);
@@ -557,18 +718,35 @@ void aif2pcm(const char *aif_filename, const char *pcm_filename, bool compress)
 	uint32_t flags = 0;
 	if (aif_data.has_loop) flags |= 0x40000000;
 	if (compress) flags |= 1;
-	STORE_U32_LE(output.data + 0, flags);
-	STORE_U32_LE(output.data + 4, pitch_adjust);
-	STORE_U32_LE(output.data + 8, loop_offset);
-	STORE_U32_LE(output.data + 12, adjusted_num_samples);
-	memcpy(&output.data[header_size], pcm->data, pcm->length);
+	STORE_U32_LE(output->data + 0, flags);
+	STORE_U32_LE(output->data + 4, pitch_adjust);
+	STORE_U32_LE(output->data + 8, loop_offset);
+	STORE_U32_LE(output->data + 12, adjusted_num_samples);
+
+	if (compress)
+	{
+		output->length = header_size + delta_compress(aif_data.samples, aif_data.real_num_samples, trellis, &output->data[header_size]);
+	}
+	else
+	{
+		memcpy(&output->data[header_size], aif_data.samples, aif_data.real_num_samples);
+		output->length = header_size + aif_data.real_num_samples;
+	}
+
+	free(aif_data.samples);
+}
+
+// Reads an .aif file and produces a .pcm file containing an array of 8-bit samples.
+void aif2pcm(const char *aif_filename, const char *pcm_filename, bool compress, bool trellis)
+{
+	struct Bytes *aif = read_bytearray(aif_filename);
+	struct Bytes output;
+
+	convert_aif(aif, compress, trellis, &output);
 	write_bytearray(pcm_filename, &output);
 
-	free(aif->data);
-	free(aif);
-	free(pcm);
+	free_bytearray(aif);
 	free(output.data);
-	free(aif_data.samples);
 }
 
 // Reads a .pcm file containing an array of 8-bit samples and produces an .aif file.
@@ -821,10 +999,374 @@ void pcm2aif(const char *pcm_filename, const char *aif_filename, uint32_t base_n
 	free(aif);
 }
 
+// A batch manifest has one job per line, with the same arguments as a single
+// conversion: aif_file bin_file [--compress | --trellis]. Blank lines and
+// lines starting with '#' are ignored. The jobs are shared out between a pool
+// of worker threads.
+//
+// The cache file has a header line and then a "hash bin_file" line for every
+// output, where the hash covers the input bytes and the options it was made
+// with. A job whose hash is unchanged and whose output still exists is skipped
+// without touching the output, so touched but unchanged samples cost one read.
+
+// Bump this whenever a change to aif2pcm alters its output, so that outputs
+// made by an older version are converted again.
+#define BATCH_CACHE_HEADER "aif2pcm-cache 1"
+
+struct BatchJob
+{
+	char *input;
+	char *output;
+	bool compress;
+	bool trellis;
+	bool cached;
+	uint64_t cached_hash;
+	uint64_t hash;
+};
+
+struct BatchState
+{
+	struct BatchJob *jobs;
+	int num_jobs;
+	atomic_int next_job;
+	atomic_int num_converted;
+};
+
+// Maps a whole file into memory read-only.
+static void map_file(const char *filename, struct Bytes *bytes)
+{
+#ifdef _WIN32
+	struct Bytes *read = read_bytearray(filename);
+	*bytes = *read;
+	free(read);
+#else
+	struct stat st;
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		FATAL_ERROR("Failed to open '%s' for reading!\n", filename);
+	}
+	bytes->length = st.st_size;
+	void *data = bytes->length != 0 ? mmap(NULL, bytes->length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		FATAL_ERROR("Failed to read data from '%s'!\n", filename);
+	}
+	bytes->data = data;
+#endif
+}
+
+static void unmap_file(struct Bytes *bytes)
+{
+#ifdef _WIN32
+	free(bytes->data);
+#else
+	munmap(bytes->data, bytes->length);
+#endif
+}
+
+// FNV-1a over the input bytes, then the options.
+static uint64_t hash_job(const struct Bytes *aif, const struct BatchJob *job)
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (unsigned long i = 0; i < aif->length; i++)
+		hash = (hash ^ aif->data[i]) * 1099511628211ULL;
+
+	hash = (hash ^ (job->compress | (job->trellis << 1))) * 1099511628211ULL;
+	return hash;
+}
+
+static int compare_job_outputs(const void *a, const void *b)
+{
+	return strcmp(((const struct BatchJob *)a)->output, ((const struct BatchJob *)b)->output);
+}
+
+static struct BatchJob *find_job(struct BatchState *state, char *output)
+{
+	struct BatchJob key;
+	key.output = output;
+	return bsearch(&key, state->jobs, state->num_jobs, sizeof(struct BatchJob), compare_job_outputs);
+}
+
+static char *copy_string(const char *s)
+{
+	char *copy = malloc(strlen(s) + 1);
+	if (!copy)
+	{
+		FATAL_ERROR("Failed to allocate memory for batch jobs!\n");
+	}
+	return strcpy(copy, s);
+}
+
+// Reads the manifest and sorts the jobs by output path.
+static void read_manifest(const char *filename, struct BatchState *state)
+{
+	FILE *f = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+	if (!f)
+	{
+		FATAL_ERROR("Failed to open '%s' for reading!\n", filename);
+	}
+
+	int capacity = 256;
+	char line[4096];
+	int line_num = 0;
+
+	state->jobs = malloc(capacity * sizeof(struct BatchJob));
+	state->num_jobs = 0;
+
+	while (fgets(line, sizeof(line), f))
+	{
+		char *args[4];
+		int num_args = 0;
+		char *s = line;
+
+		line_num++;
+
+		while (*s)
+		{
+			while (isspace((unsigned char)*s))
+				*s++ = '\0';
+			if (!*s || (num_args == 0 && *s == '#'))
+				break;
+			if (num_args == 4)
+			{
+				FATAL_ERROR("Batch manifest line %d has too many arguments!\n", line_num);
+			}
+			args[num_args++] = s;
+			while (*s && !isspace((unsigned char)*s))
+				s++;
+		}
+
+		if (num_args == 0)
+			continue;
+		if (num_args < 2)
+		{
+			FATAL_ERROR("Batch manifest line %d needs an input and an output file!\n", line_num);
+		}
+
+		if (state->num_jobs == capacity)
+		{
+			capacity *= 2;
+			state->jobs = realloc(state->jobs, capacity * sizeof(struct BatchJob));
+		}
+		if (!state->jobs)
+		{
+			FATAL_ERROR("Failed to allocate memory for batch jobs!\n");
+		}
+
+		struct BatchJob *job = &state->jobs[state->num_jobs++];
+		job->input = copy_string(args[0]);
+		job->output = copy_string(args[1]);
+		job->compress = false;
+		job->trellis = false;
+		job->cached = false;
+
+		for (int i = 2; i < num_args; i++)
+		{
+			if (strcmp(args[i], "--compress") == 0)
+			{
+				job->compress = true;
+			}
+			else if (strcmp(args[i], "--trellis") == 0)
+			{
+				job->compress = true;
+				job->trellis = true;
+			}
+			else
+			{
+				FATAL_ERROR("Batch manifest line %d has unknown option '%s'!\n", line_num, args[i]);
+			}
+		}
+	}
+
+	if (ferror(f))
+	{
+		FATAL_ERROR("Failed to read '%s'!\n", filename);
+	}
+	if (f != stdin)
+		fclose(f);
+
+	qsort(state->jobs, state->num_jobs, sizeof(struct BatchJob), compare_job_outputs);
+
+	for (int i = 1; i < state->num_jobs; i++)
+	{
+		if (strcmp(state->jobs[i - 1].output, state->jobs[i].output) == 0)
+		{
+			FATAL_ERROR("'%s' is the output of more than one batch job!\n", state->jobs[i].output);
+		}
+	}
+}
+
+// Returns the number of jobs that had a cache entry. A missing or outdated
+// cache just means that everything is converted again.
+static int load_batch_cache(const char *filename, struct BatchState *state)
+{
+	FILE *f = fopen(filename, "r");
+	char line[4096];
+	int num_cached = 0;
+
+	if (!f)
+		return 0;
+
+	if (fgets(line, sizeof(line), f) && strcmp(line, BATCH_CACHE_HEADER "\n") == 0)
+	{
+		while (fgets(line, sizeof(line), f))
+		{
+			unsigned long long hash;
+			char *output = NULL;
+
+			if (sscanf(line, "%16llx", &hash) == 1 && strlen(line) > 18 && line[16] == ' ')
+			{
+				output = &line[17];
+				output[strcspn(output, "\n")] = '\0';
+			}
+
+			struct BatchJob *job = output ? find_job(state, output) : NULL;
+			if (job && !job->cached)
+			{
+				job->cached = true;
+				job->cached_hash = hash;
+				num_cached++;
+			}
+		}
+	}
+
+	fclose(f);
+	return num_cached;
+}
+
+static void save_batch_cache(const char *filename, struct BatchState *state)
+{
+	size_t length = strlen(filename);
+	char *temp_filename = malloc(length + 5);
+	memcpy(temp_filename, filename, length);
+	strcpy(&temp_filename[length], ".tmp");
+
+	FILE *f = fopen(temp_filename, "w");
+	bool written = f != NULL;
+
+	if (f)
+	{
+		fprintf(f, "%s\n", BATCH_CACHE_HEADER);
+		for (int i = 0; i < state->num_jobs; i++)
+			fprintf(f, "%016llx %s\n", (unsigned long long)state->jobs[i].hash, state->jobs[i].output);
+		written = !ferror(f);
+		written = fclose(f) == 0 && written;
+	}
+
+	// Failing to save the cache only makes the next run slower.
+	if (!written || rename(temp_filename, filename) != 0)
+	{
+		fprintf(stderr, "Warning: failed to write '%s'.\n", filename);
+		remove(temp_filename);
+	}
+
+	free(temp_filename);
+}
+
+static bool file_exists(const char *filename)
+{
+	struct stat st;
+	return stat(filename, &st) == 0;
+}
+
+static void *batch_worker(void *arg)
+{
+	struct BatchState *state = arg;
+	int index;
+
+	while ((index = atomic_fetch_add(&state->next_job, 1)) < state->num_jobs)
+	{
+		struct BatchJob *job = &state->jobs[index];
+		struct Bytes aif;
+
+		map_file(job->input, &aif);
+		job->hash = hash_job(&aif, job);
+
+		if (!job->cached || job->cached_hash != job->hash || !file_exists(job->output))
+		{
+			struct Bytes output;
+
+			convert_aif(&aif, job->compress, job->trellis, &output);
+			write_bytearray(job->output, &output);
+			free(output.data);
+			atomic_fetch_add(&state->num_converted, 1);
+		}
+
+		unmap_file(&aif);
+	}
+
+	return NULL;
+}
+
+// Converts every sample listed in a manifest file ("-" for stdin).
+void aif2pcm_batch(const char *manifest_filename, const char *cache_filename, int num_threads)
+{
+	struct BatchState state;
+
+	read_manifest(manifest_filename, &state);
+	atomic_init(&state.next_job, 0);
+	atomic_init(&state.num_converted, 0);
+
+	int num_cached = cache_filename ? load_batch_cache(cache_filename, &state) : 0;
+
+	// The table is built here rather than racing to build it in every thread.
+	if (!delta_index_lut_ready)
+		init_delta_index_lut();
+
+	if (num_threads > state.num_jobs)
+		num_threads = state.num_jobs;
+	if (num_threads < 1)
+		num_threads = 1;
+
+	pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+	if (!threads)
+	{
+		FATAL_ERROR("Failed to allocate memory for batch threads!\n");
+	}
+
+	for (int i = 1; i < num_threads; i++)
+	{
+		if (pthread_create(&threads[i], NULL, batch_worker, &state) != 0)
+		{
+			FATAL_ERROR("Failed to create batch worker thread!\n");
+		}
+	}
+
+	batch_worker(&state);
+
+	for (int i = 1; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	int num_converted = atomic_load(&state.num_converted);
+
+	if (cache_filename && (num_converted != 0 || num_cached != state.num_jobs))
+		save_batch_cache(cache_filename, &state);
+
+	for (int i = 0; i < state.num_jobs; i++)
+	{
+		free(state.jobs[i].input);
+		free(state.jobs[i].output);
+	}
+
+	free(threads);
+	free(state.jobs);
+}
+
+static int get_default_thread_count(void)
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return count > 0 ? (int)count : 1;
+}
+
 void usage(void)
 {
 	fprintf(stderr, "Usage: aif2pcm bin_file [aif_file]\n");
-	fprintf(stderr, "       aif2pcm aif_file [bin_file] [--compress]\n");
+	fprintf(stderr, "       aif2pcm aif_file [bin_file] [--compress | --trellis]\n");
+	fprintf(stderr, "       aif2pcm --batch manifest_file [-j threads] [--cache cache_file]\n");
 }
 
 int main(int argc, char **argv)
@@ -835,10 +1377,53 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (strcmp(argv[1], "--batch") == 0)
+	{
+		char *manifest_file = NULL;
+		char *cache_file = NULL;
+		int num_threads = get_default_thread_count();
+
+		for (int i = 2; i < argc; i++)
+		{
+			if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			{
+				char *end;
+				num_threads = strtol(argv[++i], &end, 10);
+				if (*end != '\0' || num_threads < 1)
+				{
+					FATAL_ERROR("Thread count must be a positive number: '%s'\n", argv[i]);
+				}
+			}
+			else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+			{
+				cache_file = argv[++i];
+			}
+			else if (!manifest_file && (argv[i][0] != '-' || argv[i][1] == '\0'))
+			{
+				manifest_file = argv[i];
+			}
+			else
+			{
+				usage();
+				exit(1);
+			}
+		}
+
+		if (!manifest_file)
+		{
+			usage();
+			exit(1);
+		}
+
+		aif2pcm_batch(manifest_file, cache_file, num_threads);
+		return 0;
+	}
+
 	char *input_file = argv[1];
 	char *extension = get_file_extension(input_file);
 	char *output_file;
 	bool compressed = false;
+	bool trellis = false;
 
 	if (argc > 3)
 	{
@@ -848,6 +1433,11 @@ int main(int argc, char **argv)
 			{
 				compressed = true;
 			}
+			else if (strcmp(argv[i], "--trellis") == 0)
+			{
+				compressed = true;
+				trellis = true;
+			}
 		}
 	}
 
@@ -856,12 +1446,12 @@ int main(int argc, char **argv)
 		if (argc >= 3)
 		{
 			output_file = argv[2];
-			aif2pcm(input_file, output_file, compressed);
+			aif2pcm(input_file, output_file, compressed, trellis);
 		}
 		else
 		{
 			output_file = new_file_extension(input_file, "bin");
-			aif2pcm(input_file, output_file, compressed);
+			aif2pcm(input_file, output_file, compressed, trellis);
 			free(output_file);
 		}
 	}
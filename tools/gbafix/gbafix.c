@@ -33,6 +33,7 @@
 
     History
     -------
+    v1.08 - added --from-elf, --pad-to and --sha1
     v1.07 - added support for ELF input, (PikalaxALT)
     v1.06 - added output silencing, (Diegoisawesome)
     v1.05 - added debug offset argument, (Diegoisawesome)
@@ -49,9 +50,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <ctype.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "elf.h"
+#include "sha1.h"
 
-#define VER        "1.07"
+#define VER        "1.08"
 #define ARGV    argv[arg]
 #define VALUE    (ARGV+2)
 #define NUMBER    strtoul(VALUE, NULL, 0)
@@ -131,12 +140,299 @@ char HeaderComplement()
 }
 
 
+//---------------------------------------------------------------------------------
+// ELF input
+//---------------------------------------------------------------------------------
+
+typedef struct
+{
+    uint32_t        address;    // load address
+    uint32_t        size;
+    const uint8_t  *data;
+} Chunk;
+
+const uint8_t *elf_data = NULL;
+size_t elf_size = 0;
+Chunk *chunks = NULL;
+int num_chunks = 0;
+
+#ifdef _WIN32
+
+int MapElf(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *data;
+    long size;
+
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(size > 0 ? size : 1);
+    if (!data || size <= 0 || fread(data, size, 1, f) != 1) { fclose(f); free(data); return 0; }
+    fclose(f);
+    elf_data = data;
+    elf_size = size;
+    return 1;
+}
+
+#else
+
+int MapElf(const char *path)
+{
+    struct stat st;
+    void *data;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) return 0;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return 0; }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return 0;
+    elf_data = data;
+    elf_size = st.st_size;
+    return 1;
+}
+
+#endif // _WIN32
+
+int CompareChunks(const void *a, const void *b)
+{
+    uint32_t x = ((const Chunk *)a)->address;
+    uint32_t y = ((const Chunk *)b)->address;
+    return (x > y) - (x < y);
+}
+
+//---------------------------------------------------------------------------------
+int LoadElfChunks(const char *path)
+/*---------------------------------------------------------------------------------
+    Find the pieces of the ROM image the way objcopy -O binary does: every
+    allocated section that has contents, placed at its load address
+---------------------------------------------------------------------------------*/
+{
+    const Elf32_Ehdr *elfHeader;
+    const Elf32_Shdr *secHeaders;
+    const Elf32_Phdr *progHeaders;
+    int i, j;
+
+    if (!MapElf(path)) { fprintf(stderr, "Error opening input file!\n"); return 0; }
+
+    elfHeader = (const Elf32_Ehdr *)elf_data;
+    if (elf_size < sizeof(Elf32_Ehdr) || memcmp(elfHeader->e_ident, ELFMAG, SELFMAG) != 0 || elfHeader->e_ident[EI_CLASS] != ELFCLASS32
+     || elfHeader->e_shentsize != sizeof(Elf32_Shdr) || elfHeader->e_shoff > elf_size
+     || elfHeader->e_shnum > (elf_size - elfHeader->e_shoff) / sizeof(Elf32_Shdr)
+     || (elfHeader->e_phnum != 0 && (elfHeader->e_phentsize != sizeof(Elf32_Phdr) || elfHeader->e_phoff > elf_size
+     || elfHeader->e_phnum > (elf_size - elfHeader->e_phoff) / sizeof(Elf32_Phdr))))
+    {
+        fprintf(stderr, "Input file is not a valid 32-bit ELF!\n");
+        return 0;
+    }
+
+    secHeaders = (const Elf32_Shdr *)(elf_data + elfHeader->e_shoff);
+    progHeaders = (const Elf32_Phdr *)(elf_data + elfHeader->e_phoff);
+    chunks = malloc((elfHeader->e_shnum + 1) * sizeof(Chunk));
+    if (!chunks) { fprintf(stderr, "Out of memory!\n"); return 0; }
+
+    for (i = 0; i < elfHeader->e_shnum; i++)
+    {
+        const Elf32_Shdr *sec = &secHeaders[i];
+        Chunk *chunk = &chunks[num_chunks];
+
+        if (!(sec->sh_flags & SHF_ALLOC) || sec->sh_type == SHT_NOBITS || sec->sh_size == 0) continue;
+        if (sec->sh_offset > elf_size || sec->sh_size > elf_size - sec->sh_offset)
+        {
+            fprintf(stderr, "Section %d extends past the end of the file!\n", i);
+            return 0;
+        }
+
+        // A section's load address comes from the segment holding it, in
+        // case the linker script gave it one apart from its run address.
+        chunk->address = sec->sh_addr;
+        for (j = 0; j < elfHeader->e_phnum; j++)
+        {
+            const Elf32_Phdr *seg = &progHeaders[j];
+            if (seg->p_type == PT_LOAD && sec->sh_offset >= seg->p_offset && sec->sh_offset - seg->p_offset < seg->p_filesz)
+            {
+                chunk->address = seg->p_paddr + (sec->sh_offset - seg->p_offset);
+                break;
+            }
+        }
+        chunk->size = sec->sh_size;
+        chunk->data = elf_data + sec->sh_offset;
+        num_chunks++;
+    }
+
+    if (num_chunks == 0) { fprintf(stderr, "Input file has no loadable sections!\n"); return 0; }
+
+    qsort(chunks, num_chunks, sizeof(Chunk), CompareChunks);
+
+    for (i = 1; i < num_chunks; i++)
+    {
+        if ((uint64_t)chunks[i-1].address + chunks[i-1].size > chunks[i].address)
+        {
+            fprintf(stderr, "Sections overlap at 0x%08X!\n", (unsigned)chunks[i].address);
+            return 0;
+        }
+    }
+
+    if (chunks[0].size < sizeof(Header)) { fprintf(stderr, "First section is too small to hold the ROM header!\n"); return 0; }
+
+    return 1;
+}
+
+
+//---------------------------------------------------------------------------------
+// ROM output
+//---------------------------------------------------------------------------------
+
+typedef struct
+{
+    FILE               *file;
+    uint32_t            size;       // bytes written so far
+    struct Sha1Context  sha1;
+} RomWriter;
+
+//---------------------------------------------------------------------------------
+void WriteRom(RomWriter *rom, const uint8_t *data, uint32_t size)
+/*---------------------------------------------------------------------------------
+    Append to the image, hashing as we go. The fixed header takes the place
+    of the one in the input.
+---------------------------------------------------------------------------------*/
+{
+    if (rom->size < sizeof(Header))
+    {
+        uint32_t n = sizeof(Header) - rom->size;
+        if (n > size) n = size;
+        fwrite((uint8_t *)&header + rom->size, 1, n, rom->file);
+        Sha1Update(&rom->sha1, (uint8_t *)&header + rom->size, n);
+        rom->size += n;
+        data += n;
+        size -= n;
+    }
+
+    fwrite(data, 1, size, rom->file);
+    Sha1Update(&rom->sha1, data, size);
+    rom->size += size;
+}
+
+//---------------------------------------------------------------------------------
+void FillRom(RomWriter *rom, uint32_t size)
+//---------------------------------------------------------------------------------
+{
+    static uint8_t fill[0x1000];
+    memset(fill, 0xFF, sizeof(fill));
+
+    while (size)
+    {
+        uint32_t n = size < sizeof(fill) ? size : sizeof(fill);
+        WriteRom(rom, fill, n);
+        size -= n;
+    }
+}
+
+//---------------------------------------------------------------------------------
+int CheckSha1(const char *listfile, const char *name, const char *hex)
+/*---------------------------------------------------------------------------------
+    Look name up in a sha1sum-style list and report like sha1sum -c
+---------------------------------------------------------------------------------*/
+{
+    char line[1024];
+    FILE *list = fopen(listfile, "r");
+
+    if (!list) { fprintf(stderr, "Error opening %s!\n", listfile); return 0; }
+
+    while (fgets(line, sizeof(line), list))
+    {
+        char *entry = line + 40;
+        int n;
+
+        line[strcspn(line, "\r\n")] = 0;
+        if (strlen(line) < 42 || entry[0] != ' ' || (entry[1] != ' ' && entry[1] != '*')) continue;
+        if (strcmp(entry + 2, name) != 0) continue;
+
+        fclose(list);
+        for (n = 0; n < 40; n++)
+        {
+            if (tolower((unsigned char)line[n]) != hex[n])
+            {
+                printf("%s: FAILED\n", name);
+                fprintf(stderr, "gbafix: WARNING: computed checksum did NOT match\n");
+                return 0;
+            }
+        }
+        printf("%s: OK\n", name);
+        return 1;
+    }
+
+    fclose(list);
+    fprintf(stderr, "%s has no checksum for %s!\n", listfile, name);
+    return 0;
+}
+
+//---------------------------------------------------------------------------------
+int WriteRomFromElf(const char *outfile, uint32_t pad_to, int schedule_pad, const char *sha1_list)
+/*---------------------------------------------------------------------------------
+    Write the flat image in one pass: gaps and padding are filled with 0xFF,
+    and the SHA-1 of the result is computed on the way out
+---------------------------------------------------------------------------------*/
+{
+    RomWriter rom;
+    uint32_t base = chunks[0].address;
+    unsigned char digest[20];
+    char hex[41];
+    int i, bit, ok;
+
+    rom.file = fopen(outfile, "wb");
+    if (!rom.file) { fprintf(stderr, "Error opening output file!\n"); return 0; }
+    rom.size = 0;
+    Sha1Init(&rom.sha1);
+
+    for (i = 0; i < num_chunks; i++)
+    {
+        FillRom(&rom, chunks[i].address - base - rom.size);
+        WriteRom(&rom, chunks[i].data, chunks[i].size);
+    }
+
+    if (pad_to > base && pad_to - base > rom.size)
+        FillRom(&rom, pad_to - base - rom.size);
+
+    if (schedule_pad)
+    {
+        for (bit=31; bit>=0; bit--) if (rom.size & (1u<<bit)) break;
+        if (bit < 31 && rom.size != (1u<<bit))
+            FillRom(&rom, (1u<<(bit+1)) - rom.size);
+    }
+
+    ok = !ferror(rom.file);
+    if (fclose(rom.file) != 0) ok = 0;
+    if (!ok)
+    {
+        fprintf(stderr, "Error writing output file!\n");
+        remove(outfile);
+        return 0;
+    }
+
+    Sha1Final(&rom.sha1, digest);
+    Sha1ToHex(digest, hex);
+
+    if (sha1_list && sha1_list[0])
+        return CheckSha1(sha1_list, outfile, hex);
+    if (sha1_list)
+        printf("%s  %s\n", hex, outfile);
+
+    return 1;
+}
+
+
 //---------------------------------------------------------------------------------
 int main(int argc, char *argv[])
 //---------------------------------------------------------------------------------
 {
     int arg;
     char *argfile = 0;
+    char *outfile = 0;
+    char *sha1_list = 0;
+    uint32_t pad_to = 0;
     FILE *infile;
     int silent = 0;
     int schedule_pad = 0;
@@ -148,6 +444,7 @@ int main(int argc, char *argv[])
     {
         printf("GBA ROM fixer v"VER" by Dark Fader / BlackThunder / WinterMute / Diegoisawesome \n");
         printf("Syntax: gbafix <rom.gba> [-p] [-t[title]] [-c<game_code>] [-m<maker_code>] [-r<version>] [-d<debug>] [--silent]\n");
+        printf("        gbafix <rom.elf> --from-elf=<rom.gba> [--pad-to=<address>] [--sha1[=<list>]] [options]\n");
         printf("\n");
         printf("parameters:\n");
         printf("    -p              Pad to next exact power of 2. No minimum size!\n");
@@ -157,6 +454,9 @@ int main(int argc, char *argv[])
         printf("    -r<version>     Patch game version (number)\n");
         printf("    -d<debug>       Enable debugging handler and set debug entry point (0 or 1)\n");
         printf("    --silent           Silence non-error output\n");
+        printf("    --from-elf=<rom.gba>  Write the image in an ELF to rom.gba, with the header fixed\n");
+        printf("    --pad-to=<address>    Pad the image with 0xFF up to address (with --from-elf)\n");
+        printf("    --sha1[=<list>]       Print the image's SHA-1, or check it against a sha1sum list\n");
         return -1;
     }
 
@@ -165,6 +465,10 @@ int main(int argc, char *argv[])
     {
         if (ARGV[0] != '-') { argfile=ARGV; }
         if (strncmp("--silent", &ARGV[0], 7) == 0) { silent = 1; }
+        if (strncmp("--from-elf=", &ARGV[0], 11) == 0) { outfile = ARGV + 11; }
+        if (strncmp("--pad-to=", &ARGV[0], 9) == 0) { pad_to = strtoul(ARGV + 9, NULL, 0); }
+        if (strcmp("--sha1", &ARGV[0]) == 0) { sha1_list = ""; }
+        if (strncmp("--sha1=", &ARGV[0], 7) == 0) { sha1_list = ARGV + 7; }
     }
 
     // check filename
@@ -176,26 +480,36 @@ int main(int argc, char *argv[])
 
     uint32_t sh_offset = 0;
 
-    // read file
-    infile = fopen(argfile, "r+b");
-    if (!infile) { fprintf(stderr, "Error opening input file!\n"); return -1; }
-    fseek(infile, sh_offset, SEEK_SET);
-    fread(&header, sizeof(header), 1, infile);
-
-    // elf check
-    Elf32_Shdr secHeader;
-    if (memcmp(&header, ELFMAG, 4) == 0) {
-        Elf32_Ehdr *elfHeader = (Elf32_Ehdr *)&header;
-        fseek(infile, elfHeader->e_shoff, SEEK_SET);
-        int i;
-        for (i = 0; i < elfHeader->e_shnum; i++) {
-            fread(&secHeader, sizeof(Elf32_Shdr), 1, infile);
-            if (secHeader.sh_type == SHT_PROGBITS && secHeader.sh_addr == elfHeader->e_entry) break;
-        }
-        if (i == elfHeader->e_shnum) { fprintf(stderr, "Error finding entry point!\n"); return 1; }
-        fseek(infile, secHeader.sh_offset, SEEK_SET);
-        sh_offset = secHeader.sh_offset;
+    if (outfile)
+    {
+        // the header is at the start of the image
+        if (!LoadElfChunks(argfile)) return 1;
+        infile = NULL;
+        memcpy(&header, chunks[0].data, sizeof(header));
+    }
+    else
+    {
+        // read file
+        infile = fopen(argfile, "r+b");
+        if (!infile) { fprintf(stderr, "Error opening input file!\n"); return -1; }
+        fseek(infile, sh_offset, SEEK_SET);
         fread(&header, sizeof(header), 1, infile);
+
+        // elf check
+        Elf32_Shdr secHeader;
+        if (memcmp(&header, ELFMAG, 4) == 0) {
+            Elf32_Ehdr *elfHeader = (Elf32_Ehdr *)&header;
+            fseek(infile, elfHeader->e_shoff, SEEK_SET);
+            int i;
+            for (i = 0; i < elfHeader->e_shnum; i++) {
+                fread(&secHeader, sizeof(Elf32_Shdr), 1, infile);
+                if (secHeader.sh_type == SHT_PROGBITS && secHeader.sh_addr == elfHeader->e_entry) break;
+            }
+            if (i == elfHeader->e_shnum) { fprintf(stderr, "Error finding entry point!\n"); return 1; }
+            fseek(infile, secHeader.sh_offset, SEEK_SET);
+            sh_offset = secHeader.sh_offset;
+            fread(&header, sizeof(header), 1, infile);
+        }
     }
 
     // fix some data
@@ -292,6 +606,13 @@ int main(int argc, char *argv[])
     header.complement = HeaderComplement();
     //header.checksum = checksum_without_header + HeaderChecksum();
 
+    if (outfile)
+    {
+        if (!WriteRomFromElf(outfile, pad_to, schedule_pad, sha1_list)) return 1;
+        if (!silent) printf("ROM fixed!\n");
+        return 0;
+    }
+
     if (schedule_pad) {
         if (sh_offset != 0) {
             fprintf(stderr, "Warning: Cannot safely pad an ELF\n");
@@ -301,8 +622,15 @@ int main(int argc, char *argv[])
             for (bit=31; bit>=0; bit--) if (size & (1<<bit)) break;
             if (size != (1<<bit))
             {
+                char fill[0x1000];
                 int todo = (1<<(bit+1)) - size;
-                while (todo--) fputc(0xFF, infile);
+                memset(fill, 0xFF, sizeof(fill));
+                while (todo > 0)
+                {
+                    int n = todo < (int)sizeof(fill) ? todo : (int)sizeof(fill);
+                    fwrite(fill, 1, n, infile);
+                    todo -= n;
+                }
             }
         }
     }
@@ -0,0 +1,128 @@
+#include <string.h>
+#include "sha1.h"
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void Sha1Transform(uint32_t state[5], const unsigned char *block)
+{
+	uint32_t w[80];
+
+	for (int i = 0; i < 16; i++)
+		w[i] = (block[i * 4] << 24) | (block[i * 4 + 1] << 16) | (block[i * 4 + 2] << 8) | block[i * 4 + 3];
+
+	for (int i = 16; i < 80; i++)
+		w[i] = ROL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+	uint32_t a = state[0];
+	uint32_t b = state[1];
+	uint32_t c = state[2];
+	uint32_t d = state[3];
+	uint32_t e = state[4];
+
+	for (int i = 0; i < 80; i++) {
+		uint32_t f, k;
+
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5A827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8F1BBCDC;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6;
+		}
+
+		uint32_t temp = ROL32(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = ROL32(b, 30);
+		b = a;
+		a = temp;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+void Sha1Init(struct Sha1Context *ctx)
+{
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xEFCDAB89;
+	ctx->state[2] = 0x98BADCFE;
+	ctx->state[3] = 0x10325476;
+	ctx->state[4] = 0xC3D2E1F0;
+	ctx->length = 0;
+	ctx->blockSize = 0;
+}
+
+void Sha1Update(struct Sha1Context *ctx, const void *data, size_t size)
+{
+	const unsigned char *bytes = data;
+
+	ctx->length += size;
+
+	if (ctx->blockSize != 0) {
+		size_t count = 64 - ctx->blockSize;
+
+		if (count > size)
+			count = size;
+
+		memcpy(&ctx->block[ctx->blockSize], bytes, count);
+		ctx->blockSize += count;
+		bytes += count;
+		size -= count;
+
+		if (ctx->blockSize < 64)
+			return;
+
+		Sha1Transform(ctx->state, ctx->block);
+		ctx->blockSize = 0;
+	}
+
+	while (size >= 64) {
+		Sha1Transform(ctx->state, bytes);
+		bytes += 64;
+		size -= 64;
+	}
+
+	memcpy(ctx->block, bytes, size);
+	ctx->blockSize = size;
+}
+
+void Sha1Final(struct Sha1Context *ctx, unsigned char digest[20])
+{
+	uint64_t bitLength = ctx->length * 8;
+	unsigned char padding[72] = { 0x80 };
+	int paddingSize = (ctx->blockSize < 56) ? 56 - ctx->blockSize : 120 - ctx->blockSize;
+
+	for (int i = 0; i < 8; i++)
+		padding[paddingSize + i] = (unsigned char)(bitLength >> (56 - i * 8));
+
+	Sha1Update(ctx, padding, paddingSize + 8);
+
+	for (int i = 0; i < 5; i++) {
+		digest[i * 4] = (unsigned char)(ctx->state[i] >> 24);
+		digest[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 16);
+		digest[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 8);
+		digest[i * 4 + 3] = (unsigned char)ctx->state[i];
+	}
+}
+
+void Sha1ToHex(const unsigned char digest[20], char hex[41])
+{
+	static const char digits[] = "0123456789abcdef";
+
+	for (int i = 0; i < 20; i++) {
+		hex[i * 2] = digits[digest[i] >> 4];
+		hex[i * 2 + 1] = digits[digest[i] & 0xF];
+	}
+
+	hex[40] = 0;
+}
@@ -0,0 +1,19 @@
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct Sha1Context {
+	uint32_t state[5];
+	uint64_t length;
+	unsigned char block[64];
+	int blockSize;
+};
+
+void Sha1Init(struct Sha1Context *ctx);
+void Sha1Update(struct Sha1Context *ctx, const void *data, size_t size);
+void Sha1Final(struct Sha1Context *ctx, unsigned char digest[20]);
+void Sha1ToHex(const unsigned char digest[20], char hex[41]);
+
+#endif // SHA1_H
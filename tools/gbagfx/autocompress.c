@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "global.h"
+#include "util.h"
+#include "lz.h"
+#include "rl.h"
+#include "huff.h"
+#include "autocompress.h"
+
+// Tries every encoding the BIOS can decode on each asset and picks one
+// according to the policy. Every candidate is decompressed again and checked
+// against the input before it is considered.
+
+enum Codec
+{
+    CODEC_RAW,
+    CODEC_LZ,
+    CODEC_LZ_OPTIMAL,
+    CODEC_RL,
+    CODEC_HUFF,
+};
+
+struct Encoding
+{
+    const char *name;
+    enum Codec codec;
+    int param;       // LZ min search distance or Huffman bit depth
+    bool vramSafe;   // LZ77UnCompVram() can't handle matches at distance 1
+};
+
+static const struct Encoding sEncodings[] =
+{
+    { "raw",                CODEC_RAW,        0, true },
+    { "lz",                 CODEC_LZ,         2, true },
+    { "lz-search1",         CODEC_LZ,         1, false },
+    { "lz-optimal",         CODEC_LZ_OPTIMAL, 2, true },
+    { "lz-optimal-search1", CODEC_LZ_OPTIMAL, 1, false },
+    { "rl",                 CODEC_RL,         0, true },
+    { "huff4",              CODEC_HUFF,       4, true },
+    { "huff8",              CODEC_HUFF,       8, true },
+};
+
+#define NUM_ENCODINGS (int)(sizeof(sEncodings) / sizeof(sEncodings[0]))
+
+// Rough cycle counts for the loops of the BIOS decompression routines (and
+// CpuFastSet() for raw data), with the source in ROM. They are only meant for
+// ranking encodings against each other and for budgeting, not as exact timings.
+#define CYCLES_CALL             60
+#define CYCLES_RAW_WORD         8
+#define CYCLES_LZ_FLAGS         20
+#define CYCLES_LZ_LITERAL       18
+#define CYCLES_LZ_MATCH         34
+#define CYCLES_LZ_MATCH_BYTE    10
+#define CYCLES_RL_BLOCK         28
+#define CYCLES_RL_LITERAL_BYTE  12
+#define CYCLES_RL_RUN_BYTE      7
+#define CYCLES_HUFF_TREE_BYTE   4
+#define CYCLES_HUFF_BIT         14
+#define CYCLES_HUFF_WORD        12
+
+struct EncodingResult
+{
+    const struct Encoding *encoding;
+    unsigned char *data;
+    int size;
+    long long cycles;
+};
+
+struct Report
+{
+    FILE *fp;
+    bool json;
+    bool first;
+};
+
+static long long EstimateLZCycles(unsigned char *data, int uncompressedSize)
+{
+    long long cycles = CYCLES_CALL;
+    int srcPos = 4;
+    int destPos = 0;
+
+    while (destPos < uncompressedSize)
+    {
+        unsigned char flags = data[srcPos++];
+
+        cycles += CYCLES_LZ_FLAGS;
+
+        for (int i = 0; i < 8 && destPos < uncompressedSize; i++)
+        {
+            if (flags & (0x80 >> i))
+            {
+                int length = (data[srcPos] >> 4) + 3;
+
+                cycles += CYCLES_LZ_MATCH + length * CYCLES_LZ_MATCH_BYTE;
+                srcPos += 2;
+                destPos += length;
+            }
+            else
+            {
+                cycles += CYCLES_LZ_LITERAL;
+                srcPos++;
+                destPos++;
+            }
+        }
+    }
+
+    return cycles;
+}
+
+static long long EstimateRLCycles(unsigned char *data, int uncompressedSize)
+{
+    long long cycles = CYCLES_CALL;
+    int srcPos = 4;
+    int destPos = 0;
+
+    while (destPos < uncompressedSize)
+    {
+        unsigned char flags = data[srcPos++];
+
+        cycles += CYCLES_RL_BLOCK;
+
+        if (flags & 0x80)
+        {
+            int length = (flags & 0x7F) + 3;
+
+            cycles += length * CYCLES_RL_RUN_BYTE;
+            srcPos++;
+            destPos += length;
+        }
+        else
+        {
+            int length = (flags & 0x7F) + 1;
+
+            cycles += length * CYCLES_RL_LITERAL_BYTE;
+            srcPos += length;
+            destPos += length;
+        }
+    }
+
+    return cycles;
+}
+
+static long long EstimateHuffCycles(unsigned char *data, int size, int uncompressedSize)
+{
+    int treeSize = (data[4] + 1) * 2;
+    long long bits = (long long)(size - 4 - treeSize) * 8;
+
+    return CYCLES_CALL + treeSize * CYCLES_HUFF_TREE_BYTE + bits * CYCLES_HUFF_BIT
+        + ((uncompressedSize + 3) / 4) * CYCLES_HUFF_WORD;
+}
+
+static unsigned char *Encode(const struct Encoding *encoding, unsigned char *src, int srcSize, int *size)
+{
+    unsigned char *data;
+
+    switch (encoding->codec)
+    {
+    case CODEC_RAW:
+        data = malloc(srcSize);
+        if (data == NULL)
+            FATAL_ERROR("Failed to allocate memory for raw data.\n");
+        memcpy(data, src, srcSize);
+        *size = srcSize;
+        return data;
+    case CODEC_LZ:
+        return LZCompress(src, srcSize, size, encoding->param);
+    case CODEC_LZ_OPTIMAL:
+        return LZCompressOptimal(src, srcSize, size, encoding->param);
+    case CODEC_RL:
+        return RLCompress(src, srcSize, size);
+    case CODEC_HUFF:
+        return HuffCompress(src, srcSize, size, encoding->param);
+    }
+
+    return NULL;
+}
+
+static unsigned char *Decode(const struct Encoding *encoding, unsigned char *data, int size, int *uncompressedSize)
+{
+    switch (encoding->codec)
+    {
+    case CODEC_RAW:
+        return NULL;
+    case CODEC_LZ:
+    case CODEC_LZ_OPTIMAL:
+        return LZDecompress(data, size, uncompressedSize);
+    case CODEC_RL:
+        return RLDecompress(data, size, uncompressedSize);
+    case CODEC_HUFF:
+        return HuffDecompress(data, size, uncompressedSize);
+    }
+
+    return NULL;
+}
+
+static long long EstimateCycles(struct EncodingResult *result, int uncompressedSize)
+{
+    switch (result->encoding->codec)
+    {
+    case CODEC_RAW:
+        return CYCLES_CALL + ((uncompressedSize + 3) / 4) * CYCLES_RAW_WORD;
+    case CODEC_LZ:
+    case CODEC_LZ_OPTIMAL:
+        return EstimateLZCycles(result->data, uncompressedSize);
+    case CODEC_RL:
+        return EstimateRLCycles(result->data, uncompressedSize);
+    case CODEC_HUFF:
+        return EstimateHuffCycles(result->data, result->size, uncompressedSize);
+    }
+
+    return 0;
+}
+
+static void EncodeAndCheck(struct EncodingResult *result, char *path, unsigned char *src, int srcSize)
+{
+    result->data = Encode(result->encoding, src, srcSize, &result->size);
+
+    if (result->encoding->codec != CODEC_RAW)
+    {
+        int decodedSize = 0;
+        unsigned char *decoded = Decode(result->encoding, result->data, result->size, &decodedSize);
+
+        if (decodedSize != srcSize || memcmp(decoded, src, srcSize) != 0)
+            FATAL_ERROR("%s encoding of \"%s\" doesn't round-trip.\n", result->encoding->name, path);
+
+        free(decoded);
+    }
+
+    result->cycles = EstimateCycles(result, srcSize);
+}
+
+static bool IsEligible(struct EncodingResult *result, struct AutoCompressOptions *options)
+{
+    return result->encoding->vramSafe || !options->vramOnly;
+}
+
+// Picks the smallest encoding, breaking ties by decode time. POLICY_FASTEST
+// instead picks the fastest of the encodings within options->slack percent of
+// the smallest, breaking ties by size.
+static int ChooseEncoding(struct EncodingResult *results, struct AutoCompressOptions *options)
+{
+    int smallest = -1;
+
+    for (int i = 0; i < NUM_ENCODINGS; i++)
+    {
+        if (!IsEligible(&results[i], options))
+            continue;
+
+        if (smallest < 0
+         || results[i].size < results[smallest].size
+         || (results[i].size == results[smallest].size && results[i].cycles < results[smallest].cycles))
+            smallest = i;
+    }
+
+    if (options->policy == POLICY_SMALLEST)
+        return smallest;
+
+    long long sizeLimit = results[smallest].size + (long long)results[smallest].size * options->slack / 100;
+    int fastest = -1;
+
+    for (int i = 0; i < NUM_ENCODINGS; i++)
+    {
+        if (!IsEligible(&results[i], options) || results[i].size > sizeLimit)
+            continue;
+
+        if (fastest < 0
+         || results[i].cycles < results[fastest].cycles
+         || (results[i].cycles == results[fastest].cycles && results[i].size < results[fastest].size))
+            fastest = i;
+    }
+
+    return fastest;
+}
+
+static void OpenReport(struct Report *report, char *path, struct AutoCompressOptions *options)
+{
+    report->fp = NULL;
+    report->json = false;
+    report->first = true;
+
+    if (path == NULL)
+        return;
+
+    report->fp = fopen(path, "w");
+
+    if (report->fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", path);
+
+    char *extension = GetFileExtensionAfterDot(path);
+
+    report->json = (extension != NULL && strcmp(extension, "json") == 0);
+
+    if (report->json)
+        fprintf(report->fp, "{\n  \"policy\": \"%s\",\n  \"assets\": [", options->policy == POLICY_FASTEST ? "fastest" : "smallest");
+    else
+        fputs("path,size,encoding,compressed_size,ratio,decode_cycles,vram_safe,chosen\n", report->fp);
+}
+
+static void ReportAsset(struct Report *report, char *path, int size, struct EncodingResult *results, int chosen)
+{
+    FILE *fp = report->fp;
+
+    if (fp == NULL)
+        return;
+
+    if (!report->json)
+    {
+        for (int i = 0; i < NUM_ENCODINGS; i++)
+        {
+            WriteCsvField(fp, path);
+            fprintf(fp, ",%d,%s,%d,%.4f,%lld,%d,%d\n",
+                size,
+                results[i].encoding->name,
+                results[i].size,
+                (double)results[i].size / size,
+                results[i].cycles,
+                results[i].encoding->vramSafe,
+                i == chosen);
+        }
+
+        return;
+    }
+
+    fprintf(fp, "%s\n    {\n      \"path\": ", report->first ? "" : ",");
+    WriteJsonString(fp, path);
+    fprintf(fp, ",\n      \"size\": %d,\n      \"chosen\": \"%s\",\n      \"candidates\": [", size, results[chosen].encoding->name);
+
+    for (int i = 0; i < NUM_ENCODINGS; i++)
+    {
+        fprintf(fp, "%s\n        { \"encoding\": \"%s\", \"size\": %d, \"ratio\": %.4f, \"decode_cycles\": %lld, \"vram_safe\": %s }",
+            i == 0 ? "" : ",",
+            results[i].encoding->name,
+            results[i].size,
+            (double)results[i].size / size,
+            results[i].cycles,
+            results[i].encoding->vramSafe ? "true" : "false");
+    }
+
+    fputs("\n      ]\n    }", fp);
+    report->first = false;
+}
+
+static void CloseReport(struct Report *report, long long totalSize, long long totalCompressed, long long totalCycles)
+{
+    FILE *fp = report->fp;
+
+    if (fp == NULL)
+        return;
+
+    if (report->json)
+    {
+        fprintf(fp, "\n  ],\n  \"total\": { \"size\": %lld, \"compressed_size\": %lld, \"decode_cycles\": %lld }\n}\n",
+            totalSize, totalCompressed, totalCycles);
+    }
+
+    if (fclose(fp) != 0)
+        FATAL_ERROR("Failed to write report.\n");
+}
+
+void RunAutoCompress(struct FileList *files, struct AutoCompressOptions *options)
+{
+    struct Report report;
+    int chosenCounts[NUM_ENCODINGS] = {0};
+    long long totalSize = 0;
+    long long totalCompressed = 0;
+    long long totalCycles = 0;
+    int numAssets = 0;
+
+    OpenReport(&report, options->reportPath, options);
+
+    for (int i = 0; i < files->count; i++)
+    {
+        char *path = files->paths[i];
+        int srcSize;
+        unsigned char *src = ReadWholeFile(path, &srcSize);
+
+        // The compressed formats store the size in 24 bits.
+        if (srcSize == 0 || srcSize > 0xFFFFFF)
+        {
+            fprintf(stderr, "Skipping \"%s\": size %d can't be compressed.\n", path, srcSize);
+            free(src);
+            continue;
+        }
+
+        struct EncodingResult results[NUM_ENCODINGS];
+
+        for (int j = 0; j < NUM_ENCODINGS; j++)
+        {
+            results[j].encoding = &sEncodings[j];
+            EncodeAndCheck(&results[j], path, src, srcSize);
+        }
+
+        int chosen = ChooseEncoding(results, options);
+        struct EncodingResult *result = &results[chosen];
+
+        ReportAsset(&report, path, srcSize, results, chosen);
+
+        if (options->outputPath != NULL)
+        {
+            WriteWholeFile(options->outputPath, result->data, result->size);
+            printf("%s: %s, %d -> %d bytes (%.1f%%), ~%lld cycles\n", path, result->encoding->name,
+                srcSize, result->size, 100.0 * result->size / srcSize, result->cycles);
+        }
+
+        chosenCounts[chosen]++;
+        totalSize += srcSize;
+        totalCompressed += result->size;
+        totalCycles += result->cycles;
+        numAssets++;
+
+        for (int j = 0; j < NUM_ENCODINGS; j++)
+            free(results[j].data);
+
+        free(src);
+    }
+
+    CloseReport(&report, totalSize, totalCompressed, totalCycles);
+
+    if (numAssets == 0)
+        return;
+
+    printf("%d files, %lld bytes -> %lld bytes (%.1f%%), ~%lld decode cycles\n", numAssets,
+        totalSize, totalCompressed, 100.0 * totalCompressed / totalSize, totalCycles);
+
+    for (int i = 0; i < NUM_ENCODINGS; i++)
+        if (chosenCounts[i] != 0)
+            printf("  %-20s %d\n", sEncodings[i].name, chosenCounts[i]);
+}
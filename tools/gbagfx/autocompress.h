@@ -0,0 +1,24 @@
+#ifndef AUTOCOMPRESS_H
+#define AUTOCOMPRESS_H
+
+#include <stdbool.h>
+#include "util.h"
+
+enum AutoCompressPolicy
+{
+    POLICY_SMALLEST,
+    POLICY_FASTEST,
+};
+
+struct AutoCompressOptions
+{
+    enum AutoCompressPolicy policy;
+    int slack;          // percent over the smallest size POLICY_FASTEST may pick
+    bool vramOnly;      // only consider encodings the BIOS can decode to VRAM
+    char *reportPath;   // .json for a JSON report, CSV otherwise
+    char *outputPath;   // where to write the chosen encoding (one input only)
+};
+
+void RunAutoCompress(struct FileList *files, struct AutoCompressOptions *options);
+
+#endif // AUTOCOMPRESS_H
@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "global.h"
+#include "batch.h"
+
+// A manifest has one job per line: INPUT_PATH OUTPUT_PATH [options...]
+// Blank lines and lines starting with '#' are ignored. A job whose input is
+// the output of another job in the same manifest only runs once that job has
+// finished, so chains like png -> 4bpp -> 4bpp.lz can share one manifest.
+
+struct BatchJob
+{
+    int argc;
+    char **argv;
+    int dependency;   // index of the job producing this job's input, or -1
+    int firstDependent;
+    int nextSibling;
+    bool skip;
+};
+
+struct BatchState
+{
+    struct BatchJob *jobs;
+    int numJobs;
+    int *readyQueue;
+    int readyHead;
+    int readyTail;
+    int remaining;
+    int running;
+    int numSkipped;
+    BatchJobFunction runJob;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+int GetDefaultThreadCount(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? (int)count : 1;
+}
+
+static char *ReadManifest(char *path)
+{
+    FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", path);
+
+    size_t size = 0;
+    size_t capacity = 0x10000;
+    char *text = malloc(capacity + 1);
+
+    if (text == NULL)
+        FATAL_ERROR("Failed to allocate memory for reading \"%s\".\n", path);
+
+    for (;;)
+    {
+        size_t count = fread(text + size, 1, capacity - size, fp);
+
+        size += count;
+
+        if (size < capacity)
+            break;
+
+        capacity *= 2;
+        text = realloc(text, capacity + 1);
+
+        if (text == NULL)
+            FATAL_ERROR("Failed to allocate memory for reading \"%s\".\n", path);
+    }
+
+    if (ferror(fp))
+        FATAL_ERROR("Failed to read \"%s\".\n", path);
+
+    if (fp != stdin)
+        fclose(fp);
+
+    text[size] = 0;
+    return text;
+}
+
+// Splits the manifest text into jobs in place. The argv strings point into text.
+static struct BatchJob *ParseManifest(char *text, int *numJobs)
+{
+    int capacity = 256;
+    struct BatchJob *jobs = malloc(capacity * sizeof(struct BatchJob));
+    int count = 0;
+    int lineNum = 0;
+
+    if (jobs == NULL)
+        FATAL_ERROR("Failed to allocate memory for batch jobs.\n");
+
+    char *line = text;
+
+    while (*line != 0)
+    {
+        char *lineEnd = strchr(line, '\n');
+        char *next = lineEnd != NULL ? lineEnd + 1 : line + strlen(line);
+
+        if (lineEnd != NULL)
+            *lineEnd = 0;
+
+        lineNum++;
+
+        char *s = line;
+
+        while (isspace((unsigned char)*s))
+            s++;
+
+        if (*s != 0 && *s != '#')
+        {
+            // argv[0] is a placeholder for the program name.
+            int argvCapacity = 8;
+            char **argv = malloc(argvCapacity * sizeof(char *));
+            int argc = 1;
+
+            if (argv == NULL)
+                FATAL_ERROR("Failed to allocate memory for batch jobs.\n");
+
+            argv[0] = "gbagfx";
+
+            while (*s != 0)
+            {
+                if (argc + 1 >= argvCapacity)
+                {
+                    argvCapacity *= 2;
+                    argv = realloc(argv, argvCapacity * sizeof(char *));
+
+                    if (argv == NULL)
+                        FATAL_ERROR("Failed to allocate memory for batch jobs.\n");
+                }
+
+                argv[argc++] = s;
+
+                while (*s != 0 && !isspace((unsigned char)*s))
+                    s++;
+
+                if (*s != 0)
+                    *s++ = 0;
+
+                while (isspace((unsigned char)*s))
+                    s++;
+            }
+
+            argv[argc] = NULL;
+
+            if (argc < 3)
+                FATAL_ERROR("Batch manifest line %d needs an input and an output path.\n", lineNum);
+
+            if (count == capacity)
+            {
+                capacity *= 2;
+                jobs = realloc(jobs, capacity * sizeof(struct BatchJob));
+
+                if (jobs == NULL)
+                    FATAL_ERROR("Failed to allocate memory for batch jobs.\n");
+            }
+
+            jobs[count].argc = argc;
+            jobs[count].argv = argv;
+            jobs[count].dependency = -1;
+            jobs[count].firstDependent = -1;
+            jobs[count].nextSibling = -1;
+            jobs[count].skip = false;
+            count++;
+        }
+
+        line = next;
+    }
+
+    *numJobs = count;
+    return jobs;
+}
+
+static unsigned int HashString(const char *s)
+{
+    unsigned int hash = 2166136261u;
+
+    while (*s != 0)
+        hash = (hash ^ (unsigned char)*s++) * 16777619u;
+
+    return hash;
+}
+
+// Links each job to the job that produces its input, if any.
+static void ResolveDependencies(struct BatchJob *jobs, int numJobs)
+{
+    int tableSize = 1;
+
+    while (tableSize < numJobs * 2)
+        tableSize *= 2;
+
+    int *table = malloc(tableSize * sizeof(int));
+
+    if (table == NULL)
+        FATAL_ERROR("Failed to allocate memory for batch jobs.\n");
+
+    for (int i = 0; i < tableSize; i++)
+        table[i] = -1;
+
+    for (int i = 0; i < numJobs; i++)
+    {
+        char *output = jobs[i].argv[2];
+        unsigned int slot = HashString(output) & (tableSize - 1);
+
+        while (table[slot] != -1)
+        {
+            if (strcmp(jobs[table[slot]].argv[2], output) == 0)
+                FATAL_ERROR("\"%s\" is the output of more than one batch job.\n", output);
+
+            slot = (slot + 1) & (tableSize - 1);
+        }
+
+        table[slot] = i;
+    }
+
+    for (int i = 0; i < numJobs; i++)
+    {
+        char *input = jobs[i].argv[1];
+        unsigned int slot = HashString(input) & (tableSize - 1);
+
+        while (table[slot] != -1)
+        {
+            int producer = table[slot];
+
+            if (strcmp(jobs[producer].argv[2], input) == 0)
+            {
+                if (producer == i)
+                    FATAL_ERROR("Batch job for \"%s\" reads its own output.\n", input);
+
+                jobs[i].dependency = producer;
+                jobs[i].nextSibling = jobs[producer].firstDependent;
+                jobs[producer].firstDependent = i;
+                break;
+            }
+
+            slot = (slot + 1) & (tableSize - 1);
+        }
+    }
+
+    free(table);
+}
+
+static bool FileExists(char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) == 0;
+}
+
+// Must be called with the mutex held.
+static void FinishJob(struct BatchState *state, int index)
+{
+    state->remaining--;
+
+    for (int i = state->jobs[index].firstDependent; i != -1; i = state->jobs[i].nextSibling)
+    {
+        state->jobs[i].skip = state->jobs[index].skip;
+        state->readyQueue[state->readyTail++] = i;
+    }
+
+    pthread_cond_broadcast(&state->cond);
+}
+
+static void *BatchWorker(void *arg)
+{
+    struct BatchState *state = arg;
+
+    pthread_mutex_lock(&state->mutex);
+
+    for (;;)
+    {
+        while (state->readyHead == state->readyTail && state->remaining > 0)
+        {
+            if (state->running == 0)
+                FATAL_ERROR("Batch manifest has a dependency cycle.\n");
+
+            pthread_cond_wait(&state->cond, &state->mutex);
+        }
+
+        if (state->remaining == 0)
+            break;
+
+        int index = state->readyQueue[state->readyHead++];
+        struct BatchJob *job = &state->jobs[index];
+
+        // Jobs whose input is produced by some other tool (e.g. a "cat" rule)
+        // are left for the regular build to handle.
+        if (!job->skip && job->dependency == -1 && !FileExists(job->argv[1]))
+            job->skip = true;
+
+        if (job->skip)
+        {
+            fprintf(stderr, "Skipping \"%s\": input \"%s\" is not available.\n", job->argv[2], job->argv[1]);
+            state->numSkipped++;
+        }
+        else
+        {
+            state->running++;
+            pthread_mutex_unlock(&state->mutex);
+
+            if (!state->runJob(job->argc, job->argv))
+                FATAL_ERROR("Don't know how to convert \"%s\" to \"%s\".\n", job->argv[1], job->argv[2]);
+
+            pthread_mutex_lock(&state->mutex);
+            state->running--;
+        }
+
+        FinishJob(state, index);
+    }
+
+    pthread_mutex_unlock(&state->mutex);
+
+    return NULL;
+}
+
+void RunBatch(char *manifestPath, int numThreads, BatchJobFunction runJob)
+{
+    struct BatchState state;
+    char *text = ReadManifest(manifestPath);
+
+    state.jobs = ParseManifest(text, &state.numJobs);
+    state.readyQueue = malloc((state.numJobs + 1) * sizeof(int));
+    state.readyHead = 0;
+    state.readyTail = 0;
+    state.remaining = state.numJobs;
+    state.running = 0;
+    state.numSkipped = 0;
+    state.runJob = runJob;
+
+    if (state.readyQueue == NULL)
+        FATAL_ERROR("Failed to allocate memory for batch jobs.\n");
+
+    ResolveDependencies(state.jobs, state.numJobs);
+
+    for (int i = 0; i < state.numJobs; i++)
+        if (state.jobs[i].dependency == -1)
+            state.readyQueue[state.readyTail++] = i;
+
+    if (numThreads > state.numJobs)
+        numThreads = state.numJobs;
+
+    if (numThreads < 1)
+        numThreads = 1;
+
+    pthread_mutex_init(&state.mutex, NULL);
+    pthread_cond_init(&state.cond, NULL);
+
+    pthread_t *threads = malloc(numThreads * sizeof(pthread_t));
+
+    if (threads == NULL)
+        FATAL_ERROR("Failed to allocate memory for batch threads.\n");
+
+    for (int i = 0; i < numThreads; i++)
+        if (pthread_create(&threads[i], NULL, BatchWorker, &state) != 0)
+            FATAL_ERROR("Failed to create batch worker thread.\n");
+
+    for (int i = 0; i < numThreads; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_cond_destroy(&state.cond);
+    pthread_mutex_destroy(&state.mutex);
+
+    if (state.numSkipped != 0)
+        fprintf(stderr, "%d of %d batch jobs skipped.\n", state.numSkipped, state.numJobs);
+
+    for (int i = 0; i < state.numJobs; i++)
+        free(state.jobs[i].argv);
+
+    free(threads);
+    free(state.jobs);
+    free(state.readyQueue);
+    free(text);
+}
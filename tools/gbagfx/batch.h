@@ -0,0 +1,13 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+
+// Runs one conversion. argv has the same layout as gbagfx's own command line:
+// argv[1] is the input path, argv[2] the output path, followed by options.
+typedef bool (*BatchJobFunction)(int argc, char **argv);
+
+void RunBatch(char *manifestPath, int numThreads, BatchJobFunction runJob);
+int GetDefaultThreadCount(void);
+
+#endif // BATCH_H
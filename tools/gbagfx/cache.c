@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "global.h"
+#include "util.h"
+#include "sha1.h"
+#include "cache.h"
+
+// Bump this whenever a change to gbagfx alters the output of a conversion, so
+// that stale entries are no longer found.
+#define CACHE_FORMAT "gbagfx-cache-2"
+
+// Entries live in CACHE_DIR/objects/xx/yyyy..., where xxyyyy... is the SHA-1
+// of the input bytes, the file extensions and the options (see
+// CacheComputeKey). Every process appends one "hits misses" line to
+// CACHE_DIR/stats when it exits.
+
+static atomic_int sCacheHits;
+static atomic_int sCacheMisses;
+static mode_t sFileMode;
+
+// umask() can only be read by setting it, so do that once before any worker
+// threads exist.
+__attribute__((constructor)) static void InitFileMode(void)
+{
+	mode_t mask = umask(0);
+
+	umask(mask);
+	sFileMode = 0666 & ~mask;
+}
+
+static char *GetCacheDir(void)
+{
+	char *dir = getenv("GBAGFX_CACHE_DIR");
+
+	if (dir == NULL || *dir == 0)
+		return NULL;
+
+	return dir;
+}
+
+bool CacheIsEnabled(void)
+{
+	return GetCacheDir() != NULL;
+}
+
+static void MakeDirectory(char *path)
+{
+	if (mkdir(path, 0777) != 0 && errno != EEXIST)
+		FATAL_ERROR("Failed to create directory \"%s\".\n", path);
+}
+
+static void HashFileContents(struct Sha1Context *ctx, char *path)
+{
+	int size;
+	unsigned char *buffer = ReadWholeFile(path, &size);
+
+	Sha1Update(ctx, &size, sizeof(size));
+	Sha1Update(ctx, buffer, size);
+
+	free(buffer);
+}
+
+static bool IsRegularFile(char *path)
+{
+	struct stat st;
+
+	return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// The key covers everything a conversion depends on: the input bytes, the
+// input and output file extensions (which select the handler), and each
+// option. Options that name an existing file (e.g. "-palette") also
+// contribute that file's contents.
+void CacheComputeKey(char *inputPath, char *outputPath, int argc, char **argv, char key[CACHE_KEY_SIZE])
+{
+	struct Sha1Context ctx;
+	unsigned char digest[20];
+	char *inputExtension = GetFileExtensionAfterDot(inputPath);
+	char *outputExtension = GetFileExtensionAfterDot(outputPath);
+
+	Sha1Init(&ctx);
+	Sha1Update(&ctx, CACHE_FORMAT, sizeof(CACHE_FORMAT));
+	Sha1Update(&ctx, inputExtension, strlen(inputExtension) + 1);
+	Sha1Update(&ctx, outputExtension, strlen(outputExtension) + 1);
+	HashFileContents(&ctx, inputPath);
+
+	for (int i = 3; i < argc; i++) {
+		Sha1Update(&ctx, argv[i], strlen(argv[i]) + 1);
+
+		if (argv[i][0] != '-' && IsRegularFile(argv[i]))
+			HashFileContents(&ctx, argv[i]);
+	}
+
+	Sha1Final(&ctx, digest);
+	Sha1ToHex(digest, key);
+}
+
+static char *GetEntryPath(const char *key, bool createDirs)
+{
+	char *dir = GetCacheDir();
+	size_t size = strlen(dir) + CACHE_KEY_SIZE + 16;
+	char *path = malloc(size);
+
+	if (path == NULL)
+		FATAL_ERROR("Failed to allocate memory for cache path.\n");
+
+	if (createDirs) {
+		snprintf(path, size, "%s", dir);
+		MakeDirectory(path);
+		snprintf(path, size, "%s/objects", dir);
+		MakeDirectory(path);
+		snprintf(path, size, "%s/objects/%.2s", dir, key);
+		MakeDirectory(path);
+	}
+
+	snprintf(path, size, "%s/objects/%.2s/%s", dir, key, key + 2);
+	return path;
+}
+
+// Writes buffer to a temporary file next to path and renames it into place,
+// so that a concurrent reader never sees a partial file.
+static bool WriteFileAtomically(char *path, unsigned char *buffer, int size)
+{
+	size_t tempPathSize = strlen(path) + 8;
+	char *tempPath = malloc(tempPathSize);
+
+	if (tempPath == NULL)
+		FATAL_ERROR("Failed to allocate memory for cache path.\n");
+
+	snprintf(tempPath, tempPathSize, "%s.XXXXXX", path);
+
+	int fd = mkstemp(tempPath);
+	bool ok = false;
+
+	if (fd >= 0) {
+		// mkstemp() creates the file readable only by its owner, which would
+		// carry over to fetched outputs.
+		fchmod(fd, sFileMode);
+
+		FILE *fp = fdopen(fd, "wb");
+
+		if (fp != NULL) {
+			ok = (size == 0 || fwrite(buffer, size, 1, fp) == 1);
+			ok = (fclose(fp) == 0) && ok;
+		} else {
+			close(fd);
+		}
+
+		if (ok)
+			ok = (rename(tempPath, path) == 0);
+
+		if (!ok)
+			remove(tempPath);
+	}
+
+	free(tempPath);
+	return ok;
+}
+
+// Places a copy of the cached entry at outputPath. The output must not share
+// an inode with the entry: it has to get a fresh mtime so that make sees it as
+// newer than its inputs, and a later uncached run writing to it in place must
+// not change the entry.
+bool CacheFetch(const char *key, char *outputPath)
+{
+	char *entryPath = GetEntryPath(key, false);
+	bool found = IsRegularFile(entryPath);
+
+	if (found) {
+		int size;
+		unsigned char *buffer = ReadWholeFile(entryPath, &size);
+
+		if (!WriteFileAtomically(outputPath, buffer, size))
+			FATAL_ERROR("Failed to write \"%s\".\n", outputPath);
+
+		free(buffer);
+		atomic_fetch_add(&sCacheHits, 1);
+	} else {
+		atomic_fetch_add(&sCacheMisses, 1);
+	}
+
+	free(entryPath);
+	return found;
+}
+
+void CacheStore(const char *key, char *outputPath)
+{
+	char *entryPath = GetEntryPath(key, true);
+	int size;
+	unsigned char *buffer = ReadWholeFile(outputPath, &size);
+
+	// Failing to populate the cache only costs time later, so it isn't fatal.
+	if (!WriteFileAtomically(entryPath, buffer, size))
+		fprintf(stderr, "Warning: failed to write cache entry \"%s\".\n", entryPath);
+
+	free(buffer);
+	free(entryPath);
+}
+
+void CacheSaveStats(void)
+{
+	char *dir = GetCacheDir();
+	int hits = atomic_load(&sCacheHits);
+	int misses = atomic_load(&sCacheMisses);
+
+	if (dir == NULL || hits + misses == 0)
+		return;
+
+	size_t size = strlen(dir) + 16;
+	char *path = malloc(size);
+
+	if (path == NULL)
+		FATAL_ERROR("Failed to allocate memory for cache path.\n");
+
+	MakeDirectory(dir);
+	snprintf(path, size, "%s/stats", dir);
+
+	// Each process appends a single short line, which O_APPEND keeps intact
+	// when several gbagfx processes finish at the same time.
+	int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+
+	if (fd >= 0) {
+		char line[64];
+		int length = snprintf(line, sizeof(line), "%d %d\n", hits, misses);
+
+		if (write(fd, line, length) != length)
+			fprintf(stderr, "Warning: failed to update \"%s\".\n", path);
+
+		close(fd);
+	}
+
+	free(path);
+}
+
+void CachePrintStats(char *cacheDir, bool reset)
+{
+	size_t size = strlen(cacheDir) + 16;
+	char *path = malloc(size);
+	long long hits = 0;
+	long long misses = 0;
+
+	if (path == NULL)
+		FATAL_ERROR("Failed to allocate memory for cache path.\n");
+
+	snprintf(path, size, "%s/stats", cacheDir);
+
+	FILE *fp = fopen(path, "r");
+
+	if (fp != NULL) {
+		long long lineHits, lineMisses;
+
+		while (fscanf(fp, "%lld %lld", &lineHits, &lineMisses) == 2) {
+			hits += lineHits;
+			misses += lineMisses;
+		}
+
+		fclose(fp);
+	}
+
+	struct FileList entries = {};
+	long long totalSize = 0;
+
+	snprintf(path, size, "%s/objects", cacheDir);
+
+	if (access(path, F_OK) == 0)
+		AddFilesRecursive(&entries, path, NULL);
+
+	for (int i = 0; i < entries.count; i++) {
+		struct stat st;
+
+		if (stat(entries.paths[i], &st) == 0)
+			totalSize += st.st_size;
+	}
+
+	printf("entries: %d (%lld bytes)\n", entries.count, totalSize);
+	printf("hits:    %lld\n", hits);
+	printf("misses:  %lld\n", misses);
+
+	if (hits + misses != 0)
+		printf("hit rate: %.1f%%\n", 100.0 * hits / (hits + misses));
+
+	if (reset) {
+		snprintf(path, size, "%s/stats", cacheDir);
+		remove(path);
+	}
+
+	FreeFileList(&entries);
+	free(path);
+}
@@ -0,0 +1,18 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+
+// Content-addressed cache of conversion outputs. It is enabled by pointing the
+// GBAGFX_CACHE_DIR environment variable at a directory.
+
+#define CACHE_KEY_SIZE 41
+
+bool CacheIsEnabled(void);
+void CacheComputeKey(char *inputPath, char *outputPath, int argc, char **argv, char key[CACHE_KEY_SIZE]);
+bool CacheFetch(const char *key, char *outputPath);
+void CacheStore(const char *key, char *outputPath);
+void CacheSaveStats(void);
+void CachePrintStats(char *cacheDir, bool reset);
+
+#endif // CACHE_H
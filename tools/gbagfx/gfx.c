@@ -4,6 +4,10 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "global.h"
 #include "gfx.h"
 #include "util.h"
@@ -35,7 +39,10 @@ static void AdvanceMetatilePosition(int *subTileX, int *subTileY, int *metatileX
 	}
 }
 
-static void ConvertFromTiles1Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+// Reference converters that handle one pixel at a time. They are only used
+// by the tile benchmark to validate the faster converters below.
+
+static void ConvertFromTiles1BppReference(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
 {
 	int subTileX = 0;
 	int subTileY = 0;
@@ -61,7 +68,7 @@ static void ConvertFromTiles1Bpp(unsigned char *src, unsigned char *dest, int nu
 	}
 }
 
-static void ConvertFromTiles4Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+static void ConvertFromTiles4BppReference(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
 {
 	int subTileX = 0;
 	int subTileY = 0;
@@ -92,7 +99,7 @@ static void ConvertFromTiles4Bpp(unsigned char *src, unsigned char *dest, int nu
 	}
 }
 
-static void ConvertFromTiles8Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+static void ConvertFromTiles8BppReference(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
 {
 	int subTileX = 0;
 	int subTileY = 0;
@@ -119,7 +126,7 @@ static void ConvertFromTiles8Bpp(unsigned char *src, unsigned char *dest, int nu
 	}
 }
 
-static void ConvertToTiles1Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+static void ConvertToTiles1BppReference(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
 {
 	int subTileX = 0;
 	int subTileY = 0;
@@ -145,7 +152,7 @@ static void ConvertToTiles1Bpp(unsigned char *src, unsigned char *dest, int numT
 	}
 }
 
-static void ConvertToTiles4Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+static void ConvertToTiles4BppReference(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
 {
 	int subTileX = 0;
 	int subTileY = 0;
@@ -176,7 +183,7 @@ static void ConvertToTiles4Bpp(unsigned char *src, unsigned char *dest, int numT
 	}
 }
 
-static void ConvertToTiles8Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+static void ConvertToTiles8BppReference(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
 {
 	int subTileX = 0;
 	int subTileY = 0;
@@ -203,6 +210,298 @@ static void ConvertToTiles8Bpp(unsigned char *src, unsigned char *dest, int numT
 	}
 }
 
+// The fast converters handle a whole tile row at a time. Tile data stores the
+// leftmost pixel in the low bits of each byte while the image stores it in the
+// high bits, so a 4bpp row is four bytes with their nibbles swapped and a 1bpp
+// row is one byte with its bits reversed. Inverting colors flips every bit.
+
+#define R2(n) n, n + 2 * 64, n + 1 * 64, n + 3 * 64
+#define R4(n) R2(n), R2(n + 2 * 16), R2(n + 1 * 16), R2(n + 3 * 16)
+#define R6(n) R4(n), R4(n + 2 * 4), R4(n + 1 * 4), R4(n + 3 * 4)
+
+static const unsigned char sReverseBits[256] = { R6(0), R6(2), R6(1), R6(3) };
+
+#undef R2
+#undef R4
+#undef R6
+
+static inline uint32_t Load32(const unsigned char *p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline void Store32(unsigned char *p, uint32_t value)
+{
+	memcpy(p, &value, sizeof(value));
+}
+
+static inline uint64_t Load64(const unsigned char *p)
+{
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline void Store64(unsigned char *p, uint64_t value)
+{
+	memcpy(p, &value, sizeof(value));
+}
+
+static inline uint32_t SwapNibbles32(uint32_t x)
+{
+	return ((x & 0x0F0F0F0F) << 4) | ((x >> 4) & 0x0F0F0F0F);
+}
+
+#ifdef __SSE2__
+static inline __m128i SwapNibbles128(__m128i x)
+{
+	const __m128i mask = _mm_set1_epi8(0x0F);
+
+	return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(x, mask), 4), _mm_and_si128(_mm_srli_epi16(x, 4), mask));
+}
+#endif // __SSE2__
+
+// Converts one 4bpp tile. pixels points at the tile's top-left byte in the
+// image and tile at its 32 contiguous bytes of tile data.
+static inline void PackTile4Bpp(const unsigned char *pixels, int pitch, unsigned char *tile, uint32_t xorMask)
+{
+#ifdef __SSE2__
+	const __m128i xor128 = _mm_set1_epi32(xorMask);
+
+	for (int j = 0; j < 8; j += 4) {
+		__m128i rows = _mm_set_epi32(Load32(&pixels[(j + 3) * pitch]), Load32(&pixels[(j + 2) * pitch]),
+		                             Load32(&pixels[(j + 1) * pitch]), Load32(&pixels[j * pitch]));
+		_mm_storeu_si128((__m128i *)&tile[j * 4], _mm_xor_si128(SwapNibbles128(rows), xor128));
+	}
+#else
+	for (int j = 0; j < 8; j++)
+		Store32(&tile[j * 4], SwapNibbles32(Load32(&pixels[j * pitch])) ^ xorMask);
+#endif // __SSE2__
+}
+
+static inline void UnpackTile4Bpp(const unsigned char *tile, unsigned char *pixels, int pitch, uint32_t xorMask)
+{
+#ifdef __SSE2__
+	const __m128i xor128 = _mm_set1_epi32(xorMask);
+
+	for (int j = 0; j < 8; j += 4) {
+		__m128i rows = _mm_xor_si128(SwapNibbles128(_mm_loadu_si128((const __m128i *)&tile[j * 4])), xor128);
+
+		for (int k = 0; k < 4; k++) {
+			Store32(&pixels[(j + k) * pitch], _mm_cvtsi128_si32(rows));
+			rows = _mm_srli_si128(rows, 4);
+		}
+	}
+#else
+	for (int j = 0; j < 8; j++)
+		Store32(&pixels[j * pitch], SwapNibbles32(Load32(&tile[j * 4])) ^ xorMask);
+#endif // __SSE2__
+}
+
+static inline void PackTile8Bpp(const unsigned char *pixels, int pitch, unsigned char *tile, uint64_t xorMask)
+{
+#ifdef __SSE2__
+	const __m128i xor128 = _mm_set1_epi64x(xorMask);
+
+	for (int j = 0; j < 8; j += 2) {
+		__m128i rows = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)&pixels[j * pitch]),
+		                                  _mm_loadl_epi64((const __m128i *)&pixels[(j + 1) * pitch]));
+		_mm_storeu_si128((__m128i *)&tile[j * 8], _mm_xor_si128(rows, xor128));
+	}
+#else
+	for (int j = 0; j < 8; j++)
+		Store64(&tile[j * 8], Load64(&pixels[j * pitch]) ^ xorMask);
+#endif // __SSE2__
+}
+
+static inline void UnpackTile8Bpp(const unsigned char *tile, unsigned char *pixels, int pitch, uint64_t xorMask)
+{
+#ifdef __SSE2__
+	const __m128i xor128 = _mm_set1_epi64x(xorMask);
+
+	for (int j = 0; j < 8; j += 2) {
+		__m128i rows = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&tile[j * 8]), xor128);
+		_mm_storel_epi64((__m128i *)&pixels[j * pitch], rows);
+		_mm_storel_epi64((__m128i *)&pixels[(j + 1) * pitch], _mm_unpackhi_epi64(rows, rows));
+	}
+#else
+	for (int j = 0; j < 8; j++)
+		Store64(&pixels[j * pitch], Load64(&tile[j * 8]) ^ xorMask);
+#endif // __SSE2__
+}
+
+static void ConvertFromTiles1Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	int subTileX = 0;
+	int subTileY = 0;
+	int metatileX = 0;
+	int metatileY = 0;
+	int pitch = metatilesWide * metatileWidth;
+	unsigned char xorMask = invertColors ? 0xFF : 0;
+
+	for (int i = 0; i < numTiles; i++) {
+		int destY = (metatileY * metatileHeight + subTileY) * 8;
+		int destX = metatileX * metatileWidth + subTileX;
+		unsigned char *pixels = &dest[destY * pitch + destX];
+
+		for (int j = 0; j < 8; j++)
+			pixels[j * pitch] = sReverseBits[*src++] ^ xorMask;
+
+		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
+	}
+}
+
+static void ConvertFromTiles4Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	int subTileX = 0;
+	int subTileY = 0;
+	int metatileX = 0;
+	int metatileY = 0;
+	int pitch = (metatilesWide * metatileWidth) * 4;
+	uint32_t xorMask = invertColors ? 0xFFFFFFFF : 0;
+
+	for (int i = 0; i < numTiles; i++) {
+		int destY = (metatileY * metatileHeight + subTileY) * 8;
+		int destX = (metatileX * metatileWidth + subTileX) * 4;
+
+		UnpackTile4Bpp(src, &dest[destY * pitch + destX], pitch, xorMask);
+		src += 32;
+
+		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
+	}
+}
+
+static void ConvertFromTiles8Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	int subTileX = 0;
+	int subTileY = 0;
+	int metatileX = 0;
+	int metatileY = 0;
+	int pitch = (metatilesWide * metatileWidth) * 8;
+	uint64_t xorMask = invertColors ? 0xFFFFFFFFFFFFFFFFull : 0;
+
+	for (int i = 0; i < numTiles; i++) {
+		int destY = (metatileY * metatileHeight + subTileY) * 8;
+		int destX = (metatileX * metatileWidth + subTileX) * 8;
+
+		UnpackTile8Bpp(src, &dest[destY * pitch + destX], pitch, xorMask);
+		src += 64;
+
+		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
+	}
+}
+
+static void ConvertToTiles1Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	int subTileX = 0;
+	int subTileY = 0;
+	int metatileX = 0;
+	int metatileY = 0;
+	int pitch = metatilesWide * metatileWidth;
+	unsigned char xorMask = invertColors ? 0xFF : 0;
+
+	for (int i = 0; i < numTiles; i++) {
+		int srcY = (metatileY * metatileHeight + subTileY) * 8;
+		int srcX = metatileX * metatileWidth + subTileX;
+		unsigned char *pixels = &src[srcY * pitch + srcX];
+
+		for (int j = 0; j < 8; j++)
+			*dest++ = sReverseBits[pixels[j * pitch]] ^ xorMask;
+
+		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
+	}
+}
+
+static void ConvertToTiles4Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	int subTileX = 0;
+	int subTileY = 0;
+	int metatileX = 0;
+	int metatileY = 0;
+	int pitch = (metatilesWide * metatileWidth) * 4;
+	uint32_t xorMask = invertColors ? 0xFFFFFFFF : 0;
+
+	for (int i = 0; i < numTiles; i++) {
+		int srcY = (metatileY * metatileHeight + subTileY) * 8;
+		int srcX = (metatileX * metatileWidth + subTileX) * 4;
+
+		PackTile4Bpp(&src[srcY * pitch + srcX], pitch, dest, xorMask);
+		dest += 32;
+
+		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
+	}
+}
+
+static void ConvertToTiles8Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
+{
+	int subTileX = 0;
+	int subTileY = 0;
+	int metatileX = 0;
+	int metatileY = 0;
+	int pitch = (metatilesWide * metatileWidth) * 8;
+	uint64_t xorMask = invertColors ? 0xFFFFFFFFFFFFFFFFull : 0;
+
+	for (int i = 0; i < numTiles; i++) {
+		int srcY = (metatileY * metatileHeight + subTileY) * 8;
+		int srcX = (metatileX * metatileWidth + subTileX) * 8;
+
+		PackTile8Bpp(&src[srcY * pitch + srcX], pitch, dest, xorMask);
+		dest += 64;
+
+		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
+	}
+}
+
+void ConvertToTiles(unsigned char *src, unsigned char *dest, int numTiles, int bitDepth, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors, bool reference)
+{
+	switch (bitDepth) {
+	case 1:
+		if (reference)
+			ConvertToTiles1BppReference(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		else
+			ConvertToTiles1Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	case 4:
+		if (reference)
+			ConvertToTiles4BppReference(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		else
+			ConvertToTiles4Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	case 8:
+		if (reference)
+			ConvertToTiles8BppReference(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		else
+			ConvertToTiles8Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	}
+}
+
+void ConvertFromTiles(unsigned char *src, unsigned char *dest, int numTiles, int bitDepth, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors, bool reference)
+{
+	switch (bitDepth) {
+	case 1:
+		if (reference)
+			ConvertFromTiles1BppReference(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		else
+			ConvertFromTiles1Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	case 4:
+		if (reference)
+			ConvertFromTiles4BppReference(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		else
+			ConvertFromTiles4Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	case 8:
+		if (reference)
+			ConvertFromTiles8BppReference(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		else
+			ConvertFromTiles8Bpp(src, dest, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
+		break;
+	}
+}
+
 void ReadImage(char *path, int tilesWidth, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
 {
 	int tileSize = bitDepth * 8;
@@ -230,17 +529,7 @@ void ReadImage(char *path, int tilesWidth, int bitDepth, int metatileWidth, int
 
 	int metatilesWide = tilesWidth / metatileWidth;
 
-	switch (bitDepth) {
-	case 1:
-		ConvertFromTiles1Bpp(buffer, image->pixels, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 4:
-		ConvertFromTiles4Bpp(buffer, image->pixels, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 8:
-		ConvertFromTiles8Bpp(buffer, image->pixels, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	}
+	ConvertFromTiles(buffer, image->pixels, numTiles, bitDepth, metatilesWide, metatileWidth, metatileHeight, invertColors, false);
 
 	free(buffer);
 }
@@ -279,17 +568,7 @@ void WriteImage(char *path, int numTiles, int bitDepth, int metatileWidth, int m
 
 	int metatilesWide = tilesWidth / metatileWidth;
 
-	switch (bitDepth) {
-	case 1:
-		ConvertToTiles1Bpp(image->pixels, buffer, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 4:
-		ConvertToTiles4Bpp(image->pixels, buffer, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 8:
-		ConvertToTiles8Bpp(image->pixels, buffer, numTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	}
+	ConvertToTiles(image->pixels, buffer, numTiles, bitDepth, metatilesWide, metatileWidth, metatileHeight, invertColors, false);
 
 	WriteWholeFile(path, buffer, bufferSize);
 
@@ -30,6 +30,8 @@ struct Image {
 void ReadImage(char *path, int tilesWidth, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors);
 void WriteImage(char *path, int numTiles, int bitDepth, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors);
 void FreeImage(struct Image *image);
+void ConvertToTiles(unsigned char *src, unsigned char *dest, int numTiles, int bitDepth, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors, bool reference);
+void ConvertFromTiles(unsigned char *src, unsigned char *dest, int numTiles, int bitDepth, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors, bool reference);
 void ReadGbaPalette(char *path, struct Palette *palette);
 void WriteGbaPalette(char *path, struct Palette *palette);
 
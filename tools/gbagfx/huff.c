@@ -1,215 +1,354 @@
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
-#include <assert.h>
 #include <stdio.h>
 #include <stdint.h>
 #include "global.h"
 #include "huff.h"
 
-static int cmp_tree(const void * a0, const void * b0) {
-    return ((struct HuffData *)a0)->value - ((struct HuffData *)b0)->value;
+/*
+ * GBA BIOS Huffman format:
+ *   - 4-byte header: 0x20 | bitDepth, then the uncompressed size (24 bits).
+ *   - Tree table: one size byte ((table size / 2) - 1) followed by the nodes
+ *     in breadth-first order. A branch node holds the offset to its pair of
+ *     children in the low 6 bits, and flags telling whether the left (0x80)
+ *     or right (0x40) child is a leaf. A leaf holds its symbol.
+ *   - Bitstream, in 32-bit little-endian words read from the most significant
+ *     bit down. Since the BIOS reads whole words, the tree table is padded so
+ *     the bitstream is word-aligned, and the input is encoded as if it were
+ *     zero-padded to a multiple of 4 bytes.
+ */
+
+#define HUFF_CHUNK_SIZE 0x10000
+#define HUFF_MAX_SYMBOLS 256
+#define HUFF_MAX_NODES (2 * HUFF_MAX_SYMBOLS - 1)
+#define HUFF_MAX_CODE_BITS 64
+
+struct HuffNode {
+    uint32_t value;
+    bool isLeaf;
+    unsigned char key;
+    int left;
+    int right;
+};
+
+struct HuffTree {
+    struct HuffNode nodes[HUFF_MAX_NODES];
+    int root;
+};
+
+struct HuffEncoder {
+    struct HuffCode codes[HUFF_MAX_SYMBOLS];
+    int bitDepth;
+    uint64_t bitBuffer; // pending bits, right-aligned
+    int bitCount;       // number of pending bits, always < 32 between calls
+};
+
+struct HuffDecoder {
+    unsigned char tree[512]; // the tree table, starting with its size byte
+    int treeSize;
+    int bitDepth;
+    int treePos;
+    uint32_t value;
+    int numValues;
+};
+
+static inline void write_32_le(unsigned char * dest, uint32_t value) {
+    dest[0] = value;
+    dest[1] = value >> 8;
+    dest[2] = value >> 16;
+    dest[3] = value >> 24;
 }
 
-typedef int (*cmpfun)(const void *, const void *);
-
-int msort_r(void * data, size_t count, size_t size, cmpfun cmp, void * buffer) {
-    /*
-     * Out-of-place mergesort (stable sort)
-     * Returns 1 on success, 0 on failure
-     */
-    void * leftPtr;
-    void * rightPtr;
-    void * leftEnd;
-    void * rightEnd;
-    int i;
-
-    switch (count) {
-    case 0:
-        // Should never be here
-        return 0;
+static inline uint32_t read_32_le(const unsigned char * src) {
+    return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+}
 
-    case 1:
-        // Nothing to do here
-        break;
+static void count_symbols(const unsigned char * src, int size, int bitDepth, uint32_t * freqs) {
+    if (bitDepth == 8) {
+        for (int i = 0; i < size; i++)
+            freqs[src[i]]++;
+    } else {
+        for (int i = 0; i < size; i++) {
+            freqs[src[i] & 0xF]++;
+            freqs[src[i] >> 4]++;
+        }
+    }
+}
+
+// The zero bytes that pad the input to a whole number of words are encoded too.
+static void count_padding(int srcSize, int bitDepth, uint32_t * freqs) {
+    int padding = -srcSize & 3;
+
+    freqs[0] += padding * (8 / bitDepth);
+}
 
-    case 2:
-        // Swap the two entries if the right one compares higher.
-        if (cmp(data, data + size) > 0) {
-            memcpy(buffer, data, size);
-            memcpy(data, data + size, size);
-            memcpy(data + size, buffer, size);
+/*
+ * Builds the tree the same way as repeatedly stable-sorting the node list by
+ * frequency and merging the two lowest nodes: leaves are ordered by frequency
+ * then symbol, and among nodes of equal frequency, leaves are taken before
+ * merged nodes, which are taken in the order they were created. The first
+ * node taken becomes the right child and the second the left child.
+ */
+static void build_tree(const uint32_t * freqs, int bitDepth, struct HuffTree * tree) {
+    int nsymbols = 1 << bitDepth;
+    int nleaves = 0;
+    struct HuffNode * nodes = tree->nodes;
+
+    for (int i = 0; i < nsymbols; i++) {
+        if (freqs[i] != 0) {
+            nodes[nleaves].value = freqs[i];
+            nodes[nleaves].isLeaf = true;
+            nodes[nleaves].key = i;
+            nleaves++;
         }
-        break;
-    default:
-        // Merge sort out-of-place.
-        leftPtr = data;
-        leftEnd = rightPtr = data + count / 2 * size;
-        rightEnd = data + count * size;
-
-        // Sort the left half
-        if (!msort_r(leftPtr, count / 2, size, cmp, buffer))
-            return 0;
+    }
 
-        // Sort the right half
-        if (!msort_r(rightPtr, count / 2 + (count & 1), size, cmp, buffer))
-            return 0;
+    if (nleaves == 0)
+        FATAL_ERROR("Fatal error while compressing Huff file.\n");
 
-        // Merge the sorted halves out of place
-        i = 0;
-        do {
-            if (cmp(leftPtr, rightPtr) <= 0) {
-                memcpy(buffer + i * size, leftPtr, size);
-                leftPtr += size;
-            } else {
-                memcpy(buffer + i * size, rightPtr, size);
-                rightPtr += size;
-            }
+    // The root must be a branch node, so give a lone symbol an unused sibling.
+    if (nleaves == 1) {
+        nodes[1] = nodes[0];
+        nodes[0].value = 0;
+        nodes[0].key = (nodes[1].key == 0) ? 1 : 0;
+        nleaves = 2;
+    }
 
-        } while (++i < count && leftPtr < leftEnd && rightPtr < rightEnd);
+    // Stable insertion sort by frequency.
+    for (int i = 1; i < nleaves; i++) {
+        struct HuffNode node = nodes[i];
+        int j = i;
 
-        // Copy the remainder
-        if (i < count) {
-            if (leftPtr < leftEnd) {
-                memcpy(buffer + i * size, leftPtr, leftEnd - leftPtr);
-            }
-            else {
-                memcpy(buffer + i * size, rightPtr, rightEnd - rightPtr);
-            }
+        while (j > 0 && nodes[j - 1].value > node.value) {
+            nodes[j] = nodes[j - 1];
+            j--;
         }
 
-        // Copy the merged data back
-        memcpy(data, buffer, count * size);
-        break;
+        nodes[j] = node;
     }
 
-    return 1;
-}
+    int leafHead = 0;
+    int mergedHead = nleaves;
+    int mergedTail = nleaves;
+
+    while (mergedTail < 2 * nleaves - 1) {
+        int picked[2];
+
+        for (int k = 0; k < 2; k++) {
+            if (leafHead < nleaves && (mergedHead == mergedTail || nodes[leafHead].value <= nodes[mergedHead].value))
+                picked[k] = leafHead++;
+            else
+                picked[k] = mergedHead++;
+        }
+
+        nodes[mergedTail].value = nodes[picked[0]].value + nodes[picked[1]].value;
+        nodes[mergedTail].isLeaf = false;
+        nodes[mergedTail].left = picked[1];
+        nodes[mergedTail].right = picked[0];
+        mergedTail++;
+    }
 
-int msort(void * data, size_t count, size_t size, cmpfun cmp) {
-    void * buffer = malloc(count * size);
-    if (buffer == NULL) return 0;
-    int result = msort_r(data, count, size, cmp, buffer);
-    free(buffer);
-    return result;
+    tree->root = mergedTail - 1;
 }
 
-static void write_tree(unsigned char * dest, HuffNode_t * tree, int nitems, struct BitEncoding * encoding) {
-    /*
-     * The example used to guide this function encodes the tree in a
-     * breadth-first manner.  We attempt to emulate that here.
-     */
+static void assign_codes(const struct HuffTree * tree, int index, uint64_t path, int depth, struct HuffCode * codes) {
+    const struct HuffNode * node = &tree->nodes[index];
 
-    int i, j, k;
+    if (node->isLeaf) {
+        codes[node->key].bitstring = path;
+        codes[node->key].nbits = depth;
+        return;
+    }
 
-    // There are (2 * nitems - 1) nodes in the binary tree.  Allocate that.
-    HuffNode_t * traversal = calloc(2 * nitems - 1, sizeof(HuffNode_t));
-    if (traversal == NULL)
-        FATAL_ERROR("Fatal error while compressing Huff file.\n");
+    if (depth + 1 > HUFF_MAX_CODE_BITS)
+        FATAL_ERROR("Fatal error while compressing Huff file: code is too long.\n");
 
-    // The first node is the root of the tree.
-    traversal[0] = *tree;
-    i = 1;
-
-    // Copy the tree into a breadth-first ordering using brute force.
-    for (int depth = 1; i < 2 * nitems - 1; depth++) {
-        // Consider every possible path up to the current depth.
-        for (j = 0; i < 2 * nitems - 1 && j < 1 << depth; j++) {
-            // The index of the path is used to encode the path itself.
-            // Start from the most significant relevant bit and work our way down.
-            // Keep track of the current and previous nodes.
-            HuffNode_t * currNode = traversal;
-            HuffNode_t * parent = NULL;
-            for (k = 0; k < depth; k++) {
-                if (currNode->header.isLeaf)
-                    break;
-                parent = currNode;
-                if ((j >> (depth - k - 1)) & 1)
-                    currNode = currNode->branch.right;
-                else
-                    currNode = currNode->branch.left;
-            }
-            // Check that the length of the current path equals the current depth.
-            if (k == depth) {
-                // Make sure we can encode the current branch.
-                // Bail here if we cannot.
-                // This is only applicable for 8-bit encodings.
-                if (traversal + i - parent > 128)
-                    FATAL_ERROR("Fatal error while compressing Huff file: unable to encode binary tree.\n");
-                // Copy the current node, and update its parent.
-                traversal[i] = *currNode;
-                if (parent != NULL) {
-                    if ((j & 1) == 1)
-                        parent->branch.right = traversal + i;
-                    else
-                        parent->branch.left = traversal + i;
-                }
-                // Encode the path through the tree in the lookup table
-                if (traversal[i].header.isLeaf) {
-                    encoding[traversal[i].leaf.key].nbits = depth;
-                    encoding[traversal[i].leaf.key].bitstring = j;
+    assign_codes(tree, node->left, path << 1, depth + 1, codes);
+    assign_codes(tree, node->right, (path << 1) | 1, depth + 1, codes);
+}
+
+/*
+ * Lays out the tree table, one pair of children at a time. A branch node can
+ * only point up to 64 pairs ahead, which breadth-first order doesn't always
+ * manage for 8-bit trees. In compact mode, when all pending branches can
+ * afford to wait, the one with the fewest branch children is placed first,
+ * which keeps the number of pending branches down. Returns the size of the
+ * table, or 0 if it can't be laid out.
+ */
+static int layout_tree(const struct HuffTree * tree, unsigned char * table, bool compact) {
+    const struct HuffNode * nodes = tree->nodes;
+    int pending[HUFF_MAX_NODES];
+    int pendingPos[HUFF_MAX_NODES];
+    int npending = 0;
+    int next = 2;
+
+    pending[npending] = tree->root;
+    pendingPos[npending] = 1;
+    npending++;
+
+    while (npending > 0) {
+        int j = 0;
+
+        if (compact) {
+            bool canWait = true;
+
+            // Pending branches are in order of position, and so of deadline.
+            for (int k = 0; k < npending && canWait; k++)
+                if (next + 2 * (k + 1) - (pendingPos[k] & ~1) > 128)
+                    canWait = false;
+
+            if (canWait) {
+                int fewest = 3;
+
+                for (int k = 0; k < npending; k++) {
+                    const struct HuffNode * node = &nodes[pending[k]];
+                    int branches = !nodes[node->left].isLeaf + !nodes[node->right].isLeaf;
+
+                    if (branches <= fewest) {
+                        fewest = branches;
+                        j = k;
+                    }
                 }
-                i++;
             }
         }
-    }
 
-    // Encode the size of the tree.
-    // This is used by the decompressor to skip the tree.
-    dest[4] = nitems - 1;
+        const struct HuffNode * node = &nodes[pending[j]];
+        int pos = pendingPos[j];
 
-    // Encode each node in the tree.
-    for (i = 0; i < 2 * nitems - 1; i++) {
-        HuffNode_t * currNode = traversal + i;
-        if (currNode->header.isLeaf) {
-            dest[5 + i] = traversal[i].leaf.key;
-        } else {
-            dest[5 + i] = (((currNode->branch.right - traversal - i) / 2) - 1);
-            if (currNode->branch.left->header.isLeaf)
-                dest[5 + i] |= 0x80;
-            if (currNode->branch.right->header.isLeaf)
-                dest[5 + i] |= 0x40;
+        npending--;
+        memmove(&pending[j], &pending[j + 1], (npending - j) * sizeof(int));
+        memmove(&pendingPos[j], &pendingPos[j + 1], (npending - j) * sizeof(int));
+
+        if (next - (pos & ~1) > 128)
+            return 0;
+
+        table[pos] = (next - (pos & ~1)) / 2 - 1;
+
+        for (int bit = 0; bit < 2; bit++) {
+            const struct HuffNode * child = &nodes[bit ? node->right : node->left];
+
+            if (child->isLeaf) {
+                table[pos] |= 0x80 >> bit;
+                table[next + bit] = child->key;
+            } else {
+                pending[npending] = bit ? node->right : node->left;
+                pendingPos[npending] = next + bit;
+                npending++;
+            }
         }
+
+        next += 2;
     }
 
-    free(traversal);
+    return next;
 }
 
-static inline void write_32_le(unsigned char * dest, int * destPos, uint32_t * buff, int * buffPos) {
-    dest[*destPos] = *buff;
-    dest[*destPos + 1] = *buff >> 8;
-    dest[*destPos + 2] = *buff >> 16;
-    dest[*destPos + 3] = *buff >> 24;
-    *destPos += 4;
-    *buff = 0;
-    *buffPos = 0;
+// Writes the tree table to dest and fills in the code of each symbol.
+// Returns the size of the table, including its size byte and padding.
+static int write_tree(const struct HuffTree * tree, unsigned char * dest, struct HuffCode * codes) {
+    assign_codes(tree, tree->root, 0, 0, codes);
+
+    int tableSize = layout_tree(tree, dest, false);
+
+    if (tableSize == 0)
+        tableSize = layout_tree(tree, dest, true);
+
+    if (tableSize == 0)
+        FATAL_ERROR("Fatal error while compressing Huff file: unable to encode binary tree.\n");
+
+    // Pad the table so that the bitstream starts on a word boundary.
+    if ((4 + tableSize) % 4 != 0) {
+        memset(dest + tableSize, 0, 2);
+        tableSize += 2;
+    }
+
+    dest[0] = tableSize / 2 - 1;
+    return tableSize;
 }
 
-static inline void read_32_le(unsigned char * src, int * srcPos, uint32_t * buff) {
-    uint32_t tmp = src[*srcPos];
-    tmp |= src[*srcPos + 1] << 8;
-    tmp |= src[*srcPos + 2] << 16;
-    tmp |= src[*srcPos + 3] << 24;
-    *srcPos += 4;
-    *buff = tmp;
+static inline int put_bits(struct HuffEncoder * enc, uint64_t bitstring, int nbits, unsigned char * dest) {
+    enc->bitBuffer = (enc->bitBuffer << nbits) | bitstring;
+    enc->bitCount += nbits;
+
+    if (enc->bitCount < 32)
+        return 0;
+
+    enc->bitCount -= 32;
+    write_32_le(dest, (uint32_t)(enc->bitBuffer >> enc->bitCount));
+    enc->bitBuffer &= ((uint64_t)1 << enc->bitCount) - 1;
+    return 4;
+}
+
+static inline int put_symbol(struct HuffEncoder * enc, int symbol, unsigned char * dest) {
+    const struct HuffCode * code = &enc->codes[symbol];
+
+    if (code->nbits <= 32)
+        return put_bits(enc, code->bitstring, code->nbits, dest);
+
+    int destPos = put_bits(enc, code->bitstring >> 32, code->nbits - 32, dest);
+    return destPos + put_bits(enc, code->bitstring & 0xFFFFFFFF, 32, dest + destPos);
 }
 
-static void write_bits(unsigned char * dest, int * destPos, struct BitEncoding * encoding, int value, uint32_t * buff, int * buffBits) {
-    int nbits = encoding[value].nbits;
-    uint32_t bitstring = encoding[value].bitstring;
-
-    if (*buffBits + nbits >= 32) {
-        int diff = *buffBits + nbits - 32;
-        *buff <<= nbits - diff;
-        *buff |= bitstring >> diff;
-        bitstring &= ~(1 << diff);
-        nbits = diff;
-        write_32_le(dest, destPos, buff, buffBits);
+// Encodes size bytes, writing completed words to dest. Returns the number of
+// bytes written.
+static int encode_bytes(struct HuffEncoder * enc, const unsigned char * src, int size, unsigned char * dest) {
+    int destPos = 0;
+
+    if (enc->bitDepth == 8) {
+        for (int i = 0; i < size; i++)
+            destPos += put_symbol(enc, src[i], dest + destPos);
+    } else {
+        for (int i = 0; i < size; i++) {
+            destPos += put_symbol(enc, src[i] & 0xF, dest + destPos);
+            destPos += put_symbol(enc, src[i] >> 4, dest + destPos);
+        }
     }
-    if (nbits != 0) {
-        *buff <<= nbits;
-        *buff |= bitstring;
-        *buffBits += nbits;
+
+    return destPos;
+}
+
+// Encodes the padding and writes out any remaining bits, left-aligned.
+static int finish_encoding(struct HuffEncoder * enc, int srcSize, unsigned char * dest) {
+    static const unsigned char zeros[3];
+    int destPos = encode_bytes(enc, zeros, -srcSize & 3, dest);
+
+    if (enc->bitCount != 0) {
+        write_32_le(dest + destPos, (uint32_t)(enc->bitBuffer << (32 - enc->bitCount)));
+        destPos += 4;
+        enc->bitBuffer = 0;
+        enc->bitCount = 0;
     }
+
+    return destPos;
+}
+
+static int max_code_bits(const struct HuffEncoder * enc) {
+    int maxBits = 0;
+
+    for (int i = 0; i < (1 << enc->bitDepth); i++)
+        if (enc->codes[i].nbits > maxBits)
+            maxBits = enc->codes[i].nbits;
+
+    return maxBits;
+}
+
+// Sets up the encoder and writes the header and tree table to dest.
+// Returns the number of bytes written.
+static int start_encoding(struct HuffEncoder * enc, const uint32_t * freqs, int srcSize, int bitDepth, unsigned char * dest) {
+    struct HuffTree tree;
+
+    memset(enc, 0, sizeof(*enc));
+    enc->bitDepth = bitDepth;
+
+    build_tree(freqs, bitDepth, &tree);
+
+    dest[0] = bitDepth | 0x20;
+    dest[1] = srcSize;
+    dest[2] = srcSize >> 8;
+    dest[3] = srcSize >> 16;
+
+    return 4 + write_tree(&tree, dest + 4, enc->codes);
 }
 
 /*
@@ -219,180 +358,247 @@ MAIN COMPRESSION/DECOMPRESSION ROUTINES
  */
 
 unsigned char * HuffCompress(unsigned char * src, int srcSize, int * compressedSize_p, int bitDepth) {
-    if (srcSize <= 0)
+    if (srcSize <= 0 || srcSize > 0xFFFFFF)
         goto fail;
 
-    int worstCaseDestSize = 4 + (2 << bitDepth) + srcSize * 3;
+    uint32_t freqs[HUFF_MAX_SYMBOLS] = {0};
+    struct HuffEncoder enc;
+    unsigned char header[4 + 512];
+
+    count_symbols(src, srcSize, bitDepth, freqs);
+    count_padding(srcSize, bitDepth, freqs);
+
+    int headerSize = start_encoding(&enc, freqs, srcSize, bitDepth, header);
+
+    // The exact size of the bitstream is known from the code lengths.
+    uint64_t totalBits = 0;
+
+    for (int i = 0; i < (1 << bitDepth); i++)
+        totalBits += (uint64_t)freqs[i] * enc.codes[i].nbits;
+
+    int destSize = headerSize + (int)((totalBits + 31) / 32) * 4;
+    unsigned char * dest = malloc(destSize);
 
-    unsigned char *dest = malloc(worstCaseDestSize);
     if (dest == NULL)
         goto fail;
 
-    int nitems = 1 << bitDepth;
+    memcpy(dest, header, headerSize);
+
+    int destPos = headerSize;
+    destPos += encode_bytes(&enc, src, srcSize, dest + destPos);
+    destPos += finish_encoding(&enc, srcSize, dest + destPos);
 
-    HuffNode_t * freqs = calloc(nitems, sizeof(HuffNode_t));
-    if (freqs == NULL)
+    if (destPos != destSize)
         goto fail;
 
-    struct BitEncoding * encoding = calloc(nitems, sizeof(struct BitEncoding));
-    if (encoding == NULL)
+    *compressedSize_p = destPos;
+    return dest;
+
+fail:
+    FATAL_ERROR("Fatal error while compressing Huff file.\n");
+}
+
+// Compresses src to dest while only holding one chunk of each in memory.
+// src is read twice, first to count symbols, so it must be seekable.
+void HuffCompressStream(FILE * src, FILE * dest, int bitDepth) {
+    uint32_t freqs[HUFF_MAX_SYMBOLS] = {0};
+    unsigned char * chunk = malloc(HUFF_CHUNK_SIZE);
+    long srcSize = 0;
+    size_t count;
+
+    if (chunk == NULL)
         goto fail;
 
-    // Set up the frequencies table.  This will inform the tree.
-    for (int i = 0; i < nitems; i++) {
-        freqs[i].header.isLeaf = 1;
-        freqs[i].header.value = 0;
-        freqs[i].leaf.key = i;
+    while ((count = fread(chunk, 1, HUFF_CHUNK_SIZE, src)) != 0) {
+        count_symbols(chunk, count, bitDepth, freqs);
+        srcSize += count;
     }
 
-    // Count each nybble or byte.
-    for (int i = 0; i < srcSize; i++) {
-        if (bitDepth == 8) {
-            freqs[src[i]].header.value++;
-        } else {
-            freqs[src[i] >> 4].header.value++;
-            freqs[src[i] & 0xF].header.value++;
-        }
-    }
+    if (ferror(src) || srcSize <= 0 || srcSize > 0xFFFFFF)
+        goto fail;
 
-#ifdef DEBUG
-    for (int i = 0; i < nitems; i++) {
-        fprintf(stderr, "%d: %d\n", i, freqs[i].header.value);
-    }
-#endif // DEBUG
+    count_padding(srcSize, bitDepth, freqs);
+
+    struct HuffEncoder enc;
+    unsigned char header[4 + 512];
+    int headerSize = start_encoding(&enc, freqs, srcSize, bitDepth, header);
 
-    // Sort the frequency table.
-    if (!msort(freqs, nitems, sizeof(HuffNode_t), cmp_tree))
+    if (fwrite(header, headerSize, 1, dest) != 1)
         goto fail;
 
-    // Prune zero-frequency values.
-    for (int i = 0; i < nitems; i++) {
-        if (freqs[i].header.value != 0) {
-            if (i > 0) {
-                for (int j = i; j < nitems; j++) {
-                    freqs[j - i] = freqs[j];
-                }
-                nitems -= i;
-            }
-            break;
-        }
-        // This should never happen:
-        if (i == nitems - 1)
-            goto fail;
-    }
+    // Worst case output for one chunk, plus the final padding and flush.
+    size_t outSize = (size_t)HUFF_CHUNK_SIZE * (8 / bitDepth) * max_code_bits(&enc) / 8 + 64;
+    unsigned char * out = malloc(outSize);
 
-    HuffNode_t * tree = calloc(nitems * 2 - 1, sizeof(HuffNode_t));
-    if (tree == NULL)
+    if (out == NULL || fseek(src, 0, SEEK_SET) != 0)
         goto fail;
 
-    // Iteratively collapse the two least frequent nodes.
-    HuffNode_t * endptr = freqs + nitems - 2;
-
-    for (int i = 0; i < nitems - 1; i++) {
-        HuffNode_t * left = freqs;
-        HuffNode_t * right = freqs + 1;
-        tree[i * 2] = *right;
-        tree[i * 2 + 1] = *left;
-        for (int j = 0; j < nitems - i - 2; j++)
-            freqs[j] = freqs[j + 2];
-        endptr->header.isLeaf = 0;
-        endptr->header.value = tree[i * 2].header.value + tree[i * 2 + 1].header.value;
-        endptr->branch.left = tree + i * 2;
-        endptr->branch.right = tree + i * 2 + 1;
-        endptr--;
-        if (i < nitems - 2 && !msort(freqs, nitems - i - 1, sizeof(HuffNode_t), cmp_tree))
-            goto fail;
-    }
+    long remaining = srcSize;
 
-    // Write the tree breadth-first, and create the path lookup table.
-    write_tree(dest, freqs, nitems, encoding);
+    while (remaining > 0 && (count = fread(chunk, 1, HUFF_CHUNK_SIZE, src)) != 0) {
+        if ((long)count > remaining)
+            count = remaining;
 
-    free(tree);
-    free(freqs);
+        int outPos = encode_bytes(&enc, chunk, count, out);
 
-    // Encode the data itself.
-    int destPos = 4 + nitems * 2;
-    uint32_t destBuf = 0;
-    uint32_t srcBuf = 0;
-    int destBitPos = 0;
+        if (outPos != 0 && fwrite(out, outPos, 1, dest) != 1)
+            goto fail;
 
-    for (int srcPos = 0; srcPos < srcSize;) {
-        read_32_le(src, &srcPos, &srcBuf);
-        for (int i = 0; i < 32 / bitDepth; i++) {
-            write_bits(dest, &destPos, encoding, srcBuf & (0xFF >> (8 - bitDepth)), &destBuf, &destBitPos);
-            srcBuf >>= bitDepth;
-        }
+        remaining -= count;
     }
 
-    if (destBitPos != 0) {
-        write_32_le(dest, &destPos, &destBuf, &destBitPos);
-    }
+    // The input changed between the two passes.
+    if (remaining != 0)
+        goto fail;
 
-    free(encoding);
+    int outPos = finish_encoding(&enc, srcSize, out);
 
-    // Write the header.
-    dest[0] = bitDepth | 0x20;
-    dest[1] = srcSize;
-    dest[2] = srcSize >> 8;
-    dest[3] = srcSize >> 16;
-    *compressedSize_p = (destPos + 3) & ~3;
-    return dest;
+    if (outPos != 0 && fwrite(out, outPos, 1, dest) != 1)
+        goto fail;
+
+    free(out);
+    free(chunk);
+    return;
 
 fail:
     FATAL_ERROR("Fatal error while compressing Huff file.\n");
 }
 
+// Parses the header and the tree table's size byte. Returns the uncompressed size.
+static int start_decoding(struct HuffDecoder * dec, const unsigned char * header) {
+    dec->bitDepth = header[0] & 15;
+
+    if (dec->bitDepth != 4 && dec->bitDepth != 8)
+        FATAL_ERROR("Fatal error while decompressing Huff file.\n");
+
+    dec->treeSize = (header[4] + 1) * 2;
+    dec->treePos = 1;
+    dec->value = 0;
+    dec->numValues = 0;
+
+    return (header[3] << 16) | (header[2] << 8) | header[1];
+}
+
+// Decodes one word of the bitstream. Returns the number of bytes written to
+// dest, which needs room for up to 32 bytes.
+static int decode_word(struct HuffDecoder * dec, uint32_t window, unsigned char * dest) {
+    int destPos = 0;
+
+    for (int i = 0; i < 32; i++) {
+        int curBit = (window >> 31) & 1;
+        unsigned char treeView = dec->tree[dec->treePos];
+        bool isLeaf = ((treeView << curBit) & 0x80) != 0;
+        int next = (dec->treePos & ~1) + ((treeView & 0x3F) + 1) * 2 + curBit;
+
+        if (next >= dec->treeSize)
+            FATAL_ERROR("Fatal error while decompressing Huff file.\n");
+
+        if (isLeaf) {
+            dec->value >>= dec->bitDepth;
+            dec->value |= (uint32_t)dec->tree[next] << (32 - dec->bitDepth);
+            dec->numValues++;
+
+            if (dec->numValues == 32 / dec->bitDepth) {
+                write_32_le(dest + destPos, dec->value);
+                destPos += 4;
+                dec->value = 0;
+                dec->numValues = 0;
+            }
+
+            dec->treePos = 1;
+        } else {
+            dec->treePos = next;
+        }
+
+        window <<= 1;
+    }
+
+    return destPos;
+}
+
 unsigned char * HuffDecompress(unsigned char * src, int srcSize, int * uncompressedSize_p) {
-    if (srcSize < 4)
+    if (srcSize < 5)
         goto fail;
 
-    int bitDepth = *src & 15;
-    if (bitDepth != 4 && bitDepth != 8)
+    struct HuffDecoder dec;
+    int destSize = start_decoding(&dec, src);
+
+    if (4 + dec.treeSize > srcSize)
         goto fail;
 
-    int destSize = (src[3] << 16) | (src[2] << 8) | src[1];
+    memcpy(dec.tree, src + 4, dec.treeSize);
 
-    unsigned char *dest = malloc(destSize);
+    // Whole words are decoded, so leave room for overshooting destSize.
+    unsigned char * dest = malloc(destSize + 32);
 
     if (dest == NULL)
         goto fail;
 
-    int treePos = 5;
-    int treeSize = (src[4] + 1) * 2;
-    int srcPos = 4 + treeSize;
+    int srcPos = 4 + dec.treeSize;
     int destPos = 0;
-    int curValPos = 0;
-    uint32_t destTmp = 0;
-    uint32_t window;
 
-    for (;;)
-    {
-        if (srcPos >= srcSize)
+    while (destPos < destSize) {
+        if (srcPos + 4 > srcSize)
             goto fail;
-        read_32_le(src, &srcPos, &window);
-        for (int i = 0; i < 32; i++) {
-            int curBit = (window >> 31) & 1;
-            unsigned char treeView = src[treePos];
-            bool isLeaf = ((treeView << curBit) & 0x80) != 0;
-            treePos &= ~1; // align
-            treePos += ((treeView & 0x3F) + 1) * 2 + curBit;
-            if (isLeaf) {
-                destTmp >>= bitDepth;
-                destTmp |= (src[treePos] << (32 - bitDepth));
-                curValPos++;
-                if (curValPos == 32 / bitDepth) {
-                    write_32_le(dest, &destPos, &destTmp, &curValPos);
-                    if (destPos == destSize) {
-                        *uncompressedSize_p = destSize;
-                        return dest;
-                    }
-                }
-                treePos = 5;
-            }
-            window <<= 1;
-        }
+
+        destPos += decode_word(&dec, read_32_le(src + srcPos), dest + destPos);
+        srcPos += 4;
+    }
+
+    *uncompressedSize_p = destSize;
+    return dest;
+
+fail:
+    FATAL_ERROR("Fatal error while decompressing Huff file.\n");
+}
+
+// Decompresses src to dest while only holding one chunk of each in memory.
+void HuffDecompressStream(FILE * src, FILE * dest) {
+    struct HuffDecoder dec;
+    unsigned char header[5];
+
+    if (fread(header, sizeof(header), 1, src) != 1)
+        goto fail;
+
+    int destSize = start_decoding(&dec, header);
+
+    dec.tree[0] = header[4];
+
+    if (fread(dec.tree + 1, dec.treeSize - 1, 1, src) != 1)
+        goto fail;
+
+    unsigned char * chunk = malloc(HUFF_CHUNK_SIZE);
+    unsigned char * out = malloc(HUFF_CHUNK_SIZE * 8);
+
+    if (chunk == NULL || out == NULL)
+        goto fail;
+
+    int remaining = destSize;
+
+    while (remaining > 0) {
+        size_t count = fread(chunk, 1, HUFF_CHUNK_SIZE, src);
+
+        if (count < 4)
+            goto fail;
+
+        int outPos = 0;
+
+        for (size_t i = 0; i + 4 <= count; i += 4)
+            outPos += decode_word(&dec, read_32_le(chunk + i), out + outPos);
+
+        if (outPos > remaining)
+            outPos = remaining;
+
+        if (outPos != 0 && fwrite(out, outPos, 1, dest) != 1)
+            goto fail;
+
+        remaining -= outPos;
     }
 
+    free(chunk);
+    free(out);
+    return;
+
 fail:
     FATAL_ERROR("Fatal error while decompressing Huff file.\n");
 }
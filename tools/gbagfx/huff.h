@@ -1,38 +1,17 @@
 #ifndef HUFF_H
 #define HUFF_H
 
-union HuffNode;
+#include <stdio.h>
+#include <stdint.h>
 
-struct HuffData {
-    unsigned value:31;
-    unsigned isLeaf:1;
-};
-
-struct HuffLeaf {
-    struct HuffData header;
-    unsigned char key;
-};
-
-struct HuffBranch {
-    struct HuffData header;
-    union HuffNode * left;
-    union HuffNode * right;
-};
-
-union HuffNode {
-    struct HuffData header;
-    struct HuffLeaf leaf;
-    struct HuffBranch branch;
-};
-
-typedef union HuffNode HuffNode_t;
-
-struct BitEncoding {
-    unsigned long long nbits:6;
-    unsigned long long bitstring:58;
+struct HuffCode {
+    uint64_t bitstring;
+    int nbits;
 };
 
 unsigned char * HuffCompress(unsigned char * buffer, int srcSize, int * compressedSize_p, int bitDepth);
 unsigned char * HuffDecompress(unsigned char * buffer, int srcSize, int * uncompressedSize_p);
+void HuffCompressStream(FILE * src, FILE * dest, int bitDepth);
+void HuffDecompressStream(FILE * src, FILE * dest);
 
 #endif //HUFF_H
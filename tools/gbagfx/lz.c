@@ -69,7 +69,162 @@ fail:
 	FATAL_ERROR("Fatal error while decompressing LZ file.\n");
 }
 
-unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+// LZ10 format limits
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH 18
+#define LZ_WINDOW_SIZE 0x1000
+
+// The match finder keeps hash chains over 3-byte prefixes. The chain links
+// live in a ring buffer that is twice the window size, so that a link is never
+// overwritten while its position can still be reached from inside the window.
+#define LZ_HASH_BITS 15
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+#define LZ_CHAIN_MASK (2 * LZ_WINDOW_SIZE - 1)
+
+struct LZMatchFinder {
+	unsigned char *src;
+	int srcSize;
+	int minDistance;
+	int insertPos;
+	int head[LZ_HASH_SIZE];
+	int prev[LZ_CHAIN_MASK + 1];
+};
+
+static inline unsigned int LZHash(unsigned char *p)
+{
+	unsigned int key = (p[0] << 16) | (p[1] << 8) | p[2];
+
+	return (key * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static struct LZMatchFinder *LZCreateMatchFinder(unsigned char *src, int srcSize, int minDistance)
+{
+	struct LZMatchFinder *finder = malloc(sizeof(struct LZMatchFinder));
+
+	if (finder == NULL)
+		FATAL_ERROR("Failed to allocate LZ match finder.\n");
+
+	finder->src = src;
+	finder->srcSize = srcSize;
+	finder->minDistance = minDistance;
+	finder->insertPos = 0;
+
+	for (int i = 0; i < LZ_HASH_SIZE; i++)
+		finder->head[i] = -1;
+
+	return finder;
+}
+
+// Adds every position before srcPos to the hash chains.
+static void LZInsertUpTo(struct LZMatchFinder *finder, int srcPos)
+{
+	int limit = finder->srcSize - (LZ_MIN_MATCH - 1);
+
+	if (limit > srcPos)
+		limit = srcPos;
+
+	while (finder->insertPos < limit) {
+		int pos = finder->insertPos++;
+		unsigned int hash = LZHash(&finder->src[pos]);
+
+		finder->prev[pos & LZ_CHAIN_MASK] = finder->head[hash];
+		finder->head[hash] = pos;
+	}
+
+	if (finder->insertPos < srcPos)
+		finder->insertPos = srcPos;
+}
+
+// Finds the longest match for srcPos, preferring the smallest distance among
+// matches of equal length. Only matches of at least LZ_MIN_MATCH bytes are
+// reported; anything shorter returns 0.
+static int LZFindMatch(struct LZMatchFinder *finder, int srcPos, int *matchDistance)
+{
+	unsigned char *src = finder->src;
+	int maxSize = finder->srcSize - srcPos;
+
+	if (maxSize > LZ_MAX_MATCH)
+		maxSize = LZ_MAX_MATCH;
+
+	if (maxSize < LZ_MIN_MATCH)
+		return 0;
+
+	LZInsertUpTo(finder, srcPos);
+
+	int bestBlockDistance = 0;
+	int bestBlockSize = 0;
+	int candidate = finder->head[LZHash(&src[srcPos])];
+
+	// Chain entries are visited in order of increasing distance, so replacing
+	// the best match only on a strictly longer one keeps the nearest match.
+	while (candidate >= 0) {
+		int blockDistance = srcPos - candidate;
+
+		if (blockDistance > LZ_WINDOW_SIZE)
+			break;
+
+		if (blockDistance >= finder->minDistance
+		    && src[candidate + bestBlockSize] == src[srcPos + bestBlockSize]) {
+			int blockSize = 0;
+
+			while (blockSize < maxSize && src[candidate + blockSize] == src[srcPos + blockSize])
+				blockSize++;
+
+			if (blockSize > bestBlockSize) {
+				bestBlockDistance = blockDistance;
+				bestBlockSize = blockSize;
+
+				if (blockSize == maxSize)
+					break;
+			}
+		}
+
+		candidate = finder->prev[candidate & LZ_CHAIN_MASK];
+	}
+
+	if (bestBlockSize < LZ_MIN_MATCH)
+		return 0;
+
+	*matchDistance = bestBlockDistance;
+	return bestBlockSize;
+}
+
+// Reference match finder that tries every distance in the window. It is much
+// slower than the hash chains and is only kept to validate them.
+static int LZFindMatchBruteForce(unsigned char *src, int srcSize, int srcPos, int minDistance, int *matchDistance)
+{
+	int bestBlockDistance = 0;
+	int bestBlockSize = 0;
+	int blockDistance = minDistance;
+
+	while (blockDistance <= srcPos && blockDistance <= LZ_WINDOW_SIZE) {
+		int blockStart = srcPos - blockDistance;
+		int blockSize = 0;
+
+		while (blockSize < LZ_MAX_MATCH
+		    && srcPos + blockSize < srcSize
+		    && src[blockStart + blockSize] == src[srcPos + blockSize])
+			blockSize++;
+
+		if (blockSize > bestBlockSize) {
+			bestBlockDistance = blockDistance;
+			bestBlockSize = blockSize;
+
+			if (blockSize == LZ_MAX_MATCH)
+				break;
+		}
+
+		blockDistance++;
+	}
+
+	if (bestBlockSize < LZ_MIN_MATCH)
+		return 0;
+
+	*matchDistance = bestBlockDistance;
+	return bestBlockSize;
+}
+
+static unsigned char *LZCompressGreedy(unsigned char *src, int srcSize, int *compressedSize, const int minDistance, bool bruteForce)
 {
 	if (srcSize <= 0)
 		goto fail;
@@ -84,6 +239,8 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 	if (dest == NULL)
 		goto fail;
 
+	struct LZMatchFinder *finder = bruteForce ? NULL : LZCreateMatchFinder(src, srcSize, minDistance);
+
 	// header
 	dest[0] = 0x10; // LZ compression type
 	dest[1] = (unsigned char)srcSize;
@@ -99,30 +256,14 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 
 		for (int i = 0; i < 8; i++) {
 			int bestBlockDistance = 0;
-			int bestBlockSize = 0;
-			int blockDistance = minDistance;
-
-			while (blockDistance <= srcPos && blockDistance <= 0x1000) {
-				int blockStart = srcPos - blockDistance;
-				int blockSize = 0;
-
-				while (blockSize < 18
-				    && srcPos + blockSize < srcSize
-				    && src[blockStart + blockSize] == src[srcPos + blockSize])
-					blockSize++;
-
-				if (blockSize > bestBlockSize) {
-					bestBlockDistance = blockDistance;
-					bestBlockSize = blockSize;
-
-					if (blockSize == 18)
-						break;
-				}
+			int bestBlockSize;
 
-				blockDistance++;
-			}
+			if (bruteForce)
+				bestBlockSize = LZFindMatchBruteForce(src, srcSize, srcPos, minDistance, &bestBlockDistance);
+			else
+				bestBlockSize = LZFindMatch(finder, srcPos, &bestBlockDistance);
 
-			if (bestBlockSize >= 3) {
+			if (bestBlockSize >= LZ_MIN_MATCH) {
 				*flags |= (0x80 >> i);
 				srcPos += bestBlockSize;
 				bestBlockSize -= 3;
@@ -142,6 +283,7 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 						dest[destPos++] = 0;
 				}
 
+				free(finder);
 				*compressedSize = destPos;
 				return dest;
 			}
@@ -151,3 +293,113 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 fail:
 	FATAL_ERROR("Fatal error while compressing LZ file.\n");
 }
+
+unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+{
+	return LZCompressGreedy(src, srcSize, compressedSize, minDistance, false);
+}
+
+unsigned char *LZCompressBruteForce(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+{
+	return LZCompressGreedy(src, srcSize, compressedSize, minDistance, true);
+}
+
+// Optimal parse: every literal costs 9 bits and every match 17 bits (including
+// the flag bit), regardless of its length or distance. Working backwards from
+// the end of the input, the cheapest encoding of each suffix is either a
+// literal followed by the cheapest encoding of the next suffix, or a match of
+// any length up to the longest match at that position. The longest match is
+// found with the same rules as the greedy encoder, so minDistance is honored.
+unsigned char *LZCompressOptimal(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+{
+	if (srcSize <= 0)
+		goto fail;
+
+	int *matchSizes = malloc(srcSize * sizeof(int));
+	int *matchDistances = malloc(srcSize * sizeof(int));
+	int *cost = malloc((srcSize + 1) * sizeof(int));
+	int *choice = malloc(srcSize * sizeof(int));
+
+	if (matchSizes == NULL || matchDistances == NULL || cost == NULL || choice == NULL)
+		goto fail;
+
+	struct LZMatchFinder *finder = LZCreateMatchFinder(src, srcSize, minDistance);
+
+	for (int srcPos = 0; srcPos < srcSize; srcPos++)
+		matchSizes[srcPos] = LZFindMatch(finder, srcPos, &matchDistances[srcPos]);
+
+	free(finder);
+
+	cost[srcSize] = 0;
+
+	for (int srcPos = srcSize - 1; srcPos >= 0; srcPos--) {
+		// choice is the number of bytes the token at this position covers;
+		// 1 means a literal.
+		cost[srcPos] = cost[srcPos + 1] + 9;
+		choice[srcPos] = 1;
+
+		// Ties go to the longer match, which also decodes faster.
+		for (int blockSize = LZ_MIN_MATCH; blockSize <= matchSizes[srcPos]; blockSize++) {
+			if (cost[srcPos + blockSize] + 17 <= cost[srcPos]) {
+				cost[srcPos] = cost[srcPos + blockSize] + 17;
+				choice[srcPos] = blockSize;
+			}
+		}
+	}
+
+	int worstCaseDestSize = 4 + srcSize + ((srcSize + 7) / 8);
+
+	// Round up to the next multiple of four.
+	worstCaseDestSize = (worstCaseDestSize + 3) & ~3;
+
+	unsigned char *dest = malloc(worstCaseDestSize);
+
+	if (dest == NULL)
+		goto fail;
+
+	// header
+	dest[0] = 0x10; // LZ compression type
+	dest[1] = (unsigned char)srcSize;
+	dest[2] = (unsigned char)(srcSize >> 8);
+	dest[3] = (unsigned char)(srcSize >> 16);
+
+	int srcPos = 0;
+	int destPos = 4;
+	unsigned char *flags = NULL;
+
+	for (int i = 0; srcPos < srcSize; i = (i + 1) % 8) {
+		if (i == 0) {
+			flags = &dest[destPos++];
+			*flags = 0;
+		}
+
+		int blockSize = choice[srcPos];
+
+		if (blockSize >= LZ_MIN_MATCH) {
+			int blockDistance = matchDistances[srcPos] - 1;
+
+			*flags |= (0x80 >> i);
+			srcPos += blockSize;
+			blockSize -= 3;
+			dest[destPos++] = (blockSize << 4) | ((unsigned int)blockDistance >> 8);
+			dest[destPos++] = (unsigned char)blockDistance;
+		} else {
+			dest[destPos++] = src[srcPos++];
+		}
+	}
+
+	// Pad to multiple of 4 bytes.
+	while (destPos % 4 != 0)
+		dest[destPos++] = 0;
+
+	free(matchSizes);
+	free(matchDistances);
+	free(cost);
+	free(choice);
+
+	*compressedSize = destPos;
+	return dest;
+
+fail:
+	FATAL_ERROR("Fatal error while compressing LZ file.\n");
+}
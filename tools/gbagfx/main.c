@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
 #include "global.h"
 #include "util.h"
 #include "options.h"
@@ -13,6 +14,10 @@
 #include "rl.h"
 #include "font.h"
 #include "huff.h"
+#include "batch.h"
+#include "cache.h"
+#include "autocompress.h"
+#include "tiledup.h"
 
 struct CommandHandler
 {
@@ -21,6 +26,12 @@ struct CommandHandler
     void(*function)(char *inputPath, char *outputPath, int argc, char **argv);
 };
 
+struct NamedCommandHandler
+{
+    const char *name;
+    void(*function)(int argc, char **argv);
+};
+
 void ConvertGbaToPng(char *inputPath, char *outputPath, struct GbaToPngOptions *options)
 {
     struct Image image;
@@ -339,6 +350,7 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
 {
     int overflowSize = 0;
     int minDistance = 2; // default, for compatibility with LZ77UnCompVram()
+    bool optimal = false;
 
     for (int i = 3; i < argc; i++)
     {
@@ -370,6 +382,10 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
             if (minDistance < 1)
                 FATAL_ERROR("LZ min search distance must be positive.\n");
         }
+        else if (strcmp(option, "-optimal") == 0)
+        {
+            optimal = true;
+        }
         else
         {
             FATAL_ERROR("Unrecognized option \"%s\".\n", option);
@@ -386,7 +402,22 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
     unsigned char *buffer = ReadWholeFileZeroPadded(inputPath, &fileSize, overflowSize);
 
     int compressedSize;
-    unsigned char *compressedData = LZCompress(buffer, fileSize + overflowSize, &compressedSize, minDistance);
+    unsigned char *compressedData;
+
+    if (optimal)
+    {
+        int greedySize;
+        unsigned char *greedyData = LZCompress(buffer, fileSize + overflowSize, &greedySize, minDistance);
+
+        compressedData = LZCompressOptimal(buffer, fileSize + overflowSize, &compressedSize, minDistance);
+        printf("%s: %d bytes (greedy %d bytes, %+d)\n", outputPath, compressedSize, greedySize, compressedSize - greedySize);
+
+        free(greedyData);
+    }
+    else
+    {
+        compressedData = LZCompress(buffer, fileSize + overflowSize, &compressedSize, minDistance);
+    }
 
     compressedData[1] = (unsigned char)fileSize;
     compressedData[2] = (unsigned char)(fileSize >> 8);
@@ -446,7 +477,6 @@ void HandleRLDecompressCommand(char *inputPath, char *outputPath, int argc UNUSE
 
 void HandleHuffCompressCommand(char *inputPath, char *outputPath, int argc, char **argv)
 {
-    int fileSize;
     int bitDepth = 4;
 
     for (int i = 3; i < argc; i++)
@@ -472,39 +502,497 @@ void HandleHuffCompressCommand(char *inputPath, char *outputPath, int argc, char
         }
     }
 
-    unsigned char *buffer = ReadWholeFile(inputPath, &fileSize);
+    // The Huffman commands stream the file in chunks rather than reading it whole.
+    FILE *src = fopen(inputPath, "rb");
 
-    int compressedSize;
-    unsigned char *compressedData = HuffCompress(buffer, fileSize, &compressedSize, bitDepth);
+    if (src == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", inputPath);
 
-    free(buffer);
+    FILE *dest = fopen(outputPath, "wb");
 
-    WriteWholeFile(outputPath, compressedData, compressedSize);
+    if (dest == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", outputPath);
 
-    free(compressedData);
+    HuffCompressStream(src, dest, bitDepth);
+
+    fclose(src);
+
+    if (fclose(dest) != 0)
+        FATAL_ERROR("Failed to write \"%s\".\n", outputPath);
 }
 
 void HandleHuffDecompressCommand(char *inputPath, char *outputPath, int argc UNUSED, char **argv UNUSED)
 {
-    int fileSize;
-    unsigned char *buffer = ReadWholeFile(inputPath, &fileSize);
+    FILE *src = fopen(inputPath, "rb");
 
-    int uncompressedSize;
-    unsigned char *uncompressedData = HuffDecompress(buffer, fileSize, &uncompressedSize);
+    if (src == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", inputPath);
 
-    free(buffer);
+    FILE *dest = fopen(outputPath, "wb");
 
-    WriteWholeFile(outputPath, uncompressedData, uncompressedSize);
+    if (dest == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", outputPath);
 
-    free(uncompressedData);
+    HuffDecompressStream(src, dest);
+
+    fclose(src);
+
+    if (fclose(dest) != 0)
+        FATAL_ERROR("Failed to write \"%s\".\n", outputPath);
 }
 
-int main(int argc, char **argv)
+// Compresses every file given (directories are searched for the uncompressed
+// graphics the build feeds to LZ) and reports the throughput of the hash chain
+// encoder. The brute force reference encoder is also timed unless -nocheck is
+// given, and its output must match byte for byte.
+void HandleLZBenchmarkCommand(int argc, char **argv)
 {
-    char converted = 0;
+    static const char *const extensions[] = { "1bpp", "4bpp", "8bpp", "gbapal", "bin", NULL };
+    struct FileList files = {};
+    int minDistance = 2;
+    bool check = true;
 
-    if (argc < 3)
-        FATAL_ERROR("Usage: gbagfx INPUT_PATH OUTPUT_PATH [options...]\n");
+    for (int i = 2; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-search") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No size following \"-search\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &minDistance))
+                FATAL_ERROR("Failed to parse LZ min search distance.\n");
+
+            if (minDistance < 1)
+                FATAL_ERROR("LZ min search distance must be positive.\n");
+        }
+        else if (strcmp(option, "-nocheck") == 0)
+        {
+            check = false;
+        }
+        else if (option[0] == '-')
+        {
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+        }
+        else
+        {
+            AddFilesRecursive(&files, option, extensions);
+        }
+    }
+
+    if (files.count == 0)
+        FATAL_ERROR("Usage: gbagfx lzbench [-search N] [-nocheck] PATH...\n");
+
+    double totalInput = 0;
+    double totalOutput = 0;
+    clock_t fastTime = 0;
+    clock_t referenceTime = 0;
+    int mismatches = 0;
+
+    for (int i = 0; i < files.count; i++)
+    {
+        int fileSize;
+        unsigned char *buffer = ReadWholeFile(files.paths[i], &fileSize);
+
+        if (fileSize == 0)
+        {
+            free(buffer);
+            continue;
+        }
+
+        int compressedSize;
+        clock_t start = clock();
+        unsigned char *compressedData = LZCompress(buffer, fileSize, &compressedSize, minDistance);
+        fastTime += clock() - start;
+
+        if (check)
+        {
+            int referenceSize;
+            start = clock();
+            unsigned char *referenceData = LZCompressBruteForce(buffer, fileSize, &referenceSize, minDistance);
+            referenceTime += clock() - start;
+
+            if (referenceSize != compressedSize || memcmp(referenceData, compressedData, compressedSize) != 0)
+            {
+                fprintf(stderr, "Output mismatch for \"%s\".\n", files.paths[i]);
+                mismatches++;
+            }
+
+            free(referenceData);
+        }
+
+        totalInput += fileSize;
+        totalOutput += compressedSize;
+
+        free(compressedData);
+        free(buffer);
+    }
+
+    double fastSeconds = (double)fastTime / CLOCKS_PER_SEC;
+
+    printf("%d files, %.0f bytes -> %.0f bytes (%.1f%%)\n", files.count, totalInput, totalOutput, 100.0 * totalOutput / totalInput);
+    printf("hash chain:  %8.3f s  %8.2f MB/s\n", fastSeconds, totalInput / 1e6 / fastSeconds);
+
+    if (check)
+    {
+        double referenceSeconds = (double)referenceTime / CLOCKS_PER_SEC;
+
+        printf("brute force: %8.3f s  %8.2f MB/s\n", referenceSeconds, totalInput / 1e6 / referenceSeconds);
+        printf("%d mismatches\n", mismatches);
+    }
+
+    FreeFileList(&files);
+
+    if (mismatches != 0)
+        exit(1);
+}
+
+// Compresses every file given (directories are searched like lzbench does)
+// with each encoding the BIOS can decode and picks one per file according to
+// the policy. With -output, the chosen encoding of a single file is written.
+void HandleAutoCompressCommand(int argc, char **argv)
+{
+    static const char *const extensions[] = { "1bpp", "4bpp", "8bpp", "gbapal", "bin", NULL };
+    struct FileList files = {};
+    struct AutoCompressOptions options = {};
+    bool haveSlack = false;
+
+    options.policy = POLICY_SMALLEST;
+
+    for (int i = 2; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-policy") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No policy following \"-policy\".\n");
+
+            i++;
+
+            if (strcmp(argv[i], "smallest") == 0)
+                options.policy = POLICY_SMALLEST;
+            else if (strcmp(argv[i], "fastest") == 0)
+                options.policy = POLICY_FASTEST;
+            else
+                FATAL_ERROR("Unknown policy \"%s\".\n", argv[i]);
+        }
+        else if (strcmp(option, "-slack") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No percentage following \"-slack\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &options.slack))
+                FATAL_ERROR("Failed to parse slack.\n");
+
+            if (options.slack < 0)
+                FATAL_ERROR("Slack must not be negative.\n");
+
+            haveSlack = true;
+        }
+        else if (strcmp(option, "-vram") == 0)
+        {
+            options.vramOnly = true;
+        }
+        else if (strcmp(option, "-report") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No file name following \"-report\".\n");
+
+            i++;
+
+            options.reportPath = argv[i];
+        }
+        else if (strcmp(option, "-output") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No file name following \"-output\".\n");
+
+            i++;
+
+            options.outputPath = argv[i];
+        }
+        else if (option[0] == '-')
+        {
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+        }
+        else
+        {
+            AddFilesRecursive(&files, option, extensions);
+        }
+    }
+
+    if (files.count == 0)
+        FATAL_ERROR("Usage: gbagfx auto-compress [-policy smallest|fastest] [-slack PERCENT] [-vram] [-report FILE.csv|FILE.json] [-output FILE] PATH...\n");
+
+    if (options.outputPath != NULL && files.count != 1)
+        FATAL_ERROR("\"-output\" needs exactly one input file.\n");
+
+    // Raw data always decodes fastest, so by default "fastest" only considers
+    // encodings at most 10% larger than the smallest one.
+    if (!haveSlack)
+        options.slack = 10;
+
+    RunAutoCompress(&files, &options);
+
+    FreeFileList(&files);
+}
+
+// Indexes every 8x8 tile of the given .4bpp/.8bpp files and reports how many
+// are duplicates, or flipped copies, of a tile seen earlier in the same file
+// or in another one. "-sheet" writes the unique tiles of all the files, and
+// "-tilemap" a BG tilemap (with flip bits) that rebuilds the single input
+// from the sheet, one entry per tile in file order.
+void HandleTileDedupCommand(int argc, char **argv)
+{
+    struct FileList files = {};
+    struct TileDedupOptions options = {};
+
+    for (int i = 2; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-noflip") == 0)
+        {
+            options.noFlip = true;
+        }
+        else if (strcmp(option, "-report") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No file name following \"-report\".\n");
+
+            i++;
+
+            options.reportPath = argv[i];
+        }
+        else if (strcmp(option, "-sheet") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No file name following \"-sheet\".\n");
+
+            i++;
+
+            options.sheetPath = argv[i];
+        }
+        else if (strcmp(option, "-tilemap") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No file name following \"-tilemap\".\n");
+
+            i++;
+
+            options.tilemapPath = argv[i];
+        }
+        else if (strcmp(option, "-base") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No tile number following \"-base\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &options.baseTile) || options.baseTile < 0)
+                FATAL_ERROR("Failed to parse base tile number.\n");
+        }
+        else if (strcmp(option, "-palette") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No palette number following \"-palette\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &options.palette) || options.palette < 0 || options.palette > 15)
+                FATAL_ERROR("Palette number must be between 0 and 15.\n");
+        }
+        else if (option[0] == '-')
+        {
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+        }
+        else
+        {
+            AddFilesRecursive(&files, option, (const char *const[]){ "4bpp", "8bpp", NULL });
+        }
+    }
+
+    if (files.count == 0)
+        FATAL_ERROR("Usage: gbagfx tiledup [-noflip] [-report FILE.csv|FILE.json] [-sheet FILE] [-tilemap FILE.bin [-base N] [-palette N]] PATH...\n");
+
+    if (options.tilemapPath != NULL)
+    {
+        if (files.count != 1)
+            FATAL_ERROR("\"-tilemap\" needs exactly one input file.\n");
+
+        if (options.sheetPath == NULL)
+            FATAL_ERROR("\"-tilemap\" needs \"-sheet\" for the tiles it refers to.\n");
+    }
+
+    RunTileDedup(&files, &options);
+
+    FreeFileList(&files);
+}
+
+// Converts each PNG to tiles and back the given number of times (1000 by
+// default) with both the per-pixel reference converters and the row-based
+// ones, checks that they produce the same bytes and reports their throughput.
+void HandleTileBenchmarkCommand(int argc, char **argv)
+{
+    struct FileList files = {};
+    int iterations = 1000;
+    int bitDepth = 4;
+    int metatileWidth = 1;
+    int metatileHeight = 1;
+
+    for (int i = 2; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-iterations") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No count following \"-iterations\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &iterations) || iterations < 1)
+                FATAL_ERROR("Failed to parse iteration count.\n");
+        }
+        else if (strcmp(option, "-depth") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No bit depth following \"-depth\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &bitDepth) || (bitDepth != 1 && bitDepth != 4 && bitDepth != 8))
+                FATAL_ERROR("Bit depth must be 1, 4 or 8.\n");
+        }
+        else if (strcmp(option, "-mwidth") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No metatile width value following \"-mwidth\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &metatileWidth) || metatileWidth < 1)
+                FATAL_ERROR("Failed to parse metatile width.\n");
+        }
+        else if (strcmp(option, "-mheight") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No metatile height value following \"-mheight\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &metatileHeight) || metatileHeight < 1)
+                FATAL_ERROR("Failed to parse metatile height.\n");
+        }
+        else if (option[0] == '-')
+        {
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+        }
+        else
+        {
+            AddFilesRecursive(&files, option, (const char *const[]){ "png", NULL });
+        }
+    }
+
+    if (files.count == 0)
+        FATAL_ERROR("Usage: gbagfx tilebench [-iterations N] [-depth 1|4|8] [-mwidth W] [-mheight H] PNG_PATH...\n");
+
+    double totalBytes = 0;
+    clock_t times[2][2] = {};
+    int mismatches = 0;
+
+    for (int i = 0; i < files.count; i++)
+    {
+        struct Image image;
+
+        image.bitDepth = bitDepth;
+        ReadPng(files.paths[i], &image);
+
+        int tilesWidth = image.width / 8;
+        int tilesHeight = image.height / 8;
+
+        if (image.width % 8 != 0 || image.height % 8 != 0
+         || tilesWidth % metatileWidth != 0 || tilesHeight % metatileHeight != 0)
+        {
+            fprintf(stderr, "Skipping \"%s\": size doesn't fit the metatile layout.\n", files.paths[i]);
+            FreeImage(&image);
+            continue;
+        }
+
+        int numTiles = tilesWidth * tilesHeight;
+        int metatilesWide = tilesWidth / metatileWidth;
+        int size = numTiles * bitDepth * 8;
+        unsigned char *tiles[2] = { malloc(size), malloc(size) };
+        unsigned char *pixels[2] = { calloc(size, 1), calloc(size, 1) };
+
+        if (tiles[0] == NULL || tiles[1] == NULL || pixels[0] == NULL || pixels[1] == NULL)
+            FATAL_ERROR("Failed to allocate memory for pixels.\n");
+
+        // Index 0 is the reference converter and index 1 the fast one.
+        for (int reference = 0; reference < 2; reference++)
+        {
+            int k = !reference;
+            clock_t start = clock();
+
+            for (int n = 0; n < iterations; n++)
+                ConvertToTiles(image.pixels, tiles[k], numTiles, bitDepth, metatilesWide, metatileWidth, metatileHeight, n & 1, reference);
+
+            times[k][0] += clock() - start;
+            start = clock();
+
+            for (int n = 0; n < iterations; n++)
+                ConvertFromTiles(tiles[k], pixels[k], numTiles, bitDepth, metatilesWide, metatileWidth, metatileHeight, n & 1, reference);
+
+            times[k][1] += clock() - start;
+        }
+
+        if (memcmp(tiles[0], tiles[1], size) != 0 || memcmp(pixels[0], pixels[1], size) != 0)
+        {
+            fprintf(stderr, "Output mismatch for \"%s\".\n", files.paths[i]);
+            mismatches++;
+        }
+
+        totalBytes += (double)size * iterations;
+
+        for (int k = 0; k < 2; k++)
+        {
+            free(tiles[k]);
+            free(pixels[k]);
+        }
+
+        FreeImage(&image);
+    }
+
+    static const char *const names[2] = { "reference", "fast" };
+
+    for (int k = 0; k < 2; k++)
+    {
+        double toSeconds = (double)times[k][0] / CLOCKS_PER_SEC;
+        double fromSeconds = (double)times[k][1] / CLOCKS_PER_SEC;
+
+        printf("%-9s  to tiles: %8.2f MB/s  from tiles: %8.2f MB/s\n", names[k],
+               totalBytes / 1e6 / toSeconds, totalBytes / 1e6 / fromSeconds);
+    }
+
+    printf("%d mismatches\n", mismatches);
+
+    FreeFileList(&files);
+
+    if (mismatches != 0)
+        exit(1);
+}
+
+// Converts argv[1] to argv[2], picking the handler from the file extensions.
+// Returns false if no handler matches.
+bool RunConversion(int argc, char **argv)
+{
+    bool converted = false;
 
     struct CommandHandler handlers[] =
     {
@@ -574,8 +1062,24 @@ int main(int argc, char **argv)
         if ((handlers[i].inputFileExtension == NULL || strcmp(handlers[i].inputFileExtension, inputFileExtension) == 0)
             && (handlers[i].outputFileExtension == NULL || strcmp(handlers[i].outputFileExtension, outputFileExtension) == 0))
         {
-            handlers[i].function(inputPath, outputPath, argc, argv);
-            converted = 1;
+            char cacheKey[CACHE_KEY_SIZE];
+            bool cached = false;
+
+            if (CacheIsEnabled())
+            {
+                CacheComputeKey(inputPath, outputPath, argc, argv, cacheKey);
+                cached = CacheFetch(cacheKey, outputPath);
+            }
+
+            if (!cached)
+            {
+                handlers[i].function(inputPath, outputPath, argc, argv);
+
+                if (CacheIsEnabled())
+                    CacheStore(cacheKey, outputPath);
+            }
+
+            converted = true;
             break;
         }
     }
@@ -583,8 +1087,105 @@ int main(int argc, char **argv)
     if (outputPath != argv[2])
         free(outputPath);
 
-    if (!converted)
+    return converted;
+}
+
+// Runs every conversion listed in a manifest file ("-" for stdin) on a pool of
+// worker threads. See batch.c for the manifest format.
+void HandleBatchCommand(int argc, char **argv)
+{
+    char *manifestPath = NULL;
+    int numThreads = GetDefaultThreadCount();
+
+    for (int i = 2; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-j") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No thread count following \"-j\".\n");
+
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &numThreads))
+                FATAL_ERROR("Failed to parse thread count.\n");
+
+            if (numThreads < 1)
+                FATAL_ERROR("Thread count must be positive.\n");
+        }
+        else if (manifestPath == NULL && (option[0] != '-' || option[1] == 0))
+        {
+            manifestPath = option;
+        }
+        else
+        {
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+        }
+    }
+
+    if (manifestPath == NULL)
+        FATAL_ERROR("Usage: gbagfx batch MANIFEST_PATH [-j THREADS]\n");
+
+    RunBatch(manifestPath, numThreads, RunConversion);
+}
+
+void HandleCacheStatsCommand(int argc, char **argv)
+{
+    char *cacheDir = getenv("GBAGFX_CACHE_DIR");
+    bool reset = false;
+
+    for (int i = 2; i < argc; i++)
+    {
+        char *option = argv[i];
+
+        if (strcmp(option, "-reset") == 0)
+            reset = true;
+        else if (option[0] != '-')
+            cacheDir = option;
+        else
+            FATAL_ERROR("Unrecognized option \"%s\".\n", option);
+    }
+
+    if (cacheDir == NULL || *cacheDir == 0)
+        FATAL_ERROR("Usage: gbagfx cache-stats [CACHE_DIR] [-reset]\n");
+
+    CachePrintStats(cacheDir, reset);
+}
+
+int main(int argc, char **argv)
+{
+    struct NamedCommandHandler namedHandlers[] =
+    {
+        { "auto-compress", HandleAutoCompressCommand },
+        { "batch", HandleBatchCommand },
+        { "cache-stats", HandleCacheStatsCommand },
+        { "lzbench", HandleLZBenchmarkCommand },
+        { "tilebench", HandleTileBenchmarkCommand },
+        { "tiledup", HandleTileDedupCommand },
+        { NULL, NULL }
+    };
+
+    if (argc >= 2)
+    {
+        for (int i = 0; namedHandlers[i].function != NULL; i++)
+        {
+            if (strcmp(namedHandlers[i].name, argv[1]) == 0)
+            {
+                namedHandlers[i].function(argc, argv);
+                CacheSaveStats();
+                return 0;
+            }
+        }
+    }
+
+    if (argc < 3)
+        FATAL_ERROR("Usage: gbagfx INPUT_PATH OUTPUT_PATH [options...]\n");
+
+    if (!RunConversion(argc, argv))
         FATAL_ERROR("Don't know how to convert \"%s\" to \"%s\".\n", argv[1], argv[2]);
 
+    CacheSaveStats();
+
     return 0;
 }
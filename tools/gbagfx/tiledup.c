@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "global.h"
+#include "util.h"
+#include "tiledup.h"
+
+// Finds the 8x8 tiles that appear more than once in a set of .4bpp/.8bpp
+// files, within one file or across several, and optionally also as a
+// horizontally and/or vertically flipped copy. Every tile is looked up by its
+// canonical form, the smallest (by memcmp) of its flipped variants, so a tile
+// and its mirror images land in the same entry of the index.
+
+#define FLIP_H 1
+#define FLIP_V 2
+
+#define MAX_TILE_SIZE 64
+
+// A text BG tilemap entry only has 10 bits for the tile number.
+#define MAX_TILEMAP_TILE 0x3FF
+
+struct TileEntry
+{
+    unsigned char canonical[MAX_TILE_SIZE];
+    int tileSize;
+    int file;           // where the tile was first seen
+    int tile;
+    int flip;           // flips that turn the canonical form into the first occurrence
+    int sheetIndex;
+};
+
+struct TileIndex
+{
+    struct TileEntry *entries;
+    int count;
+    int capacity;
+    int *slots;         // entry number + 1, or 0 if empty
+    int numSlots;       // power of two, at least twice count
+};
+
+struct FileStats
+{
+    int tiles;
+    int unique;
+    int duplicates;     // identical to an earlier tile
+    int flipDuplicates; // a flipped copy of an earlier tile
+    int crossFile;      // duplicates of either kind first seen in another file
+};
+
+struct Report
+{
+    FILE *fp;
+    bool json;
+    bool first;
+    bool firstMatch;
+};
+
+static const char *const sFlipNames[4] = { "none", "h", "v", "hv" };
+
+static void FlipTile(const unsigned char *src, unsigned char *dest, int tileSize, int flip)
+{
+    int rowSize = tileSize / 8;
+
+    for (int y = 0; y < 8; y++)
+    {
+        const unsigned char *srcRow = src + ((flip & FLIP_V) ? 7 - y : y) * rowSize;
+        unsigned char *destRow = dest + y * rowSize;
+
+        if (!(flip & FLIP_H))
+        {
+            memcpy(destRow, srcRow, rowSize);
+            continue;
+        }
+
+        // In 4bpp the left pixel of a pair is in the low nibble, so the
+        // nibbles swap as well as the bytes.
+        for (int x = 0; x < rowSize; x++)
+        {
+            unsigned char b = srcRow[rowSize - 1 - x];
+            destRow[x] = (tileSize == 32) ? (unsigned char)((b << 4) | (b >> 4)) : b;
+        }
+    }
+}
+
+// Writes the canonical form of tile and returns the flips that turn it back
+// into tile. Flips are their own inverse and commute, so that is the same set
+// of flips that made the canonical form.
+static int Canonicalize(const unsigned char *tile, unsigned char *canonical, int tileSize, bool noFlip)
+{
+    int best = 0;
+
+    memcpy(canonical, tile, tileSize);
+
+    if (noFlip)
+        return 0;
+
+    for (int flip = 1; flip < 4; flip++)
+    {
+        unsigned char flipped[MAX_TILE_SIZE];
+
+        FlipTile(tile, flipped, tileSize, flip);
+
+        if (memcmp(flipped, canonical, tileSize) < 0)
+        {
+            memcpy(canonical, flipped, tileSize);
+            best = flip;
+        }
+    }
+
+    return best;
+}
+
+static uint32_t HashTile(const unsigned char *tile, int tileSize)
+{
+    uint32_t hash = 2166136261u ^ tileSize;
+
+    for (int i = 0; i < tileSize; i++)
+        hash = (hash ^ tile[i]) * 16777619u;
+
+    return hash;
+}
+
+static void GrowIndex(struct TileIndex *index)
+{
+    int numSlots = index->numSlots != 0 ? index->numSlots * 2 : 1024;
+    int *slots = calloc(numSlots, sizeof(int));
+
+    if (slots == NULL)
+        FATAL_ERROR("Failed to allocate memory for tile index.\n");
+
+    for (int i = 0; i < index->count; i++)
+    {
+        struct TileEntry *entry = &index->entries[i];
+        uint32_t slot = HashTile(entry->canonical, entry->tileSize) & (numSlots - 1);
+
+        while (slots[slot] != 0)
+            slot = (slot + 1) & (numSlots - 1);
+
+        slots[slot] = i + 1;
+    }
+
+    free(index->slots);
+    index->slots = slots;
+    index->numSlots = numSlots;
+}
+
+// Returns the entry for the canonical tile, adding it if it isn't there yet.
+static struct TileEntry *LookupTile(struct TileIndex *index, const unsigned char *canonical, int tileSize, bool *added)
+{
+    if ((index->count + 1) * 2 > index->numSlots)
+        GrowIndex(index);
+
+    uint32_t slot = HashTile(canonical, tileSize) & (index->numSlots - 1);
+
+    while (index->slots[slot] != 0)
+    {
+        struct TileEntry *entry = &index->entries[index->slots[slot] - 1];
+
+        if (entry->tileSize == tileSize && memcmp(entry->canonical, canonical, tileSize) == 0)
+        {
+            *added = false;
+            return entry;
+        }
+
+        slot = (slot + 1) & (index->numSlots - 1);
+    }
+
+    if (index->count == index->capacity)
+    {
+        index->capacity = index->capacity != 0 ? index->capacity * 2 : 1024;
+        index->entries = realloc(index->entries, index->capacity * sizeof(struct TileEntry));
+
+        if (index->entries == NULL)
+            FATAL_ERROR("Failed to allocate memory for tile index.\n");
+    }
+
+    struct TileEntry *entry = &index->entries[index->count];
+
+    memcpy(entry->canonical, canonical, tileSize);
+    entry->tileSize = tileSize;
+    index->slots[slot] = ++index->count;
+    *added = true;
+
+    return entry;
+}
+
+static void OpenReport(struct Report *report, char *path, struct TileDedupOptions *options)
+{
+    report->fp = NULL;
+    report->json = false;
+    report->first = true;
+    report->firstMatch = true;
+
+    if (path == NULL)
+        return;
+
+    report->fp = fopen(path, "w");
+
+    if (report->fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for writing.\n", path);
+
+    char *extension = GetFileExtensionAfterDot(path);
+
+    report->json = (extension != NULL && strcmp(extension, "json") == 0);
+
+    if (report->json)
+        fprintf(report->fp, "{\n  \"flips\": %s,\n  \"assets\": [", options->noFlip ? "false" : "true");
+    else
+        fputs("path,tiles,unique,duplicates,flip_duplicates,cross_file\n", report->fp);
+}
+
+static void BeginReportAsset(struct Report *report, char *path)
+{
+    FILE *fp = report->fp;
+
+    if (fp == NULL || !report->json)
+        return;
+
+    fprintf(fp, "%s\n    {\n      \"path\": ", report->first ? "" : ",");
+    WriteJsonString(fp, path);
+    fputs(",\n      \"matches\": [", fp);
+    report->first = false;
+    report->firstMatch = true;
+}
+
+// Only the JSON report lists the individual matches; the CSV one has a row
+// of counts per file.
+static void ReportMatch(struct Report *report, int tile, char *sourcePath, int sourceTile, int flip)
+{
+    FILE *fp = report->fp;
+
+    if (fp == NULL || !report->json)
+        return;
+
+    fprintf(fp, "%s\n        { \"tile\": %d, \"source\": ", report->firstMatch ? "" : ",", tile);
+    WriteJsonString(fp, sourcePath);
+    fprintf(fp, ", \"source_tile\": %d, \"flip\": \"%s\" }", sourceTile, sFlipNames[flip]);
+    report->firstMatch = false;
+}
+
+static void EndReportAsset(struct Report *report, char *path, struct FileStats *stats)
+{
+    FILE *fp = report->fp;
+
+    if (fp == NULL)
+        return;
+
+    if (!report->json)
+    {
+        WriteCsvField(fp, path);
+        fprintf(fp, ",%d,%d,%d,%d,%d\n", stats->tiles, stats->unique, stats->duplicates, stats->flipDuplicates, stats->crossFile);
+        return;
+    }
+
+    fprintf(fp, "%s],\n      \"tiles\": %d,\n      \"unique\": %d,\n      \"duplicates\": %d,\n      \"flip_duplicates\": %d,\n      \"cross_file\": %d\n    }",
+        report->firstMatch ? "" : "\n      ",
+        stats->tiles, stats->unique, stats->duplicates, stats->flipDuplicates, stats->crossFile);
+}
+
+static void CloseReport(struct Report *report, struct FileStats *total)
+{
+    FILE *fp = report->fp;
+
+    if (fp == NULL)
+        return;
+
+    if (report->json)
+    {
+        fprintf(fp, "\n  ],\n  \"total\": { \"tiles\": %d, \"unique\": %d, \"duplicates\": %d, \"flip_duplicates\": %d, \"cross_file\": %d }\n}\n",
+            total->tiles, total->unique, total->duplicates, total->flipDuplicates, total->crossFile);
+    }
+
+    if (fclose(fp) != 0)
+        FATAL_ERROR("Failed to write report.\n");
+}
+
+static int GetTileSize(char *path)
+{
+    char *extension = GetFileExtensionAfterDot(path);
+
+    if (extension != NULL && strcmp(extension, "4bpp") == 0)
+        return 32;
+
+    if (extension != NULL && strcmp(extension, "8bpp") == 0)
+        return 64;
+
+    return 0;
+}
+
+void RunTileDedup(struct FileList *files, struct TileDedupOptions *options)
+{
+    struct TileIndex index = {};
+    struct Report report;
+    struct FileStats total = {};
+    unsigned char *sheet = NULL;
+    int sheetTileSize = 0;
+    uint16_t *tilemap = NULL;
+    int numTilemapEntries = 0;
+    int numAssets = 0;
+
+    OpenReport(&report, options->reportPath, options);
+
+    for (int i = 0; i < files->count; i++)
+    {
+        char *path = files->paths[i];
+        int tileSize = GetTileSize(path);
+
+        if (tileSize == 0)
+            FATAL_ERROR("\"%s\" is not a .4bpp or .8bpp file.\n", path);
+
+        int size;
+        unsigned char *data = ReadWholeFile(path, &size);
+
+        if (size % tileSize != 0)
+        {
+            fprintf(stderr, "Skipping \"%s\": size %d is not a whole number of tiles.\n", path, size);
+            free(data);
+            continue;
+        }
+
+        if (options->sheetPath != NULL)
+        {
+            if (sheetTileSize != 0 && sheetTileSize != tileSize)
+                FATAL_ERROR("Can't put 4bpp and 8bpp tiles in the same sheet (\"%s\").\n", path);
+
+            sheetTileSize = tileSize;
+        }
+
+        int numTiles = size / tileSize;
+        struct FileStats stats = {};
+
+        if (options->tilemapPath != NULL)
+        {
+            tilemap = malloc(numTiles * sizeof(uint16_t));
+
+            if (tilemap == NULL)
+                FATAL_ERROR("Failed to allocate memory for tilemap.\n");
+
+            numTilemapEntries = numTiles;
+        }
+
+        BeginReportAsset(&report, path);
+
+        for (int j = 0; j < numTiles; j++)
+        {
+            unsigned char canonical[MAX_TILE_SIZE];
+            int flip = Canonicalize(data + j * tileSize, canonical, tileSize, options->noFlip);
+            bool added;
+            struct TileEntry *entry = LookupTile(&index, canonical, tileSize, &added);
+
+            stats.tiles++;
+
+            if (added)
+            {
+                entry->file = i;
+                entry->tile = j;
+                entry->flip = flip;
+                entry->sheetIndex = total.unique + stats.unique;
+                stats.unique++;
+                flip = 0;
+
+                if (options->sheetPath != NULL)
+                {
+                    sheet = realloc(sheet, (entry->sheetIndex + 1) * tileSize);
+
+                    if (sheet == NULL)
+                        FATAL_ERROR("Failed to allocate memory for tile sheet.\n");
+
+                    memcpy(sheet + entry->sheetIndex * tileSize, data + j * tileSize, tileSize);
+                }
+            }
+            else
+            {
+                // The sheet holds the first occurrence, so this tile is that
+                // one flipped back to canonical form and then flipped again.
+                flip ^= entry->flip;
+
+                if (flip == 0)
+                    stats.duplicates++;
+                else
+                    stats.flipDuplicates++;
+
+                if (entry->file != i)
+                    stats.crossFile++;
+
+                ReportMatch(&report, j, files->paths[entry->file], entry->tile, flip);
+            }
+
+            if (tilemap != NULL)
+            {
+                int tileNum = options->baseTile + entry->sheetIndex;
+
+                if (tileNum > MAX_TILEMAP_TILE)
+                    FATAL_ERROR("Tile number %d in \"%s\" doesn't fit in a tilemap entry.\n", tileNum, path);
+
+                tilemap[j] = tileNum | ((flip & FLIP_H) ? 0x400 : 0) | ((flip & FLIP_V) ? 0x800 : 0) | (options->palette << 12);
+            }
+        }
+
+        EndReportAsset(&report, path, &stats);
+
+        total.tiles += stats.tiles;
+        total.unique += stats.unique;
+        total.duplicates += stats.duplicates;
+        total.flipDuplicates += stats.flipDuplicates;
+        total.crossFile += stats.crossFile;
+        numAssets++;
+
+        free(data);
+    }
+
+    CloseReport(&report, &total);
+
+    if (options->sheetPath != NULL)
+        WriteWholeFile(options->sheetPath, sheet, total.unique * sheetTileSize);
+
+    if (tilemap != NULL)
+        WriteWholeFile(options->tilemapPath, tilemap, numTilemapEntries * sizeof(uint16_t));
+
+    free(tilemap);
+    free(sheet);
+    free(index.entries);
+    free(index.slots);
+
+    if (numAssets == 0 || total.tiles == 0)
+        return;
+
+    printf("%d files, %d tiles -> %d unique (%.1f%%)\n", numAssets,
+        total.tiles, total.unique, 100.0 * total.unique / total.tiles);
+    printf("  %-16s %d\n", "duplicates", total.duplicates);
+    printf("  %-16s %d\n", "flip duplicates", total.flipDuplicates);
+    printf("  %-16s %d\n", "cross-file", total.crossFile);
+}
@@ -0,0 +1,19 @@
+#ifndef TILEDUP_H
+#define TILEDUP_H
+
+#include <stdbool.h>
+#include "util.h"
+
+struct TileDedupOptions
+{
+    bool noFlip;        // only count exact duplicates, e.g. for sprites
+    char *reportPath;   // .json for a JSON report, CSV otherwise
+    char *sheetPath;    // where to write the unique tiles of all the inputs
+    char *tilemapPath;  // where to write a BG tilemap into the sheet (one input only)
+    int baseTile;       // added to every tile number in the tilemap
+    int palette;        // palette number for the tilemap entries
+};
+
+void RunTileDedup(struct FileList *files, struct TileDedupOptions *options);
+
+#endif // TILEDUP_H
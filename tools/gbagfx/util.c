@@ -6,6 +6,8 @@
 #include <stdbool.h>
 #include <errno.h>
 #include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include "global.h"
 #include "util.h"
 
@@ -129,3 +131,135 @@ void WriteWholeFile(char *path, void *buffer, int bufferSize)
 
 	fclose(fp);
 }
+
+static void AddFileToList(struct FileList *list, const char *path)
+{
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? list->capacity * 2 : 64;
+		list->paths = realloc(list->paths, list->capacity * sizeof(char *));
+
+		if (list->paths == NULL)
+			FATAL_ERROR("Failed to allocate memory for file list.\n");
+	}
+
+	list->paths[list->count] = strdup(path);
+
+	if (list->paths[list->count] == NULL)
+		FATAL_ERROR("Failed to allocate memory for file list.\n");
+
+	list->count++;
+}
+
+static bool HasExtension(char *path, const char *const *extensions)
+{
+	if (extensions == NULL)
+		return true;
+
+	char *extension = GetFileExtensionAfterDot(path);
+
+	if (extension == NULL)
+		return false;
+
+	for (int i = 0; extensions[i] != NULL; i++)
+		if (strcmp(extension, extensions[i]) == 0)
+			return true;
+
+	return false;
+}
+
+// Adds path to the list if it is a file. If it is a directory, it is walked
+// recursively and every file whose extension is in the NULL-terminated
+// extensions array is added (all files if extensions is NULL).
+void AddFilesRecursive(struct FileList *list, char *path, const char *const *extensions)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0)
+		FATAL_ERROR("Failed to stat \"%s\".\n", path);
+
+	if (!S_ISDIR(st.st_mode)) {
+		AddFileToList(list, path);
+		return;
+	}
+
+	DIR *dir = opendir(path);
+
+	if (dir == NULL)
+		FATAL_ERROR("Failed to open directory \"%s\".\n", path);
+
+	struct dirent *entry;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+
+		size_t childPathSize = strlen(path) + strlen(entry->d_name) + 2;
+		char *childPath = malloc(childPathSize);
+
+		if (childPath == NULL)
+			FATAL_ERROR("Failed to allocate memory for path.\n");
+
+		snprintf(childPath, childPathSize, "%s/%s", path, entry->d_name);
+
+		if (stat(childPath, &st) == 0) {
+			if (S_ISDIR(st.st_mode))
+				AddFilesRecursive(list, childPath, extensions);
+			else if (HasExtension(childPath, extensions))
+				AddFileToList(list, childPath);
+		}
+
+		free(childPath);
+	}
+
+	closedir(dir);
+}
+
+void FreeFileList(struct FileList *list)
+{
+	for (int i = 0; i < list->count; i++)
+		free(list->paths[i]);
+
+	free(list->paths);
+	list->paths = NULL;
+	list->count = 0;
+	list->capacity = 0;
+}
+
+void WriteCsvField(FILE *fp, const char *s)
+{
+	if (strpbrk(s, ",\"\n") == NULL)
+	{
+		fputs(s, fp);
+		return;
+	}
+
+	fputc('"', fp);
+
+	for (; *s != 0; s++)
+	{
+		if (*s == '"')
+			fputc('"', fp);
+		fputc(*s, fp);
+	}
+
+	fputc('"', fp);
+}
+
+void WriteJsonString(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+
+	for (; *s != 0; s++)
+	{
+		unsigned char c = *s;
+
+		if (c == '"' || c == '\\')
+			fprintf(fp, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(fp, "\\u%04x", c);
+		else
+			fputc(c, fp);
+	}
+
+	fputc('"', fp);
+}
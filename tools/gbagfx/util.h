@@ -3,13 +3,24 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <stdio.h>
 #include <stdbool.h>
 
+struct FileList {
+	char **paths;
+	int count;
+	int capacity;
+};
+
 bool ParseNumber(char *s, char **end, int radix, int *intValue);
 char *GetFileExtension(char *path);
 char *GetFileExtensionAfterDot(char *path);
 unsigned char *ReadWholeFile(char *path, int *size);
 unsigned char *ReadWholeFileZeroPadded(char *path, int *size, int padAmount);
 void WriteWholeFile(char *path, void *buffer, int bufferSize);
+void AddFilesRecursive(struct FileList *list, char *path, const char *const *extensions);
+void FreeFileList(struct FileList *list);
+void WriteCsvField(FILE *fp, const char *s);
+void WriteJsonString(FILE *fp, const char *s);
 
 #endif // UTIL_H
@@ -7,6 +7,17 @@
 #include <string>
 using std::string; using std::to_string;
 
+#include <fstream>
+using std::ifstream; using std::ofstream;
+
+#include <sstream>
+using std::istringstream; using std::ostringstream;
+
+#include <iostream>
+using std::cin;
+
+#include <chrono>
+
 #include <inja.hpp>
 using namespace inja;
 using json = nlohmann::json;
@@ -23,20 +34,14 @@ string get_custom_var(string key)
     return customVars[key];
 }
 
-int main(int argc, char *argv[])
-{
-    if (argc != 4)
-        FATAL_ERROR("USAGE: jsonproc <json-filepath> <template-filepath> <output-filepath>\n");
-
-    string jsonfilepath = argv[1];
-    string templateFilepath = argv[2];
-    string outputFilepath = argv[3];
-
-    Environment env;
+// The files of the output being rendered, for doNotModifyHeader.
+string currentJsonFilepath;
+string currentTemplateFilepath;
 
-    // Add custom command callbacks.
-    env.add_callback("doNotModifyHeader", 0, [jsonfilepath, templateFilepath](Arguments& args) {
-        return "//\n// DO NOT MODIFY THIS FILE! It is auto-generated from " + jsonfilepath +" and Inja template " + templateFilepath + "\n//\n";
+void add_callbacks(Environment& env)
+{
+    env.add_callback("doNotModifyHeader", 0, [](Arguments& args) {
+        return "//\n// DO NOT MODIFY THIS FILE! It is auto-generated from " + currentJsonFilepath +" and Inja template " + currentTemplateFilepath + "\n//\n";
     });
 
     env.add_callback("contains", 2, [](Arguments& args) {
@@ -102,6 +107,170 @@ int main(int argc, char *argv[])
     env.add_callback("isEmpty", 1, [](Arguments& args) {
         return args.at(0)->empty();
     });
+}
+
+// Writes text to filepath unless the file already holds exactly that text.
+// Returns whether the file was written.
+bool write_if_changed(const string& filepath, const string& text)
+{
+    ifstream inFile(filepath, std::ios::binary);
+
+    if (inFile.is_open())
+    {
+        ostringstream oldText;
+        oldText << inFile.rdbuf();
+
+        if (oldText.str() == text)
+            return false;
+
+        inFile.close();
+    }
+
+    ofstream outFile(filepath, std::ios::binary);
+
+    if (!outFile.is_open())
+        FATAL_ERROR("JSONPROC_ERROR: Cannot open %s for writing.\n", filepath.c_str());
+
+    outFile << text;
+    outFile.close();
+
+    if (!outFile)
+        FATAL_ERROR("JSONPROC_ERROR: Failed to write %s.\n", filepath.c_str());
+
+    return true;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct TemplateStats
+{
+    double parseMs = 0;
+    double renderMs = 0;
+    int outputs = 0;
+    int written = 0;
+};
+
+// Renders each "<json-filepath> <template-filepath> <output-filepath>" line of
+// jobFilepath ("-" for stdin) with one environment. Each template and JSON
+// file is parsed once however many outputs use it, and an output is only
+// written if its contents changed.
+void run_batch(const string& jobFilepath, bool timing)
+{
+    ifstream jobFile;
+    bool isStdin = (jobFilepath == "-");
+
+    if (!isStdin)
+    {
+        jobFile.open(jobFilepath);
+
+        if (!jobFile.is_open())
+            FATAL_ERROR("JSONPROC_ERROR: Cannot open %s for reading.\n", jobFilepath.c_str());
+    }
+
+    std::istream& jobs = isStdin ? cin : jobFile;
+
+    Environment env;
+    add_callbacks(env);
+
+    std::map<string, Template> templates;
+    std::map<string, json> jsonFiles;
+    std::map<string, TemplateStats> stats;
+    string line;
+
+    while (std::getline(jobs, line))
+    {
+        istringstream fields(line);
+        string jsonFilepath, templateFilepath, outputFilepath, extra;
+
+        if (!(fields >> jsonFilepath) || jsonFilepath[0] == '#')
+            continue;
+
+        if (!(fields >> templateFilepath >> outputFilepath) || (fields >> extra))
+            FATAL_ERROR("JSONPROC_ERROR: Expected \"<json-filepath> <template-filepath> <output-filepath>\" in \"%s\".\n", line.c_str());
+
+        TemplateStats& templateStats = stats[templateFilepath];
+        auto start = std::chrono::steady_clock::now();
+
+        try
+        {
+            auto tmpl = templates.find(templateFilepath);
+
+            if (tmpl == templates.end())
+            {
+                tmpl = templates.emplace(templateFilepath, env.parse_template(templateFilepath)).first;
+                templateStats.parseMs += elapsed_ms(start);
+                start = std::chrono::steady_clock::now();
+            }
+
+            auto data = jsonFiles.find(jsonFilepath);
+
+            if (data == jsonFiles.end())
+                data = jsonFiles.emplace(jsonFilepath, env.load_json(jsonFilepath)).first;
+
+            // Every output starts with no variables set, as it would in a
+            // process of its own.
+            customVars.clear();
+            currentJsonFilepath = jsonFilepath;
+            currentTemplateFilepath = templateFilepath;
+
+            string text = env.render(tmpl->second, data->second);
+
+            templateStats.renderMs += elapsed_ms(start);
+            templateStats.outputs++;
+
+            if (write_if_changed(outputFilepath, text))
+                templateStats.written++;
+        }
+        catch (const std::exception& e)
+        {
+            FATAL_ERROR("JSONPROC_ERROR: %s: %s\n", outputFilepath.c_str(), e.what());
+        }
+    }
+
+    if (timing)
+    {
+        for (auto& entry : stats)
+        {
+            const TemplateStats& templateStats = entry.second;
+            fprintf(stderr, "%s: parse %.2f ms, render %.2f ms, %d output(s), %d written\n",
+                    entry.first.c_str(), templateStats.parseMs, templateStats.renderMs,
+                    templateStats.outputs, templateStats.written);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 2 && string(argv[1]) == "-batch")
+    {
+        bool timing = (argc >= 3 && string(argv[2]) == "-timing");
+        int jobArg = timing ? 3 : 2;
+
+        if (argc > jobArg + 1)
+            FATAL_ERROR("USAGE: jsonproc -batch [-timing] [<job-filepath>]\n");
+
+        run_batch(argc == jobArg + 1 ? argv[jobArg] : "-", timing);
+        return 0;
+    }
+
+    if (argc != 4)
+        FATAL_ERROR("USAGE: jsonproc <json-filepath> <template-filepath> <output-filepath>\n"
+                    "       jsonproc -batch [-timing] [<job-filepath>]\n");
+
+    string jsonfilepath = argv[1];
+    string templateFilepath = argv[2];
+    string outputFilepath = argv[3];
+
+    Environment env;
+
+    currentJsonFilepath = jsonfilepath;
+    currentTemplateFilepath = templateFilepath;
+
+    // Add custom command callbacks.
+    add_callbacks(env);
 
     try
     {
@@ -24,6 +24,15 @@ using std::ostringstream;
 #include <limits>
 using std::numeric_limits;
 
+#include <atomic>
+using std::atomic;
+
+#include <thread>
+using std::thread;
+
+#include <unordered_map>
+using std::unordered_map;
+
 #include "json11.h"
 using json11::Json;
 
@@ -50,7 +59,27 @@ string read_text_file(string filepath) {
     return text;
 }
 
+// Leaves the file alone if it already has this text, so that its timestamp
+// only changes when its content does.
 void write_text_file(string filepath, string text) {
+    ifstream in_file(filepath, std::ifstream::binary);
+
+    if (in_file.is_open()) {
+        in_file.seekg(0, std::ios::end);
+
+        if (in_file.tellg() == (std::streampos)text.size()) {
+            string old_text(text.size(), '\0');
+
+            in_file.seekg(0, std::ios::beg);
+            in_file.read(&old_text[0], old_text.size());
+
+            if (in_file && old_text == text)
+                return;
+        }
+
+        in_file.close();
+    }
+
     ofstream out_file(filepath, std::ofstream::binary);
 
     if (!out_file.is_open())
@@ -61,7 +90,17 @@ void write_text_file(string filepath, string text) {
     out_file.close();
 }
 
-string generate_map_header_text(Json map_data, Json layouts_data) {
+Json read_json_file(string filepath) {
+    string err;
+    Json data = Json::parse(read_text_file(filepath), err);
+
+    if (data == Json())
+        FATAL_ERROR("%s\n", err.c_str());
+
+    return data;
+}
+
+Json find_layout(Json map_data, Json layouts_data) {
     string map_layout_id = map_data["layout"].string_value();
 
     vector<Json> matched;
@@ -74,8 +113,10 @@ string generate_map_header_text(Json map_data, Json layouts_data) {
     if (matched.size() != 1)
         FATAL_ERROR("Failed to find matching layout for %s.\n", map_layout_id.c_str());
 
-    Json layout = matched[0];
+    return matched[0];
+}
 
+string generate_map_header_text(Json map_data, Json layout) {
     ostringstream text;
 
     text << map_data["name"].string_value() << "::\n"
@@ -374,31 +415,41 @@ string get_directory_name(string filename) {
     return filename.substr(0, dir_pos + 1);
 }
 
-void process_map(string map_filepath, string layouts_filepath) {
-    string mapdata_err, layouts_err;
-
-    string mapdata_json_text = read_text_file(map_filepath);
-    string layouts_json_text = read_text_file(layouts_filepath);
-
-    Json map_data = Json::parse(mapdata_json_text, mapdata_err);
-    if (map_data == Json())
-        FATAL_ERROR("%s\n", mapdata_err.c_str());
-
-    Json layouts_data = Json::parse(layouts_json_text, layouts_err);
-    if (layouts_data == Json())
-        FATAL_ERROR("%s\n", layouts_err.c_str());
-
-    string header_text = generate_map_header_text(map_data, layouts_data);
+void write_map_files(string files_dir, Json map_data, Json layout) {
+    string header_text = generate_map_header_text(map_data, layout);
     string events_text = version == "firered" ? generate_firered_map_events_text(map_data)
                                               : generate_map_events_text(map_data);
     string connections_text = generate_map_connections_text(map_data);
 
-    string files_dir = get_directory_name(map_filepath);
     write_text_file(files_dir + "header.inc", header_text);
     write_text_file(files_dir + "events.inc", events_text);
     write_text_file(files_dir + "connections.inc", connections_text);
 }
 
+void process_map(string map_filepath, string layouts_filepath) {
+    Json map_data = read_json_file(map_filepath);
+    Json layouts_data = read_json_file(layouts_filepath);
+
+    write_map_files(get_directory_name(map_filepath), map_data, find_layout(map_data, layouts_data));
+}
+
+vector<string> get_map_names(Json groups_data) {
+    vector<string> map_names;
+
+    for (auto &group : groups_data["group_order"].array_items())
+    for (auto map_name : groups_data[group.string_value()].array_items())
+        map_names.push_back(map_name.string_value());
+
+    return map_names;
+}
+
+string get_map_filepath(string groups_filepath, string map_name) {
+    string file_dir = get_directory_name(groups_filepath);
+    char dir_separator = file_dir.back();
+
+    return file_dir + map_name + dir_separator + "map.json";
+}
+
 string generate_groups_text(Json groups_data) {
     ostringstream text;
 
@@ -480,10 +531,7 @@ string generate_events_text(Json groups_data) {
     return text.str();
 }
 
-string generate_map_constants_text(string groups_filepath, Json groups_data) {
-    string file_dir = get_directory_name(groups_filepath);
-    char dir_separator = file_dir.back();
-
+string generate_map_constants_text(Json groups_data, const map<string, Json> &maps_data) {
     ostringstream text;
 
     text << "#ifndef GUARD_CONSTANTS_MAP_GROUPS_H\n"
@@ -497,9 +545,7 @@ string generate_map_constants_text(string groups_filepath, Json groups_data) {
         size_t max_length = 0;
 
         for (auto &map_name : groups_data[group.string_value()].array_items()) {
-            string header_filepath = file_dir + map_name.string_value() + dir_separator + "map.json";
-            string err_str;
-            Json map_data = Json::parse(read_text_file(header_filepath), err_str);
+            Json map_data = maps_data.at(map_name.string_value());
             map_ids.push_back(map_data["id"]);
             if (map_data["id"].string_value().length() > max_length)
                 max_length = map_data["id"].string_value().length();
@@ -521,18 +567,12 @@ string generate_map_constants_text(string groups_filepath, Json groups_data) {
     return text.str();
 }
 
-void process_groups(string groups_filepath) {
-    string err;
-    Json groups_data = Json::parse(read_text_file(groups_filepath), err);
-
-    if (groups_data == Json())
-        FATAL_ERROR("%s\n", err.c_str());
-
+void write_groups_files(string groups_filepath, Json groups_data, const map<string, Json> &maps_data) {
     string groups_text = generate_groups_text(groups_data);
     string connections_text = generate_connections_text(groups_data);
     string headers_text = generate_headers_text(groups_data);
     string events_text = generate_events_text(groups_data);
-    string map_header_text = generate_map_constants_text(groups_filepath, groups_data);
+    string map_header_text = generate_map_constants_text(groups_data, maps_data);
 
     string file_dir = get_directory_name(groups_filepath);
     char s = file_dir.back();
@@ -544,6 +584,16 @@ void process_groups(string groups_filepath) {
     write_text_file(file_dir + ".." + s + ".." + s + "include" + s + "constants" + s + "map_groups.h", map_header_text);
 }
 
+void process_groups(string groups_filepath) {
+    Json groups_data = read_json_file(groups_filepath);
+    map<string, Json> maps_data;
+
+    for (string map_name : get_map_names(groups_data))
+        maps_data[map_name] = read_json_file(get_map_filepath(groups_filepath, map_name));
+
+    write_groups_files(groups_filepath, groups_data, maps_data);
+}
+
 string generate_layout_headers_text(Json layouts_data) {
     ostringstream text;
 
@@ -609,13 +659,7 @@ string generate_layouts_constants_text(Json layouts_data) {
     return text.str();
 }
 
-void process_layouts(string layouts_filepath) {
-    string err;
-    Json layouts_data = Json::parse(read_text_file(layouts_filepath), err);
-
-    if (layouts_data == Json())
-        FATAL_ERROR("%s\n", err.c_str());
-
+void write_layouts_files(string layouts_filepath, Json layouts_data) {
     string layout_headers_text = generate_layout_headers_text(layouts_data);
     string layouts_table_text = generate_layouts_table_text(layouts_data);
     string layouts_constants_text = generate_layouts_constants_text(layouts_data);
@@ -628,6 +672,65 @@ void process_layouts(string layouts_filepath) {
     write_text_file(file_dir + ".." + s + ".." + s + "include" + s + "constants" + s + "layouts.h", layouts_constants_text);
 }
 
+void process_layouts(string layouts_filepath) {
+    write_layouts_files(layouts_filepath, read_json_file(layouts_filepath));
+}
+
+// Generates everything the map, groups and layouts modes do, parsing each
+// JSON file once. The per-map files are generated on num_threads threads.
+void process_all(string groups_filepath, string layouts_filepath, int num_threads) {
+    Json groups_data = read_json_file(groups_filepath);
+    Json layouts_data = read_json_file(layouts_filepath);
+
+    // Layout ids that appear more than once map to null, the same as ones
+    // that don't appear at all, since neither has a single match.
+    unordered_map<string, Json> layouts_by_id;
+
+    for (auto &layout : layouts_data["layouts"].array_items()) {
+        auto inserted = layouts_by_id.emplace(layout["id"].string_value(), layout);
+        if (!inserted.second)
+            inserted.first->second = Json();
+    }
+
+    vector<string> map_names = get_map_names(groups_data);
+    vector<Json> maps_data(map_names.size());
+    atomic<size_t> next(0);
+
+    auto work = [&]() {
+        size_t i;
+        while ((i = next++) < map_names.size()) {
+            string map_filepath = get_map_filepath(groups_filepath, map_names[i]);
+            Json map_data = read_json_file(map_filepath);
+            string map_layout_id = map_data["layout"].string_value();
+            auto layout = layouts_by_id.find(map_layout_id);
+
+            if (layout == layouts_by_id.end() || layout->second == Json())
+                FATAL_ERROR("Failed to find matching layout for %s.\n", map_layout_id.c_str());
+
+            write_map_files(get_directory_name(map_filepath), map_data, layout->second);
+            maps_data[i] = map_data;
+        }
+    };
+
+    vector<thread> threads;
+
+    for (int i = 1; i < num_threads; i++)
+        threads.emplace_back(work);
+
+    work();
+
+    for (thread &t : threads)
+        t.join();
+
+    map<string, Json> maps_by_name;
+
+    for (size_t i = 0; i < map_names.size(); i++)
+        maps_by_name[map_names[i]] = maps_data[i];
+
+    write_groups_files(groups_filepath, groups_data, maps_by_name);
+    write_layouts_files(layouts_filepath, layouts_data);
+}
+
 int main(int argc, char *argv[]) {
     if (argc < 3)
         FATAL_ERROR("USAGE: mapjson <mode> <game-version> [options]\n");
@@ -638,8 +741,8 @@ int main(int argc, char *argv[]) {
 
     char *mode_arg = argv[1];
     string mode(mode_arg);
-    if (mode != "layouts" && mode != "map" && mode != "groups")
-        FATAL_ERROR("ERROR: <mode> must be 'layouts', 'map', or 'groups'.\n");
+    if (mode != "layouts" && mode != "map" && mode != "groups" && mode != "all")
+        FATAL_ERROR("ERROR: <mode> must be 'layouts', 'map', 'groups', or 'all'.\n");
 
     if (mode == "map") {
         if (argc != 5)
@@ -666,6 +769,22 @@ int main(int argc, char *argv[]) {
 
         process_layouts(filepath);
     }
+    else if (mode == "all") {
+        int num_threads = thread::hardware_concurrency();
+
+        if (argc == 7 && string(argv[5]) == "-j")
+            num_threads = std::atoi(argv[6]);
+        else if (argc != 5)
+            FATAL_ERROR("USAGE: mapjson all <game-version> <groups_file> <layouts_file> [-j <threads>]\n");
+
+        if (num_threads < 1)
+            num_threads = 1;
+
+        string groups_filepath(argv[3]);
+        string layouts_filepath(argv[4]);
+
+        process_all(groups_filepath, layouts_filepath, num_threads);
+    }
 
     return 0;
 }
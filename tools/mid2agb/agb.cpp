@@ -502,6 +502,25 @@ void PrintAgbTrack(std::vector<Event>& events)
 
             ResetTrackVars();
             break;
+        case EventType::SubroutineBegin:
+            std::fprintf(g_outputFile, "%s_%u_S%u:\n", g_asmLabel.c_str(), g_agbTrack, event.param2);
+            ResetTrackVars();
+            break;
+        case EventType::SubroutineEnd:
+            PrintByte("PEND");
+            break;
+        case EventType::SubroutineCall:
+        {
+            PrintByte("PATT");
+            PrintWord("%s_%u_S%u", g_asmLabel.c_str(), g_agbTrack, event.param2);
+
+            // The call may be inside a whole-note pattern, which still needs
+            // its PEND.
+            bool inPattern = s_inPattern;
+            ResetTrackVars();
+            s_inPattern = inPattern;
+            break;
+        }
         case EventType::Tempo:
             PrintByte("TEMPO , %u*%s_tbs/2", 60000000 / event.param2, g_asmLabel.c_str());
             PrintWait(event.time);
@@ -41,6 +41,8 @@ int g_reverb = -1;
 int g_clocksPerBeat = 1;
 bool g_exactGateTime = false;
 bool g_compressionEnabled = true;
+bool g_extractSubroutines = false;
+bool g_printCompressionTime = false;
 
 [[noreturn]] static void PrintUsage()
 {
@@ -58,6 +60,8 @@ bool g_compressionEnabled = true;
         "            -X  48 clocks/beat (default:24 clocks/beat)\n"
         "            -E  exact gate-time\n"
         "            -N  no compression\n"
+        "            -O  move repeated runs of events into subroutines\n"
+        "            -T  print compression time\n"
     );
     std::exit(1);
 }
@@ -160,6 +164,9 @@ int main(int argc, char** argv)
             case 'N':
                 g_compressionEnabled = false;
                 break;
+            case 'O':
+                g_extractSubroutines = true;
+                break;
             case 'P':
                 arg = GetArgument(argc, argv, i);
                 if (arg == nullptr)
@@ -172,6 +179,9 @@ int main(int argc, char** argv)
                     PrintUsage();
                 g_reverb = std::stoi(arg);
                 break;
+            case 'T':
+                g_printCompressionTime = true;
+                break;
             case 'V':
                 arg = GetArgument(argc, argv, i);
                 if (arg == nullptr)
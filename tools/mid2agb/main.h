@@ -35,5 +35,7 @@ extern int g_reverb;
 extern int g_clocksPerBeat;
 extern bool g_exactGateTime;
 extern bool g_compressionEnabled;
+extern bool g_extractSubroutines;
+extern bool g_printCompressionTime;
 
 #endif // MAIN_H
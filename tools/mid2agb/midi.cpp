@@ -23,7 +23,9 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <chrono>
 #include <memory>
+#include <unordered_map>
 #include "midi.h"
 #include "main.h"
 #include "error.h"
@@ -53,6 +55,8 @@ static int s_blockCount = 0;
 static int s_minNote;
 static int s_maxNote;
 static int s_runningStatus;
+static std::chrono::steady_clock::duration s_compressionTime;
+static std::size_t s_compressedEventCount;
 
 void Seek(long offset)
 {
@@ -850,67 +854,540 @@ int CalculateCompressionScore(std::vector<Event>& events, int index)
     return score;
 }
 
-bool IsCompressionMatch(std::vector<Event>& events, int index1, int index2)
+// Returns the index of the pattern boundary that ends the whole note starting
+// at index, and hashes the fields that decide whether two whole notes match:
+// those of the WholeNoteMark that aren't its number, and every event up to
+// the boundary.
+static int HashWholeNote(std::vector<Event>& events, int index, std::uint64_t& hash)
 {
+    const std::uint64_t prime = 1099511628211u;
+    std::uint64_t h = 14695981039346656037u;
+
+    auto mix = [&](std::uint64_t value)
+    {
+        h = (h ^ value) * prime;
+    };
+
+    mix((int)events[index].type);
+    mix(events[index].note);
+    mix(events[index].param1);
+    mix((std::uint32_t)events[index].time);
+
+    int i;
+
+    for (i = index + 1; !IsPatternBoundary(events[i].type); i++)
+    {
+        mix((std::uint32_t)events[i].time);
+        mix((int)events[i].type | (events[i].note << 8) | (events[i].param1 << 16));
+        mix((std::uint32_t)events[i].param2);
+    }
+
+    hash = h;
+    return i;
+}
+
+static bool IsCompressionMatch(std::vector<Event>& events, int index1, int end1, int index2, int end2)
+{
+    if (end1 - index1 != end2 - index2)
+        return false;
+
     if (events[index1].type != events[index2].type ||
         events[index1].note != events[index2].note ||
         events[index1].param1 != events[index2].param1 ||
         events[index1].time != events[index2].time)
         return false;
 
-    index1++;
-    index2++;
-
-    do
+    for (int i = 1; index1 + i < end1; i++)
     {
-        if (events[index1] != events[index2])
+        if (events[index1 + i] != events[index2 + i])
             return false;
+    }
 
-        index1++;
-        index2++;
-    } while (!IsPatternBoundary(events[index1].type));
-
-    return IsPatternBoundary(events[index2].type);
+    return true;
 }
 
-void CompressWholeNote(std::vector<Event>& events, int index)
+// Turns every whole note that repeats an earlier one into a reference to it.
+// Whole notes are looked up by hash, so each event is only looked at once or
+// twice, and the score is only calculated for the first of each kind of
+// whole note. Whole notes that score too low are never turned into patterns,
+// nor used as one.
+void Compress(std::vector<Event>& events)
 {
-    for (int j = index + 1; events[j].type != EventType::EndOfTrack; j++)
+    struct WholeNote
+    {
+        int index;
+        int end;
+        bool compressible;
+    };
+
+    std::unordered_multimap<std::uint64_t, WholeNote> wholeNotes;
+
+    for (int i = 0; events[i].type != EventType::EndOfTrack; i++)
     {
-        while (events[j].type != EventType::WholeNoteMark)
+        if (events[i].type != EventType::WholeNoteMark)
+            continue;
+
+        std::uint64_t hash;
+        int end = HashWholeNote(events, i, hash);
+        const WholeNote *match = nullptr;
+        auto range = wholeNotes.equal_range(hash);
+
+        for (auto it = range.first; it != range.second && match == nullptr; ++it)
         {
-            j++;
+            if (IsCompressionMatch(events, it->second.index, it->second.end, i, end))
+                match = &it->second;
+        }
 
-            if (events[j].type == EventType::EndOfTrack)
-                return;
+        if (match == nullptr)
+        {
+            wholeNotes.emplace(hash, WholeNote{ i, end, CalculateCompressionScore(events, i) >= 6 });
+        }
+        else if (match->compressible)
+        {
+            events[i].type = EventType::Pattern;
+            events[i].param2 = events[match->index].param2 & 0x7FFFFFFF;
+            events[match->index].param2 |= 0x80000000;
         }
 
-        if (IsCompressionMatch(events, index, j))
+        // The events up to the boundary can't be whole notes.
+        i = end - 1;
+    }
+}
+
+// Events that can be moved into a subroutine. Once the track vars have been
+// reset they print the same wherever they are, and they only change how later
+// events print through those vars. Pattern boundaries (end of tie included)
+// have to stay where they are for whole-note patterns to end in the right
+// place.
+static bool IsSubroutineEvent(const Event& event)
+{
+    switch (event.type)
+    {
+    case EventType::Note:
+    case EventType::Tempo:
+    case EventType::InstrumentChange:
+    case EventType::PitchBend:
+    case EventType::TimeSplit:
+        return true;
+    case EventType::Controller:
+        switch (event.param1)
         {
-            events[j].type = EventType::Pattern;
-            events[j].param2 = events[index].param2 & 0x7FFFFFFF;
-            events[index].param2 |= 0x80000000;
+        case 0x01:
+        case 0x07:
+        case 0x0A:
+        case 0x14:
+        case 0x15:
+        case 0x16:
+        case 0x18:
+        case 0x1A:
+            return true;
         }
+        return false;
+    default:
+        return false;
     }
 }
 
-void Compress(std::vector<Event>& events)
+// What the printer remembers from one event to the next that decides how
+// many bytes an event takes. See PrintNote and PrintOp.
+struct PrintState
 {
-    for (int i = 0; events[i].type != EventType::EndOfTrack; i++)
+    int lastOp;
+    int lastNote;
+    int lastVelocity;
+    bool keepLastOp;
+
+    PrintState() : lastOp(-1), lastNote(-1), lastVelocity(-1), keepLastOp(false) {}
+};
+
+// Returns how many bytes of sequence data a subroutine event prints as, and
+// updates the state the way printing it does.
+static int CalculateEventSize(const Event& event, PrintState& state)
+{
+    int size = 0;
+    int op = -1;
+
+    switch (event.type)
     {
-        while (events[i].type != EventType::WholeNoteMark)
+    case EventType::Note:
+    {
+        int velocity = g_noteVelocityLUT[event.param1];
+        int duration = (event.param2 == -1) ? -1 : g_noteDurationLUT[event.param2];
+        int gateTime = (g_exactGateTime && duration != -1) ? event.param2 - duration : 0;
+        bool noteChanged = (event.note != state.lastNote);
+        bool velocityChanged = (velocity != state.lastVelocity);
+
+        op = ((int)event.type << 8) | (duration + 1);
+
+        // A note only leaves out its op after a wait.
+        if (!state.keepLastOp)
+            state.lastOp = -1;
+        state.keepLastOp = false;
+
+        if (noteChanged || velocityChanged || gateTime > 0)
         {
-            i++;
+            size += (op != state.lastOp) + 1;
+            state.lastNote = event.note;
 
-            if (events[i].type == EventType::EndOfTrack)
-                return;
+            if (velocityChanged || gateTime > 0)
+            {
+                size++;
+                state.lastVelocity = velocity;
+            }
+
+            if (gateTime > 0)
+                size++;
+        }
+        else
+        {
+            size++;
         }
+        break;
+    }
+    case EventType::Tempo:
+        size += 2;
+        state.keepLastOp = true;
+        break;
+    case EventType::InstrumentChange:
+    case EventType::PitchBend:
+        op = (int)event.type << 8;
+        size += (op != state.lastOp) + 1;
+        break;
+    case EventType::Controller:
+        op = ((int)event.type << 8) | event.param1;
+        size += (op != state.lastOp) + 1;
+        break;
+    default:
+        break;
+    }
+
+    if (op != -1)
+        state.lastOp = op;
+
+    if (event.time > 0)
+    {
+        size++;
+        state.keepLastOp = true;
+    }
+
+    return size;
+}
+
+static int CalculateSequenceSize(std::vector<Event>& events, int index, int length, PrintState& state)
+{
+    int size = 0;
+
+    for (int i = index; i < index + length; i++)
+        size += CalculateEventSize(events[i], state);
+
+    return size;
+}
+
+static bool IsSamePrintState(const PrintState& state1, const PrintState& state2)
+{
+    return state1.lastOp == state2.lastOp
+        && state1.lastNote == state2.lastNote
+        && state1.lastVelocity == state2.lastVelocity
+        && state1.keepLastOp == state2.keepLastOp;
+}
+
+// Updates the state for any event that gets printed, the way PrintAgbTrack
+// does, and returns its size if it is a subroutine event.
+static int AdvancePrintState(const Event& event, PrintState& state)
+{
+    if (IsSubroutineEvent(event))
+        return CalculateEventSize(event, state);
+
+    switch (event.type)
+    {
+    case EventType::Label:
+    case EventType::LoopEnd:
+    case EventType::LoopEndBegin:
+    case EventType::LoopBegin:
+    case EventType::Pattern:
+        state = PrintState();
+        break;
+    case EventType::WholeNoteMark:
+        if (event.param2 & 0x80000000)
+            state = PrintState();
+        break;
+    case EventType::EndOfTie:
+        state.lastOp = -1;
+        break;
+    case EventType::Controller:
+        if (event.param1 == 0x11)
+            state = PrintState();
+        break;
+    default:
+        break;
+    }
+
+    if (event.time > 0)
+        state.keepLastOp = true;
+
+    return 0;
+}
+
+static std::uint64_t HashEvent(const Event& event)
+{
+    std::uint64_t h = (std::uint32_t)event.time;
+    h = h * 1099511628211u + ((int)event.type | (event.note << 8) | (event.param1 << 16));
+    h = h * 1099511628211u + (std::uint32_t)event.param2;
+    return h ^ (h >> 29);
+}
+
+static bool IsSequenceMatch(std::vector<Event>& events, int index1, int index2, int length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        if (events[index1 + i] != events[index2 + i])
+            return false;
+    }
+
+    return true;
+}
 
-        if (CalculateCompressionScore(events, i) >= 6)
+// Moves runs of events that occur more than once in a track into subroutines,
+// if that makes the track smaller. A subroutine is left where it first occurs
+// outside of a whole-note pattern, with a label before it and a PEND after it
+// (which does nothing when it isn't called), and the other occurrences become
+// PATTs. Runs never cross a pattern boundary, so a PATT made inside a whole-note
+// pattern nests only two deep. The longest runs are tried first.
+std::unique_ptr<std::vector<Event>> ExtractSubroutines(std::vector<Event>& inEvents)
+{
+    enum Region
+    {
+        Normal,
+        InPattern,
+        Skipped,
+    };
+
+    int count = 0;
+
+    while (inEvents[count].type != EventType::EndOfTrack)
+        count++;
+
+    std::vector<Region> regions(count);
+    std::vector<bool> used(count);
+    std::vector<PrintState> states(count + 1);
+    std::vector<std::uint64_t> prefixHashes(count + 1);
+    const std::uint64_t base = 0x100000001B3u;
+
+    Region region = Normal;
+    PrintState state;
+
+    for (int i = 0; i < count; i++)
+    {
+        const Event& event = inEvents[i];
+
+        if (event.type == EventType::Pattern)
+            region = Skipped;
+        else if (event.type == EventType::WholeNoteMark && (event.param2 & 0x80000000))
+            region = InPattern;
+        else if (IsPatternBoundary(event.type))
+            region = Normal;
+
+        regions[i] = region;
+        states[i] = state;
+        prefixHashes[i + 1] = prefixHashes[i] * base + HashEvent(event);
+        used[i] = (region == Skipped || !IsSubroutineEvent(event));
+
+        if (region != Skipped)
+            AdvancePrintState(event, state);
+    }
+
+    // Returns how many more bytes the events from index on print as when
+    // printing them starts from state instead of from inlineState.
+    auto calculateResumeSize = [&](int index, PrintState state, PrintState inlineState)
+    {
+        int size = 0;
+
+        for (int i = index; i < count && !IsSamePrintState(state, inlineState); i++)
         {
-            CompressWholeNote(events, i);
+            if (regions[i] != Skipped)
+                size += AdvancePrintState(inEvents[i], state) - AdvancePrintState(inEvents[i], inlineState);
         }
+
+        return size;
+    };
+
+    struct Subroutine
+    {
+        int index;
+        int length;
+        std::vector<int> calls;
+    };
+
+    std::vector<Subroutine> subroutines;
+
+    int maxLength = 0;
+
+    for (int i = 0, runLength = 0; i < count; i++)
+    {
+        runLength = used[i] ? 0 : runLength + 1;
+        maxLength = std::max(maxLength, runLength);
     }
+
+    for (int length = maxLength; length >= 2; length--)
+    {
+        std::uint64_t basePower = 1;
+
+        for (int i = 0; i < length; i++)
+            basePower *= base;
+
+        // Hash every run of this length that is still free, keeping the
+        // hashes in the order they were first seen.
+        std::vector<int> freeLengths(count + 1);
+        std::unordered_map<std::uint64_t, std::vector<int>> runs;
+        std::vector<std::uint64_t> order;
+
+        for (int i = count - 1; i >= 0; i--)
+            freeLengths[i] = used[i] ? 0 : freeLengths[i + 1] + 1;
+
+        for (int i = 0; i < count; i++)
+        {
+            if (freeLengths[i] >= length)
+            {
+                std::uint64_t hash = prefixHashes[i + length] - prefixHashes[i] * basePower;
+                std::vector<int>& indexes = runs[hash];
+
+                if (indexes.empty())
+                    order.push_back(hash);
+
+                indexes.push_back(i);
+            }
+        }
+
+        for (std::uint64_t hash : order)
+        {
+            std::vector<int>& indexes = runs[hash];
+
+            if (indexes.size() < 2)
+                continue;
+
+            // Runs with the same hash almost always match, but check.
+            while (!indexes.empty())
+            {
+                int first = indexes[0];
+                std::vector<int> matches;
+                std::vector<int> rest;
+
+                for (int index : indexes)
+                {
+                    if (IsSequenceMatch(inEvents, first, index, length))
+                        matches.push_back(index);
+                    else
+                        rest.push_back(index);
+                }
+
+                indexes.swap(rest);
+
+                std::vector<int> occurrences;
+                int source = -1;
+
+                for (int index : matches)
+                {
+                    if (!occurrences.empty() && index < occurrences.back() + length)
+                        continue;
+
+                    if (std::find(used.begin() + index, used.begin() + index + length, true) != used.begin() + index + length)
+                        continue;
+
+                    if (source == -1 && regions[index] == Normal)
+                        source = index;
+
+                    occurrences.push_back(index);
+                }
+
+                if (occurrences.size() < 2 || source == -1)
+                    continue;
+
+                // Each PATT takes 5 bytes and the subroutine a PEND. The
+                // subroutine and whatever follows it and each PATT start
+                // with less running status than they had.
+                PrintState bodyState;
+                int bodySize = CalculateSequenceSize(inEvents, source, length, bodyState);
+                int saving = -(bodySize + 1);
+
+                bodyState.keepLastOp = true;
+
+                for (int index : occurrences)
+                {
+                    PrintState inlineState = states[index];
+                    saving += CalculateSequenceSize(inEvents, index, length, inlineState);
+
+                    if (index == source)
+                    {
+                        saving -= calculateResumeSize(index + length, bodyState, inlineState);
+                    }
+                    else
+                    {
+                        saving -= 5 + calculateResumeSize(index + length, PrintState(), inlineState);
+                    }
+                }
+
+                if (saving <= 0)
+                    continue;
+
+                Subroutine subroutine;
+                subroutine.index = source;
+                subroutine.length = length;
+
+                for (int index : occurrences)
+                {
+                    std::fill(used.begin() + index, used.begin() + index + length, true);
+
+                    if (index != source)
+                        subroutine.calls.push_back(index);
+                }
+
+                subroutines.push_back(subroutine);
+            }
+        }
+    }
+
+    std::vector<int> sourceAt(count, -1);
+    std::vector<int> callAt(count, -1);
+
+    for (unsigned i = 0; i < subroutines.size(); i++)
+    {
+        sourceAt[subroutines[i].index] = i;
+
+        for (int index : subroutines[i].calls)
+            callAt[index] = i;
+    }
+
+    std::unique_ptr<std::vector<Event>> outEvents(new std::vector<Event>());
+
+    for (int i = 0; i < (int)inEvents.size(); i++)
+    {
+        if (i < count && sourceAt[i] != -1)
+        {
+            const Subroutine& subroutine = subroutines[sourceAt[i]];
+            Event event = {};
+            event.type = EventType::SubroutineBegin;
+            event.param2 = sourceAt[i];
+            outEvents->push_back(event);
+            outEvents->insert(outEvents->end(), inEvents.begin() + i, inEvents.begin() + i + subroutine.length);
+            event.type = EventType::SubroutineEnd;
+            outEvents->push_back(event);
+            i += subroutine.length - 1;
+        }
+        else if (i < count && callAt[i] != -1)
+        {
+            Event event = {};
+            event.type = EventType::SubroutineCall;
+            event.param2 = callAt[i];
+            outEvents->push_back(event);
+            i += subroutines[callAt[i]].length - 1;
+        }
+        else
+        {
+            outEvents->push_back(inEvents[i]);
+        }
+    }
+
+    return outEvents;
 }
 
 void ReadMidiTracks()
@@ -953,7 +1430,15 @@ void ReadMidiTracks()
                 CalculateWaits(*events);
 
                 if (g_compressionEnabled)
+                {
+                    auto start = std::chrono::steady_clock::now();
                     Compress(*events);
+                    s_compressionTime += std::chrono::steady_clock::now() - start;
+                    s_compressedEventCount += events->size();
+
+                    if (g_extractSubroutines)
+                        events = ExtractSubroutines(*events);
+                }
 
                 PrintAgbTrack(*events);
 
@@ -961,4 +1446,11 @@ void ReadMidiTracks()
             }
         }
     }
+
+    if (g_printCompressionTime)
+    {
+        std::fprintf(stderr, "%s: %d tracks, %lu events, compressed in %.3f ms\n",
+            g_asmLabel.c_str(), g_agbTrack - 1, (unsigned long)s_compressedEventCount,
+            std::chrono::duration<double, std::milli>(s_compressionTime).count());
+    }
 }
@@ -41,6 +41,9 @@ enum class EventType
     Pattern = 0x17,
     TimeSignature = 0x18,
     Tempo = 0x19,
+    SubroutineBegin = 0x1A,
+    SubroutineEnd = 0x1B,
+    SubroutineCall = 0x1C,
     InstrumentChange = 0x21,
     Controller = 0x22,
     PitchBend = 0x23,
@@ -0,0 +1,660 @@
+#include "constant_database.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sys/stat.h>
+
+#include "expression.h"
+#include "mapped_file.h"
+
+namespace core
+{
+
+    // Deeper than this, an include is assumed to be recursive.
+    static const int kMaxIncludeDepth = 200;
+
+    static bool IsDirective(Token::Type type)
+    {
+        switch (type)
+        {
+        case Token::Type::kIfDef:
+        case Token::Type::kIfNDef:
+        case Token::Type::kDefine:
+        case Token::Type::kEndIf:
+        case Token::Type::kInclude:
+        case Token::Type::kIf:
+        case Token::Type::kElif:
+        case Token::Type::kElse:
+        case Token::Type::kUndef:
+        case Token::Type::kDirective:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static std::string GetDir(const std::string &path)
+    {
+        std::size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    }
+
+    static bool FileExists(const std::string &path)
+    {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && !S_ISDIR(st.st_mode);
+    }
+
+    // If the whole file is wrapped in "#ifndef GUARD ... #endif", returns GUARD,
+    // so that including the file again can be skipped without walking it.
+    static std::string FindGuard(const std::vector<Token> &tokens)
+    {
+        if (tokens.size() < 3 || tokens[0].type() != Token::Type::kIfNDef || tokens[1].type() != Token::Type::kIdentifier || tokens[1].first_on_line() || !tokens[2].first_on_line())
+            return "";
+
+        int depth = 0;
+
+        for (std::size_t i = 0; i < tokens.size(); i++)
+        {
+            if (!tokens[i].first_on_line())
+                continue;
+
+            switch (tokens[i].type())
+            {
+            case Token::Type::kIf:
+            case Token::Type::kIfDef:
+            case Token::Type::kIfNDef:
+                depth++;
+                break;
+            case Token::Type::kElif:
+            case Token::Type::kElse:
+                if (depth == 1)
+                    return "";
+                break;
+            case Token::Type::kEndIf:
+                if (--depth == 0)
+                {
+                    for (std::size_t j = i + 1; j < tokens.size(); j++)
+                    {
+                        if (tokens[j].first_on_line())
+                            return "";
+                    }
+                    return tokens[1].string_value();
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        return "";
+    }
+
+    uint64_t ConstantDatabase::HashContent(const char *data, std::size_t size)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+
+        for (std::size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+    // A macro whose replacement list is a single number, or is wholly
+    // parenthesized, can stand in an expression as its value. Others have to be
+    // expanded where they're used, since e.g. "#define A 1 + 2" makes "A * 3"
+    // equal 7, not 9.
+    bool ConstantDatabase::IsAtomic(const std::vector<Token> &body)
+    {
+        if (body.size() == 1)
+            return body[0].type() == Token::Type::kNumber;
+
+        if (body.size() == 2)
+        {
+            Token::Type op = body[0].type();
+            return (op == Token::Type::kMinus || op == Token::Type::kPlus || op == Token::Type::kBitNot) && body[1].type() == Token::Type::kNumber;
+        }
+
+        if (body.empty() || body.front().type() != Token::Type::kOpenParen || body.back().type() != Token::Type::kCloseParen)
+            return false;
+
+        int depth = 0;
+
+        for (std::size_t i = 0; i < body.size(); i++)
+        {
+            if (body[i].type() == Token::Type::kOpenParen)
+            {
+                depth++;
+            }
+            else if (body[i].type() == Token::Type::kCloseParen && --depth == 0)
+            {
+                return i == body.size() - 1;
+            }
+        }
+
+        return false;
+    }
+
+    void ConstantDatabase::AddIncludeDir(const std::string &dir)
+    {
+        include_dirs_.push_back(dir.empty() || dir.back() == '/' ? dir : dir + "/");
+    }
+
+    // Like -D on a compiler's command line.
+    void ConstantDatabase::Define(const std::string &name, const std::string &value)
+    {
+        Macro macro;
+        macro.body = lexer_.LexString(value.empty() ? "1" : value);
+        macro.atomic = IsAtomic(macro.body);
+        macros_[name] = std::move(macro);
+        generation_++;
+    }
+
+    bool ConstantDatabase::ProcessFile(const std::string &path)
+    {
+        if (!FileExists(path))
+            return false;
+
+        ProcessHeader(path, 0);
+        return true;
+    }
+
+    std::shared_ptr<const ConstantDatabase::Header> ConstantDatabase::LoadHeader(const std::string &path, int &file_index)
+    {
+        auto found = headers_by_path_.find(path);
+
+        if (found != headers_by_path_.end())
+        {
+            file_index = file_indexes_[path];
+            return found->second;
+        }
+
+        MappedFile file(path);
+
+        if (!file.is_open())
+            return nullptr;
+
+        uint64_t hash = HashContent(file.data(), file.size());
+
+        file_index = files_.size();
+        files_.emplace_back(path, hash);
+        file_indexes_[path] = file_index;
+
+        std::shared_ptr<const Header> &header = headers_by_hash_[hash];
+
+        if (!header)
+        {
+            std::shared_ptr<Header> lexed = std::make_shared<Header>();
+            lexed->tokens = lexer_.LexBuffer(file.data(), file.size());
+            lexed->guard = FindGuard(lexed->tokens);
+            header = lexed;
+        }
+
+        headers_by_path_[path] = header;
+        return header;
+    }
+
+    // "file.h" is looked for next to the including file first, <file.h> only
+    // in the include dirs.
+    std::string ConstantDatabase::FindInclude(const std::string &name, const std::string &dir, bool quoted) const
+    {
+        if (quoted && FileExists(dir + name))
+            return dir + name;
+
+        for (const std::string &include_dir : include_dirs_)
+        {
+            if (FileExists(include_dir + name))
+                return include_dir + name;
+        }
+
+        return "";
+    }
+
+    void ConstantDatabase::ProcessHeader(const std::string &path, int depth)
+    {
+        if (depth > kMaxIncludeDepth)
+        {
+            std::cerr << path << ": warning: #include nested too deeply" << std::endl;
+            return;
+        }
+
+        if (pragma_once_.count(path))
+            return;
+
+        int file_index;
+        std::shared_ptr<const Header> header = LoadHeader(path, file_index);
+
+        if (!header || (!header->guard.empty() && macros_.count(header->guard)))
+            return;
+
+        const std::vector<Token> &tokens = header->tokens;
+        std::vector<Conditional> conditionals;
+        std::size_t i = 0;
+
+        while (i < tokens.size())
+        {
+            std::size_t line_end = i + 1;
+
+            while (line_end < tokens.size() && !tokens[line_end].first_on_line())
+            {
+                line_end++;
+            }
+
+            if (tokens[i].first_on_line() && IsDirective(tokens[i].type()))
+                ProcessDirective(&tokens[i], tokens.data() + line_end, path, file_index, depth, conditionals);
+
+            i = line_end;
+        }
+
+        if (!conditionals.empty())
+            std::cerr << path << ": warning: unterminated conditional directive" << std::endl;
+    }
+
+    void ConstantDatabase::ProcessDirective(const Token *directive, const Token *end, const std::string &path, int file_index, int depth, std::vector<Conditional> &conditionals)
+    {
+        const Token *args = directive + 1;
+        bool active = conditionals.empty() || conditionals.back().active;
+
+        switch (directive->type())
+        {
+        case Token::Type::kIfDef:
+        case Token::Type::kIfNDef:
+        {
+            bool condition = false;
+            if (active)
+            {
+                bool defined = args != end && args->type() == Token::Type::kIdentifier && macros_.count(args->string_value());
+                condition = defined == (directive->type() == Token::Type::kIfDef);
+            }
+            conditionals.push_back({condition, condition, active});
+            return;
+        }
+        case Token::Type::kIf:
+        {
+            bool condition = active && EvaluateCondition(args, end);
+            conditionals.push_back({condition, condition, active});
+            return;
+        }
+        case Token::Type::kElif:
+        case Token::Type::kElse:
+        {
+            if (conditionals.empty())
+            {
+                std::cerr << path << ":" << directive->line() << ": warning: #else or #elif without #if" << std::endl;
+                return;
+            }
+            Conditional &conditional = conditionals.back();
+            bool condition = conditional.parent_active && !conditional.taken;
+            if (condition && directive->type() == Token::Type::kElif)
+                condition = EvaluateCondition(args, end);
+            conditional.active = condition;
+            conditional.taken = conditional.taken || condition;
+            return;
+        }
+        case Token::Type::kEndIf:
+            if (conditionals.empty())
+                std::cerr << path << ":" << directive->line() << ": warning: #endif without #if" << std::endl;
+            else
+                conditionals.pop_back();
+            return;
+        default:
+            break;
+        }
+
+        if (!active)
+            return;
+
+        switch (directive->type())
+        {
+        case Token::Type::kDefine:
+            AddMacro(args, end, file_index, directive->line());
+            break;
+        case Token::Type::kUndef:
+            if (args != end && args->type() == Token::Type::kIdentifier)
+            {
+                macros_.erase(args->string_value());
+                generation_++;
+            }
+            break;
+        case Token::Type::kInclude:
+        {
+            std::string name;
+            bool quoted = args != end && args->type() == Token::Type::kString;
+
+            if (quoted)
+            {
+                name = args->string_value();
+            }
+            else if (args != end && args->type() == Token::Type::kLessThan)
+            {
+                for (const Token *pos = args + 1; pos != end && pos->type() != Token::Type::kGreaterThan; pos++)
+                {
+                    name += pos->Spelling();
+                }
+            }
+
+            std::string include_path = FindInclude(name, GetDir(path), quoted);
+
+            // System headers don't define anything we're after.
+            if (!include_path.empty())
+                ProcessHeader(include_path, depth + 1);
+            else if (quoted)
+                std::cerr << path << ":" << directive->line() << ": warning: can't find \"" << name << "\"" << std::endl;
+            break;
+        }
+        case Token::Type::kDirective:
+            if (directive->string_value() == "pragma" && args != end && args->type() == Token::Type::kIdentifier && args->string_value() == "once")
+                pragma_once_.insert(path);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void ConstantDatabase::AddMacro(const Token *begin, const Token *end, int file_index, int line)
+    {
+        if (begin == end || begin->type() != Token::Type::kIdentifier)
+            return;
+
+        Macro macro;
+        const Token *pos = begin + 1;
+
+        macro.file = file_index;
+        macro.line = line;
+
+        if (pos != end && pos->type() == Token::Type::kOpenParen && !pos->leading_space())
+        {
+            bool after_param = false;
+
+            macro.function_like = true;
+
+            for (pos++; pos != end && pos->type() != Token::Type::kCloseParen; pos++)
+            {
+                if (pos->type() == Token::Type::kIdentifier)
+                {
+                    macro.params.push_back(pos->string_value());
+                    after_param = true;
+                }
+                else if (pos->type() == Token::Type::kOther && pos->string_value() == ".")
+                {
+                    // "..." names its arguments __VA_ARGS__, and "args..." args.
+                    if (!macro.variadic && !after_param)
+                        macro.params.push_back("__VA_ARGS__");
+                    macro.variadic = true;
+                }
+                else
+                {
+                    after_param = false;
+                }
+            }
+
+            if (pos != end)
+                pos++;
+        }
+
+        macro.body.assign(pos, end);
+        macro.atomic = !macro.function_like && IsAtomic(macro.body);
+        macros_[begin->string_value()] = std::move(macro);
+        generation_++;
+    }
+
+    void ConstantDatabase::PasteTokens(std::vector<Token> &tokens, const Token &rhs)
+    {
+        if (tokens.empty())
+        {
+            tokens.push_back(rhs);
+            return;
+        }
+
+        std::vector<Token> pasted = lexer_.LexString(tokens.back().Spelling() + rhs.Spelling());
+
+        if (pasted.size() == 1)
+            tokens.back() = pasted[0];
+        else
+            tokens.push_back(rhs);
+    }
+
+    // Expands the macros in [begin, end) into out. Object-like macros that are
+    // atomic are left for the evaluator, which looks up their memoized values.
+    void ConstantDatabase::Expand(const Token *begin, const Token *end, bool is_condition, std::vector<Token> &out)
+    {
+        const Token *pos = begin;
+
+        while (pos != end)
+        {
+            if (pos->type() != Token::Type::kIdentifier)
+            {
+                out.push_back(*pos++);
+                continue;
+            }
+
+            const std::string &name = pos->string_value();
+
+            if (is_condition && name == "defined")
+            {
+                pos++;
+                bool paren = pos != end && pos->type() == Token::Type::kOpenParen;
+                if (paren)
+                    pos++;
+                bool defined = pos != end && pos->type() == Token::Type::kIdentifier && macros_.count(pos->string_value());
+                if (pos != end)
+                    pos++;
+                if (paren && pos != end && pos->type() == Token::Type::kCloseParen)
+                    pos++;
+                out.push_back(Token(Token::Type::kNumber, defined ? 1 : 0, defined ? "1" : "0"));
+                continue;
+            }
+
+            auto it = macros_.find(name);
+
+            if (it == macros_.end() || expanding_.count(name) || it->second.atomic)
+            {
+                out.push_back(*pos++);
+                continue;
+            }
+
+            const Macro &macro = it->second;
+
+            if (macro.function_like)
+            {
+                if (pos + 1 == end || pos[1].type() != Token::Type::kOpenParen)
+                    out.push_back(*pos++);
+                else
+                    pos = ExpandFunction(macro, name, pos + 1, end, is_condition, out);
+                continue;
+            }
+
+            expanding_.insert(name);
+            Expand(macro.body.data(), macro.body.data() + macro.body.size(), is_condition, out);
+            expanding_.erase(name);
+            pos++;
+        }
+    }
+
+    // Expands a call to a function-like macro, given the position of its
+    // opening parenthesis. Returns the position after the call.
+    const Token *ConstantDatabase::ExpandFunction(const Macro &macro, const std::string &name, const Token *open, const Token *end, bool is_condition, std::vector<Token> &out)
+    {
+        std::vector<std::vector<Token>> args(1);
+        const Token *pos = open + 1;
+        int depth = 0;
+
+        for (; pos != end; pos++)
+        {
+            if (pos->type() == Token::Type::kOpenParen)
+            {
+                depth++;
+            }
+            else if (pos->type() == Token::Type::kCloseParen)
+            {
+                if (depth-- == 0)
+                    break;
+            }
+            else if (pos->type() == Token::Type::kComma && depth == 0 && !(macro.variadic && args.size() == macro.params.size()))
+            {
+                args.emplace_back();
+                continue;
+            }
+            args.back().push_back(*pos);
+        }
+
+        // An unterminated call is left as it is.
+        if (pos == end)
+        {
+            out.push_back(open[-1]);
+            return open;
+        }
+
+        args.resize(macro.params.size());
+
+        auto find_param = [&macro](const Token &token) {
+            if (token.type() != Token::Type::kIdentifier)
+                return -1;
+            auto param = std::find(macro.params.begin(), macro.params.end(), token.string_value());
+            return param == macro.params.end() ? -1 : static_cast<int>(param - macro.params.begin());
+        };
+
+        const std::vector<Token> &body = macro.body;
+        std::vector<Token> result;
+
+        for (std::size_t i = 0; i < body.size(); i++)
+        {
+            int param = find_param(body[i]);
+
+            if (body[i].type() == Token::Type::kHash && i + 1 < body.size() && find_param(body[i + 1]) >= 0)
+            {
+                std::string text;
+                for (const Token &token : args[find_param(body[++i])])
+                {
+                    if (!text.empty() && token.leading_space())
+                        text += ' ';
+                    text += token.Spelling();
+                }
+                result.push_back(Token(Token::Type::kString, text));
+            }
+            else if (body[i].type() == Token::Type::kHashHash && i + 1 < body.size())
+            {
+                const Token &rhs = body[++i];
+                int rhs_param = find_param(rhs);
+
+                if (rhs_param < 0)
+                {
+                    PasteTokens(result, rhs);
+                }
+                else if (!args[rhs_param].empty())
+                {
+                    PasteTokens(result, args[rhs_param][0]);
+                    result.insert(result.end(), args[rhs_param].begin() + 1, args[rhs_param].end());
+                }
+            }
+            else if (param >= 0)
+            {
+                // Arguments are expanded first, unless they're pasted.
+                const std::vector<Token> &arg = args[param];
+                if (i + 1 < body.size() && body[i + 1].type() == Token::Type::kHashHash)
+                    result.insert(result.end(), arg.begin(), arg.end());
+                else
+                    Expand(arg.data(), arg.data() + arg.size(), is_condition, result);
+            }
+            else
+            {
+                result.push_back(body[i]);
+            }
+        }
+
+        expanding_.insert(name);
+        Expand(result.data(), result.data() + result.size(), is_condition, out);
+        expanding_.erase(name);
+
+        return pos + 1;
+    }
+
+    bool ConstantDatabase::EvaluateTokens(const std::vector<Token> &tokens, bool is_condition, long long &value)
+    {
+        // In #if, identifiers that are left after expansion count as 0.
+        ExpressionEvaluator evaluator([this, is_condition](const std::string &name, long long &result) {
+            if (Evaluate(name, result))
+                return true;
+            result = 0;
+            return is_condition;
+        });
+
+        return evaluator.Evaluate(tokens.data(), tokens.data() + tokens.size(), value);
+    }
+
+    bool ConstantDatabase::EvaluateCondition(const Token *begin, const Token *end)
+    {
+        std::vector<Token> expanded;
+        long long value;
+
+        Expand(begin, end, true, expanded);
+        return EvaluateTokens(expanded, true, value) && value != 0;
+    }
+
+    // Evaluates an object-like macro as it's defined right now. The value is
+    // remembered until the next #define or #undef.
+    bool ConstantDatabase::Evaluate(const std::string &name, long long &value)
+    {
+        auto it = macros_.find(name);
+
+        if (it == macros_.end() || it->second.function_like)
+            return false;
+
+        Macro &macro = it->second;
+
+        if (macro.generation == generation_ && (macro.state == Macro::State::kResolved || macro.state == Macro::State::kFailed))
+        {
+            value = macro.value;
+            return macro.state == Macro::State::kResolved;
+        }
+
+        // A macro that refers to itself isn't a constant.
+        if (macro.state == Macro::State::kEvaluating)
+            return false;
+
+        std::vector<Token> expanded;
+
+        macro.state = Macro::State::kEvaluating;
+        expanding_.insert(name);
+        Expand(macro.body.data(), macro.body.data() + macro.body.size(), false, expanded);
+        expanding_.erase(name);
+
+        bool resolved = EvaluateTokens(expanded, false, value);
+
+        macro.state = resolved ? Macro::State::kResolved : Macro::State::kFailed;
+        macro.generation = generation_;
+        macro.value = value;
+        return resolved;
+    }
+
+    // Returns every object-like macro that evaluates to an integer, sorted by
+    // name. The rest (strings, expressions using variables, ...) are left out.
+    std::vector<Constant> ConstantDatabase::Resolve()
+    {
+        std::vector<std::string> names;
+        std::vector<Constant> constants;
+
+        for (const auto &macro : macros_)
+        {
+            if (!macro.second.function_like)
+                names.push_back(macro.first);
+        }
+
+        std::sort(names.begin(), names.end());
+
+        for (const std::string &name : names)
+        {
+            long long value;
+            if (Evaluate(name, value))
+            {
+                const Macro &macro = macros_[name];
+                constants.emplace_back(name, static_cast<int>(value), macro.file, macro.line);
+            }
+        }
+
+        return constants;
+    }
+
+} // namespace core
@@ -0,0 +1,131 @@
+#ifndef INCLUDE_CORE_CONSTANT_DATABASE_H
+#define INCLUDE_CORE_CONSTANT_DATABASE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "lexer.h"
+
+namespace core
+{
+    class Constant
+    {
+    public:
+        Constant(std::string name, int value, int file, int line) : name_(name), value_(value), file_(file), line_(line) {}
+
+        const std::string &name() const { return name_; }
+        int value() const { return value_; }
+        int file() const { return file_; } // index into files(), or -1 for the command line
+        int line() const { return line_; }
+
+    private:
+        std::string name_;
+        int value_;
+        int file_;
+        int line_;
+    };
+
+    class SourceFile
+    {
+    public:
+        SourceFile(std::string path, uint64_t hash) : path_(path), hash_(hash) {}
+
+        const std::string &path() const { return path_; }
+        uint64_t hash() const { return hash_; }
+
+    private:
+        std::string path_;
+        uint64_t hash_;
+    };
+
+    // Runs headers through enough of the preprocessor to know what every macro
+    // expands to: #include, #if and friends, #define and #undef, including
+    // function-like macros, # and ##. Macros are only evaluated when asked
+    // for, and each value is remembered until a later #define or #undef could
+    // change it. Headers are lexed once per distinct content, however many
+    // times and under however many paths they are included.
+    class ConstantDatabase
+    {
+    public:
+        ConstantDatabase() = default;
+
+        void AddIncludeDir(const std::string &dir);
+        void Define(const std::string &name, const std::string &value);
+        bool ProcessFile(const std::string &path);
+
+        bool Evaluate(const std::string &name, long long &value);
+        std::vector<Constant> Resolve();
+
+        const std::vector<SourceFile> &files() const { return files_; }
+
+    private:
+        struct Header
+        {
+            std::vector<Token> tokens;
+            std::string guard; // the macro an include guard wraps the whole file in
+        };
+
+        struct Macro
+        {
+            bool function_like = false;
+            bool variadic = false;
+            bool atomic = false;
+            std::vector<std::string> params;
+            std::vector<Token> body;
+            int file = -1;
+            int line = 0;
+
+            enum class State
+            {
+                kUnknown,
+                kEvaluating,
+                kResolved,
+                kFailed,
+            };
+            State state = State::kUnknown;
+            unsigned generation = 0;
+            long long value = 0;
+        };
+
+        struct Conditional
+        {
+            bool active;    // the lines in the current branch are processed
+            bool taken;     // some branch has been processed already
+            bool parent_active;
+        };
+
+        std::shared_ptr<const Header> LoadHeader(const std::string &path, int &file_index);
+        std::string FindInclude(const std::string &name, const std::string &dir, bool quoted) const;
+        void ProcessHeader(const std::string &path, int depth);
+        void ProcessDirective(const Token *directive, const Token *end, const std::string &path, int file_index, int depth, std::vector<Conditional> &conditionals);
+        void AddMacro(const Token *begin, const Token *end, int file_index, int line);
+
+        bool EvaluateCondition(const Token *begin, const Token *end);
+        bool EvaluateTokens(const std::vector<Token> &tokens, bool is_condition, long long &value);
+        void Expand(const Token *begin, const Token *end, bool is_condition, std::vector<Token> &out);
+        const Token *ExpandFunction(const Macro &macro, const std::string &name, const Token *open, const Token *end, bool is_condition, std::vector<Token> &out);
+        void PasteTokens(std::vector<Token> &tokens, const Token &rhs);
+
+        static uint64_t HashContent(const char *data, std::size_t size);
+        static bool IsAtomic(const std::vector<Token> &body);
+
+        std::vector<std::string> include_dirs_;
+        std::unordered_map<std::string, Macro> macros_;
+        std::unordered_set<std::string> expanding_;
+        unsigned generation_ = 1;
+
+        std::vector<SourceFile> files_;
+        std::unordered_map<std::string, int> file_indexes_;
+        std::unordered_map<uint64_t, std::shared_ptr<const Header>> headers_by_hash_;
+        std::unordered_map<std::string, std::shared_ptr<const Header>> headers_by_path_;
+        std::unordered_set<std::string> pragma_once_;
+        Lexer lexer_;
+    };
+} // namespace core
+
+#endif // INCLUDE_CORE_CONSTANT_DATABASE_H
@@ -0,0 +1,281 @@
+#include "constant_index.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "mapped_file.h"
+
+namespace core
+{
+
+    static const char kMagic[4] = {'C', 'D', 'B', 'X'};
+    static const uint32_t kVersion = 1;
+    static const std::size_t kHeaderSize = 32;
+    static const std::size_t kFileSize = 16;
+    static const std::size_t kConstantSize = 16;
+
+    static uint32_t HashName(const char *name)
+    {
+        uint32_t hash = 2166136261u;
+
+        while (*name != 0)
+            hash = (hash ^ static_cast<unsigned char>(*name++)) * 16777619u;
+
+        return hash;
+    }
+
+    static uint64_t HashBytes(uint64_t hash, const char *data, std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; i++)
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+
+        return hash;
+    }
+
+    static void PutU32(std::string &out, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            out += static_cast<char>(value >> (i * 8));
+    }
+
+    static void PutU64(std::string &out, uint64_t value)
+    {
+        PutU32(out, static_cast<uint32_t>(value));
+        PutU32(out, static_cast<uint32_t>(value >> 32));
+    }
+
+    static uint32_t GetU32(const uint8_t *data)
+    {
+        return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+    }
+
+    static uint64_t GetU64(const uint8_t *data)
+    {
+        return GetU32(data) | (static_cast<uint64_t>(GetU32(data + 4)) << 32);
+    }
+
+    // The command-line arguments that affect what goes into the index.
+    uint64_t ConstantIndex::HashConfig(const std::vector<std::string> &args)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+
+        for (const std::string &arg : args)
+            hash = HashBytes(hash, arg.c_str(), arg.length() + 1);
+
+        return hash;
+    }
+
+    bool ConstantIndex::Write(const std::string &path, uint64_t config_hash, const std::vector<SourceFile> &files, const std::vector<Constant> &constants)
+    {
+        std::string strings;
+        std::string out;
+
+        // Keep the table at most half full.
+        uint32_t slot_count = 1;
+        while (slot_count < constants.size() * 2)
+            slot_count *= 2;
+
+        std::vector<uint32_t> slots(slot_count, 0);
+
+        out.append(kMagic, 4);
+        PutU32(out, kVersion);
+        PutU64(out, config_hash);
+        PutU32(out, files.size());
+        PutU32(out, constants.size());
+        PutU32(out, slot_count);
+
+        std::string body;
+
+        for (const SourceFile &file : files)
+        {
+            PutU32(body, strings.size());
+            PutU32(body, 0);
+            PutU64(body, file.hash());
+            strings += file.path() + '\0';
+        }
+
+        for (std::size_t i = 0; i < constants.size(); i++)
+        {
+            const Constant &constant = constants[i];
+            uint32_t slot = HashName(constant.name().c_str()) & (slot_count - 1);
+
+            while (slots[slot] != 0)
+                slot = (slot + 1) & (slot_count - 1);
+
+            slots[slot] = i + 1;
+
+            PutU32(body, strings.size());
+            PutU32(body, static_cast<uint32_t>(constant.value()));
+            PutU32(body, static_cast<uint32_t>(constant.file()));
+            PutU32(body, constant.line());
+            strings += constant.name() + '\0';
+        }
+
+        for (uint32_t slot : slots)
+            PutU32(body, slot);
+
+        PutU32(out, strings.size());
+        out += body;
+        out += strings;
+
+        std::string temp_path = path + ".tmp";
+        std::ofstream stream(temp_path, std::ios::binary);
+
+        stream.write(out.data(), out.size());
+        stream.close();
+
+        if (!stream || std::rename(temp_path.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temp_path.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    bool ConstantIndex::Load(const std::string &path)
+    {
+        std::ifstream stream(path, std::ios::binary);
+
+        if (!stream)
+            return false;
+
+        data_.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+
+        if (data_.size() < kHeaderSize || std::memcmp(data_.data(), kMagic, 4) != 0 || GetU32(&data_[4]) != kVersion)
+            return false;
+
+        config_hash_ = GetU64(&data_[8]);
+        file_count_ = GetU32(&data_[16]);
+        constant_count_ = GetU32(&data_[20]);
+        slot_count_ = GetU32(&data_[24]);
+        string_size_ = GetU32(&data_[28]);
+
+        uint64_t expected_size = kHeaderSize + static_cast<uint64_t>(file_count_) * kFileSize + static_cast<uint64_t>(constant_count_) * kConstantSize + static_cast<uint64_t>(slot_count_) * 4 + string_size_;
+
+        if (data_.size() != expected_size || slot_count_ == 0 || (slot_count_ & (slot_count_ - 1)) != 0 || slot_count_ < constant_count_)
+            return false;
+
+        files_ = &data_[kHeaderSize];
+        constants_ = files_ + file_count_ * kFileSize;
+        slots_ = constants_ + constant_count_ * kConstantSize;
+        strings_ = reinterpret_cast<const char *>(slots_ + slot_count_ * 4);
+
+        if (string_size_ != 0 && strings_[string_size_ - 1] != '\0')
+            return false;
+
+        for (uint32_t i = 0; i < file_count_; i++)
+        {
+            if (GetU32(files_ + i * kFileSize) >= string_size_)
+                return false;
+        }
+
+        for (uint32_t i = 0; i < constant_count_; i++)
+        {
+            const uint8_t *entry = constants_ + i * kConstantSize;
+            uint32_t file = GetU32(entry + 8);
+
+            if (GetU32(entry) >= string_size_ || (file >= file_count_ && file != UINT32_MAX))
+                return false;
+        }
+
+        for (uint32_t i = 0; i < slot_count_; i++)
+        {
+            if (GetU32(slots_ + i * 4) > constant_count_)
+                return false;
+        }
+
+        return true;
+    }
+
+    // Rehashes every file the index was built from.
+    bool ConstantIndex::IsUpToDate(uint64_t config_hash) const
+    {
+        if (config_hash != config_hash_)
+            return false;
+
+        for (uint32_t i = 0; i < file_count_; i++)
+        {
+            MappedFile file(GetFilePath(i));
+
+            if (!file.is_open())
+                return false;
+
+            if (HashBytes(14695981039346656037ULL, file.data(), file.size()) != GetU64(files_ + i * kFileSize + 8))
+                return false;
+        }
+
+        return true;
+    }
+
+    const char *ConstantIndex::GetString(uint32_t offset) const
+    {
+        return strings_ + offset;
+    }
+
+    const uint8_t *ConstantIndex::FindEntry(const std::string &name) const
+    {
+        if (slot_count_ == 0)
+            return nullptr;
+
+        uint32_t slot = HashName(name.c_str()) & (slot_count_ - 1);
+
+        for (uint32_t probes = 0; probes < slot_count_; probes++)
+        {
+            uint32_t index = GetU32(slots_ + slot * 4);
+
+            if (index == 0)
+                return nullptr;
+
+            const uint8_t *entry = constants_ + (index - 1) * kConstantSize;
+
+            if (name == GetString(GetU32(entry)))
+                return entry;
+
+            slot = (slot + 1) & (slot_count_ - 1);
+        }
+
+        return nullptr;
+    }
+
+    bool ConstantIndex::Find(const std::string &name, int &value) const
+    {
+        const uint8_t *entry = FindEntry(name);
+
+        if (entry == nullptr)
+            return false;
+
+        value = static_cast<int>(GetU32(entry + 4));
+        return true;
+    }
+
+    bool ConstantIndex::FindLocation(const std::string &name, std::string &file, int &line) const
+    {
+        const uint8_t *entry = FindEntry(name);
+
+        if (entry == nullptr)
+            return false;
+
+        file = GetFilePath(static_cast<int>(GetU32(entry + 8)));
+        line = static_cast<int>(GetU32(entry + 12));
+        return true;
+    }
+
+    Constant ConstantIndex::GetConstant(uint32_t index) const
+    {
+        const uint8_t *entry = constants_ + index * kConstantSize;
+
+        return Constant(GetString(GetU32(entry)), static_cast<int>(GetU32(entry + 4)), static_cast<int>(GetU32(entry + 8)), static_cast<int>(GetU32(entry + 12)));
+    }
+
+    std::string ConstantIndex::GetFilePath(int index) const
+    {
+        if (index < 0 || static_cast<uint32_t>(index) >= file_count_)
+            return "<command line>";
+
+        return GetString(GetU32(files_ + index * kFileSize));
+    }
+
+} // namespace core
@@ -0,0 +1,59 @@
+#ifndef INCLUDE_CORE_CONSTANT_INDEX_H
+#define INCLUDE_CORE_CONSTANT_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "constant_database.h"
+
+namespace core
+{
+    // A resolved symbol table on disk. Looking a name up is a single probe
+    // sequence in a hash table, so other tools can load the index and resolve
+    // names without running the preprocessor. The index also records every
+    // file that went into it with its content hash, so that it can tell when
+    // it needs to be built again.
+    //
+    // Layout (all integers little-endian):
+    //   header:    "CDBX", version, config hash (u64), file count,
+    //              constant count, slot count, string table size
+    //   files:     path (string offset), pad, content hash (u64)
+    //   constants: name (string offset), value (i32), file index, line
+    //   slots:     constant index + 1, or 0 for an empty slot
+    //   strings:   NUL-terminated
+    class ConstantIndex
+    {
+    public:
+        static bool Write(const std::string &path, uint64_t config_hash, const std::vector<SourceFile> &files, const std::vector<Constant> &constants);
+
+        bool Load(const std::string &path);
+        bool IsUpToDate(uint64_t config_hash) const;
+
+        bool Find(const std::string &name, int &value) const;
+        bool FindLocation(const std::string &name, std::string &file, int &line) const;
+
+        uint32_t constant_count() const { return constant_count_; }
+        Constant GetConstant(uint32_t index) const;
+        std::string GetFilePath(int index) const;
+
+        static uint64_t HashConfig(const std::vector<std::string> &args);
+
+    private:
+        const uint8_t *FindEntry(const std::string &name) const;
+        const char *GetString(uint32_t offset) const;
+
+        std::vector<uint8_t> data_;
+        uint64_t config_hash_ = 0;
+        uint32_t file_count_ = 0;
+        uint32_t constant_count_ = 0;
+        uint32_t slot_count_ = 0;
+        uint32_t string_size_ = 0;
+        const uint8_t *files_ = nullptr;
+        const uint8_t *constants_ = nullptr;
+        const uint8_t *slots_ = nullptr;
+        const char *strings_ = nullptr;
+    };
+} // namespace core
+
+#endif // INCLUDE_CORE_CONSTANT_INDEX_H
@@ -0,0 +1,247 @@
+#include "expression.h"
+
+namespace core
+{
+
+    // Higher binds tighter. 0 means the token isn't a binary operator.
+    int ExpressionEvaluator::GetPrecedence(Token::Type type)
+    {
+        switch (type)
+        {
+        case Token::Type::kTimes:
+        case Token::Type::kDivide:
+        case Token::Type::kModulo:
+            return 10;
+        case Token::Type::kPlus:
+        case Token::Type::kMinus:
+            return 9;
+        case Token::Type::kLeftShift:
+        case Token::Type::kRightShift:
+            return 8;
+        case Token::Type::kLessThan:
+        case Token::Type::kGreaterThan:
+        case Token::Type::kLessOrEqual:
+        case Token::Type::kGreaterOrEqual:
+            return 7;
+        case Token::Type::kEqual:
+        case Token::Type::kNotEqual:
+            return 6;
+        case Token::Type::kBitAnd:
+            return 5;
+        case Token::Type::kBitXor:
+            return 4;
+        case Token::Type::kBitOr:
+            return 3;
+        case Token::Type::kLogicalAnd:
+            return 2;
+        case Token::Type::kLogicalOr:
+            return 1;
+        default:
+            return 0;
+        }
+    }
+
+    bool ExpressionEvaluator::Accept(Token::Type type)
+    {
+        if (pos_ != end_ && pos_->type() == type)
+        {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+
+    bool ExpressionEvaluator::Evaluate(const Token *begin, const Token *end, long long &value)
+    {
+        pos_ = begin;
+        end_ = end;
+        unevaluated_ = 0;
+
+        return ParseConditional(value) && pos_ == end_;
+    }
+
+    bool ExpressionEvaluator::ParseConditional(long long &value)
+    {
+        long long condition;
+
+        if (!ParseBinary(1, condition))
+            return false;
+
+        if (!Accept(Token::Type::kQuestion))
+        {
+            value = condition;
+            return true;
+        }
+
+        long long if_true, if_false;
+
+        unevaluated_ += !condition;
+        bool ok = ParseConditional(if_true);
+        unevaluated_ -= !condition;
+
+        if (!ok || !Accept(Token::Type::kColon))
+            return false;
+
+        unevaluated_ += !!condition;
+        ok = ParseConditional(if_false);
+        unevaluated_ -= !!condition;
+
+        value = condition ? if_true : if_false;
+        return ok;
+    }
+
+    bool ExpressionEvaluator::ParseBinary(int min_precedence, long long &value)
+    {
+        if (!ParseUnary(value))
+            return false;
+
+        while (pos_ != end_)
+        {
+            Token::Type op = pos_->type();
+            int precedence = GetPrecedence(op);
+
+            if (precedence < min_precedence || precedence == 0)
+                break;
+
+            pos_++;
+
+            // The right side of && and || is only evaluated if it matters.
+            bool skip = (op == Token::Type::kLogicalAnd && !value) || (op == Token::Type::kLogicalOr && value);
+            long long rhs;
+
+            unevaluated_ += skip;
+            bool ok = ParseBinary(precedence + 1, rhs);
+            unevaluated_ -= skip;
+
+            if (!ok || !Apply(op, value, rhs, value))
+                return false;
+        }
+
+        return true;
+    }
+
+    bool ExpressionEvaluator::ParseUnary(long long &value)
+    {
+        if (Accept(Token::Type::kMinus))
+        {
+            if (!ParseUnary(value))
+                return false;
+            value = -value;
+            return true;
+        }
+        if (Accept(Token::Type::kPlus))
+        {
+            return ParseUnary(value);
+        }
+        if (Accept(Token::Type::kBitNot))
+        {
+            if (!ParseUnary(value))
+                return false;
+            value = ~value;
+            return true;
+        }
+        if (Accept(Token::Type::kLogicalNot))
+        {
+            if (!ParseUnary(value))
+                return false;
+            value = !value;
+            return true;
+        }
+
+        return ParsePrimary(value);
+    }
+
+    bool ExpressionEvaluator::ParsePrimary(long long &value)
+    {
+        if (pos_ == end_)
+            return false;
+
+        const Token &token = *pos_++;
+
+        switch (token.type())
+        {
+        case Token::Type::kNumber:
+            value = static_cast<unsigned int>(token.int_value());
+            return true;
+        case Token::Type::kIdentifier:
+            if (resolver_(token.string_value(), value))
+                return true;
+            value = 0;
+            return unevaluated_ > 0;
+        case Token::Type::kOpenParen:
+            return ParseConditional(value) && Accept(Token::Type::kCloseParen);
+        default:
+            return false;
+        }
+    }
+
+    bool ExpressionEvaluator::Apply(Token::Type op, long long lhs, long long rhs, long long &value)
+    {
+        switch (op)
+        {
+        case Token::Type::kTimes:
+            value = lhs * rhs;
+            return true;
+        case Token::Type::kDivide:
+        case Token::Type::kModulo:
+            if (rhs == 0)
+            {
+                value = 0;
+                return unevaluated_ > 0;
+            }
+            value = op == Token::Type::kDivide ? lhs / rhs : lhs % rhs;
+            return true;
+        case Token::Type::kPlus:
+            value = lhs + rhs;
+            return true;
+        case Token::Type::kMinus:
+            value = lhs - rhs;
+            return true;
+        case Token::Type::kLeftShift:
+        case Token::Type::kRightShift:
+            if (rhs < 0 || rhs >= 64)
+            {
+                value = 0;
+                return unevaluated_ > 0;
+            }
+            value = op == Token::Type::kLeftShift ? static_cast<long long>(static_cast<unsigned long long>(lhs) << rhs) : lhs >> rhs;
+            return true;
+        case Token::Type::kLessThan:
+            value = lhs < rhs;
+            return true;
+        case Token::Type::kGreaterThan:
+            value = lhs > rhs;
+            return true;
+        case Token::Type::kLessOrEqual:
+            value = lhs <= rhs;
+            return true;
+        case Token::Type::kGreaterOrEqual:
+            value = lhs >= rhs;
+            return true;
+        case Token::Type::kEqual:
+            value = lhs == rhs;
+            return true;
+        case Token::Type::kNotEqual:
+            value = lhs != rhs;
+            return true;
+        case Token::Type::kBitAnd:
+            value = lhs & rhs;
+            return true;
+        case Token::Type::kBitXor:
+            value = lhs ^ rhs;
+            return true;
+        case Token::Type::kBitOr:
+            value = lhs | rhs;
+            return true;
+        case Token::Type::kLogicalAnd:
+            value = lhs && rhs;
+            return true;
+        case Token::Type::kLogicalOr:
+            value = lhs || rhs;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+} // namespace core
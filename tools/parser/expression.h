@@ -0,0 +1,44 @@
+#ifndef INCLUDE_CORE_EXPRESSION_H
+#define INCLUDE_CORE_EXPRESSION_H
+
+#include <functional>
+#include <string>
+
+#include "lexer.h"
+
+namespace core
+{
+    // Evaluates a C integer constant expression, such as a #define's
+    // replacement list or an #if condition, with every operator C allows in
+    // one. Identifiers are handed to the resolver, and one it can't resolve
+    // makes the whole expression fail.
+    class ExpressionEvaluator
+    {
+    public:
+        typedef std::function<bool(const std::string &name, long long &value)> Resolver;
+
+        explicit ExpressionEvaluator(const Resolver &resolver) : resolver_(resolver) {}
+
+        bool Evaluate(const Token *begin, const Token *end, long long &value);
+
+    private:
+        bool ParseConditional(long long &value);
+        bool ParseBinary(int min_precedence, long long &value);
+        bool ParseUnary(long long &value);
+        bool ParsePrimary(long long &value);
+        bool Apply(Token::Type op, long long lhs, long long rhs, long long &value);
+        bool Accept(Token::Type type);
+
+        static int GetPrecedence(Token::Type type);
+
+        Resolver resolver_;
+        const Token *pos_ = nullptr;
+        const Token *end_ = nullptr;
+
+        // Inside the side of && || or ?: that C doesn't evaluate, errors like
+        // dividing by zero don't count.
+        int unevaluated_ = 0;
+    };
+} // namespace core
+
+#endif // INCLUDE_CORE_EXPRESSION_H
@@ -0,0 +1,483 @@
+#include "legacy_lexer.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace core
+{
+
+    bool LegacyLexer::IsNumber()
+    {
+        char c = Peek();
+        return (c >= '0' && c <= '9');
+    }
+
+    bool LegacyLexer::IsWhitespace()
+    {
+        char c = Peek();
+        return (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v');
+    }
+
+    bool LegacyLexer::IsHexAlpha()
+    {
+        char c = Peek();
+        return ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'));
+    }
+
+    bool LegacyLexer::IsAlpha()
+    {
+        char c = Peek();
+        return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_');
+    }
+
+    bool LegacyLexer::IsAlphaNumber()
+    {
+        return IsAlpha() || IsNumber();
+    };
+
+    char LegacyLexer::Peek()
+    {
+        return index_ < data_.length() ? data_[index_] : '\0';
+    }
+
+    char LegacyLexer::PeekNext()
+    {
+        return index_ + 1 < data_.length() ? data_[index_ + 1] : '\0';
+    }
+
+    char LegacyLexer::Next()
+    {
+        char c = Peek();
+        if (c == '\n')
+            line_++;
+        if (index_ < data_.length())
+            index_++;
+        return c;
+    }
+
+    // Skips whitespace, comments and escaped newlines, and returns whether there
+    // was anything to skip. An unescaped newline starts a new logical line.
+    bool LegacyLexer::SkipWhitespaceAndComments()
+    {
+        bool skipped = false;
+
+        while (index_ < data_.length())
+        {
+            if (Peek() == '\n')
+            {
+                at_line_start_ = true;
+            }
+            else if (Peek() == '\\' && (PeekNext() == '\n' || (PeekNext() == '\r' && index_ + 2 < data_.length() && data_[index_ + 2] == '\n')))
+            {
+                Next();
+                if (Peek() == '\r')
+                    Next();
+            }
+            else if (Peek() == '/' && PeekNext() == '/')
+            {
+                while (index_ < data_.length() && Peek() != '\n')
+                    Next();
+                skipped = true;
+                continue;
+            }
+            else if (Peek() == '/' && PeekNext() == '*')
+            {
+                Next();
+                Next();
+                while (index_ < data_.length() && !(Peek() == '*' && PeekNext() == '/'))
+                    Next();
+                Next(); // last *
+                Next(); // last /
+                skipped = true;
+                continue;
+            }
+            else if (!IsWhitespace())
+            {
+                break;
+            }
+
+            Next();
+            skipped = true;
+        }
+
+        return skipped;
+    }
+
+    Token LegacyLexer::ConsumeIdentifier()
+    {
+        std::string identifer = "";
+
+        while (IsAlphaNumber())
+        {
+            identifer += Next();
+        }
+
+        return Token(Token::Type::kIdentifier, identifer);
+    }
+
+    // Reads a whole preprocessing number, so that e.g. "0x10u" or "1e5" is never
+    // split, and evaluates it as a C integer constant. Anything that isn't one
+    // (like a floating-point number) becomes an unknown token.
+    Token LegacyLexer::ConsumeNumber()
+    {
+        std::string spelling = "";
+
+        while (IsAlphaNumber() || Peek() == '.')
+        {
+            spelling += Next();
+        }
+
+        std::size_t digits_start = 0;
+        int base = 10;
+
+        if (spelling.length() > 1 && spelling[0] == '0')
+        {
+            if (spelling[1] == 'x' || spelling[1] == 'X')
+            {
+                base = 16;
+                digits_start = 2;
+            }
+            else if (spelling[1] == 'b' || spelling[1] == 'B')
+            {
+                base = 2;
+                digits_start = 2;
+            }
+            else
+            {
+                base = 8;
+            }
+        }
+
+        char *end;
+        unsigned long long value = std::strtoull(spelling.c_str() + digits_start, &end, base);
+        std::size_t suffix_start = end - spelling.c_str();
+
+        bool valid = suffix_start > digits_start;
+        for (std::size_t i = suffix_start; i < spelling.length(); i++)
+        {
+            char c = spelling[i];
+            if (c != 'u' && c != 'U' && c != 'l' && c != 'L')
+                valid = false;
+        }
+
+        if (!valid)
+        {
+            return Token(Token::Type::kOther, spelling);
+        }
+
+        return Token(Token::Type::kNumber, static_cast<int>(static_cast<uint32_t>(value)), spelling);
+    }
+
+    Token LegacyLexer::ConsumeString()
+    {
+        std::string value = "";
+        Next(); // Consume opening quote
+
+        while (index_ < data_.length() && Peek() != '\"' && Peek() != '\n')
+        {
+            if (Peek() == '\\')
+            {
+                value += Next();
+            }
+            value += Next();
+        }
+        if (Peek() == '\"')
+        {
+            Next(); // Consume final quote
+        }
+        return Token(Token::Type::kString, value);
+    }
+
+    // A character constant is just another way to write a number.
+    Token LegacyLexer::ConsumeChar()
+    {
+        std::string spelling(1, Next());
+        int value = 0;
+
+        while (index_ < data_.length() && Peek() != '\'' && Peek() != '\n')
+        {
+            char c = Next();
+            spelling += c;
+
+            if (c == '\\')
+            {
+                c = Next();
+                spelling += c;
+
+                switch (c)
+                {
+                case 'n':
+                    c = '\n';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case '0':
+                    c = '\0';
+                    break;
+                }
+            }
+
+            value = (value << 8) | static_cast<unsigned char>(c);
+        }
+
+        if (Peek() != '\'')
+        {
+            return Token(Token::Type::kOther, spelling);
+        }
+
+        spelling += Next();
+        return Token(Token::Type::kNumber, value, spelling);
+    }
+
+    Token LegacyLexer::ConsumeMacro()
+    {
+        while (Peek() == ' ' || Peek() == '\t')
+        {
+            Next();
+        }
+
+        Token id = ConsumeIdentifier();
+
+        if (id.string_value() == "ifdef")
+        {
+            return Token(Token::Type::kIfDef);
+        }
+        if (id.string_value() == "ifndef")
+        {
+            return Token(Token::Type::kIfNDef);
+        }
+        if (id.string_value() == "define")
+        {
+            return Token(Token::Type::kDefine);
+        }
+        if (id.string_value() == "endif")
+        {
+            return Token(Token::Type::kEndIf);
+        }
+
+        if (id.string_value() == "include")
+        {
+            return Token(Token::Type::kInclude);
+        }
+        if (id.string_value() == "if")
+        {
+            return Token(Token::Type::kIf);
+        }
+        if (id.string_value() == "elif")
+        {
+            return Token(Token::Type::kElif);
+        }
+        if (id.string_value() == "else")
+        {
+            return Token(Token::Type::kElse);
+        }
+        if (id.string_value() == "undef")
+        {
+            return Token(Token::Type::kUndef);
+        }
+
+        return Token(Token::Type::kDirective, id.string_value());
+    }
+
+    std::vector<Token> LegacyLexer::LexString(const std::string &data)
+    {
+        index_ = 0;
+        line_ = 1;
+        data_ = data;
+
+        return Lex();
+    }
+
+    std::vector<Token> LegacyLexer::LexFile(const std::string &path)
+    {
+        std::ifstream file;
+        file.open(path);
+
+        std::stringstream stream;
+        stream << file.rdbuf();
+
+        index_ = 0;
+        line_ = 1;
+        data_ = stream.str();
+
+        file.close();
+
+        return Lex();
+    }
+
+    std::vector<Token> LegacyLexer::Lex()
+    {
+        std::vector<Token> tokens;
+        at_line_start_ = true;
+
+        while (true)
+        {
+            bool leading_space = SkipWhitespaceAndComments();
+
+            if (index_ >= data_.length())
+            {
+                break;
+            }
+
+            int line = line_;
+            bool first_on_line = at_line_start_;
+            at_line_start_ = false;
+
+            if (IsAlpha())
+            {
+                tokens.push_back(ConsumeIdentifier());
+            }
+            else if (IsNumber())
+            {
+                tokens.push_back(ConsumeNumber());
+            }
+            else
+            {
+                char c = Next();
+
+                switch (c)
+                {
+                case '*':
+                    tokens.push_back(Token(Token::Type::kTimes));
+                    break;
+                case '-':
+                    tokens.push_back(Token(Token::Type::kMinus));
+                    break;
+                case '+':
+                    tokens.push_back(Token(Token::Type::kPlus));
+                    break;
+                case '/':
+                    tokens.push_back(Token(Token::Type::kDivide));
+                    break;
+                case '%':
+                    tokens.push_back(Token(Token::Type::kModulo));
+                    break;
+                case '(':
+                    tokens.push_back(Token(Token::Type::kOpenParen));
+                    break;
+                case ')':
+                    tokens.push_back(Token(Token::Type::kCloseParen));
+                    break;
+                case '^':
+                    tokens.push_back(Token(Token::Type::kBitXor));
+                    break;
+                case '~':
+                    tokens.push_back(Token(Token::Type::kBitNot));
+                    break;
+                case ',':
+                    tokens.push_back(Token(Token::Type::kComma));
+                    break;
+                case '?':
+                    tokens.push_back(Token(Token::Type::kQuestion));
+                    break;
+                case ':':
+                    tokens.push_back(Token(Token::Type::kColon));
+                    break;
+                case '&':
+                    if (Peek() == '&')
+                    {
+                        Next();
+                        tokens.push_back(Token(Token::Type::kLogicalAnd));
+                        break;
+                    }
+                    tokens.push_back(Token(Token::Type::kBitAnd));
+                    break;
+                case '|':
+                    if (Peek() == '|')
+                    {
+                        Next();
+                        tokens.push_back(Token(Token::Type::kLogicalOr));
+                        break;
+                    }
+                    tokens.push_back(Token(Token::Type::kBitOr));
+                    break;
+                case '!':
+                    if (Peek() == '=')
+                    {
+                        Next();
+                        tokens.push_back(Token(Token::Type::kNotEqual));
+                        break;
+                    }
+                    tokens.push_back(Token(Token::Type::kLogicalNot));
+                    break;
+                case '=':
+                    if (Peek() == '=')
+                    {
+                        Next();
+                        tokens.push_back(Token(Token::Type::kEqual));
+                        break;
+                    }
+                    tokens.push_back(Token(Token::Type::kOther, "="));
+                    break;
+                case '#':
+                    if (first_on_line)
+                    {
+                        tokens.push_back(ConsumeMacro());
+                        break;
+                    }
+                    if (Peek() == '#')
+                    {
+                        Next();
+                        tokens.push_back(Token(Token::Type::kHashHash));
+                        break;
+                    }
+                    tokens.push_back(Token(Token::Type::kHash));
+                    break;
+                case '\"':
+                    index_--;
+                    tokens.push_back(ConsumeString());
+                    break;
+                case '\'':
+                    index_--;
+                    tokens.push_back(ConsumeChar());
+                    break;
+                case '<':
+                    if (Peek() == '<')
+                    {
+                        Next();
+                        tokens.push_back(Token(Token::Type::kLeftShift));
+                        break;
+                    }
+                    if (Peek() == '=')
+                    {
+                        Next();
+                        tokens.push_back(Token(Token::Type::kLessOrEqual));
+                        break;
+                    }
+                    tokens.push_back(Token(Token::Type::kLessThan));
+                    break;
+                case '>':
+                    if (Peek() == '>')
+                    {
+                        Next();
+                        tokens.push_back(Token(Token::Type::kRightShift));
+                        break;
+                    }
+                    if (Peek() == '=')
+                    {
+                        Next();
+                        tokens.push_back(Token(Token::Type::kGreaterOrEqual));
+                        break;
+                    }
+                    tokens.push_back(Token(Token::Type::kGreaterThan));
+                    break;
+
+                default:
+                    tokens.push_back(Token(Token::Type::kOther, std::string(1, c)));
+                    break;
+                }
+            }
+
+            tokens.back().set_position(line, first_on_line, leading_space);
+        }
+
+        return tokens;
+    }
+
+} // namespace core
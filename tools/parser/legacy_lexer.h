@@ -0,0 +1,51 @@
+#ifndef INCLUDE_CORE_LEGACY_LEXER_H
+#define INCLUDE_CORE_LEGACY_LEXER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "lexer.h"
+
+namespace core
+{
+    // The lexer as it was before StreamLexer: it reads the whole file into a
+    // std::string and peeks at it a character at a time. Nothing uses it any
+    // more; it's only kept so that `parser bench` can compare against it.
+    class LegacyLexer
+    {
+    public:
+        LegacyLexer() = default;
+        ~LegacyLexer() = default;
+
+        std::vector<Token> LexFile(const std::string &path);
+        std::vector<Token> LexString(const std::string &data);
+
+    private:
+        std::vector<Token> Lex();
+        char Peek();
+        char PeekNext();
+        char Next();
+        bool IsNumber();
+        bool IsAlpha();
+        bool IsHexAlpha();
+        bool IsAlphaNumber();
+        bool IsWhitespace();
+        bool SkipWhitespaceAndComments();
+
+        Token ConsumeIdentifier();
+        Token ConsumeNumber();
+        Token ConsumeString();
+        Token ConsumeChar();
+        Token ConsumeMacro();
+
+        std::string ReadIdentifier();
+
+        std::string data_ = "";
+        uint32_t index_ = 0;
+        int line_ = 1;
+        bool at_line_start_ = true;
+    };
+} // namespace core
+
+#endif // INCLUDE_CORE_LEGACY_LEXER_H
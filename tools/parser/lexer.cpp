@@ -1,162 +1,439 @@
 #include "lexer.h"
 
 #include <fstream>
-#include <iostream>
-#include <sstream>
+
+#include "mapped_file.h"
+#include "symbol_table.h"
 
 namespace core
 {
 
-    bool Lexer::IsNumber()
+    static bool IsNumber(char c)
     {
-        char c = Peek();
         return (c >= '0' && c <= '9');
     }
 
-    bool Lexer::IsWhitespace()
+    static bool IsWhitespace(char c)
     {
-        char c = Peek();
-        return (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+        return (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v');
     }
 
-    bool Lexer::IsHexAlpha()
+    static bool IsAlpha(char c)
     {
-        char c = Peek();
-        return ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'));
+        return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_');
     }
 
-    bool Lexer::IsAlpha()
+    static bool IsAlphaNumber(char c)
     {
-        char c = Peek();
-        return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'));
+        return IsAlpha(c) || IsNumber(c);
     }
 
-    bool Lexer::IsAlphaNumber()
+    static int DigitValue(char c)
     {
-        return IsAlpha() || IsNumber();
-    };
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'z')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'Z')
+            return c - 'A' + 10;
+        return 36;
+    }
 
-    char Lexer::Peek()
+    // Skips whitespace, comments and escaped newlines, and returns whether there
+    // was anything to skip. An unescaped newline starts a new logical line.
+    bool StreamLexer::SkipWhitespaceAndComments()
     {
-        return data_[index_];
+        bool skipped = false;
+
+        while (pos_ < end_)
+        {
+            char c = *pos_;
+
+            if (c == '\n')
+            {
+                at_line_start_ = true;
+                line_++;
+            }
+            else if (c == '\\' && (PeekNext() == '\n' || (PeekNext() == '\r' && pos_ + 2 < end_ && pos_[2] == '\n')))
+            {
+                pos_++;
+                if (*pos_ == '\r')
+                    pos_++;
+                line_++;
+            }
+            else if (c == '/' && PeekNext() == '/')
+            {
+                while (pos_ < end_ && *pos_ != '\n')
+                    pos_++;
+                skipped = true;
+                continue;
+            }
+            else if (c == '/' && PeekNext() == '*')
+            {
+                pos_ += 2;
+                while (pos_ < end_ && !(*pos_ == '*' && PeekNext() == '/'))
+                {
+                    if (*pos_ == '\n')
+                        line_++;
+                    pos_++;
+                }
+                pos_ = pos_ + 2 < end_ ? pos_ + 2 : end_;
+                skipped = true;
+                continue;
+            }
+            else if (!IsWhitespace(c))
+            {
+                break;
+            }
+
+            pos_++;
+            skipped = true;
+        }
+
+        return skipped;
     }
 
-    char Lexer::Next()
+    void StreamLexer::ConsumeIdentifier(TokenView &token)
     {
-        char c = Peek();
-        index_++;
-        return c;
+        const char *start = pos_;
+
+        while (pos_ < end_ && IsAlphaNumber(*pos_))
+            pos_++;
+
+        token.type = Token::Type::kIdentifier;
+        token.text = StringRef(start, pos_ - start);
+
+        if (symbols_ != nullptr)
+            token.symbol = symbols_->Intern(start, pos_ - start);
     }
 
-    Token Lexer::ConsumeIdentifier()
+    // Reads a whole preprocessing number, so that e.g. "0x10u" or "1e5" is never
+    // split, and evaluates it as a C integer constant. Anything that isn't one
+    // (like a floating-point number) becomes an unknown token.
+    void StreamLexer::ConsumeNumber(TokenView &token)
     {
-        std::string identifer = "";
+        const char *start = pos_;
+
+        while (pos_ < end_ && (IsAlphaNumber(*pos_) || *pos_ == '.'))
+            pos_++;
+
+        const char *digits = start;
+        int base = 10;
+
+        if (pos_ - start > 1 && start[0] == '0')
+        {
+            if (start[1] == 'x' || start[1] == 'X')
+            {
+                base = 16;
+                digits += 2;
+            }
+            else if (start[1] == 'b' || start[1] == 'B')
+            {
+                base = 2;
+                digits += 2;
+            }
+            else
+            {
+                base = 8;
+            }
+        }
+
+        unsigned long long value = 0;
+        const char *p = digits;
+
+        while (p < pos_ && DigitValue(*p) < base)
+            value = value * base + DigitValue(*p++);
 
-        while (IsAlphaNumber() || Peek() == '_')
+        bool valid = p > digits;
+        for (; p < pos_; p++)
         {
-            identifer += Next();
+            if (*p != 'u' && *p != 'U' && *p != 'l' && *p != 'L')
+                valid = false;
         }
 
-        return Token(Token::Type::kIdentifier, identifer);
+        token.type = valid ? Token::Type::kNumber : Token::Type::kOther;
+        token.text = StringRef(start, pos_ - start);
+        token.int_value = valid ? static_cast<int>(static_cast<uint32_t>(value)) : 0;
     }
 
-    Token Lexer::ConsumeNumber()
+    void StreamLexer::ConsumeString(TokenView &token)
     {
-        std::string identifer = "";
+        pos_++; // Consume opening quote
+        const char *start = pos_;
 
-        if (Peek() == '0')
+        while (pos_ < end_ && *pos_ != '\"' && *pos_ != '\n')
         {
-            identifer += Next();
-            if (Peek() == 'x')
-            {
-                identifer += Next();
-            }
+            if (*pos_ == '\\' && pos_ + 1 < end_ && *++pos_ == '\n')
+                line_++;
+            pos_++;
+        }
+
+        token.type = Token::Type::kString;
+        token.text = StringRef(start, pos_ - start);
+
+        if (pos_ < end_ && *pos_ == '\"')
+            pos_++; // Consume final quote
+    }
+
+    // A character constant is just another way to write a number.
+    void StreamLexer::ConsumeChar(TokenView &token)
+    {
+        const char *start = pos_++;
+        int value = 0;
+
+        while (pos_ < end_ && *pos_ != '\'' && *pos_ != '\n')
+        {
+            char c = *pos_++;
 
-            while (IsNumber() || IsHexAlpha())
+            if (c == '\\')
             {
-                identifer += Next();
+                c = Peek();
+                if (c == '\n')
+                    line_++;
+                if (pos_ < end_)
+                    pos_++;
+
+                switch (c)
+                {
+                case 'n':
+                    c = '\n';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case '0':
+                    c = '\0';
+                    break;
+                }
             }
 
-            return Token(Token::Type::kNumber, std::stoi(identifer, nullptr, 16));
+            value = (value << 8) | static_cast<unsigned char>(c);
         }
 
-        while (IsNumber())
+        if (Peek() != '\'')
         {
-            identifer += Next();
+            token.type = Token::Type::kOther;
+            token.text = StringRef(start, pos_ - start);
+            return;
         }
 
-        return Token(Token::Type::kNumber, std::stoi(identifer));
+        pos_++;
+        token.type = Token::Type::kNumber;
+        token.text = StringRef(start, pos_ - start);
+        token.int_value = value;
     }
 
-    // TODO: Doesn't currently support escape characters
-    Token Lexer::ConsumeString()
+    void StreamLexer::ConsumeMacro(TokenView &token)
     {
-        std::string value = "";
-        if (Next() != '\"')
-        {
-            // Error
-        }
+        while (Peek() == ' ' || Peek() == '\t')
+            pos_++;
+
+        const char *start = pos_;
+
+        while (pos_ < end_ && IsAlphaNumber(*pos_))
+            pos_++;
+
+        StringRef name(start, pos_ - start);
+        token.text = name;
+
+        if (name == "define")
+            token.type = Token::Type::kDefine;
+        else if (name == "ifdef")
+            token.type = Token::Type::kIfDef;
+        else if (name == "ifndef")
+            token.type = Token::Type::kIfNDef;
+        else if (name == "endif")
+            token.type = Token::Type::kEndIf;
+        else if (name == "include")
+            token.type = Token::Type::kInclude;
+        else if (name == "if")
+            token.type = Token::Type::kIf;
+        else if (name == "elif")
+            token.type = Token::Type::kElif;
+        else if (name == "else")
+            token.type = Token::Type::kElse;
+        else if (name == "undef")
+            token.type = Token::Type::kUndef;
+        else
+            token.type = Token::Type::kDirective;
+    }
+
+    void StreamLexer::ConsumeSymbol(TokenView &token)
+    {
+        const char *start = pos_;
+        char c = *pos_++;
+        Token::Type type;
 
-        // TODO: error if we never see a quote
-        while (Peek() != '\"')
+        switch (c)
         {
-            value += Next();
+        case '*':
+            type = Token::Type::kTimes;
+            break;
+        case '-':
+            type = Token::Type::kMinus;
+            break;
+        case '+':
+            type = Token::Type::kPlus;
+            break;
+        case '/':
+            type = Token::Type::kDivide;
+            break;
+        case '%':
+            type = Token::Type::kModulo;
+            break;
+        case '(':
+            type = Token::Type::kOpenParen;
+            break;
+        case ')':
+            type = Token::Type::kCloseParen;
+            break;
+        case '^':
+            type = Token::Type::kBitXor;
+            break;
+        case '~':
+            type = Token::Type::kBitNot;
+            break;
+        case ',':
+            type = Token::Type::kComma;
+            break;
+        case '?':
+            type = Token::Type::kQuestion;
+            break;
+        case ':':
+            type = Token::Type::kColon;
+            break;
+        case '&':
+            type = Peek() == '&' ? (pos_++, Token::Type::kLogicalAnd) : Token::Type::kBitAnd;
+            break;
+        case '|':
+            type = Peek() == '|' ? (pos_++, Token::Type::kLogicalOr) : Token::Type::kBitOr;
+            break;
+        case '!':
+            type = Peek() == '=' ? (pos_++, Token::Type::kNotEqual) : Token::Type::kLogicalNot;
+            break;
+        case '=':
+            type = Peek() == '=' ? (pos_++, Token::Type::kEqual) : Token::Type::kOther;
+            break;
+        case '#':
+            type = Peek() == '#' ? (pos_++, Token::Type::kHashHash) : Token::Type::kHash;
+            break;
+        case '<':
+            if (Peek() == '<')
+                type = (pos_++, Token::Type::kLeftShift);
+            else if (Peek() == '=')
+                type = (pos_++, Token::Type::kLessOrEqual);
+            else
+                type = Token::Type::kLessThan;
+            break;
+        case '>':
+            if (Peek() == '>')
+                type = (pos_++, Token::Type::kRightShift);
+            else if (Peek() == '=')
+                type = (pos_++, Token::Type::kGreaterOrEqual);
+            else
+                type = Token::Type::kGreaterThan;
+            break;
+        default:
+            type = Token::Type::kOther;
+            break;
         }
-        Next(); // Consume final quote
-        return Token(Token::Type::kString, value);
+
+        token.type = type;
+        token.text = StringRef(start, pos_ - start);
     }
 
-    Token Lexer::ConsumeMacro()
+    bool StreamLexer::Next(TokenView &token)
     {
-        Token id = ConsumeIdentifier();
+        bool leading_space = SkipWhitespaceAndComments();
+
+        if (pos_ >= end_)
+            return false;
 
-        if (id.string_value() == "ifdef")
+        token.line = line_;
+        token.first_on_line = at_line_start_;
+        token.leading_space = leading_space;
+        token.int_value = 0;
+        at_line_start_ = false;
+
+        char c = *pos_;
+
+        if (IsAlpha(c))
         {
-            return Token(Token::Type::kIfDef);
+            ConsumeIdentifier(token);
         }
-        if (id.string_value() == "ifndef")
+        else if (IsNumber(c))
         {
-            return Token(Token::Type::kIfNDef);
+            ConsumeNumber(token);
         }
-        if (id.string_value() == "define")
+        else if (c == '\"')
         {
-            return Token(Token::Type::kDefine);
+            ConsumeString(token);
         }
-        if (id.string_value() == "endif")
+        else if (c == '\'')
         {
-            return Token(Token::Type::kEndIf);
+            ConsumeChar(token);
         }
-
-        if (id.string_value() == "include")
+        else if (c == '#' && token.first_on_line)
+        {
+            pos_++;
+            ConsumeMacro(token);
+        }
+        else
         {
-            return Token(Token::Type::kInclude);
+            ConsumeSymbol(token);
         }
 
-        return Token(Token::Type::kDefine);
+        return true;
     }
 
-    std::vector<Token> Lexer::LexString(const std::string &data)
+    Token TokenView::ToToken() const
     {
-        index_ = 0;
-        data_ = data;
+        Token token(type);
 
-        return Lex();
+        switch (type)
+        {
+        case Token::Type::kIdentifier:
+        case Token::Type::kString:
+        case Token::Type::kOther:
+        case Token::Type::kDirective:
+            token = Token(type, text.str());
+            break;
+        case Token::Type::kNumber:
+            token = Token(type, int_value, text.str());
+            break;
+        default:
+            break;
+        }
+
+        token.set_position(line, first_on_line, leading_space);
+        return token;
     }
 
-    std::vector<Token> Lexer::LexFile(const std::string &path)
+    std::vector<Token> Lexer::LexBuffer(const char *data, std::size_t size)
     {
-        std::ifstream file;
-        file.open(path);
+        std::vector<Token> tokens;
+        StreamLexer lexer(data, size);
+        TokenView view;
 
-        std::stringstream stream;
-        stream << file.rdbuf();
+        while (lexer.Next(view))
+            tokens.push_back(view.ToToken());
 
-        index_ = 0;
-        data_ = stream.str();
+        return tokens;
+    }
 
-        file.close();
+    std::vector<Token> Lexer::LexString(const std::string &data)
+    {
+        return LexBuffer(data.data(), data.length());
+    }
+
+    std::vector<Token> Lexer::LexFile(const std::string &path)
+    {
+        MappedFile file(path);
 
-        return Lex();
+        return LexBuffer(file.data(), file.size());
     }
 
     void Lexer::LexFileDumpTokens(const std::string &path, const std::string &out)
@@ -164,7 +441,7 @@ namespace core
         std::ofstream file;
         file.open(out);
 
-        for (Token token : LexFile(path))
+        for (const Token &token : LexFile(path))
         {
             file << token.ToString() << std::endl;
         }
@@ -172,122 +449,6 @@ namespace core
         file.close();
     }
 
-    std::vector<Token> Lexer::Lex()
-    {
-        std::vector<Token> tokens;
-
-        while (index_ < data_.length())
-        {
-            while (IsWhitespace())
-            {
-                Next();
-            }
-
-            if (IsAlpha())
-            {
-                tokens.push_back(ConsumeIdentifier());
-                continue;
-            }
-
-            if (IsNumber())
-            {
-                tokens.push_back(ConsumeNumber());
-                continue;
-            }
-
-            switch (Peek())
-            {
-            case '*':
-                Next();
-                tokens.push_back(Token(Token::Type::kTimes));
-                break;
-            case '-':
-                Next();
-                tokens.push_back(Token(Token::Type::kMinus));
-                break;
-            case '+':
-                Next();
-                tokens.push_back(Token(Token::Type::kPlus));
-                break;
-            case '(':
-                Next();
-                tokens.push_back(Token(Token::Type::kOpenParen));
-                break;
-            case ')':
-                Next();
-                tokens.push_back(Token(Token::Type::kCloseParen));
-                break;
-            case '&':
-                Next();
-                tokens.push_back(Token(Token::Type::kBitAnd));
-                break;
-            case '|':
-                Next();
-                tokens.push_back(Token(Token::Type::kBitOr));
-                break;
-            case '^':
-                Next();
-                tokens.push_back(Token(Token::Type::kBitXor));
-                break;
-            case ',':
-                Next();
-                tokens.push_back(Token(Token::Type::kComma));
-                break;
-            case '#':
-                Next();
-                tokens.push_back(ConsumeMacro());
-                break;
-            case '\"':
-                tokens.push_back(ConsumeString());
-                break;
-            case '<':
-                Next();
-                if (Peek() == '<')
-                {
-                    Next();
-                    tokens.push_back(Token(Token::Type::kLeftShift));
-                    break;
-                }
-                tokens.push_back(Token(Token::Type::kLessThan));
-                break;
-            case '>':
-                Next();
-                if (Peek() == '>')
-                {
-                    Next();
-                    tokens.push_back(Token(Token::Type::kRightShift));
-                    break;
-                }
-                tokens.push_back(Token(Token::Type::kGreaterThan));
-                break;
-
-            case '/':
-                Next();
-                switch (Peek())
-                {
-                case '/':
-                    while (Next() != '\n')
-                        ;
-                    continue;
-                case '*':
-                    while (Next() != '*')
-                        ;
-                    Next(); // last /
-                    continue;
-                default:
-                    tokens.push_back(Token(Token::Type::kDivide));
-                    continue;
-                }
-
-            default:
-                std::cout << "Unknown char:" << Next() << std::endl;
-                break;
-            }
-        }
-
-        return tokens;
-    }
-
     std::string Token::ToString() const
     {
         switch (type())
@@ -302,6 +463,16 @@ namespace core
             return "Macro: EndIf";
         case core::Token::Type::kInclude:
             return "Macro: Include";
+        case core::Token::Type::kIf:
+            return "Macro: If";
+        case core::Token::Type::kElif:
+            return "Macro: Elif";
+        case core::Token::Type::kElse:
+            return "Macro: Else";
+        case core::Token::Type::kUndef:
+            return "Macro: Undef";
+        case core::Token::Type::kDirective:
+            return "Macro: " + string_value();
         case core::Token::Type::kNumber:
             return "Number: " + std::to_string(int_value());
         case core::Token::Type::kString:
@@ -338,6 +509,83 @@ namespace core
             return "Symbol: \"";
         case core::Token::Type::kComma:
             return "Symbol: ,";
+        case core::Token::Type::kOther:
+            return "Other: " + string_value();
+        default:
+            return "Symbol: " + Spelling();
+        }
+    }
+
+    // The token as it would be written in source. Directives have no spelling
+    // of their own, since they never appear inside an expression.
+    std::string Token::Spelling() const
+    {
+        switch (type())
+        {
+        case core::Token::Type::kIdentifier:
+        case core::Token::Type::kNumber:
+        case core::Token::Type::kOther:
+            return string_value();
+        case core::Token::Type::kString:
+            return "\"" + string_value() + "\"";
+        case core::Token::Type::kOpenParen:
+            return "(";
+        case core::Token::Type::kCloseParen:
+            return ")";
+        case core::Token::Type::kLessThan:
+            return "<";
+        case core::Token::Type::kGreaterThan:
+            return ">";
+        case core::Token::Type::kLeftShift:
+            return "<<";
+        case core::Token::Type::kRightShift:
+            return ">>";
+        case core::Token::Type::kPlus:
+            return "+";
+        case core::Token::Type::kMinus:
+            return "-";
+        case core::Token::Type::kTimes:
+            return "*";
+        case core::Token::Type::kDivide:
+            return "/";
+        case core::Token::Type::kBitXor:
+            return "^";
+        case core::Token::Type::kBitAnd:
+            return "&";
+        case core::Token::Type::kBitOr:
+            return "|";
+        case core::Token::Type::kQuote:
+            return "\"";
+        case core::Token::Type::kComma:
+            return ",";
+        case core::Token::Type::kModulo:
+            return "%";
+        case core::Token::Type::kBitNot:
+            return "~";
+        case core::Token::Type::kLogicalNot:
+            return "!";
+        case core::Token::Type::kLogicalAnd:
+            return "&&";
+        case core::Token::Type::kLogicalOr:
+            return "||";
+        case core::Token::Type::kEqual:
+            return "==";
+        case core::Token::Type::kNotEqual:
+            return "!=";
+        case core::Token::Type::kLessOrEqual:
+            return "<=";
+        case core::Token::Type::kGreaterOrEqual:
+            return ">=";
+        case core::Token::Type::kQuestion:
+            return "?";
+        case core::Token::Type::kColon:
+            return ":";
+        case core::Token::Type::kHash:
+            return "#";
+        case core::Token::Type::kHashHash:
+            return "##";
+        default:
+            return "";
         }
     }
 
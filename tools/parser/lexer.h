@@ -1,6 +1,9 @@
 #ifndef INCLUDE_CORE_LEXER_H
 #define INCLUDE_CORE_LEXER_H
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -17,6 +20,11 @@ namespace core
             kDefine,
             kEndIf,
             kInclude,
+            kIf,
+            kElif,
+            kElse,
+            kUndef,
+            kDirective, // any other directive, named by string_value()
 
             // Identifiers
             kIdentifier,
@@ -41,25 +49,132 @@ namespace core
             kBitOr,
             kQuote,
             kComma,
+            kModulo,
+            kBitNot,
+            kLogicalNot,
+            kLogicalAnd,
+            kLogicalOr,
+            kEqual,
+            kNotEqual,
+            kLessOrEqual,
+            kGreaterOrEqual,
+            kQuestion,
+            kColon,
+            kHash,
+            kHashHash,
+            kOther, // punctuation that doesn't matter to expressions, e.g. ';'
 
         };
 
         Token(Type type) : type_(type) {}
         Token(Type type, std::string string_value) : type_(type), string_value_(string_value) {}
         Token(Type type, int int_value) : type_(type), int_value_(int_value) {}
+        Token(Type type, int int_value, std::string string_value) : type_(type), string_value_(string_value), int_value_(int_value) {}
 
         Type type() const { return type_; }
         const std::string &string_value() const { return string_value_; }
         int int_value() const { return int_value_; }
 
+        // Where the token is: its line, whether it starts a logical line
+        // (directives end at the next token that does), and whether there was
+        // whitespace before it, which tells "F(x)" from "F (x)" in a #define.
+        int line() const { return line_; }
+        bool first_on_line() const { return first_on_line_; }
+        bool leading_space() const { return leading_space_; }
+        void set_position(int line, bool first_on_line, bool leading_space)
+        {
+            line_ = line;
+            first_on_line_ = first_on_line;
+            leading_space_ = leading_space;
+        }
+
         std::string ToString() const;
+        std::string Spelling() const;
 
     private:
         Type type_;
         std::string string_value_;
-        int int_value_;
+        int int_value_ = 0;
+        int line_ = 0;
+        bool first_on_line_ = false;
+        bool leading_space_ = false;
+    };
+
+    // A piece of text that lives somewhere else, usually the file being lexed.
+    class StringRef
+    {
+    public:
+        StringRef() = default;
+        StringRef(const char *data, std::size_t length) : data_(data), length_(length) {}
+
+        const char *data() const { return data_; }
+        std::size_t length() const { return length_; }
+        std::string str() const { return std::string(data_, length_); }
+
+        bool operator==(const char *text) const
+        {
+            return std::strlen(text) == length_ && std::memcmp(data_, text, length_) == 0;
+        }
+
+    private:
+        const char *data_ = nullptr;
+        std::size_t length_ = 0;
+    };
+
+    class SymbolTable;
+
+    // What StreamLexer hands out: the same information as a Token, but its
+    // text points into the buffer being lexed, so it's only valid as long as
+    // the buffer is. text is the identifier, the spelling of a number or of an
+    // unknown token, what's between the quotes of a string, or a directive's
+    // name.
+    struct TokenView
+    {
+        Token::Type type = Token::Type::kOther;
+        StringRef text;
+        int int_value = 0;
+        uint32_t symbol = 0; // identifiers only, when lexing with a SymbolTable
+        int line = 0;
+        bool first_on_line = false;
+        bool leading_space = false;
+
+        // A Token with its own copy of the text.
+        Token ToToken() const;
+    };
+
+    // Lexes a buffer one token at a time without allocating anything, apart
+    // from the first time the SymbolTable (if there is one) sees an
+    // identifier.
+    class StreamLexer
+    {
+    public:
+        StreamLexer(const char *data, std::size_t size, SymbolTable *symbols = nullptr)
+            : pos_(data), end_(data + size), symbols_(symbols) {}
+
+        // Returns false once the buffer is used up.
+        bool Next(TokenView &token);
+
+    private:
+        char Peek() const { return pos_ < end_ ? *pos_ : '\0'; }
+        char PeekNext() const { return pos_ + 1 < end_ ? pos_[1] : '\0'; }
+        bool SkipWhitespaceAndComments();
+
+        void ConsumeIdentifier(TokenView &token);
+        void ConsumeNumber(TokenView &token);
+        void ConsumeString(TokenView &token);
+        void ConsumeChar(TokenView &token);
+        void ConsumeMacro(TokenView &token);
+        void ConsumeSymbol(TokenView &token);
+
+        const char *pos_;
+        const char *end_;
+        SymbolTable *symbols_;
+        int line_ = 1;
+        bool at_line_start_ = true;
     };
 
+    // Lexes a whole file or string up front, for code that wants to index
+    // into the tokens or keep them around.
     class Lexer
     {
     public:
@@ -68,27 +183,8 @@ namespace core
 
         std::vector<Token> LexFile(const std::string &path);
         std::vector<Token> LexString(const std::string &data);
+        std::vector<Token> LexBuffer(const char *data, std::size_t size);
         void LexFileDumpTokens(const std::string &path, const std::string &out);
-
-    private:
-        std::vector<Token> Lex();
-        char Peek();
-        char Next();
-        bool IsNumber();
-        bool IsAlpha();
-        bool IsHexAlpha();
-        bool IsAlphaNumber();
-        bool IsWhitespace();
-
-        Token ConsumeIdentifier();
-        Token ConsumeNumber();
-        Token ConsumeString();
-        Token ConsumeMacro();
-
-        std::string ReadIdentifier();
-
-        std::string data_ = "";
-        uint32_t index_ = 0;
     };
 } // namespace core
 
@@ -1,6 +1,14 @@
+#include "constant_database.h"
+#include "constant_index.h"
+#include "legacy_lexer.h"
 #include "lexer.h"
+#include "mapped_file.h"
 #include "parser.h"
+#include "symbol_table.h"
 
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <map>
 
@@ -21,7 +29,6 @@ void sanity_test()
         "../../include/constants/global.h",
         "../../include/constants/trainers.h",
         "../../include/constants/map_groups.h",
-        // "../../include/constants/flags.h",
     };
 
     std::map<std::string, int> expected = {
@@ -35,12 +42,10 @@ void sanity_test()
 
     std::map<std::string, int> dfns;
 
-    core::Lexer lexer;
     core::Parser parser;
     for (const std::string &file : supported)
     {
-        auto tokens = lexer.LexFile(file);
-        auto defines = parser.Parse(tokens);
+        auto defines = parser.ParseFile(file);
         for (const auto &define : defines)
         {
             dfns[define.name()] = define.value();
@@ -56,6 +61,318 @@ void sanity_test()
                       << ". Expected = " << x.second << ". Actual = " << dfns[x.first] << std::endl;
         }
     }
+
+    // flags.h needs #include and function-like macros, so it goes through
+    // the constant database instead.
+    core::ConstantDatabase database;
+    database.AddIncludeDir("../../include");
+    database.ProcessFile("../../include/constants/flags.h");
+
+    std::map<std::string, int> expected_flags = {
+        {"FLAG_HIDDEN_ITEMS_START", 0x3E8},
+        {"FLAG_DEFEATED_BROCK", 0x4B0},
+        {"NUM_TRAINERS", 744},
+        {"FLAG_SYS_SAFARI_MODE", 0x800},
+    };
+
+    for (auto const &x : expected_flags)
+    {
+        long long value = 0;
+        if (!database.Evaluate(x.first, value) || value != x.second)
+        {
+            std::cout << "[WARNING] Mismatched value for "
+                      << x.first
+                      << ". Expected = " << x.second << ". Actual = " << value << std::endl;
+        }
+    }
+}
+
+static void usage()
+{
+    std::cerr << "Usage: parser build [-I DIR]... [-D NAME[=VALUE]]... -o INDEX HEADER..." << std::endl
+              << "       parser lookup INDEX NAME..." << std::endl
+              << "       parser dump INDEX" << std::endl
+              << "       parser sanity" << std::endl
+              << "       parser bench [-n PASSES] FILE..." << std::endl;
+}
+
+// Resolves every constant the headers define and writes them to the index,
+// unless the index was built from the same arguments and file contents.
+static int build(int argc, char *argv[])
+{
+    core::ConstantDatabase database;
+    std::vector<std::string> config;
+    std::vector<std::string> headers;
+    std::string index_path;
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if ((arg == "-I" || arg == "-D" || arg == "-o") && i + 1 < argc)
+        {
+            std::string value = argv[++i];
+
+            if (arg == "-o")
+            {
+                index_path = value;
+                continue;
+            }
+
+            if (arg == "-I")
+            {
+                database.AddIncludeDir(value);
+            }
+            else
+            {
+                std::size_t equals = value.find('=');
+                database.Define(value.substr(0, equals), equals == std::string::npos ? "" : value.substr(equals + 1));
+            }
+
+            config.push_back(arg);
+            config.push_back(value);
+        }
+        else if (arg[0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            headers.push_back(arg);
+            config.push_back(arg);
+        }
+    }
+
+    if (index_path.empty() || headers.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    uint64_t config_hash = core::ConstantIndex::HashConfig(config);
+    core::ConstantIndex index;
+
+    if (index.Load(index_path) && index.IsUpToDate(config_hash))
+        return 0;
+
+    for (const std::string &header : headers)
+    {
+        if (!database.ProcessFile(header))
+        {
+            std::cerr << "Failed to open \"" << header << "\" for reading." << std::endl;
+            return 1;
+        }
+    }
+
+    if (!core::ConstantIndex::Write(index_path, config_hash, database.files(), database.Resolve()))
+    {
+        std::cerr << "Failed to write \"" << index_path << "\"." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+static bool load_index(const char *path, core::ConstantIndex &index)
+{
+    if (!index.Load(path))
+    {
+        std::cerr << "\"" << path << "\" is missing or isn't a constant index." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static int lookup(int argc, char *argv[])
+{
+    core::ConstantIndex index;
+    int status = 0;
+
+    if (!load_index(argv[2], index))
+        return 1;
+
+    for (int i = 3; i < argc; i++)
+    {
+        int value;
+        if (index.Find(argv[i], value))
+        {
+            std::cout << argv[i] << " " << value << std::endl;
+        }
+        else
+        {
+            std::cerr << argv[i] << " isn't a known constant." << std::endl;
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+static int dump(char *path)
+{
+    core::ConstantIndex index;
+
+    if (!load_index(path, index))
+        return 1;
+
+    for (uint32_t i = 0; i < index.constant_count(); i++)
+    {
+        core::Constant constant = index.GetConstant(i);
+        std::cout << constant.name() << " " << constant.value() << " " << index.GetFilePath(constant.file()) << ":" << constant.line() << std::endl;
+    }
+
+    return 0;
+}
+
+// Each pass lexes every file once and returns how many tokens it saw.
+static uint64_t lex_legacy(const std::vector<std::string> &paths)
+{
+    core::LegacyLexer lexer;
+    uint64_t count = 0;
+
+    for (const std::string &path : paths)
+        count += lexer.LexFile(path).size();
+
+    return count;
+}
+
+static uint64_t lex_to_vectors(const std::vector<std::string> &paths)
+{
+    core::Lexer lexer;
+    uint64_t count = 0;
+
+    for (const std::string &path : paths)
+        count += lexer.LexFile(path).size();
+
+    return count;
+}
+
+static uint64_t count_stream_tokens(const std::vector<std::string> &paths, core::SymbolTable *symbols)
+{
+    uint64_t count = 0;
+
+    for (const std::string &path : paths)
+    {
+        core::MappedFile file(path);
+        core::StreamLexer lexer(file.data(), file.size(), symbols);
+        core::TokenView token;
+
+        while (lexer.Next(token))
+            count++;
+    }
+
+    return count;
+}
+
+static uint64_t lex_streaming(const std::vector<std::string> &paths)
+{
+    return count_stream_tokens(paths, nullptr);
+}
+
+// Starts from an empty SymbolTable, as a fresh run would.
+static uint64_t lex_interning(const std::vector<std::string> &paths)
+{
+    core::SymbolTable symbols;
+
+    return count_stream_tokens(paths, &symbols);
+}
+
+// Each pass parses the #defines of every file once and returns how many it
+// found.
+static uint64_t parse_vectors(const std::vector<std::string> &paths)
+{
+    core::Lexer lexer;
+    core::Parser parser;
+    uint64_t count = 0;
+
+    for (const std::string &path : paths)
+        count += parser.Parse(lexer.LexFile(path)).size();
+
+    return count;
+}
+
+static uint64_t parse_streaming(const std::vector<std::string> &paths)
+{
+    core::Parser parser;
+    uint64_t count = 0;
+
+    for (const std::string &path : paths)
+        count += parser.ParseFile(path).size();
+
+    return count;
+}
+
+// Runs pass the given number of times and prints how many items per second
+// it got through.
+static void time_passes(const char *name, const char *unit, int passes, uint64_t (*pass)(const std::vector<std::string> &), const std::vector<std::string> &paths)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t count = 0;
+
+    for (int i = 0; i < passes; i++)
+        count += pass(paths);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << name << ": " << static_cast<uint64_t>(count / seconds) << " " << unit << "/s (" << seconds << " s)" << std::endl;
+}
+
+// Compares the lexer from before StreamLexer, lexing into vectors of Tokens
+// (which is what ConstantDatabase does) and pulling tokens from StreamLexer,
+// then parsing #defines from a vector and straight from StreamLexer, e.g.
+//     parser bench $(find include/constants src/data -name '*.h')
+static int bench(int argc, char *argv[])
+{
+    std::vector<std::string> paths;
+    int passes = 20;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            passes = std::atoi(argv[++i]);
+        else
+            paths.push_back(argv[i]);
+    }
+
+    if (paths.empty() || passes <= 0)
+    {
+        usage();
+        return 1;
+    }
+
+    uint64_t bytes = 0;
+
+    for (const std::string &path : paths)
+    {
+        core::MappedFile file(path);
+
+        if (!file.is_open())
+        {
+            std::cerr << "Failed to open \"" << path << "\" for reading." << std::endl;
+            return 1;
+        }
+
+        bytes += file.size();
+    }
+
+    uint64_t tokens = lex_streaming(paths);
+    std::cout << paths.size() << " files, " << bytes << " bytes, " << tokens << " tokens, " << passes << " passes" << std::endl;
+
+    if (lex_legacy(paths) != tokens || parse_vectors(paths) != parse_streaming(paths))
+    {
+        std::cerr << "The lexers or parsers disagree." << std::endl;
+        return 1;
+    }
+
+    time_passes("LegacyLexer", "tokens", passes, lex_legacy, paths);
+    time_passes("Lexer (std::vector<Token>)", "tokens", passes, lex_to_vectors, paths);
+    time_passes("StreamLexer", "tokens", passes, lex_streaming, paths);
+    time_passes("StreamLexer + SymbolTable", "tokens", passes, lex_interning, paths);
+    time_passes("Parser (std::vector<Token>)", "defines", passes, parse_vectors, paths);
+    time_passes("Parser (StreamLexer)", "defines", passes, parse_streaming, paths);
+
+    return 0;
 }
 
 int main(int argc, char *argv[])
@@ -74,7 +391,7 @@ int main(int argc, char *argv[])
     // src/data/heal_locations.h
     // src/data/trainers.h
 
-    // -- Define Parsing
+    // -- Define Parsing (handled by ConstantDatabase, not Parser)
     // #define ITEM_TO_BERRY(itemId)(((itemId - FIRST_BERRY_INDEX) + 1))
     // include/constants/items.h
     // Needs #include and string literal
@@ -100,21 +417,20 @@ int main(int argc, char *argv[])
     // include/constants/trainers.h
     // include/constants/map_groups.h
 
-    sanity_test();
-
-    core::Lexer lexer;
-    core::Parser parser;
-
-    auto tokens = lexer.LexFile("../../include/constants/flags.h");
-    for (auto t : tokens) {
-      std::cout << t.ToString() << std::endl;
+    if (argc >= 2 && std::strcmp(argv[1], "build") == 0)
+        return build(argc, argv);
+    if (argc >= 4 && std::strcmp(argv[1], "lookup") == 0)
+        return lookup(argc, argv);
+    if (argc == 3 && std::strcmp(argv[1], "dump") == 0)
+        return dump(argv[2]);
+    if (argc >= 3 && std::strcmp(argv[1], "bench") == 0)
+        return bench(argc, argv);
+    if (argc == 2 && std::strcmp(argv[1], "sanity") == 0)
+    {
+        sanity_test();
+        return 0;
     }
-    // auto defines = parser.Parse(tokens);
 
-    // for (auto statement : defines)
-    // {
-    //     std::cout << statement.name() << " = " << statement.value() << std::endl;
-    // }
-
-    return 0;
+    usage();
+    return 1;
 }
@@ -0,0 +1,75 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace core
+{
+#ifdef _WIN32
+
+    MappedFile::MappedFile(const std::string &path)
+    {
+        std::ifstream stream(path, std::ios::binary);
+
+        if (!stream)
+            return;
+
+        buffer_.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+        open_ = true;
+    }
+
+    MappedFile::~MappedFile()
+    {
+    }
+
+#else
+
+    MappedFile::MappedFile(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+
+        if (fd < 0)
+            return;
+
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        {
+            size_ = st.st_size;
+
+            // mmap can't map an empty file, but there's nothing to read anyway.
+            if (size_ == 0)
+            {
+                open_ = true;
+            }
+            else
+            {
+                void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+                if (data != MAP_FAILED)
+                {
+                    data_ = static_cast<const char *>(data);
+                    open_ = true;
+                }
+            }
+        }
+
+        close(fd);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (data_ != nullptr)
+            munmap(const_cast<char *>(data_), size_);
+    }
+
+#endif // _WIN32
+} // namespace core
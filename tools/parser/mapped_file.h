@@ -0,0 +1,34 @@
+#ifndef INCLUDE_CORE_MAPPED_FILE_H
+#define INCLUDE_CORE_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace core
+{
+    // A whole file in memory, mapped where the OS allows it, so lexing it
+    // needs no copy.
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string &path);
+        ~MappedFile();
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        bool is_open() const { return open_; }
+        const char *data() const { return data_; }
+        std::size_t size() const { return size_; }
+
+    private:
+        bool open_ = false;
+        const char *data_ = nullptr;
+        std::size_t size_ = 0;
+#ifdef _WIN32
+        std::vector<char> buffer_;
+#endif
+    };
+} // namespace core
+
+#endif // INCLUDE_CORE_MAPPED_FILE_H
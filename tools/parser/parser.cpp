@@ -1,277 +1,105 @@
 #include "parser.h"
 
-#include <iostream>
-#include <vector>
+#include "expression.h"
+#include "mapped_file.h"
 
 namespace core
 {
 
-    int Parser::GetPrecedence(const Token &token)
+    int Parser::EvaluateExpression(const Token *begin, const Token *end)
     {
-        switch (token.type())
-        {
-        case Token::Type::kTimes:
-            return 3;
-        case Token::Type::kDivide:
-            return 3;
-        case Token::Type::kPlus:
-            return 4;
-        case Token::Type::kMinus:
-            return 4;
-        case Token::Type::kLeftShift:
-            return 5;
-        case Token::Type::kRightShift:
-            return 5;
-        case Token::Type::kBitAnd:
-          return 8;
-        case Token::Type::kBitXor:
-          return 9;
-        case Token::Type::kBitOr:
-          return 10;
-
-        default: {
-            std::cout << "Asked for precedence of unmapped token: " << token.ToString() << std::endl;
-            return 0;
-        }
-        }
+        ExpressionEvaluator evaluator([this](const std::string &name, long long &value) {
+            // error if name not in top level
+            auto it = top_level_.find(name);
+            value = it != top_level_.end() ? it->second : 0;
+            return true;
+        });
+
+        long long value = 0;
+        evaluator.Evaluate(begin, end, value);
+        return static_cast<int>(value);
     }
 
-    std::vector<Token> Parser::ToPostfix()
+    // Takes the rest of a #define's line, after the directive itself. Returns
+    // false for a function-like macro, which isn't a constant.
+    bool Parser::ParseDefine(const Token *begin, const Token *end, DefineStatement &statement)
     {
-        std::vector<Token::Type> types = {
-            Token::Type::kNumber,
-            Token::Type::kIdentifier,
-            Token::Type::kOpenParen,
-            Token::Type::kCloseParen,
-            Token::Type::kLeftShift,
-            Token::Type::kRightShift,
-            Token::Type::kPlus,
-            Token::Type::kMinus,
-            Token::Type::kTimes,
-            Token::Type::kDivide,
-            Token::Type::kBitXor,
-            Token::Type::kBitAnd,
-            Token::Type::kBitOr,
-        };
+        if (begin == end || begin->type() != Token::Type::kIdentifier)
+            return false;
 
-        std::vector<Token> output;
-        std::vector<Token> stack;
-
-        while (std::find(types.begin(), types.end(), Peek().type()) != types.end())
-        {
-            Token token = Next();
-            if (token.type() == Token::Type::kNumber || token.type() == Token::Type::kIdentifier)
-            {
-                output.push_back(token);
-            }
-            else if (token.type() == Token::Type::kOpenParen)
-            {
-                stack.push_back(token);
-            }
-            else if (token.type() == Token::Type::kCloseParen)
-            {
-                while (!stack.empty() && stack.back().type() != Token::Type::kOpenParen)
-                {
-                    Token back = stack.back();
-                    stack.pop_back();
-                    output.push_back(back);
-                }
+        std::string identifer = begin->string_value();
+        begin++;
 
-                // Next();
+        if (begin != end && begin->type() == Token::Type::kOpenParen && !begin->leading_space())
+            return false;
 
-                if (!stack.empty())
-                {
-                    // pop the left parenthesis token
-                    stack.pop_back();
-                }
-                else
-                {
-                    std::cout << "Mismatched parentheses detected in expression!" << std::endl;
-                }
-            }
-            else
-            {
-                // token is an operator
-                while (!stack.empty() && stack.back().type() != Token::Type::kOpenParen && GetPrecedence(stack.back()) <= GetPrecedence(token))
-                {
-                    Token back = stack.back();
-                    stack.pop_back();
-                    output.push_back(back);
-                }
-                stack.push_back(token);
-            }
-        }
+        int value = begin != end ? EvaluateExpression(begin, end) : 0;
 
-        while (!stack.empty())
-        {
-            if (stack.back().type() == Token::Type::kOpenParen || stack.back().type() == Token::Type::kCloseParen)
-            {
-                std::cout << "Mismatched parentheses detected in expression!" << std::endl;
-            }
-            else
-            {
-                Token back = stack.back();
-                stack.pop_back();
-                output.push_back(back);
-            }
-        }
-
-        return output;
-    }
-
-    Token Parser::Peek() { return tokens_[index_]; }
-
-    Token Parser::Next()
-    {
-        Token t = Peek();
-        index_++;
-        return t;
-    }
-
-    int Parser::ResolveIdentifier()
-    {
-        std::string iden_val = Next().string_value();
-        // error if iden_val not in top level
-        return top_level_[iden_val];
+        top_level_[identifer] = value;
+        statement = DefineStatement(identifer, value);
+        return true;
     }
 
-    bool Parser::IsOperator(const Token &token)
+    std::vector<DefineStatement> Parser::Parse(const std::vector<Token> &tokens)
     {
-        std::vector<Token::Type> types = {
-            Token::Type::kLeftShift,
-            Token::Type::kRightShift,
-            Token::Type::kPlus,
-            Token::Type::kMinus,
-            Token::Type::kTimes,
-            Token::Type::kDivide,
-            Token::Type::kBitXor,
-            Token::Type::kBitAnd,
-            Token::Type::kBitOr,
-        };
-        return std::find(types.begin(), types.end(), token.type()) != types.end();
-    }
+        std::vector<DefineStatement> statements;
+        DefineStatement statement("", 0);
+        std::size_t index = 0;
 
-    int Parser::EvaluateExpression(std::vector<Token> tokens)
-    {
-        std::vector<Token> stack;
-        for (Token token : tokens)
+        while (index < tokens.size())
         {
-            if (IsOperator(token) && stack.size() > 1)
-            {
-                int op2 = stack.back().int_value();
-                stack.pop_back();
-                int op1 = stack.back().int_value();
-                stack.pop_back();
-                int result = 0;
-                if (token.type() == Token::Type::kTimes)
-                {
-                    result = op1 * op2;
-                }
-                if (token.type() == Token::Type::kDivide)
-                {
-                    result = op1 / op2;
-                }
-                if (token.type() == Token::Type::kPlus)
-                {
-                    result = op1 + op2;
-                }
-                if (token.type() == Token::Type::kMinus)
-                {
-                    result = op1 - op2;
-                }
-                if (token.type() == Token::Type::kLeftShift)
-                {
-                    result = op1 << op2;
-                }
-                if (token.type() == Token::Type::kRightShift)
-                {
-                    result = op1 >> op2;
-                }
-                if (token.type() == Token::Type::kBitAnd) {
-                    result = op1 & op2;
-                }
-                if (token.type() == Token::Type::kBitXor) {
-                    result = op1 ^ op2;
-                }
-                if (token.type() == Token::Type::kBitOr) {
-                    result = op1 | op2;
-                }
+            if (tokens[index++].type() != Token::Type::kDefine)
+                continue;
 
-                stack.push_back(Token(Token::Type::kNumber, result));
-            }
+            std::size_t line_end = index;
 
-            if (token.type() == Token::Type::kNumber)
-            {
-                stack.push_back(token);
-            }
+            while (line_end < tokens.size() && !tokens[line_end].first_on_line())
+                line_end++;
 
-            if (token.type() == Token::Type::kIdentifier)
-            {
-                // error if iden_val not in top level
-                std::string iden_val = token.string_value();
-                stack.push_back(Token(Token::Type::kNumber, top_level_[iden_val]));
-            }
-        }
-        return stack.size() ? stack.back().int_value() : 0;
-    }
+            if (ParseDefine(tokens.data() + index, tokens.data() + line_end, statement))
+                statements.push_back(statement);
 
-    DefineStatement Parser::ParseDefine()
-    {
-        if (Next().type() != Token::Type::kDefine)
-        {
-            // error
-        }
-
-        if (Peek().type() != Token::Type::kIdentifier)
-        {
-            // error
+            index = line_end;
         }
 
-        std::string identifer = Next().string_value();
-
-        // Ambiguous. Need to forward look for the replacement list
-        // if (Peek().type() == Token::Type::kOpenParen)
-        // {
-        //     // Parameters (x, y, x) Expression
-        //     Next();
-
-        //     while (Peek().type() != Token::Type::kCloseParen)
-        //     {
-        //         std::cout << Next().string_value() << std::endl;
-        //         if (Peek().type() == Token::Type::kComma) { Next(); }
-        //     }
-
-        //     Next();
-        //     // parse expression
-        // }
-
-        int value = EvaluateExpression(ToPostfix());
-
-        top_level_[identifer] = value;
-        return DefineStatement(identifer, value);
+        return statements;
     }
 
-    std::vector<DefineStatement> Parser::Parse(std::vector<Token> tokens)
+    std::vector<DefineStatement> Parser::Parse(StreamLexer &lexer)
     {
-        index_ = 0;
-        tokens_ = std::move(tokens);
         std::vector<DefineStatement> statements;
+        DefineStatement statement("", 0);
+        std::vector<Token> line;
+        TokenView token;
+        bool more = lexer.Next(token);
 
-        while (index_ < tokens_.size())
+        while (more)
         {
-            switch (Peek().type())
+            if (token.type != Token::Type::kDefine)
             {
-            case Token::Type::kDefine:
-                statements.push_back(ParseDefine());
-                break;
-
-            default:
-                Next();
-                break;
+                more = lexer.Next(token);
+                continue;
             }
+
+            // The token that ends the line is left in token for the next turn.
+            line.clear();
+
+            while ((more = lexer.Next(token)) && !token.first_on_line)
+                line.push_back(token.ToToken());
+
+            if (ParseDefine(line.data(), line.data() + line.size(), statement))
+                statements.push_back(statement);
         }
 
         return statements;
     }
 
-} // namespace core
\ No newline at end of file
+    std::vector<DefineStatement> Parser::ParseFile(const std::string &path)
+    {
+        MappedFile file(path);
+        StreamLexer lexer(file.data(), file.size());
+
+        return Parse(lexer);
+    }
+
+} // namespace core
@@ -22,25 +22,23 @@ namespace core
         int value_;
     };
 
+    // Evaluates the object-like #defines in one token stream, in order. Names
+    // that haven't been defined yet count as 0, and directives other than
+    // #define are skipped. See ConstantDatabase for following includes.
     class Parser
     {
     public:
         Parser() = default;
 
-        std::vector<DefineStatement> Parse(std::vector<Token> tokens);
+        std::vector<DefineStatement> Parse(const std::vector<Token> &tokens);
+
+        // Pulls tokens from the lexer as it goes; only the lines of #defines
+        // are turned into Tokens.
+        std::vector<DefineStatement> Parse(StreamLexer &lexer);
+        std::vector<DefineStatement> ParseFile(const std::string &path);
     private:
-        int EvaluateExpression(std::vector<Token> tokens);
-        int ResolveIdentifier();
-        int GetPrecedence(const Token& token);
-        bool IsOperator(const Token& token);
-        std::vector<Token> ToPostfix();
-        DefineStatement ParseDefine();
-
-        Token Peek();
-        Token Next();
-
-        unsigned long index_;
-        std::vector<Token> tokens_;
+        int EvaluateExpression(const Token *begin, const Token *end);
+        bool ParseDefine(const Token *begin, const Token *end, DefineStatement &statement);
 
         std::map<std::string, int> top_level_;
     };
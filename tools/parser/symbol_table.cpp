@@ -0,0 +1,66 @@
+#include "symbol_table.h"
+
+#include <cstring>
+
+namespace core
+{
+    // FNV-1a, as in constant_index.cpp.
+    uint32_t SymbolTable::Hash(const char *text, std::size_t length)
+    {
+        uint32_t hash = 2166136261u;
+
+        for (std::size_t i = 0; i < length; i++)
+        {
+            hash ^= static_cast<unsigned char>(text[i]);
+            hash *= 16777619u;
+        }
+
+        return hash;
+    }
+
+    // Keeps the table at most half full, so probes stay short.
+    void SymbolTable::Grow()
+    {
+        std::vector<uint32_t> slots(slots_.empty() ? 1024 : slots_.size() * 2, 0);
+        std::size_t mask = slots.size() - 1;
+
+        for (uint32_t symbol = 0; symbol < names_.size(); symbol++)
+        {
+            std::size_t i = hashes_[symbol] & mask;
+
+            while (slots[i] != 0)
+                i = (i + 1) & mask;
+
+            slots[i] = symbol + 1;
+        }
+
+        slots_.swap(slots);
+    }
+
+    uint32_t SymbolTable::Intern(const char *text, std::size_t length)
+    {
+        if ((names_.size() + 1) * 2 > slots_.size())
+            Grow();
+
+        uint32_t hash = Hash(text, length);
+        std::size_t mask = slots_.size() - 1;
+        std::size_t i = hash & mask;
+
+        while (slots_[i] != 0)
+        {
+            uint32_t symbol = slots_[i] - 1;
+            const std::string &name = names_[symbol];
+
+            if (hashes_[symbol] == hash && name.length() == length && std::memcmp(name.data(), text, length) == 0)
+                return symbol;
+
+            i = (i + 1) & mask;
+        }
+
+        uint32_t symbol = names_.size();
+        names_.emplace_back(text, length);
+        hashes_.push_back(hash);
+        slots_[i] = symbol + 1;
+        return symbol;
+    }
+} // namespace core
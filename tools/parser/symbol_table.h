@@ -0,0 +1,33 @@
+#ifndef INCLUDE_CORE_SYMBOL_TABLE_H
+#define INCLUDE_CORE_SYMBOL_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace core
+{
+    // Gives every distinct identifier a small number, so that code that sees
+    // the same names over and over can compare and look them up as integers.
+    // Looking up a name that's already there doesn't allocate.
+    class SymbolTable
+    {
+    public:
+        SymbolTable() = default;
+
+        uint32_t Intern(const char *text, std::size_t length);
+        const std::string &name(uint32_t symbol) const { return names_[symbol]; }
+        std::size_t size() const { return names_.size(); }
+
+    private:
+        static uint32_t Hash(const char *text, std::size_t length);
+        void Grow();
+
+        std::vector<std::string> names_;
+        std::vector<uint32_t> hashes_;
+        std::vector<uint32_t> slots_; // symbol + 1, or 0 for an empty slot
+    };
+} // namespace core
+
+#endif // INCLUDE_CORE_SYMBOL_TABLE_H
@@ -23,6 +23,7 @@
 #include <stdexcept>
 #include <string>
 #include <memory>
+#include <vector>
 #include "preproc.h"
 #include "c_file.h"
 #include "char_util.h"
@@ -31,28 +32,7 @@
 
 CFile::CFile(std::string filename) : m_filename(filename)
 {
-    FILE *fp = std::fopen(filename.c_str(), "rb");
-
-    if (fp == NULL)
-        FATAL_ERROR("Failed to open \"%s\" for reading.\n", filename.c_str());
-
-    std::fseek(fp, 0, SEEK_END);
-
-    m_size = std::ftell(fp);
-
-    if (m_size < 0)
-        FATAL_ERROR("File size of \"%s\" is less than zero.\n", filename.c_str());
-
-    m_buffer = new char[m_size + 1];
-
-    std::rewind(fp);
-
-    if (std::fread(m_buffer, m_size, 1, fp) != 1)
-        FATAL_ERROR("Failed to read \"%s\".\n", filename.c_str());
-
-    m_buffer[m_size] = 0;
-
-    std::fclose(fp);
+    m_buffer = ReadSourceFile(filename, m_size);
 
     m_pos = 0;
     m_lineNum = 1;
@@ -83,21 +63,21 @@ void CFile::Preproc()
         {
             if (m_buffer[m_pos] == stringChar)
             {
-                std::putchar(stringChar);
+                m_output.push_back(stringChar);
                 m_pos++;
                 stringChar = 0;
             }
             else if (m_buffer[m_pos] == '\\' && m_buffer[m_pos + 1] == stringChar)
             {
-                std::putchar('\\');
-                std::putchar(stringChar);
+                m_output.push_back('\\');
+                m_output.push_back(stringChar);
                 m_pos += 2;
             }
             else
             {
                 if (m_buffer[m_pos] == '\n')
                     m_lineNum++;
-                std::putchar(m_buffer[m_pos]);
+                m_output.push_back(m_buffer[m_pos]);
                 m_pos++;
             }
         }
@@ -111,7 +91,7 @@ void CFile::Preproc()
 
             char c = m_buffer[m_pos++];
 
-            std::putchar(c);
+            m_output.push_back(c);
 
             if (c == '\n')
                 m_lineNum++;
@@ -121,6 +101,9 @@ void CFile::Preproc()
                 stringChar = '\'';
         }
     }
+
+    std::fwrite(m_output.data(), 1, m_output.size(), stdout);
+    m_output.clear();
 }
 
 bool CFile::ConsumeHorizontalWhitespace()
@@ -140,7 +123,7 @@ bool CFile::ConsumeNewline()
     {
         m_pos += 2;
         m_lineNum++;
-        std::putchar('\n');
+        m_output.push_back('\n');
         return true;
     }
 
@@ -148,7 +131,7 @@ bool CFile::ConsumeNewline()
     {
         m_pos++;
         m_lineNum++;
-        std::putchar('\n');
+        m_output.push_back('\n');
         return true;
     }
 
@@ -191,7 +174,7 @@ void CFile::TryConvertString()
 
     SkipWhitespace();
 
-    std::printf("{ ");
+    m_output += "{ ";
 
     while (1)
     {
@@ -213,7 +196,7 @@ void CFile::TryConvertString()
             }
 
             for (int i = 0; i < length; i++)
-                printf("0x%02X, ", s[i]);
+                AppendHexByte(s[i]);
         }
         else if (m_buffer[m_pos] == ')')
         {
@@ -232,9 +215,9 @@ void CFile::TryConvertString()
     }
 
     if (noTerminator)
-        std::printf(" }");
+        m_output += " }";
     else
-        std::printf("0xFF }");
+        m_output += "0xFF }";
 }
 
 bool CFile::CheckIdentifier(const std::string& ident)
@@ -248,7 +231,8 @@ bool CFile::CheckIdentifier(const std::string& ident)
     return (i == ident.length());
 }
 
-std::unique_ptr<unsigned char[]> CFile::ReadWholeFile(const std::string& path, int& size)
+// Appends the contents of a file to data.
+void CFile::ReadWholeFile(const std::string& path, std::string& data)
 {
     FILE* fp = std::fopen(path.c_str(), "rb");
 
@@ -257,39 +241,151 @@ std::unique_ptr<unsigned char[]> CFile::ReadWholeFile(const std::string& path, i
 
     std::fseek(fp, 0, SEEK_END);
 
-    size = std::ftell(fp);
+    long size = std::ftell(fp);
+    std::size_t offset = data.size();
 
-    std::unique_ptr<unsigned char[]> buffer = std::unique_ptr<unsigned char[]>(new unsigned char[size]);
+    data.resize(offset + size);
 
     std::rewind(fp);
 
-    if (std::fread(buffer.get(), size, 1, fp) != 1)
+    if (size != 0 && std::fread(&data[offset], size, 1, fp) != 1)
         RaiseError("Failed to read \"%s\".\n", path.c_str());
 
     std::fclose(fp);
-
-    return buffer;
 }
 
-int ExtractData(const std::unique_ptr<unsigned char[]>& buffer, int offset, int size)
+unsigned int ExtractData(const unsigned char* buffer, int size)
 {
     switch (size)
     {
     case 1:
-        return buffer[offset];
+        return buffer[0];
     case 2:
-        return (buffer[offset + 1] << 8)
-            | buffer[offset];
+        return (buffer[1] << 8)
+            | buffer[0];
     case 4:
-        return (buffer[offset + 3] << 24)
-            | (buffer[offset + 2] << 16)
-            | (buffer[offset + 1] << 8)
-            | buffer[offset];
+        return ((unsigned int)buffer[3] << 24)
+            | (buffer[2] << 16)
+            | (buffer[1] << 8)
+            | buffer[0];
     default:
         FATAL_ERROR("Invalid size passed to ExtractData.\n");
     }
 }
 
+void CFile::AppendHexByte(unsigned char value)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    char s[6] = { '0', 'x', digits[value >> 4], digits[value & 0xF], ',', ' ' };
+
+    m_output.append(s, sizeof(s));
+}
+
+// Appends value in decimal, the same as printf("%u").
+void CFile::AppendDecimal(unsigned int value)
+{
+    char s[10];
+    int i = sizeof(s);
+
+    do
+    {
+        s[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+
+    m_output.append(s + i, sizeof(s) - i);
+}
+
+// Appends the elements of an INCBIN file as initializers, the same text as
+// printf'ing each element with "%d," or "%uu,".
+void CFile::AppendInitializerList(const std::string& data, int size, bool isSigned)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    std::size_t count = data.size() / size;
+
+    m_output.reserve(m_output.size() + count * (size == 4 ? 12 : 6));
+
+    for (std::size_t i = 0; i < count; i++)
+    {
+        unsigned int value = ExtractData(bytes + i * size, size);
+
+        if (isSigned && (int)value < 0)
+        {
+            m_output.push_back('-');
+            AppendDecimal(-value);
+        }
+        else
+        {
+            AppendDecimal(value);
+        }
+
+        if (!isSigned)
+            m_output.push_back('u');
+
+        m_output.push_back(',');
+    }
+}
+
+// Appends data as a single string literal. Printable characters are written
+// as they are, and everything else as a three digit octal escape, which can't
+// run into a following digit the way a hex escape would. '?' is escaped so
+// that nothing can form a trigraph.
+void CFile::AppendStringLiteral(const std::string& data)
+{
+    static const char digits[] = "01234567";
+
+    m_output.reserve(m_output.size() + data.size() * 4 + 2);
+    m_output.push_back('"');
+
+    for (unsigned char c : data)
+    {
+        if (IsAsciiPrintable(c) && c != '"' && c != '\\' && c != '?')
+        {
+            m_output.push_back(c);
+        }
+        else
+        {
+            char s[4] = { '\\', digits[c >> 6], digits[(c >> 3) & 7], digits[c & 7] };
+            m_output.append(s, sizeof(s));
+        }
+    }
+
+    m_output.push_back('"');
+}
+
+// If the output so far ends with "[] =", returns the position just after the
+// '[', which is where the size of the array goes. Otherwise, returns npos.
+std::size_t CFile::FindUnsizedArray()
+{
+    std::size_t pos = m_output.size();
+    const char expected[] = { '=', ']', '[' };
+
+    for (char c : expected)
+    {
+        while (pos > 0 && IsAsciiWhitespace(m_output[pos - 1]))
+            pos--;
+
+        if (pos == 0 || m_output[pos - 1] != c)
+            return std::string::npos;
+
+        pos--;
+    }
+
+    return pos + 1;
+}
+
+// Returns whether the next token in the input is one that can follow a whole
+// initializer in a declaration.
+bool CFile::IsEndOfDeclarator()
+{
+    long pos = m_pos;
+
+    while (pos < m_size && IsAsciiWhitespace(m_buffer[pos]))
+        pos++;
+
+    return pos < m_size && (m_buffer[pos] == ';' || m_buffer[pos] == ',');
+}
+
 void CFile::TryConvertIncbin()
 {
     std::string idents[6] = { "INCBIN_S8", "INCBIN_U8", "INCBIN_S16", "INCBIN_U16", "INCBIN_S32", "INCBIN_U32" };
@@ -326,7 +422,11 @@ void CFile::TryConvertIncbin()
 
     m_pos++;
 
-    std::printf("{");
+    std::size_t arraySizePos = (size == 1 && g_compactIncbin) ? FindUnsizedArray() : std::string::npos;
+    std::size_t outputStart = m_output.size();
+    std::vector<std::string> files;
+    std::vector<std::size_t> fileOutputPos;
+    std::size_t totalSize = 0;
 
     while (true)
     {
@@ -362,25 +462,13 @@ void CFile::TryConvertIncbin()
 
         m_pos++;
 
-        int fileSize;
-        std::unique_ptr<unsigned char[]> buffer = ReadWholeFile(path, fileSize);
-
-        if ((fileSize % size) != 0)
-            RaiseError("Size %d doesn't evenly divide file size %d.\n", size, fileSize);
-
-        int count = fileSize / size;
-        int offset = 0;
+        files.emplace_back();
+        ReadWholeFile(path, files.back());
+        fileOutputPos.push_back(m_output.size() - outputStart);
+        totalSize += files.back().size();
 
-        for (int i = 0; i < count; i++)
-        {
-            int data = ExtractData(buffer, offset, size);
-            offset += size;
-
-            if (isSigned)
-                std::printf("%d,", data);
-            else
-                std::printf("%uu,", data);
-        }
+        if ((files.back().size() % size) != 0)
+            RaiseError("Size %d doesn't evenly divide file size %d.\n", size, (int)files.back().size());
 
         SkipWhitespace();
 
@@ -395,7 +483,40 @@ void CFile::TryConvertIncbin()
 
     m_pos++;
 
-    std::printf("}");
+    // Any newlines between the paths were output while they were being read.
+    // They are taken back out and put after the data of the file they follow.
+    std::string whitespace = m_output.substr(outputStart);
+    std::size_t whitespacePos = 0;
+
+    m_output.resize(outputStart);
+
+    // An 8-bit INCBIN that is the whole initializer of an unsized array can be
+    // string literals instead, which cc1 reads as one token per file rather
+    // than one constant per byte. The array is given its size explicitly so
+    // that no null terminator is added, which keeps its contents and size the
+    // same.
+    bool useString = (arraySizePos != std::string::npos && totalSize != 0 && IsEndOfDeclarator());
+
+    if (useString)
+        m_output.insert(arraySizePos, std::to_string(totalSize));
+    else
+        m_output.push_back('{');
+
+    for (std::size_t i = 0; i < files.size(); i++)
+    {
+        m_output.append(whitespace, whitespacePos, fileOutputPos[i] - whitespacePos);
+        whitespacePos = fileOutputPos[i];
+
+        if (useString)
+            AppendStringLiteral(files[i]);
+        else
+            AppendInitializerList(files[i], size, isSigned);
+    }
+
+    m_output.append(whitespace, whitespacePos, std::string::npos);
+
+    if (!useString)
+        m_output.push_back('}');
 }
 
 // Reports a diagnostic message.
@@ -42,13 +42,20 @@ private:
     long m_size;
     long m_lineNum;
     std::string m_filename;
+    std::string m_output;
 
     bool ConsumeHorizontalWhitespace();
     bool ConsumeNewline();
     void SkipWhitespace();
     void TryConvertString();
-    std::unique_ptr<unsigned char[]> ReadWholeFile(const std::string& path, int& size);
+    void AppendHexByte(unsigned char value);
+    void ReadWholeFile(const std::string& path, std::string& data);
     bool CheckIdentifier(const std::string& ident);
+    void AppendDecimal(unsigned int value);
+    void AppendInitializerList(const std::string& data, int size, bool isSigned);
+    void AppendStringLiteral(const std::string& data);
+    std::size_t FindUnsizedArray();
+    bool IsEndOfDeclarator();
     void TryConvertIncbin();
     void ReportDiagnostic(const char* type, const char* format, std::va_list args);
     void RaiseError(const char* format, ...);
@@ -56,6 +56,11 @@ inline bool IsAsciiPrintable(unsigned char c)
     return (c >= ' ' && c <= '~');
 }
 
+inline bool IsAsciiWhitespace(unsigned char c)
+{
+    return (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+}
+
 // Returns whether the character can start a C identifier or the identifier of a "{FOO}" constant in strings.
 inline bool IsIdentifierStartingChar(unsigned char c)
 {
@@ -18,9 +18,19 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdint>
 #include <cstdarg>
+#include <cstring>
+#include <iterator>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
 #include "preproc.h"
 #include "charmap.h"
 #include "char_util.h"
@@ -369,10 +379,83 @@ void CharmapReader::SkipWhitespace()
         m_pos++;
 }
 
-Charmap::Charmap(std::string filename)
+// Binary cache format: a CacheHeader, then the char page index, the char
+// pages, the astral chars, the escapes, the sequences, the constant slots and
+// the constant names, each stored as raw arrays in host byte order.
+static const char kCacheMagic[16] = "preproc-cmap-1";
+
+struct CacheHeader
+{
+    char magic[16];
+    std::int64_t mtime;
+    std::int64_t size;
+    std::uint32_t numCharPages;
+    std::uint32_t numAstralChars;
+    std::uint32_t numSequences;
+    std::uint32_t numConstantSlots;
+    std::uint32_t constantNamesLength;
+    std::uint32_t padding;
+};
+
+static bool GetFileStamp(const std::string& path, long long& mtime, long long& size)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+
+#if defined(__APPLE__)
+    mtime = st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    mtime = st.st_mtime * 1000000000LL;
+#else
+    mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+    size = st.st_size;
+    return true;
+}
+
+// FNV-1a
+static std::uint32_t HashConstantName(const char* name, std::size_t length)
+{
+    std::uint32_t hash = 2166136261u;
+
+    for (std::size_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+
+    return hash;
+}
+
+Charmap::Charmap(const std::string& filename, const std::string& cachePath)
+{
+    long long mtime, size;
+    bool useCache = !cachePath.empty() && GetFileStamp(filename, mtime, size);
+
+    if (useCache && LoadCache(cachePath, mtime, size))
+        return;
+
+    Parse(filename);
+
+    if (useCache)
+        SaveCache(cachePath, mtime, size);
+}
+
+void Charmap::Parse(const std::string& filename)
 {
     CharmapReader reader(filename);
 
+    std::fill(std::begin(m_charPageIndex), std::end(m_charPageIndex), 0);
+    std::fill(std::begin(m_escapes), std::end(m_escapes), 0);
+
+    // Page 0 is shared by every block of 256 chars that has nothing mapped,
+    // and sequence 0 is the unmapped sequence.
+    m_charPages.assign(256, 0);
+    m_sequences.assign(1, CharmapSequence());
+    m_constantSlots.assign(16, ConstantSlot());
+    m_astralChars.clear();
+    m_constantNames.clear();
+    m_numConstants = 0;
+
     for (;;)
     {
         Lhs lhs = reader.ReadLhs();
@@ -387,22 +470,246 @@ Charmap::Charmap(std::string filename)
         switch (lhs.type)
         {
         case LhsType::Char:
-            if (m_chars.find(lhs.code) != m_chars.end())
+        {
+            std::uint16_t& slot = CharSlot(lhs.code);
+            if (slot != 0)
                 reader.RaiseError("redefining char");
-            m_chars[lhs.code] = sequence;
+            slot = AddSequence(sequence);
             break;
+        }
         case LhsType::Escape:
-            if (m_escapes[lhs.code].length() != 0)
+            if (m_escapes[lhs.code] != 0)
                 reader.RaiseError("redefining escape");
-            m_escapes[lhs.code] = sequence;
+            m_escapes[lhs.code] = AddSequence(sequence);
             break;
         case LhsType::Constant:
-            if (m_constants.find(lhs.name) != m_constants.end())
+            if (Constant(lhs.name.c_str(), lhs.name.length()) != nullptr)
                 reader.RaiseError("redefining constant");
-            m_constants[lhs.name] = sequence;
+            AddConstant(lhs.name, AddSequence(sequence));
             break;
         }
 
         reader.ExpectEmptyRestOfLine();
     }
 }
+
+std::uint16_t Charmap::AddSequence(const std::string& sequence)
+{
+    if (m_sequences.size() > UINT16_MAX)
+        FATAL_ERROR("Too many entries in charmap.\n");
+
+    CharmapSequence entry = CharmapSequence();
+
+    entry.length = sequence.length();
+    std::copy(sequence.begin(), sequence.end(), entry.bytes);
+    m_sequences.push_back(entry);
+
+    return m_sequences.size() - 1;
+}
+
+std::uint16_t Charmap::FindAstralChar(std::int32_t code) const
+{
+    auto it = std::lower_bound(m_astralChars.begin(), m_astralChars.end(), code,
+                               [](const AstralChar& c, std::int32_t code) { return c.code < code; });
+
+    return (it != m_astralChars.end() && it->code == code) ? it->sequence : 0;
+}
+
+// Returns a reference to the sequence index for a char, adding a page or an
+// astral char for it if needed.
+std::uint16_t& Charmap::CharSlot(std::int32_t code)
+{
+    if (code < 0x10000)
+    {
+        std::uint16_t& page = m_charPageIndex[code >> 8];
+
+        if (page == 0)
+        {
+            page = m_charPages.size() >> 8;
+            m_charPages.resize(m_charPages.size() + 256, 0);
+        }
+
+        return m_charPages[(page << 8) | (code & 0xFF)];
+    }
+
+    auto it = std::lower_bound(m_astralChars.begin(), m_astralChars.end(), code,
+                               [](const AstralChar& c, std::int32_t code) { return c.code < code; });
+
+    if (it == m_astralChars.end() || it->code != code)
+    {
+        AstralChar c = AstralChar();
+        c.code = code;
+        it = m_astralChars.insert(it, c);
+    }
+
+    return it->sequence;
+}
+
+// Returns the index of the slot holding a constant, or of the empty slot where
+// it would go.
+std::size_t Charmap::FindConstantSlot(const char* name, std::size_t length, std::uint32_t hash) const
+{
+    std::size_t mask = m_constantSlots.size() - 1;
+    std::size_t i = hash & mask;
+
+    for (;;)
+    {
+        const ConstantSlot& slot = m_constantSlots[i];
+
+        if (slot.sequence == 0)
+            return i;
+
+        if (slot.hash == hash && slot.nameLength == length
+         && m_constantNames.compare(slot.nameOffset, length, name, length) == 0)
+            return i;
+
+        i = (i + 1) & mask;
+    }
+}
+
+const CharmapSequence* Charmap::Constant(const char* name, std::size_t length) const
+{
+    std::uint16_t sequence = m_constantSlots[FindConstantSlot(name, length, HashConstantName(name, length))].sequence;
+
+    return sequence != 0 ? &m_sequences[sequence] : nullptr;
+}
+
+void Charmap::AddConstant(const std::string& name, std::uint16_t sequence)
+{
+    // Keep the table at most half full, so that probe sequences stay short.
+    if ((m_numConstants + 1) * 2 > m_constantSlots.size())
+    {
+        std::vector<ConstantSlot> oldSlots(m_constantSlots.size() * 2, ConstantSlot());
+
+        oldSlots.swap(m_constantSlots);
+
+        for (const ConstantSlot& slot : oldSlots)
+        {
+            if (slot.sequence != 0)
+                m_constantSlots[FindConstantSlot(&m_constantNames[slot.nameOffset], slot.nameLength, slot.hash)] = slot;
+        }
+    }
+
+    ConstantSlot slot;
+
+    if (name.length() > UINT16_MAX)
+        FATAL_ERROR("Charmap constant \"%s\" is too long.\n", name.c_str());
+
+    slot.hash = HashConstantName(name.c_str(), name.length());
+    slot.nameOffset = m_constantNames.length();
+    slot.nameLength = name.length();
+    slot.sequence = sequence;
+
+    m_constantNames += name;
+    m_constantSlots[FindConstantSlot(name.c_str(), name.length(), slot.hash)] = slot;
+    m_numConstants++;
+}
+
+bool Charmap::LoadCache(const std::string& cachePath, long long mtime, long long size)
+{
+    FILE *fp = std::fopen(cachePath.c_str(), "rb");
+
+    if (fp == NULL)
+        return false;
+
+    CacheHeader header;
+    bool ok = std::fread(&header, sizeof(header), 1, fp) == 1
+           && std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) == 0
+           && header.mtime == mtime
+           && header.size == size
+           && header.numCharPages != 0
+           && header.numSequences != 0
+           && header.numConstantSlots != 0
+           && (header.numConstantSlots & (header.numConstantSlots - 1)) == 0;
+
+    if (ok)
+    {
+        m_charPages.resize(header.numCharPages * 256);
+        m_astralChars.resize(header.numAstralChars);
+        m_sequences.resize(header.numSequences);
+        m_constantSlots.resize(header.numConstantSlots);
+        m_constantNames.resize(header.constantNamesLength);
+
+        ok = std::fread(m_charPageIndex, sizeof(m_charPageIndex), 1, fp) == 1
+          && std::fread(m_charPages.data(), sizeof(std::uint16_t), m_charPages.size(), fp) == m_charPages.size()
+          && std::fread(m_astralChars.data(), sizeof(AstralChar), m_astralChars.size(), fp) == m_astralChars.size()
+          && std::fread(m_escapes, sizeof(m_escapes), 1, fp) == 1
+          && std::fread(m_sequences.data(), sizeof(CharmapSequence), m_sequences.size(), fp) == m_sequences.size()
+          && std::fread(m_constantSlots.data(), sizeof(ConstantSlot), m_constantSlots.size(), fp) == m_constantSlots.size()
+          && std::fread(&m_constantNames[0], 1, m_constantNames.size(), fp) == m_constantNames.size()
+          && std::fgetc(fp) == EOF;
+    }
+
+    std::fclose(fp);
+
+    // Everything the lookups index with has to be in range, so that a corrupt
+    // cache can't make them read out of bounds.
+    for (std::size_t i = 0; ok && i < 256; i++)
+        ok = m_charPageIndex[i] < header.numCharPages;
+
+    for (std::size_t i = 0; ok && i < m_charPages.size(); i++)
+        ok = m_charPages[i] < m_sequences.size();
+
+    for (std::size_t i = 0; ok && i < m_astralChars.size(); i++)
+        ok = m_astralChars[i].sequence < m_sequences.size();
+
+    for (std::size_t i = 0; ok && i < 128; i++)
+        ok = m_escapes[i] < m_sequences.size();
+
+    for (std::size_t i = 0; ok && i < m_constantSlots.size(); i++)
+    {
+        const ConstantSlot& slot = m_constantSlots[i];
+        ok = slot.sequence < m_sequences.size()
+          && (std::size_t)slot.nameOffset + slot.nameLength <= m_constantNames.size();
+    }
+
+    for (std::size_t i = 0; ok && i < m_sequences.size(); i++)
+        ok = m_sequences[i].length <= kMaxCharmapSequenceLength;
+
+    return ok;
+}
+
+// Failing to save the cache only makes the next run slower. Each process
+// writes its own temporary file, so that parallel builds can't interleave
+// their writes.
+void Charmap::SaveCache(const std::string& cachePath, long long mtime, long long size) const
+{
+    std::string tempPath = cachePath + ".tmp" + std::to_string(getpid());
+    FILE *fp = std::fopen(tempPath.c_str(), "wb");
+
+    if (fp == NULL)
+    {
+        std::fprintf(stderr, "Warning: failed to write \"%s\".\n", cachePath.c_str());
+        return;
+    }
+
+    CacheHeader header = CacheHeader();
+
+    std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.mtime = mtime;
+    header.size = size;
+    header.numCharPages = m_charPages.size() >> 8;
+    header.numAstralChars = m_astralChars.size();
+    header.numSequences = m_sequences.size();
+    header.numConstantSlots = m_constantSlots.size();
+    header.constantNamesLength = m_constantNames.size();
+
+    std::fwrite(&header, sizeof(header), 1, fp);
+    std::fwrite(m_charPageIndex, sizeof(m_charPageIndex), 1, fp);
+    std::fwrite(m_charPages.data(), sizeof(std::uint16_t), m_charPages.size(), fp);
+    std::fwrite(m_astralChars.data(), sizeof(AstralChar), m_astralChars.size(), fp);
+    std::fwrite(m_escapes, sizeof(m_escapes), 1, fp);
+    std::fwrite(m_sequences.data(), sizeof(CharmapSequence), m_sequences.size(), fp);
+    std::fwrite(m_constantSlots.data(), sizeof(ConstantSlot), m_constantSlots.size(), fp);
+    std::fwrite(m_constantNames.data(), 1, m_constantNames.size(), fp);
+
+    bool ok = !std::ferror(fp);
+
+    ok = (std::fclose(fp) == 0) && ok;
+
+    if (!ok || std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+        std::fprintf(stderr, "Warning: failed to write \"%s\".\n", cachePath.c_str());
+        std::remove(tempPath.c_str());
+    }
+}
@@ -21,44 +21,83 @@
 #ifndef CHARMAP_H
 #define CHARMAP_H
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
-#include <map>
 #include <vector>
 
+const unsigned long kMaxCharmapSequenceLength = 16;
+
+// The bytes that a char, escape or constant maps to. They are stored inline so
+// that looking up and copying a sequence never allocates.
+struct CharmapSequence
+{
+    std::uint8_t length;
+    std::uint8_t bytes[kMaxCharmapSequenceLength];
+};
+
+// The charmap compiled into flat tables. Chars in the BMP are found through a
+// two-level table indexed by code point, escapes through a table indexed by
+// ASCII code, and constants through an open-addressed hash table. All of them
+// hold indexes into one array of sequences, where index 0 means unmapped.
+// The tables can be saved to a binary cache file, which is loaded instead of
+// parsing the charmap again for as long as the charmap's mtime and size match.
 class Charmap
 {
 public:
-    Charmap(std::string filename);
+    Charmap(const std::string& filename, const std::string& cachePath = std::string());
 
-    std::string Char(std::int32_t code)
+    const CharmapSequence* Char(std::int32_t code) const
     {
-        auto it = m_chars.find(code);
+        std::uint16_t index;
 
-        if (it == m_chars.end())
-            return std::string();
+        if (code >= 0 && code < 0x10000)
+            index = m_charPages[(m_charPageIndex[code >> 8] << 8) | (code & 0xFF)];
+        else
+            index = FindAstralChar(code);
 
-        return it->second;
+        return index != 0 ? &m_sequences[index] : nullptr;
     }
 
-    std::string Escape(unsigned char code)
+    const CharmapSequence* Escape(unsigned char code) const
     {
-        return m_escapes[code];
+        return (code < 128 && m_escapes[code] != 0) ? &m_sequences[m_escapes[code]] : nullptr;
     }
 
-    std::string Constant(std::string identifier)
+    const CharmapSequence* Constant(const char* name, std::size_t length) const;
+
+private:
+    struct AstralChar
     {
-        auto it = m_constants.find(identifier);
+        std::int32_t code;
+        std::uint16_t sequence;
+    };
 
-        if (it == m_constants.end())
-            return std::string();
+    struct ConstantSlot
+    {
+        std::uint32_t hash;
+        std::uint32_t nameOffset;
+        std::uint16_t nameLength;
+        std::uint16_t sequence;
+    };
 
-        return it->second;
-    }
-private:
-    std::map<std::int32_t, std::string> m_chars;
-    std::string m_escapes[128];
-    std::map<std::string, std::string> m_constants;
+    std::uint16_t m_charPageIndex[256];
+    std::vector<std::uint16_t> m_charPages;
+    std::vector<AstralChar> m_astralChars;
+    std::uint16_t m_escapes[128];
+    std::vector<CharmapSequence> m_sequences;
+    std::vector<ConstantSlot> m_constantSlots;
+    std::string m_constantNames;
+    std::size_t m_numConstants = 0;
+
+    void Parse(const std::string& filename);
+    bool LoadCache(const std::string& cachePath, long long mtime, long long size);
+    void SaveCache(const std::string& cachePath, long long mtime, long long size) const;
+    std::uint16_t AddSequence(const std::string& sequence);
+    std::uint16_t FindAstralChar(std::int32_t code) const;
+    std::uint16_t& CharSlot(std::int32_t code);
+    std::size_t FindConstantSlot(const char* name, std::size_t length, std::uint32_t hash) const;
+    void AddConstant(const std::string& name, std::uint16_t sequence);
 };
 
 #endif // CHARMAP_H
@@ -18,14 +18,21 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
 #include <string>
 #include <stack>
+#include <vector>
 #include "preproc.h"
 #include "asm_file.h"
 #include "c_file.h"
 #include "charmap.h"
+#include "char_util.h"
+#include "string_parser.h"
 
 Charmap* g_charmap;
+bool g_compactIncbin;
 
 void PrintAsmBytes(unsigned char *s, int length)
 {
@@ -109,6 +116,48 @@ void PreprocCFile(std::string filename)
     cFile.Preproc();
 }
 
+// Reads a whole source file into a new null-terminated buffer. "-" reads
+// standard input, so that preproc can sit in a pipeline after the C
+// preprocessor without an intermediate file.
+char* ReadSourceFile(const std::string& filename, long& size)
+{
+    bool isStdin = (filename == "-");
+    FILE *fp = isStdin ? stdin : std::fopen(filename.c_str(), "rb");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", filename.c_str());
+
+    long capacity = 1 << 16;
+    char* buffer = new char[capacity + 1];
+    size_t count;
+
+    size = 0;
+
+    while ((count = std::fread(buffer + size, 1, capacity - size, fp)) != 0)
+    {
+        size += count;
+
+        if (size == capacity)
+        {
+            char* newBuffer = new char[capacity * 2 + 1];
+            std::memcpy(newBuffer, buffer, size);
+            delete[] buffer;
+            buffer = newBuffer;
+            capacity *= 2;
+        }
+    }
+
+    if (std::ferror(fp))
+        FATAL_ERROR("Failed to read \"%s\".\n", filename.c_str());
+
+    buffer[size] = 0;
+
+    if (!isStdin)
+        std::fclose(fp);
+
+    return buffer;
+}
+
 char* GetFileExtension(char* filename)
 {
     char* extension = filename;
@@ -130,27 +179,296 @@ char* GetFileExtension(char* filename)
     return extension;
 }
 
+// Returns the language of a file from its extension, unless -x was given.
+std::string GetLanguage(char* filename, const std::string& forcedLanguage)
+{
+    if (!forcedLanguage.empty())
+        return forcedLanguage;
+
+    char* extension = GetFileExtension(filename);
+
+    if (!extension)
+        FATAL_ERROR("\"%s\" has no file extension.\n", filename);
+
+    if ((extension[0] == 's') && extension[1] == 0)
+        return "asm";
+    else if ((extension[0] == 'c' || extension[0] == 'i') && extension[1] == 0)
+        return "c";
+    else
+        FATAL_ERROR("\"%s\" has an unknown file extension of \"%s\".\n", filename, extension);
+}
+
+void PreprocFile(char* filename, const std::string& language)
+{
+    if (language == "asm")
+        PreprocAsmFile(filename);
+    else
+        PreprocCFile(filename);
+}
+
+// Output goes through stdio in large blocks rather than a line at a time.
+void SetOutputBuffer()
+{
+    static char buffer[1 << 20];
+    std::setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+}
+
+// Processes each "SRC_FILE OUTPUT_FILE" line of jobFile ("-" for stdin) with
+// the charmap that was loaded once. Each output is written to a temporary file
+// that is renamed into place when it is complete, so a failure partway through
+// never leaves a truncated output behind.
+void RunBatch(const char* jobFile, const std::string& forcedLanguage)
+{
+    bool isStdin = (std::strcmp(jobFile, "-") == 0);
+    FILE *fp = isStdin ? stdin : std::fopen(jobFile, "r");
+
+    if (fp == NULL)
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", jobFile);
+
+    char line[2 * kMaxPath + 2];
+    char srcPath[kMaxPath];
+    char outputPath[kMaxPath];
+    char extra;
+
+    while (std::fgets(line, sizeof(line), fp))
+    {
+        int count = std::sscanf(line, "%255s %255s %c", srcPath, outputPath, &extra);
+
+        if (count <= 0 || srcPath[0] == '#')
+            continue;
+
+        if (count != 2)
+            FATAL_ERROR("Expected \"SRC_FILE OUTPUT_FILE\" in batch job \"%s\".\n", line);
+
+        std::string language = GetLanguage(srcPath, forcedLanguage);
+        std::string tempPath = std::string(outputPath) + ".tmp";
+
+        if (!std::freopen(tempPath.c_str(), "wb", stdout))
+            FATAL_ERROR("Failed to open \"%s\" for writing.\n", tempPath.c_str());
+
+        SetOutputBuffer();
+        PreprocFile(srcPath, language);
+
+        if (std::fflush(stdout) != 0 || std::ferror(stdout))
+            FATAL_ERROR("Failed to write \"%s\".\n", tempPath.c_str());
+
+        if (std::rename(tempPath.c_str(), outputPath) != 0)
+            FATAL_ERROR("Failed to rename \"%s\" to \"%s\".\n", tempPath.c_str(), outputPath);
+    }
+
+    if (!isStdin)
+        std::fclose(fp);
+}
+
+// Returns the position of the string literal after "_(", "__(" or ".string"
+// at pos, or -1 if there isn't one.
+static long FindCharmapString(const char* buffer, long pos)
+{
+    if (pos > 0 && IsIdentifierChar(buffer[pos - 1]))
+        return -1;
+
+    if (std::strncmp(&buffer[pos], "__(", 3) == 0)
+        pos += 3;
+    else if (std::strncmp(&buffer[pos], "_(", 2) == 0)
+        pos += 2;
+    else if (std::strncmp(&buffer[pos], ".string", 7) == 0 && !IsIdentifierChar(buffer[pos + 7]))
+        pos += 7;
+    else
+        return -1;
+
+    while (buffer[pos] == ' ' || buffer[pos] == '\t' || buffer[pos] == '\n' || buffer[pos] == '\r')
+        pos++;
+
+    return buffer[pos] == '"' ? pos : -1;
+}
+
+static double ElapsedMicroseconds(std::chrono::steady_clock::time_point start, int passes)
+{
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / passes;
+}
+
+// Times loading the charmap from its text and from the binary cache, and then
+// converting every charmap string found in the given files.
+void RunBenchmark(const char* charmapPath, const std::string& cachePath, const std::vector<char*>& files)
+{
+    const int loadPasses = 100;
+    const int convertPasses = 20;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < loadPasses; i++)
+        delete new Charmap(charmapPath);
+
+    std::printf("charmap text:  %10.1f us per load\n", ElapsedMicroseconds(start, loadPasses));
+
+    if (!cachePath.empty())
+    {
+        delete new Charmap(charmapPath, cachePath);
+
+        start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < loadPasses; i++)
+            delete new Charmap(charmapPath, cachePath);
+
+        std::printf("charmap cache: %10.1f us per load\n", ElapsedMicroseconds(start, loadPasses));
+    }
+
+    g_charmap = new Charmap(charmapPath, cachePath);
+
+    struct Source
+    {
+        char* buffer;
+        long size;
+        std::vector<long> strings;
+    };
+
+    std::vector<Source> sources;
+    long numStrings = 0;
+    long inputSize = 0;
+    long outputSize = 0;
+    unsigned char s[kMaxStringLength];
+    int length;
+
+    for (char* file : files)
+    {
+        Source source;
+        source.buffer = ReadSourceFile(file, source.size);
+
+        for (long pos = 0; pos < source.size; pos++)
+        {
+            long stringPos = FindCharmapString(source.buffer, pos);
+
+            if (stringPos < 0)
+                continue;
+
+            // Strings that don't convert, such as ones with a pad length in
+            // asm, are left out rather than timed with their exceptions.
+            try
+            {
+                StringParser stringParser(source.buffer, source.size);
+                int count = stringParser.ParseString(stringPos, s, length);
+
+                source.strings.push_back(stringPos);
+                numStrings++;
+                inputSize += count;
+                outputSize += length;
+                pos = stringPos + count - 1;
+            }
+            catch (std::runtime_error&)
+            {
+            }
+        }
+
+        sources.push_back(source);
+    }
+
+    start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < convertPasses; i++)
+    {
+        for (Source& source : sources)
+        {
+            StringParser stringParser(source.buffer, source.size);
+
+            for (long pos : source.strings)
+                stringParser.ParseString(pos, s, length);
+        }
+    }
+
+    double microseconds = ElapsedMicroseconds(start, convertPasses);
+
+    std::printf("strings:       %10.1f us per pass (%ld strings, %ld bytes in, %ld bytes out, %.1f MB/s)\n",
+                microseconds, numStrings, inputSize, outputSize, inputSize / microseconds);
+
+    for (Source& source : sources)
+        delete[] source.buffer;
+}
+
+const char* const USAGE =
+    "Usage: preproc [-x c|asm] [-compact-incbin] [-charmap-cache CACHE_FILE]\n"
+    "               SRC_FILE CHARMAP_FILE\n"
+    "       preproc -batch [-x c|asm] [-compact-incbin] [-charmap-cache CACHE_FILE]\n"
+    "               CHARMAP_FILE [JOB_FILE]\n"
+    "SRC_FILE may be \"-\" for standard input, in which case -x is required.\n"
+    "       preproc -bench [-charmap-cache CACHE_FILE] CHARMAP_FILE FILE...\n"
+    "-compact-incbin turns INCBIN_U8 and INCBIN_S8 arrays into string literals.\n"
+    "-charmap-cache loads the compiled charmap from CACHE_FILE, or saves it\n"
+    "there if it is missing or older than CHARMAP_FILE.\n"
+    "In batch mode, each line of JOB_FILE (standard input by default) names a\n"
+    "SRC_FILE and the OUTPUT_FILE to write.\n";
+
 int main(int argc, char **argv)
 {
-    if (argc != 3)
+    std::vector<char*> args;
+    std::string forcedLanguage;
+    std::string charmapCache;
+    bool batch = false;
+    bool bench = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+
+        if (arg == "-batch")
+        {
+            batch = true;
+        }
+        else if (arg == "-bench")
+        {
+            bench = true;
+        }
+        else if (arg == "-charmap-cache" && i + 1 < argc)
+        {
+            charmapCache = argv[++i];
+        }
+        else if (arg == "-compact-incbin")
+        {
+            g_compactIncbin = true;
+        }
+        else if (arg == "-x" && i + 1 < argc)
+        {
+            forcedLanguage = argv[++i];
+
+            if (forcedLanguage != "c" && forcedLanguage != "asm")
+                FATAL_ERROR("Unknown language \"%s\".\n", forcedLanguage.c_str());
+        }
+        else if (arg.length() > 1 && arg[0] == '-')
+        {
+            FATAL_ERROR("%s", USAGE);
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+    }
+
+    if (bench ? args.size() < 1 : batch ? (args.size() < 1 || args.size() > 2) : args.size() != 2)
     {
-        std::fprintf(stderr, "Usage: %s SRC_FILE CHARMAP_FILE", argv[0]);
+        std::fprintf(stderr, "%s", USAGE);
         return 1;
     }
 
-    g_charmap = new Charmap(argv[2]);
+    if (bench)
+    {
+        RunBenchmark(args[0], charmapCache, std::vector<char*>(args.begin() + 1, args.end()));
+        return 0;
+    }
+
+    if (batch)
+    {
+        g_charmap = new Charmap(args[0], charmapCache);
+        RunBatch(args.size() == 2 ? args[1] : "-", forcedLanguage);
+        return 0;
+    }
 
-    char* extension = GetFileExtension(argv[1]);
+    if (std::strcmp(args[0], "-") == 0 && forcedLanguage.empty())
+        FATAL_ERROR("Reading standard input requires -x c or -x asm.\n");
 
-    if (!extension)
-        FATAL_ERROR("\"%s\" has no file extension.\n", argv[1]);
+    g_charmap = new Charmap(args[1], charmapCache);
 
-    if ((extension[0] == 's') && extension[1] == 0)
-        PreprocAsmFile(argv[1]);
-    else if ((extension[0] == 'c' || extension[0] == 'i') && extension[1] == 0)
-        PreprocCFile(argv[1]);
-    else
-        FATAL_ERROR("\"%s\" has an unknown file extension of \"%s\".\n", argv[1], extension);
+    SetOutputBuffer();
+    PreprocFile(args[0], GetLanguage(args[0], forcedLanguage));
 
     return 0;
 }
@@ -23,6 +23,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <string>
 #include "charmap.h"
 
 #ifdef _MSC_VER
@@ -47,8 +48,10 @@ do                                               \
 
 const int kMaxPath = 256;
 const int kMaxStringLength = 1024;
-const unsigned long kMaxCharmapSequenceLength = 16;
 
 extern Charmap* g_charmap;
+extern bool g_compactIncbin;
+
+char* ReadSourceFile(const std::string& filename, long& size);
 
 #endif // PREPROC_H
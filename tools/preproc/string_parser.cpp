@@ -26,10 +26,31 @@
 #include "char_util.h"
 #include "utf8.h"
 
+// Appends bytes to the mapped string.
+void StringParser::AppendBytes(const unsigned char* bytes, int length)
+{
+    if (m_destLength + length > kMaxStringLength)
+        RaiseError("mapped string longer than %d bytes", kMaxStringLength);
+
+    for (int i = 0; i < length; i++)
+        m_dest[m_destLength++] = bytes[i];
+}
+
+// Appends an integer in little-endian order.
+void StringParser::AppendInteger(Integer integer)
+{
+    unsigned char bytes[4];
+
+    for (int i = 0; i < integer.size; i++)
+        bytes[i] = (unsigned char)(integer.value >> (8 * i));
+
+    AppendBytes(bytes, integer.size);
+}
+
 // Reads a charmap char or escape sequence.
-std::string StringParser::ReadCharOrEscape()
+void StringParser::ReadCharOrEscape()
 {
-    std::string sequence;
+    const CharmapSequence* sequence;
 
     bool isEscape = (m_buffer[m_pos] == '\\');
 
@@ -41,19 +62,21 @@ std::string StringParser::ReadCharOrEscape()
         {
             sequence = g_charmap->Char('"');
 
-            if (sequence.length() == 0)
+            if (sequence == nullptr)
                 RaiseError("no mapping exists for double quote");
 
-            return sequence;
+            AppendBytes(sequence->bytes, sequence->length);
+            return;
         }
         else if (m_buffer[m_pos] == '\\')
         {
             sequence = g_charmap->Char('\\');
 
-            if (sequence.length() == 0)
+            if (sequence == nullptr)
                 RaiseError("no mapping exists for backslash");
 
-            return sequence;
+            AppendBytes(sequence->bytes, sequence->length);
+            return;
         }
     }
 
@@ -82,7 +105,7 @@ std::string StringParser::ReadCharOrEscape()
 
     sequence = isEscape ? g_charmap->Escape(code) : g_charmap->Char(code);
 
-    if (sequence.length() == 0)
+    if (sequence == nullptr)
     {
         if (isEscape)
             RaiseError("unknown escape '\\%c'", code);
@@ -90,14 +113,12 @@ std::string StringParser::ReadCharOrEscape()
             RaiseError("unknown character U+%X", code);
     }
 
-    return sequence;
+    AppendBytes(sequence->bytes, sequence->length);
 }
 
 // Reads a charmap constant, i.e. "{FOO}".
-std::string StringParser::ReadBracketedConstants()
+void StringParser::ReadBracketedConstants()
 {
-    std::string totalSequence;
-
     m_pos++; // Assume we're on the left curly bracket.
 
     while (m_buffer[m_pos] != '}')
@@ -113,36 +134,19 @@ std::string StringParser::ReadBracketedConstants()
             while (IsIdentifierChar(m_buffer[m_pos]))
                 m_pos++;
 
-            std::string sequence = g_charmap->Constant(std::string(&m_buffer[startPos], m_pos - startPos));
+            const CharmapSequence* sequence = g_charmap->Constant(&m_buffer[startPos], m_pos - startPos);
 
-            if (sequence.length() == 0)
+            if (sequence == nullptr)
             {
                 m_buffer[m_pos] = 0;
                 RaiseError("unknown constant '%s'", &m_buffer[startPos]);
             }
 
-            totalSequence += sequence;
+            AppendBytes(sequence->bytes, sequence->length);
         }
         else if (IsAsciiDigit(m_buffer[m_pos]))
         {
-            Integer integer = ReadInteger();
-
-            switch (integer.size)
-            {
-            case 1:
-                totalSequence += (unsigned char)integer.value;
-                break;
-            case 2:
-                totalSequence += (unsigned char)integer.value;
-                totalSequence += (unsigned char)(integer.value >> 8);
-                break;
-            case 4:
-                totalSequence += (unsigned char)integer.value;
-                totalSequence += (unsigned char)(integer.value >> 8);
-                totalSequence += (unsigned char)(integer.value >> 16);
-                totalSequence += (unsigned char)(integer.value >> 24);
-                break;
-            }
+            AppendInteger(ReadInteger());
         }
         else if (m_buffer[m_pos] == 0)
         {
@@ -161,14 +165,14 @@ std::string StringParser::ReadBracketedConstants()
     }
 
     m_pos++; // Go past the right curly bracket.
-
-    return totalSequence;
 }
 
 // Reads a charmap string.
 int StringParser::ParseString(long srcPos, unsigned char* dest, int& destLength)
 {
     m_pos = srcPos;
+    m_dest = dest;
+    m_destLength = 0;
 
     if (m_buffer[m_pos] != '"')
         RaiseError("expected UTF-8 string literal");
@@ -177,23 +181,18 @@ int StringParser::ParseString(long srcPos, unsigned char* dest, int& destLength)
 
     m_pos++;
 
-    destLength = 0;
-
     while (m_buffer[m_pos] != '"')
     {
-        std::string sequence = (m_buffer[m_pos] == '{') ? ReadBracketedConstants() : ReadCharOrEscape();
-
-        for (const char& c : sequence)
-        {
-            if (destLength == kMaxStringLength)
-                RaiseError("mapped string longer than %d bytes", kMaxStringLength);
-
-            dest[destLength++] = c;
-        }
+        if (m_buffer[m_pos] == '{')
+            ReadBracketedConstants();
+        else
+            ReadCharOrEscape();
     }
 
     m_pos++; // Go past the right quote.
 
+    destLength = m_destLength;
+
     return m_pos - start;
 }
 
@@ -1,9 +1,19 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdint>
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <string>
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "ramscrgen.h"
 #include "elf.h"
 
@@ -13,7 +23,10 @@ static std::string s_elfPath;
 static std::string s_archiveFilePath;
 static std::string s_archiveObjectPath;
 
-static FILE *s_file;
+// The whole ELF file or archive being read, and the read position in it.
+static const std::uint8_t *s_data;
+static std::size_t s_dataSize;
+static std::size_t s_pos;
 
 static std::uint32_t s_sectionHeaderOffset;
 static int s_sectionHeaderEntrySize;
@@ -32,26 +45,120 @@ struct Symbol
     std::uint32_t size;
 };
 
+// A read-only view of a whole file, mapped into memory where that's possible.
+class MappedFile
+{
+public:
+    MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    bool IsOpen() const { return m_open; }
+    const std::uint8_t *GetData() const { return m_data; }
+    std::size_t GetSize() const { return m_size; }
+
+private:
+    bool m_open = false;
+    const std::uint8_t *m_data = nullptr;
+    std::size_t m_size = 0;
+#ifdef _WIN32
+    std::vector<std::uint8_t> m_buffer;
+#endif
+};
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path)
+{
+    std::ifstream stream(path, std::ios::binary);
+
+    if (!stream)
+        return;
+
+    m_buffer.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    m_open = true;
+}
+
+MappedFile::~MappedFile()
+{
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+
+    if (fd < 0)
+        return;
+
+    if (fstat(fd, &st) == 0)
+    {
+        m_size = st.st_size;
+
+        // mmap can't map an empty file, but there's nothing to read anyway.
+        if (m_size == 0)
+        {
+            m_open = true;
+        }
+        else
+        {
+            void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED)
+            {
+                m_data = static_cast<const std::uint8_t *>(data);
+                m_open = true;
+            }
+        }
+    }
+
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data != nullptr)
+        munmap(const_cast<std::uint8_t *>(m_data), m_size);
+}
+
+#endif // _WIN32
+
 static void Seek(long offset)
 {
-    if (std::fseek(s_file, s_elfFileOffset + offset, SEEK_SET) != 0)
+    if (offset < 0 || static_cast<std::size_t>(offset) > s_dataSize - s_elfFileOffset)
         FATAL_ERROR("error: failed to seek to %ld in \"%s\"", offset, s_elfPath.c_str());
+
+    s_pos = s_elfFileOffset + offset;
 }
 
 static void Skip(long offset)
 {
-    if (std::fseek(s_file, offset, SEEK_CUR) != 0)
+    if (offset < 0 || static_cast<std::size_t>(offset) > s_dataSize - s_pos)
         FATAL_ERROR("error: failed to skip %ld bytes in \"%s\"", offset, s_elfPath.c_str());
+
+    s_pos += offset;
 }
 
-static std::uint32_t ReadInt8()
+static bool ReadBytes(void *dest, std::size_t count)
 {
-    int c = std::fgetc(s_file);
+    if (count > s_dataSize - s_pos)
+        return false;
+
+    std::memcpy(dest, s_data + s_pos, count);
+    s_pos += count;
+    return true;
+}
 
-    if (c < 0)
+static std::uint32_t ReadInt8()
+{
+    if (s_pos >= s_dataSize)
         FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", s_elfPath.c_str());
 
-    return c;
+    return s_data[s_pos++];
 }
 
 static std::uint32_t ReadInt16()
@@ -74,13 +181,16 @@ static std::uint32_t ReadInt32()
 
 static std::string ReadString()
 {
-    std::string s;
-    char c;
+    const void *end = s_pos < s_dataSize ? std::memchr(s_data + s_pos, 0, s_dataSize - s_pos) : nullptr;
+
+    if (end == nullptr)
+        FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", s_elfPath.c_str());
 
-    while ((c = ReadInt8()) != 0)
-        s += c;
+    const char *start = reinterpret_cast<const char *>(s_data + s_pos);
+    std::size_t length = static_cast<const char *>(end) - start;
 
-    return s;
+    s_pos += length + 1;
+    return std::string(start, length);
 }
 
 static void VerifyElfIdent()
@@ -88,16 +198,16 @@ static void VerifyElfIdent()
     char expectedMagic[4] = { 0x7F, 'E', 'L', 'F' };
     char magic[4];
 
-    if (std::fread(magic, 4, 1, s_file) != 1)
+    if (!ReadBytes(magic, 4))
         FATAL_ERROR("error: failed to read ELF magic from \"%s\"\n", s_elfPath.c_str());
 
     if (std::memcmp(magic, expectedMagic, 4) != 0)
         FATAL_ERROR("error: ELF magic did not match in \"%s\"\n", s_elfPath.c_str());
 
-    if (std::fgetc(s_file) != 1)
+    if (ReadInt8() != 1)
         FATAL_ERROR("error: \"%s\" not 32-bit ELF\n", s_elfPath.c_str());
 
-    if (std::fgetc(s_file) != 1)
+    if (ReadInt8() != 1)
         FATAL_ERROR("error: \"%s\" not little-endian ELF\n", s_elfPath.c_str());
 }
 
@@ -106,7 +216,7 @@ static void VerifyAr()
     char expectedMagic[8] = {'!', '<', 'a', 'r', 'c', 'h', '>', '\n'};
     char magic[8];
 
-    if (std::fread(magic, 8, 1, s_file) != 1)
+    if (!ReadBytes(magic, 8))
         FATAL_ERROR("error: failed to read AR magic from \"%s\"\n", s_archiveFilePath.c_str());
 
     if (std::memcmp(magic, expectedMagic, 8) != 0)
@@ -132,13 +242,13 @@ static void FindArObj()
     std::size_t filesize;
 
     Seek(8);
-    while (!std::feof(s_file)) {
-        if (std::fread(file_ident, 16, 1, s_file) != 1)
+    while (s_pos < s_dataSize) {
+        if (!ReadBytes(file_ident, 16))
             FATAL_ERROR("error: failed to read file ident in \"%s\"\n", s_archiveFilePath.c_str());
         Skip(32);
-        if (std::fread(filesize_s, 10, 1, s_file) != 1)
+        if (!ReadBytes(filesize_s, 10))
             FATAL_ERROR("error: failed to read filesize in \"%s\"\n", s_archiveFilePath.c_str());
-        if (std::fread(end_magic, 2, 1, s_file) != 1)
+        if (!ReadBytes(end_magic, 2))
             FATAL_ERROR("error: failed to read end sentinel in \"%s\"\n", s_archiveFilePath.c_str());
         if (std::memcmp(end_magic, expectedEndMagic, 2) != 0)
             FATAL_ERROR("error: corrupted archive header in \"%s\" at \"%s\"\n", s_archiveFilePath.c_str(), file_ident);
@@ -148,10 +258,11 @@ static void FindArObj()
             *ptr = 0;
         filesize = std::strtoul(filesize_s, nullptr, 10);
         if (std::strncmp(s_archiveObjectPath.c_str(), file_ident, 16) == 0) {
-            s_elfFileOffset = std::ftell(s_file);
+            s_elfFileOffset = s_pos;
             return;
         }
-        Skip(filesize);
+        // Members are padded to an even offset.
+        Skip(std::min(filesize + (filesize & 1), s_dataSize - s_pos));
     }
 
     FATAL_ERROR("error: could not find object \"%s\" in archive \"%s\"\n", s_archiveObjectPath.c_str(), s_archiveFilePath.c_str());
@@ -236,21 +347,30 @@ static std::map<std::string, std::uint32_t> GetCommonSymbols_Shared()
     return commonSymbols;
 }
 
-std::map<std::string, std::uint32_t> GetCommonSymbolsFromLib(std::string sourcePath, std::string libpath)
+static void SplitLibPath(std::string sourcePath, std::string libpath)
 {
     std::size_t colonPos = libpath.find(':');
     if (colonPos == std::string::npos)
-        FATAL_ERROR("error: missing colon separator in libfile \"%s\"\n", s_elfPath.c_str());
+        FATAL_ERROR("error: missing colon separator in libfile \"%s\"\n", libpath.c_str());
 
     s_archiveObjectPath = libpath.substr(colonPos + 1);
     s_archiveFilePath = sourcePath + "/" + libpath.substr(1, colonPos - 1);
     s_elfPath = sourcePath + "/" + libpath.substr(1);
+}
 
-    s_file = std::fopen(s_archiveFilePath.c_str(), "rb");
+std::map<std::string, std::uint32_t> GetCommonSymbolsFromLib(std::string sourcePath, std::string libpath)
+{
+    SplitLibPath(sourcePath, libpath);
+
+    MappedFile file(s_archiveFilePath);
 
-    if (s_file == NULL)
+    if (!file.IsOpen())
         FATAL_ERROR("error: failed to open \"%s\" for reading\n", s_archiveFilePath.c_str());
 
+    s_data = file.GetData();
+    s_dataSize = file.GetSize();
+    s_pos = 0;
+
     VerifyAr();
     FindArObj();
     return GetCommonSymbols_Shared();
@@ -263,10 +383,24 @@ std::map<std::string, std::uint32_t> GetCommonSymbols(std::string sourcePath, st
         return GetCommonSymbolsFromLib(sourcePath, path);
 
     s_elfPath = sourcePath + "/" + path;
-    s_file = std::fopen(s_elfPath.c_str(), "rb");
 
-    if (s_file == NULL)
+    MappedFile file(s_elfPath);
+
+    if (!file.IsOpen())
         FATAL_ERROR("error: failed to open \"%s\" for reading\n", path.c_str());
 
+    s_data = file.GetData();
+    s_dataSize = file.GetSize();
+    s_pos = 0;
+
     return GetCommonSymbols_Shared();
 }
+
+std::string GetElfFilePath(std::string sourcePath, std::string path)
+{
+    if (path[0] != '*')
+        return sourcePath + "/" + path;
+
+    SplitLibPath(sourcePath, path);
+    return s_archiveFilePath;
+}
@@ -26,5 +26,6 @@
 #include <string>
 
 std::map<std::string, std::uint32_t> GetCommonSymbols(std::string sourcePath, std::string path);
+std::string GetElfFilePath(std::string sourcePath, std::string path);
 
 #endif // ELF_H
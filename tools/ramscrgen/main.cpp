@@ -23,11 +23,13 @@
 #include <string>
 #include "ramscrgen.h"
 #include "sym_file.h"
-#include "elf.h"
+#include "symbol_index.h"
+
+static SymbolIndex s_symbolIndex;
 
 void HandleCommonInclude(std::string filename, std::string sourcePath, std::string symOrderPath, std::string lang)
 {
-    auto commonSymbols = GetCommonSymbols(sourcePath, filename);
+    const auto& commonSymbols = s_symbolIndex.GetCommonSymbols(sourcePath, filename);
     std::size_t dotIndex;
 
     if (filename[0] == '*') {
@@ -62,9 +64,10 @@ void HandleCommonInclude(std::string filename, std::string sourcePath, std::stri
         }
         else
         {
-            if (commonSymbols.count(label) == 0)
+            auto symbol = commonSymbols.find(label);
+            if (symbol == commonSymbols.end())
                 symFile.RaiseError("no common symbol named \"%s\"", label.c_str());
-            unsigned long size = commonSymbols[label];
+            unsigned long size = symbol->second;
             int alignment = 4;
             if (size > 4)
                 alignment = 8;
@@ -144,7 +147,7 @@ int main(int argc, char **argv)
 {
     if (argc < 4)
     {
-        fprintf(stderr, "Usage: %s SECTION_NAME SYM_FILE LANG [-c SRC_PATH,COMMON_SYM_PATH]", argv[0]);
+        fprintf(stderr, "Usage: %s SECTION_NAME SYM_FILE LANG [-c SRC_PATH,COMMON_SYM_PATH [-i INDEX_PATH]]", argv[0]);
         return 1;
     }
 
@@ -155,6 +158,7 @@ int main(int argc, char **argv)
     std::string sourcePath;
     std::string commonSymPath;
     std::string libSourcePath;
+    std::string indexPath;
 
     if (argc > 4)
     {
@@ -180,8 +184,24 @@ int main(int argc, char **argv)
             libSourcePath = commonSymPath.substr(commaPos + 1);
             commonSymPath = commonSymPath.substr(0, commaPos);
         }
+
+        if (argc > 6)
+        {
+            if (std::strcmp(argv[6], "-i") != 0)
+                FATAL_ERROR("error: unrecognized argument \"%s\"\n", argv[6]);
+
+            if (argc < 8)
+                FATAL_ERROR("error: missing INDEX_PATH after \"-i\"\n");
+
+            indexPath = std::string(argv[7]);
+            s_symbolIndex.Load(indexPath);
+        }
     }
 
     ConvertSymFile(symFileName, sectionName, lang, common, sourcePath, commonSymPath, libSourcePath);
+
+    if (!indexPath.empty())
+        s_symbolIndex.Save(indexPath);
+
     return 0;
 }
@@ -0,0 +1,131 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include "ramscrgen.h"
+#include "elf.h"
+#include "symbol_index.h"
+
+// Index file format: a header line, then for each object a line with its
+// file's mtime and size, the number of common symbols and the object's path,
+// followed by a "size name" line for each symbol.
+static const char *const INDEX_HEADER = "ramscrgen-index 1";
+
+static bool GetFileStamp(const std::string& path, long long& mtime, long long& size)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+
+#if defined(__APPLE__)
+    mtime = st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    mtime = st.st_mtime * 1000000000LL;
+#else
+    mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+    size = st.st_size;
+    return true;
+}
+
+void SymbolIndex::Load(const std::string& path)
+{
+    std::ifstream stream(path);
+    std::string line;
+
+    // A missing or outdated index just means every object is read again.
+    if (!std::getline(stream, line) || line != INDEX_HEADER)
+        return;
+
+    while (std::getline(stream, line))
+    {
+        std::istringstream fields(line);
+        Entry entry;
+        int numSymbols;
+        std::string objectPath;
+
+        if (!(fields >> entry.mtime >> entry.size >> numSymbols) || fields.get() != ' ' || !std::getline(fields, objectPath))
+            break;
+
+        for (int i = 0; i < numSymbols && std::getline(stream, line); i++)
+        {
+            std::istringstream symbolFields(line);
+            std::uint32_t size;
+            std::string name;
+
+            if (symbolFields >> size >> name)
+                entry.symbols[name] = size;
+        }
+
+        if (!stream)
+            break;
+
+        m_entries[objectPath] = std::move(entry);
+    }
+}
+
+void SymbolIndex::Save(const std::string& path)
+{
+    // Drop objects that are no longer included.
+    for (auto it = m_entries.begin(); it != m_entries.end();)
+    {
+        if (it->second.used)
+        {
+            ++it;
+        }
+        else
+        {
+            it = m_entries.erase(it);
+            m_dirty = true;
+        }
+    }
+
+    if (!m_dirty)
+        return;
+
+    std::string tempPath = path + ".tmp";
+    std::ofstream stream(tempPath);
+
+    stream << INDEX_HEADER << '\n';
+
+    for (const auto& entry : m_entries)
+    {
+        stream << entry.second.mtime << ' ' << entry.second.size << ' ' << entry.second.symbols.size() << ' ' << entry.first << '\n';
+
+        for (const auto& symbol : entry.second.symbols)
+            stream << symbol.second << ' ' << symbol.first << '\n';
+    }
+
+    stream.close();
+
+    // Failing to save the index only makes the next run slower.
+    if (!stream || std::rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        std::fprintf(stderr, "Warning: failed to write \"%s\".\n", path.c_str());
+        std::remove(tempPath.c_str());
+    }
+}
+
+const std::map<std::string, std::uint32_t>& SymbolIndex::GetCommonSymbols(const std::string& sourcePath, const std::string& path)
+{
+    std::string filePath = GetElfFilePath(sourcePath, path);
+    std::string objectPath = path[0] == '*' ? sourcePath + "/" + path.substr(1) : filePath;
+    long long mtime, size;
+
+    if (!GetFileStamp(filePath, mtime, size))
+        FATAL_ERROR("error: failed to open \"%s\" for reading\n", filePath.c_str());
+
+    Entry& entry = m_entries[objectPath];
+
+    if (!entry.used && (entry.mtime != mtime || entry.size != size))
+    {
+        entry.mtime = mtime;
+        entry.size = size;
+        entry.symbols = ::GetCommonSymbols(sourcePath, path);
+        m_dirty = true;
+    }
+
+    entry.used = true;
+    return entry.symbols;
+}
@@ -0,0 +1,31 @@
+#ifndef SYMBOL_INDEX_H
+#define SYMBOL_INDEX_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Remembers the common symbols of every object it has read, along with the
+// mtime and size its file had, so that an object is only read again once it
+// changes. Objects in archives are checked against the archive's file.
+class SymbolIndex
+{
+public:
+    void Load(const std::string& path);
+    void Save(const std::string& path);
+    const std::map<std::string, std::uint32_t>& GetCommonSymbols(const std::string& sourcePath, const std::string& path);
+
+private:
+    struct Entry
+    {
+        long long mtime = -1;
+        long long size = -1;
+        bool used = false;
+        std::map<std::string, std::uint32_t> symbols;
+    };
+
+    std::map<std::string, Entry> m_entries;
+    bool m_dirty = false;
+};
+
+#endif // SYMBOL_INDEX_H
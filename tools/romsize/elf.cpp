@@ -0,0 +1,324 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include <string>
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "romsize.h"
+#include "elf.h"
+
+// Adapted from the reader in tools/ramscrgen/elf.cpp.
+
+#define SHN_UNDEF 0
+#define SHN_LORESERVE 0xFF00
+#define STT_NOTYPE 0
+#define STT_OBJECT 1
+#define STT_FUNC 2
+#define STT_FILE 4
+#define STB_LOCAL 0
+
+static std::string s_elfPath;
+
+// The whole ELF file being read, and the read position in it.
+static const std::uint8_t *s_data;
+static std::size_t s_dataSize;
+static std::size_t s_pos;
+
+static std::uint32_t s_sectionHeaderOffset;
+static int s_sectionHeaderEntrySize;
+static int s_sectionCount;
+static int s_shstrtabIndex;
+
+static std::uint32_t s_symtabOffset;
+static std::uint32_t s_strtabOffset;
+
+static std::uint32_t s_symbolCount;
+
+// A read-only view of a whole file, mapped into memory where that's possible.
+class MappedFile
+{
+public:
+    MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    bool IsOpen() const { return m_open; }
+    const std::uint8_t *GetData() const { return m_data; }
+    std::size_t GetSize() const { return m_size; }
+
+private:
+    bool m_open = false;
+    const std::uint8_t *m_data = nullptr;
+    std::size_t m_size = 0;
+#ifdef _WIN32
+    std::vector<std::uint8_t> m_buffer;
+#endif
+};
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path)
+{
+    std::ifstream stream(path, std::ios::binary);
+
+    if (!stream)
+        return;
+
+    m_buffer.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    m_open = true;
+}
+
+MappedFile::~MappedFile()
+{
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+
+    if (fd < 0)
+        return;
+
+    if (fstat(fd, &st) == 0)
+    {
+        m_size = st.st_size;
+
+        // mmap can't map an empty file, but there's nothing to read anyway.
+        if (m_size == 0)
+        {
+            m_open = true;
+        }
+        else
+        {
+            void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED)
+            {
+                m_data = static_cast<const std::uint8_t *>(data);
+                m_open = true;
+            }
+        }
+    }
+
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data != nullptr)
+        munmap(const_cast<std::uint8_t *>(m_data), m_size);
+}
+
+#endif // _WIN32
+
+static void Seek(long offset)
+{
+    if (offset < 0 || static_cast<std::size_t>(offset) > s_dataSize)
+        FATAL_ERROR("error: failed to seek to %ld in \"%s\"", offset, s_elfPath.c_str());
+
+    s_pos = offset;
+}
+
+static void Skip(long offset)
+{
+    if (offset < 0 || static_cast<std::size_t>(offset) > s_dataSize - s_pos)
+        FATAL_ERROR("error: failed to skip %ld bytes in \"%s\"", offset, s_elfPath.c_str());
+
+    s_pos += offset;
+}
+
+static bool ReadBytes(void *dest, std::size_t count)
+{
+    if (count > s_dataSize - s_pos)
+        return false;
+
+    std::memcpy(dest, s_data + s_pos, count);
+    s_pos += count;
+    return true;
+}
+
+static std::uint32_t ReadInt8()
+{
+    if (s_pos >= s_dataSize)
+        FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", s_elfPath.c_str());
+
+    return s_data[s_pos++];
+}
+
+static std::uint32_t ReadInt16()
+{
+    std::uint32_t val = 0;
+    val |= ReadInt8();
+    val |= ReadInt8() << 8;
+    return val;
+}
+
+static std::uint32_t ReadInt32()
+{
+    std::uint32_t val = 0;
+    val |= ReadInt8();
+    val |= ReadInt8() << 8;
+    val |= ReadInt8() << 16;
+    val |= ReadInt8() << 24;
+    return val;
+}
+
+static std::string ReadString()
+{
+    const void *end = s_pos < s_dataSize ? std::memchr(s_data + s_pos, 0, s_dataSize - s_pos) : nullptr;
+
+    if (end == nullptr)
+        FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", s_elfPath.c_str());
+
+    const char *start = reinterpret_cast<const char *>(s_data + s_pos);
+    std::size_t length = static_cast<const char *>(end) - start;
+
+    s_pos += length + 1;
+    return std::string(start, length);
+}
+
+static void VerifyElfIdent()
+{
+    char expectedMagic[4] = { 0x7F, 'E', 'L', 'F' };
+    char magic[4];
+
+    if (!ReadBytes(magic, 4))
+        FATAL_ERROR("error: failed to read ELF magic from \"%s\"\n", s_elfPath.c_str());
+
+    if (std::memcmp(magic, expectedMagic, 4) != 0)
+        FATAL_ERROR("error: ELF magic did not match in \"%s\"\n", s_elfPath.c_str());
+
+    if (ReadInt8() != 1)
+        FATAL_ERROR("error: \"%s\" not 32-bit ELF\n", s_elfPath.c_str());
+
+    if (ReadInt8() != 1)
+        FATAL_ERROR("error: \"%s\" not little-endian ELF\n", s_elfPath.c_str());
+}
+
+static void ReadElfHeader()
+{
+    Seek(0x20);
+    s_sectionHeaderOffset = ReadInt32();
+    Seek(0x2E);
+    s_sectionHeaderEntrySize = ReadInt16();
+    s_sectionCount = ReadInt16();
+    s_shstrtabIndex = ReadInt16();
+}
+
+static std::string GetSectionName(std::uint32_t shstrtabOffset, int index)
+{
+    Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * index);
+    std::uint32_t nameOffset = ReadInt32();
+    Seek(shstrtabOffset + nameOffset);
+    return ReadString();
+}
+
+static void FindTableOffsets()
+{
+    s_symtabOffset = 0;
+    s_strtabOffset = 0;
+
+    Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * s_shstrtabIndex + 0x10);
+    std::uint32_t shstrtabOffset = ReadInt32();
+
+    for (int i = 0; i < s_sectionCount; i++)
+    {
+        std::string name = GetSectionName(shstrtabOffset, i);
+
+        if (name == ".symtab")
+        {
+            if (s_symtabOffset)
+                FATAL_ERROR("error: mutiple .symtab sections found in \"%s\"\n", s_elfPath.c_str());
+            Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * i + 0x10);
+            s_symtabOffset = ReadInt32();
+            std::uint32_t size = ReadInt32();
+            s_symbolCount = size / 16;
+        }
+        else if (name == ".strtab")
+        {
+            if (s_strtabOffset)
+                FATAL_ERROR("error: mutiple .strtab sections found in \"%s\"\n", s_elfPath.c_str());
+            Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * i + 0x10);
+            s_strtabOffset = ReadInt32();
+        }
+    }
+
+    if (!s_symtabOffset)
+        FATAL_ERROR("error: couldn't find .symtab section in \"%s\"\n", s_elfPath.c_str());
+
+    if (!s_strtabOffset)
+        FATAL_ERROR("error: couldn't find .strtab section in \"%s\"\n", s_elfPath.c_str());
+}
+
+std::vector<ElfSymbol> GetElfSymbols(std::string path)
+{
+    s_elfPath = path;
+
+    MappedFile file(s_elfPath);
+
+    if (!file.IsOpen())
+        FATAL_ERROR("error: failed to open \"%s\" for reading\n", path.c_str());
+
+    s_data = file.GetData();
+    s_dataSize = file.GetSize();
+    s_pos = 0;
+
+    VerifyElfIdent();
+    ReadElfHeader();
+    FindTableOffsets();
+
+    std::vector<ElfSymbol> symbols;
+    std::vector<std::uint32_t> nameOffsets;
+    std::string currentFile;
+
+    for (std::uint32_t i = 0; i < s_symbolCount; i++)
+    {
+        Seek(s_symtabOffset + i * 16);
+        std::uint32_t nameOffset = ReadInt32();
+        std::uint32_t value = ReadInt32();
+        std::uint32_t size = ReadInt32();
+        std::uint32_t info = ReadInt8();
+        Skip(1);
+        std::uint32_t sectionIndex = ReadInt16();
+        std::uint32_t type = info & 0xF;
+        bool global = (info >> 4) != STB_LOCAL;
+
+        if (type == STT_FILE)
+        {
+            Seek(s_strtabOffset + nameOffset);
+            currentFile = ReadString();
+            continue;
+        }
+
+        if ((type != STT_NOTYPE && type != STT_OBJECT && type != STT_FUNC) || sectionIndex == SHN_UNDEF || sectionIndex >= SHN_LORESERVE)
+            continue;
+
+        Seek(s_strtabOffset + nameOffset);
+        std::string name = ReadString();
+
+        // Skip ARM mapping symbols ($a, $t, $d) and assembler-local labels.
+        if (name.empty() || name[0] == '$' || name.compare(0, 2, ".L") == 0)
+            continue;
+
+        if (type == STT_FUNC)
+            value &= ~1u;
+
+        symbols.push_back({name, value, size, global, global ? std::string() : currentFile});
+    }
+
+    return symbols;
+}
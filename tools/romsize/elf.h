@@ -0,0 +1,21 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ElfSymbol
+{
+    std::string name;
+    std::uint32_t value;
+    std::uint32_t size;
+    bool global;
+    std::string file; // the STT_FILE entry before a local symbol, if any
+};
+
+// The function, object and label symbols that are defined in some section.
+// Thumb function addresses have their low bit cleared.
+std::vector<ElfSymbol> GetElfSymbols(std::string path);
+
+#endif // ELF_H
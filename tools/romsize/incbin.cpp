@@ -0,0 +1,178 @@
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "romsize.h"
+#include "incbin.h"
+
+static bool IsIdentChar(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+static bool EndsWith(const std::string& s, const char *suffix)
+{
+    std::size_t length = std::strlen(suffix);
+    return s.length() >= length && s.compare(s.length() - length, length, suffix) == 0;
+}
+
+// Reads the string literal starting at pos (after whitespace), or returns
+// an empty string.
+static std::string ReadQuoted(const std::string& text, std::size_t pos)
+{
+    while (pos < text.length() && std::isspace(static_cast<unsigned char>(text[pos])))
+        pos++;
+
+    if (pos >= text.length() || text[pos] != '"')
+        return std::string();
+
+    std::size_t end = text.find('"', pos + 1);
+
+    if (end == std::string::npos)
+        return std::string();
+
+    return text.substr(pos + 1, end - pos - 1);
+}
+
+// Looks for the forms preproc expands, "NAME[...] = INCBIN_xx("path")".
+// INCBINs inside struct initializers belong to the enclosing symbol and
+// aren't tracked.
+static void ScanC(const std::string& path, const std::string& text, std::vector<Incbin>& incbins)
+{
+    std::size_t pos = 0;
+
+    while ((pos = text.find("INCBIN_", pos)) != std::string::npos)
+    {
+        std::size_t start = pos;
+        pos += 7;
+
+        if (start > 0 && IsIdentChar(text[start - 1]))
+            continue;
+
+        std::size_t open = text.find('(', pos);
+
+        if (open == std::string::npos)
+            break;
+
+        std::string assetPath = ReadQuoted(text, open + 1);
+
+        if (assetPath.empty())
+            continue;
+
+        // Walk back over "NAME[...] =".
+        long i = static_cast<long>(start) - 1;
+
+        while (i >= 0 && std::isspace(static_cast<unsigned char>(text[i])))
+            i--;
+        if (i < 0 || text[i] != '=')
+            continue;
+        i--;
+        while (i >= 0 && std::isspace(static_cast<unsigned char>(text[i])))
+            i--;
+        while (i >= 0 && text[i] == ']')
+        {
+            while (i >= 0 && text[i] != '[')
+                i--;
+            i--;
+            while (i >= 0 && std::isspace(static_cast<unsigned char>(text[i])))
+                i--;
+        }
+
+        long nameEnd = i + 1;
+
+        while (i >= 0 && IsIdentChar(text[i]))
+            i--;
+
+        if (nameEnd > i + 1)
+            incbins.push_back({text.substr(i + 1, nameEnd - i - 1), assetPath, path});
+    }
+}
+
+// Every .incbin belongs to the label before it.
+static void ScanAsm(const std::string& path, const std::string& text, std::vector<Incbin>& incbins)
+{
+    std::string label;
+    std::size_t lineStart = 0;
+
+    while (lineStart < text.length())
+    {
+        std::size_t lineEnd = text.find('\n', lineStart);
+
+        if (lineEnd == std::string::npos)
+            lineEnd = text.length();
+
+        std::size_t pos = lineStart;
+
+        while (pos < lineEnd && std::isspace(static_cast<unsigned char>(text[pos])))
+            pos++;
+
+        std::size_t end = pos;
+
+        while (end < lineEnd && IsIdentChar(text[end]))
+            end++;
+
+        if (pos == lineStart && end > pos && end < lineEnd && text[end] == ':')
+            label = text.substr(pos, end - pos);
+        else if (text.compare(pos, 7, ".incbin") == 0 && !label.empty())
+        {
+            std::string assetPath = ReadQuoted(text, pos + 7);
+
+            if (!assetPath.empty())
+                incbins.push_back({label, assetPath, path});
+        }
+
+        lineStart = lineEnd + 1;
+    }
+}
+
+void ScanIncbins(std::string dir, std::vector<Incbin>& incbins)
+{
+    DIR *d = opendir(dir.c_str());
+
+    if (d == nullptr)
+        FATAL_ERROR("error: failed to open directory \"%s\"\n", dir.c_str());
+
+    std::vector<std::string> names;
+    struct dirent *entry;
+
+    while ((entry = readdir(d)) != nullptr)
+    {
+        if (entry->d_name[0] != '.')
+            names.push_back(entry->d_name);
+    }
+
+    closedir(d);
+
+    for (const std::string& name : names)
+    {
+        std::string path = dir + "/" + name;
+        struct stat st;
+
+        if (stat(path.c_str(), &st) != 0)
+            continue;
+
+        if (S_ISDIR(st.st_mode))
+        {
+            ScanIncbins(path, incbins);
+            continue;
+        }
+
+        bool isC = EndsWith(name, ".c") || EndsWith(name, ".h");
+        bool isAsm = EndsWith(name, ".s") || EndsWith(name, ".inc");
+
+        if (!isC && !isAsm)
+            continue;
+
+        std::ifstream file(path, std::ios::binary);
+        std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        if (isC)
+            ScanC(path, text, incbins);
+        else
+            ScanAsm(path, text, incbins);
+    }
+}
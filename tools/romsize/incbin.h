@@ -0,0 +1,19 @@
+#ifndef INCBIN_H
+#define INCBIN_H
+
+#include <string>
+#include <vector>
+
+// An asset a symbol is made from: "gFoo[] = INCBIN_U32("path")" in C, or
+// ".incbin "path"" after the label "gFoo::" in assembly.
+struct Incbin
+{
+    std::string symbol;
+    std::string path;
+    std::string source;
+};
+
+// Finds the INCBINs in the C and assembly sources under dir.
+void ScanIncbins(std::string dir, std::vector<Incbin>& incbins);
+
+#endif // INCBIN_H
@@ -0,0 +1,96 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "romsize.h"
+#include "elf.h"
+#include "incbin.h"
+#include "map_file.h"
+#include "report.h"
+
+static void Usage()
+{
+    FATAL_ERROR("Usage: romsize report [-S SOURCE_DIR]... [-k KIND] [-o REPORT] MAP_FILE ELF_FILE\n"
+                "       romsize diff [-k KIND] OLD_REPORT NEW_REPORT\n"
+                "\n"
+                "Attributes every byte of ROM, EWRAM and IWRAM to a source file, a symbol\n"
+                "and, for INCBINs found under the SOURCE_DIRs, an asset. KIND limits the\n"
+                "output to one of region, section, file, symbol or asset.\n");
+}
+
+static int Report(int argc, char **argv)
+{
+    std::vector<std::string> sourceDirs;
+    std::vector<std::string> files;
+    std::string kind;
+    std::string outPath;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "-S") == 0 && i + 1 < argc)
+            sourceDirs.push_back(argv[++i]);
+        else if (std::strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+            kind = argv[++i];
+        else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            outPath = argv[++i];
+        else if (argv[i][0] == '-')
+            Usage();
+        else
+            files.push_back(argv[i]);
+    }
+
+    if (files.size() != 2)
+        Usage();
+
+    MapFile map = ReadMapFile(files[0]);
+    std::vector<ElfSymbol> symbols = GetElfSymbols(files[1]);
+    std::vector<Incbin> incbins;
+
+    for (const std::string& dir : sourceDirs)
+        ScanIncbins(dir, incbins);
+
+    std::FILE *out = outPath.empty() ? stdout : std::fopen(outPath.c_str(), "w");
+
+    if (out == nullptr)
+        FATAL_ERROR("error: failed to open \"%s\" for writing\n", outPath.c_str());
+
+    WriteReport(BuildReport(map, symbols, incbins), kind, out);
+
+    if (out != stdout && std::fclose(out) != 0)
+        FATAL_ERROR("error: failed to write \"%s\"\n", outPath.c_str());
+
+    return 0;
+}
+
+static int Diff(int argc, char **argv)
+{
+    std::vector<std::string> files;
+    std::string kind;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+            kind = argv[++i];
+        else if (argv[i][0] == '-')
+            Usage();
+        else
+            files.push_back(argv[i]);
+    }
+
+    if (files.size() != 2)
+        Usage();
+
+    WriteDiff(ReadReport(files[0]), ReadReport(files[1]), kind, stdout);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && std::strcmp(argv[1], "report") == 0)
+        return Report(argc, argv);
+    if (argc >= 2 && std::strcmp(argv[1], "diff") == 0)
+        return Diff(argc, argv);
+
+    Usage();
+    return 1;
+}
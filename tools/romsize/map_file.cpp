@@ -0,0 +1,141 @@
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "romsize.h"
+#include "map_file.h"
+
+static std::vector<std::string> SplitLine(const std::string& line)
+{
+    std::istringstream stream(line);
+    std::vector<std::string> tokens;
+    std::string token;
+
+    while (stream >> token)
+        tokens.push_back(token);
+
+    return tokens;
+}
+
+static std::string JoinTokens(const std::vector<std::string>& tokens, std::size_t start)
+{
+    std::string joined;
+
+    for (std::size_t i = start; i < tokens.size(); i++)
+    {
+        if (i != start)
+            joined += ' ';
+        joined += tokens[i];
+    }
+
+    return joined;
+}
+
+static bool ParseHex(const std::string& token, std::uint32_t& value)
+{
+    if (token.length() < 3 || token[0] != '0' || token[1] != 'x')
+        return false;
+
+    char *end;
+    unsigned long long parsed = std::strtoull(token.c_str() + 2, &end, 16);
+
+    if (*end != 0)
+        return false;
+
+    value = static_cast<std::uint32_t>(parsed);
+    return true;
+}
+
+// Lines look like this, where long section names push the rest of the line
+// onto the next one:
+//
+// .text           0x08000000   0x1234          <- output section
+//  .text          0x08000000     0x94 src/a.o  <- input section
+//                 0x08000000                AgbMain
+//  .text.unlikely
+//                 0x08000094     0x10 src/b.o
+//  *fill*         0x080000a4      0x2
+//                 0x08000100                gFoo = .
+MapFile ReadMapFile(std::string path)
+{
+    std::ifstream file(path);
+
+    if (!file.is_open())
+        FATAL_ERROR("error: failed to open \"%s\" for reading\n", path.c_str());
+
+    MapFile map;
+    std::string line;
+    bool inMemoryMap = false;
+    std::string pendingOutput;
+    std::string pendingInput;
+
+    while (std::getline(file, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        if (!inMemoryMap)
+        {
+            inMemoryMap = line == "Linker script and memory map";
+            continue;
+        }
+
+        std::vector<std::string> tokens = SplitLine(line);
+
+        if (tokens.empty())
+            continue;
+
+        std::uint32_t address, size;
+        bool indented = line[0] == ' ' || line[0] == '\t';
+        bool inputIndent = line[0] == ' ' && line.length() > 1 && line[1] != ' ';
+
+        if (!indented)
+        {
+            pendingInput.clear();
+            pendingOutput.clear();
+
+            if (tokens.size() == 1)
+                pendingOutput = tokens[0];
+            else if (tokens.size() >= 3 && ParseHex(tokens[1], address) && ParseHex(tokens[2], size))
+                map.outputSections.push_back({tokens[0], address, size});
+        }
+        else if (inputIndent)
+        {
+            pendingInput.clear();
+            pendingOutput.clear();
+
+            bool fill = tokens[0] == "*fill*";
+
+            if (tokens.size() == 1 && tokens[0][0] != '*')
+                pendingInput = tokens[0];
+            else if (tokens.size() >= 3 && ParseHex(tokens[1], address) && ParseHex(tokens[2], size) && size != 0)
+                map.inputSections.push_back({tokens[0], JoinTokens(tokens, 3), address, size, fill});
+        }
+        else if (tokens.size() >= 2 && ParseHex(tokens[0], address))
+        {
+            if (!pendingOutput.empty() && ParseHex(tokens[1], size))
+            {
+                map.outputSections.push_back({pendingOutput, address, size});
+            }
+            else if (!pendingInput.empty() && tokens.size() >= 3 && ParseHex(tokens[1], size))
+            {
+                if (size != 0)
+                    map.inputSections.push_back({pendingInput, JoinTokens(tokens, 2), address, size, false});
+            }
+            else if (tokens.size() >= 3 && tokens[2] == "=" && tokens[1] != ".")
+            {
+                map.assignments.push_back({tokens[1], address});
+            }
+
+            pendingInput.clear();
+            pendingOutput.clear();
+        }
+    }
+
+    if (!inMemoryMap)
+        FATAL_ERROR("error: \"%s\" has no memory map; is it a GNU ld map file?\n", path.c_str());
+
+    return map;
+}
@@ -0,0 +1,43 @@
+#ifndef MAP_FILE_H
+#define MAP_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MapOutputSection
+{
+    std::string name;
+    std::uint32_t address;
+    std::uint32_t size;
+};
+
+// One line of the memory map that placed some bytes: an input section
+// from an object, or padding the linker inserted (fill).
+struct MapInputSection
+{
+    std::string section;
+    std::string object;
+    std::uint32_t address;
+    std::uint32_t size;
+    bool fill;
+};
+
+// A symbol the linker script assigned, like "gHeap = .".
+struct MapAssignment
+{
+    std::string name;
+    std::uint32_t address;
+};
+
+struct MapFile
+{
+    std::vector<MapOutputSection> outputSections;
+    std::vector<MapInputSection> inputSections;
+    std::vector<MapAssignment> assignments;
+};
+
+// Reads the "Linker script and memory map" part of a GNU ld map file.
+MapFile ReadMapFile(std::string path);
+
+#endif // MAP_FILE_H
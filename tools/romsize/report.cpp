@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+#include "romsize.h"
+#include "report.h"
+
+#define REPORT_HEADER "# romsize 1"
+
+struct Region
+{
+    const char *name;
+    std::uint32_t start;
+    std::uint32_t end;
+};
+
+static const Region s_regions[] = {
+    { "ROM",   0x08000000, 0x0A000000 },
+    { "EWRAM", 0x02000000, 0x02040000 },
+    { "IWRAM", 0x03000000, 0x03008000 },
+};
+
+static const char *const s_kinds[] = { "region", "section", "file", "symbol", "asset" };
+
+static const Region *GetRegion(std::uint32_t address)
+{
+    for (const Region& region : s_regions)
+    {
+        if (address >= region.start && address < region.end)
+            return &region;
+    }
+
+    return nullptr;
+}
+
+static int RegionOrder(const std::string& name)
+{
+    for (std::size_t i = 0; i < sizeof(s_regions) / sizeof(s_regions[0]); i++)
+    {
+        if (name == s_regions[i].name)
+            return i;
+    }
+
+    return sizeof(s_regions) / sizeof(s_regions[0]);
+}
+
+static int KindOrder(const std::string& kind)
+{
+    for (std::size_t i = 0; i < sizeof(s_kinds) / sizeof(s_kinds[0]); i++)
+    {
+        if (kind == s_kinds[i])
+            return i;
+    }
+
+    return sizeof(s_kinds) / sizeof(s_kinds[0]);
+}
+
+static bool FileExists(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+static std::string BaseName(const std::string& path)
+{
+    std::size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Objects are named as the linker saw them, e.g. "src/main.o", which is
+// built from "src/main.c" or "src/main.s".
+static std::string GetSourceName(const std::string& object, std::unordered_map<std::string, std::string>& cache)
+{
+    auto cached = cache.find(object);
+
+    if (cached != cache.end())
+        return cached->second;
+
+    std::string name = object;
+
+    if (object.length() > 2 && object.compare(object.length() - 2, 2, ".o") == 0)
+    {
+        std::string stem = object.substr(0, object.length() - 2);
+
+        if (FileExists(stem + ".c"))
+            name = stem + ".c";
+        else if (FileExists(stem + ".s"))
+            name = stem + ".s";
+    }
+
+    cache[object] = name;
+    return name;
+}
+
+class Totals
+{
+public:
+    void Add(const Region *region, const char *kind, const std::string& name, std::int64_t bytes)
+    {
+        if (region != nullptr && bytes != 0)
+            m_totals[std::make_tuple(std::string(region->name), std::string(kind), name)] += bytes;
+    }
+
+    std::vector<ReportEntry> GetEntries() const
+    {
+        std::vector<ReportEntry> entries;
+
+        for (const auto& total : m_totals)
+            entries.push_back({std::get<0>(total.first), std::get<1>(total.first), total.second, std::get<2>(total.first)});
+
+        return entries;
+    }
+
+private:
+    std::map<std::tuple<std::string, std::string, std::string>, std::int64_t> m_totals;
+};
+
+// The assets a symbol is made of. Static symbols are matched to the file
+// that defines them where the ELF says which one that is.
+static std::vector<const Incbin *> FindAssets(const ElfSymbol& symbol, const std::unordered_multimap<std::string, const Incbin *>& incbinsBySymbol)
+{
+    auto range = incbinsBySymbol.equal_range(symbol.name);
+    std::vector<const Incbin *> candidates;
+    std::vector<const Incbin *> matches;
+
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        candidates.push_back(it->second);
+
+        if (!symbol.file.empty() && BaseName(it->second->source) == symbol.file)
+            matches.push_back(it->second);
+    }
+
+    if (!matches.empty() || candidates.empty())
+        return matches;
+
+    for (const Incbin *candidate : candidates)
+    {
+        if (candidate->source != candidates[0]->source)
+            return matches; // ambiguous
+    }
+
+    return candidates;
+}
+
+static void AddAssets(const Region *region, const std::vector<const Incbin *>& assets, std::uint32_t size, Totals& totals)
+{
+    if (assets.size() == 1)
+    {
+        totals.Add(region, "asset", assets[0]->path, size);
+        return;
+    }
+
+    // Several .incbins under one label: each gets its file's size, as far as
+    // the files exist (many assets are generated by the build).
+    for (const Incbin *asset : assets)
+    {
+        struct stat st;
+
+        if (size == 0 || stat(asset->path.c_str(), &st) != 0)
+            continue;
+
+        std::uint32_t assetSize = std::min<std::uint64_t>(st.st_size, size);
+        totals.Add(region, "asset", asset->path, assetSize);
+        size -= assetSize;
+    }
+}
+
+// Space the linker script reserved with e.g. "gHeap = .; . = 0x1C000;" or
+// "gFoo = .; . += 0x10;" (which is how ramscrgen places COMMON symbols).
+// ld lists it as fill, or not at all, depending on its version. Each run
+// is named after the symbol assigned where it starts. Returns false if
+// nothing was assigned in [start, end), which makes it plain fill.
+static bool AddScriptSpace(const Region *region, std::uint32_t start, std::uint32_t end, const std::vector<MapAssignment>& assignments, Totals& totals)
+{
+    auto it = std::lower_bound(assignments.begin(), assignments.end(), start, [](const MapAssignment& assignment, std::uint32_t address) {
+        return assignment.address < address;
+    });
+
+    if (it == assignments.end() || it->address >= end)
+        return false;
+
+    totals.Add(region, "file", "(linker script)", end - start);
+
+    if (it->address > start)
+        totals.Add(region, "symbol", "(linker script)", it->address - start);
+
+    for (; it != assignments.end() && it->address < end; ++it)
+    {
+        // Several symbols at one address: the last one names the run.
+        if (it + 1 != assignments.end() && (it + 1)->address == it->address)
+            continue;
+
+        std::uint32_t next = (it + 1 != assignments.end() && (it + 1)->address < end) ? (it + 1)->address : end;
+        totals.Add(region, "symbol", "(linker script):" + it->name, next - it->address);
+    }
+
+    return true;
+}
+
+std::vector<ReportEntry> BuildReport(const MapFile& map, std::vector<ElfSymbol> symbols, const std::vector<Incbin>& incbins)
+{
+    Totals totals;
+    std::unordered_map<std::string, std::string> sourceNames;
+    std::unordered_multimap<std::string, const Incbin *> incbinsBySymbol;
+
+    for (const Incbin& incbin : incbins)
+        incbinsBySymbol.emplace(incbin.symbol, &incbin);
+
+    // Where several symbols share an address, keep the one that says how
+    // big it is, preferring a global one.
+    std::stable_sort(symbols.begin(), symbols.end(), [](const ElfSymbol& a, const ElfSymbol& b) {
+        if (a.value != b.value)
+            return a.value < b.value;
+        if ((a.size != 0) != (b.size != 0))
+            return a.size != 0;
+        return a.global && !b.global;
+    });
+    symbols.erase(std::unique(symbols.begin(), symbols.end(), [](const ElfSymbol& a, const ElfSymbol& b) {
+        return a.value == b.value;
+    }), symbols.end());
+
+    std::vector<MapInputSection> inputSections = map.inputSections;
+    std::stable_sort(inputSections.begin(), inputSections.end(), [](const MapInputSection& a, const MapInputSection& b) {
+        return a.address < b.address;
+    });
+
+    std::vector<MapAssignment> assignments = map.assignments;
+    std::stable_sort(assignments.begin(), assignments.end(), [](const MapAssignment& a, const MapAssignment& b) {
+        return a.address < b.address;
+    });
+
+    for (const MapOutputSection& output : map.outputSections)
+    {
+        const Region *region = GetRegion(output.address);
+
+        if (region == nullptr || output.size == 0)
+            continue;
+
+        totals.Add(region, "region", "used", output.size);
+        totals.Add(region, "section", output.name, output.size);
+
+        std::uint32_t outputEnd = output.address + output.size;
+        std::uint32_t covered = output.address;
+
+        auto first = std::lower_bound(inputSections.begin(), inputSections.end(), output.address, [](const MapInputSection& input, std::uint32_t address) {
+            return input.address < address;
+        });
+
+        for (auto input = first; input != inputSections.end() && input->address < outputEnd; ++input)
+        {
+            std::uint32_t start = std::max(input->address, covered);
+            std::uint32_t end = std::min<std::uint64_t>(static_cast<std::uint64_t>(input->address) + input->size, outputEnd);
+
+            if (start >= end)
+                continue;
+
+            if (start > covered && !AddScriptSpace(region, covered, start, assignments, totals))
+                totals.Add(region, "file", "(gap)", start - covered);
+
+            covered = end;
+
+            if (input->fill)
+            {
+                if (!AddScriptSpace(region, start, end, assignments, totals))
+                    totals.Add(region, "file", "*fill*", end - start);
+                continue;
+            }
+
+            std::string source = GetSourceName(input->object, sourceNames);
+            totals.Add(region, "file", source, end - start);
+
+            // A symbol without a size runs up to the next one, which is how
+            // assembly labels work.
+            auto sym = std::lower_bound(symbols.begin(), symbols.end(), start, [](const ElfSymbol& symbol, std::uint32_t address) {
+                return symbol.value < address;
+            });
+            std::uint32_t pos = start;
+
+            for (; sym != symbols.end() && sym->value < end; ++sym)
+            {
+                if (sym->value < pos)
+                    continue;
+
+                std::uint32_t next = (sym + 1 != symbols.end() && (sym + 1)->value < end) ? (sym + 1)->value : end;
+                std::uint32_t size = sym->size != 0 ? std::min<std::uint64_t>(sym->size, end - sym->value) : next - sym->value;
+
+                totals.Add(region, "symbol", source + ":" + sym->name, size);
+                AddAssets(region, FindAssets(*sym, incbinsBySymbol), size, totals);
+                pos = sym->value + size;
+            }
+        }
+
+        if (covered < outputEnd && !AddScriptSpace(region, covered, outputEnd, assignments, totals))
+            totals.Add(region, "file", "(gap)", outputEnd - covered);
+    }
+
+    return totals.GetEntries();
+}
+
+// By region, then kind, then biggest first.
+static bool CompareEntries(const ReportEntry& a, const ReportEntry& b)
+{
+    int regionA = RegionOrder(a.region), regionB = RegionOrder(b.region);
+    int kindA = KindOrder(a.kind), kindB = KindOrder(b.kind);
+    std::int64_t bytesA = std::llabs(a.bytes), bytesB = std::llabs(b.bytes);
+
+    if (regionA != regionB)
+        return regionA < regionB;
+    if (kindA != kindB)
+        return kindA < kindB;
+    if (bytesA != bytesB)
+        return bytesA > bytesB;
+    return a.name < b.name;
+}
+
+// One tab-separated line per entry, biggest first, so the report can be
+// read as is, filtered with grep or re-sorted with sort.
+void WriteReport(std::vector<ReportEntry> report, const std::string& kind, std::FILE *out)
+{
+    std::sort(report.begin(), report.end(), CompareEntries);
+
+    std::fprintf(out, "%s\n", REPORT_HEADER);
+    std::fprintf(out, "# region\tkind\tbytes\tname\n");
+
+    for (const ReportEntry& entry : report)
+    {
+        if (kind.empty() || entry.kind == kind)
+            std::fprintf(out, "%s\t%s\t%" PRId64 "\t%s\n", entry.region.c_str(), entry.kind.c_str(), entry.bytes, entry.name.c_str());
+    }
+}
+
+std::vector<ReportEntry> ReadReport(std::string path)
+{
+    std::ifstream file(path);
+
+    if (!file.is_open())
+        FATAL_ERROR("error: failed to open \"%s\" for reading\n", path.c_str());
+
+    std::string line;
+
+    if (!std::getline(file, line) || line != REPORT_HEADER)
+        FATAL_ERROR("error: \"%s\" isn't a romsize report\n", path.c_str());
+
+    std::vector<ReportEntry> report;
+
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::size_t tab1 = line.find('\t');
+        std::size_t tab2 = tab1 == std::string::npos ? tab1 : line.find('\t', tab1 + 1);
+        std::size_t tab3 = tab2 == std::string::npos ? tab2 : line.find('\t', tab2 + 1);
+
+        if (tab3 == std::string::npos)
+            FATAL_ERROR("error: malformed line in \"%s\": %s\n", path.c_str(), line.c_str());
+
+        report.push_back({line.substr(0, tab1), line.substr(tab1 + 1, tab2 - tab1 - 1), std::strtoll(line.c_str() + tab2 + 1, nullptr, 10), line.substr(tab3 + 1)});
+    }
+
+    return report;
+}
+
+// Lists what changed size between two reports, biggest change first.
+void WriteDiff(const std::vector<ReportEntry>& oldReport, const std::vector<ReportEntry>& newReport, const std::string& kind, std::FILE *out)
+{
+    struct Change
+    {
+        ReportEntry delta;
+        std::int64_t oldBytes;
+        std::int64_t newBytes;
+    };
+
+    std::map<std::tuple<std::string, std::string, std::string>, std::pair<std::int64_t, std::int64_t>> sizes;
+
+    for (const ReportEntry& entry : oldReport)
+        sizes[std::make_tuple(entry.region, entry.kind, entry.name)].first += entry.bytes;
+
+    for (const ReportEntry& entry : newReport)
+        sizes[std::make_tuple(entry.region, entry.kind, entry.name)].second += entry.bytes;
+
+    std::vector<Change> changes;
+
+    for (const auto& size : sizes)
+    {
+        std::int64_t oldBytes = size.second.first;
+        std::int64_t newBytes = size.second.second;
+
+        if (oldBytes == newBytes || (!kind.empty() && std::get<1>(size.first) != kind))
+            continue;
+
+        changes.push_back({{std::get<0>(size.first), std::get<1>(size.first), newBytes - oldBytes, std::get<2>(size.first)}, oldBytes, newBytes});
+    }
+
+    std::sort(changes.begin(), changes.end(), [](const Change& a, const Change& b) {
+        return CompareEntries(a.delta, b.delta);
+    });
+
+    std::fprintf(out, "# region\tkind\told\tnew\tdelta\tname\n");
+
+    for (const Change& change : changes)
+    {
+        const ReportEntry& delta = change.delta;
+        std::fprintf(out, "%s\t%s\t%" PRId64 "\t%" PRId64 "\t%+" PRId64 "\t%s\n", delta.region.c_str(), delta.kind.c_str(), change.oldBytes, change.newBytes, delta.bytes, delta.name.c_str());
+    }
+}
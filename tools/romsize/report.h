@@ -0,0 +1,34 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "elf.h"
+#include "incbin.h"
+#include "map_file.h"
+
+// How many bytes of a region (ROM, EWRAM or IWRAM) belong to something.
+// Each kind accounts for the region separately:
+//   region   the output sections placed there
+//   section  an output section
+//   file     a source file, "*fill*" for padding, or "(linker script)" for
+//            space the linker script reserved (e.g. the heap, or COMMON
+//            symbols placed by ramscrgen)
+//   symbol   a function, data table or label, as "file:name"
+//   asset    a file pulled in with INCBIN or .incbin
+struct ReportEntry
+{
+    std::string region;
+    std::string kind;
+    std::int64_t bytes;
+    std::string name;
+};
+
+std::vector<ReportEntry> BuildReport(const MapFile& map, std::vector<ElfSymbol> symbols, const std::vector<Incbin>& incbins);
+void WriteReport(std::vector<ReportEntry> report, const std::string& kind, std::FILE *out);
+std::vector<ReportEntry> ReadReport(std::string path);
+void WriteDiff(const std::vector<ReportEntry>& oldReport, const std::vector<ReportEntry>& newReport, const std::string& kind, std::FILE *out);
+
+#endif // REPORT_H
@@ -0,0 +1,169 @@
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <sys/stat.h>
+#include "scaninc.h"
+#include "source_file.h"
+#include "dependency_cache.h"
+
+// Cache file format: a header line, then for each file a line with its mtime,
+// size, number of includes, number of incbins and path, followed by one line
+// per include and then one line per incbin.
+static const char *const CACHE_HEADER = "scaninc-cache 1";
+
+static bool GetFileStamp(const std::string& path, long long& mtime, long long& size)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+
+#if defined(__APPLE__)
+    mtime = st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    mtime = st.st_mtime * 1000000000LL;
+#else
+    mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+    size = st.st_size;
+    return true;
+}
+
+const std::string *PathTable::Intern(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Elements of an unordered_set keep their address when it rehashes.
+    return &*m_paths.insert(path).first;
+}
+
+void DependencyCache::Load(const std::string& path)
+{
+    std::ifstream stream(path);
+    std::string line;
+
+    // A missing or outdated cache just means everything gets scanned again.
+    if (!std::getline(stream, line) || line != CACHE_HEADER)
+        return;
+
+    while (std::getline(stream, line))
+    {
+        std::istringstream fields(line);
+        ScannedFile file;
+        int numIncludes, numIncbins;
+        std::string filePath;
+
+        if (!(fields >> file.mtime >> file.size >> numIncludes >> numIncbins) || fields.get() != ' ' || !std::getline(fields, filePath))
+            break;
+
+        for (int i = 0; i < numIncludes && std::getline(stream, line); i++)
+            file.includes.push_back(Intern(line));
+
+        for (int i = 0; i < numIncbins && std::getline(stream, line); i++)
+            file.incbins.push_back(Intern(line));
+
+        if (!stream)
+            break;
+
+        file.dir = Intern(GetDir(filePath));
+
+        Entry *entry = GetEntry(Intern(filePath));
+        entry->loaded = true;
+        entry->file = std::move(file);
+    }
+}
+
+void DependencyCache::Save(const std::string& path)
+{
+    if (!m_dirty)
+        return;
+
+    std::string tempPath = path + ".tmp";
+    std::ofstream stream(tempPath);
+    std::map<std::string, Entry *> sorted;
+
+    for (const auto& entry : m_entries)
+        sorted[*entry.first] = entry.second.get();
+
+    stream << CACHE_HEADER << '\n';
+
+    for (const auto& entry : sorted)
+    {
+        const ScannedFile& file = entry.second->file;
+        long long mtime, size;
+
+        // Drop files that have been deleted since they were scanned.
+        if (!entry.second->valid && !(entry.second->loaded && GetFileStamp(entry.first, mtime, size)))
+            continue;
+
+        stream << file.mtime << ' ' << file.size << ' ' << file.includes.size() << ' ' << file.incbins.size() << ' ' << entry.first << '\n';
+
+        for (const std::string *include : file.includes)
+            stream << *include << '\n';
+
+        for (const std::string *incbin : file.incbins)
+            stream << *incbin << '\n';
+    }
+
+    stream.close();
+
+    // Failing to save the cache only makes the next run slower.
+    if (!stream || std::rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        std::fprintf(stderr, "Warning: failed to write \"%s\".\n", path.c_str());
+        std::remove(tempPath.c_str());
+    }
+}
+
+DependencyCache::Entry *DependencyCache::GetEntry(const std::string *path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unique_ptr<Entry>& entry = m_entries[path];
+
+    if (!entry)
+        entry.reset(new Entry);
+
+    return entry.get();
+}
+
+// Revalidates a loaded entry against the file on disk, or scans the file.
+void DependencyCache::Check(const std::string *path, Entry *entry)
+{
+    long long mtime, size;
+
+    if (!GetFileStamp(*path, mtime, size))
+        FATAL_ERROR("Failed to open \"%s\" for reading.\n", path->c_str());
+
+    entry->valid = true;
+
+    if (entry->loaded && entry->file.mtime == mtime && entry->file.size == size)
+        return;
+
+    SourceFile source(*path);
+    ScannedFile& file = entry->file;
+
+    file.mtime = mtime;
+    file.size = size;
+    file.dir = Intern(source.GetSrcDir());
+    file.includes.clear();
+    file.incbins.clear();
+
+    for (const std::string& include : source.GetIncludes())
+        file.includes.push_back(Intern(include));
+
+    for (const std::string& incbin : source.GetIncbins())
+        file.incbins.push_back(Intern(incbin));
+
+    m_dirty = true;
+}
+
+const ScannedFile& DependencyCache::Get(const std::string *path)
+{
+    Entry *entry = GetEntry(path);
+
+    // Threads asking for the same file wait for the first one to scan it.
+    std::call_once(entry->checked, &DependencyCache::Check, this, path, entry);
+
+    return entry->file;
+}
@@ -0,0 +1,65 @@
+#ifndef DEPENDENCY_CACHE_H
+#define DEPENDENCY_CACHE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Hands out one shared copy of each distinct path, so that paths can be
+// compared and hashed by pointer. The strings live as long as the table.
+class PathTable
+{
+public:
+    const std::string *Intern(const std::string& path);
+
+private:
+    std::mutex m_mutex;
+    std::unordered_set<std::string> m_paths;
+};
+
+// The includes and incbins found in one file, along with the mtime and size
+// it had when it was scanned. All paths are interned.
+struct ScannedFile
+{
+    long long mtime;
+    long long size;
+    const std::string *dir;
+    std::vector<const std::string *> includes;
+    std::vector<const std::string *> incbins;
+};
+
+// Remembers the includes and incbins of every file it has scanned, so that
+// each file is lexed at most once per run, and not at all if the cache was
+// loaded from an earlier run and the file's mtime and size haven't changed.
+// Get() may be called from several threads at once.
+class DependencyCache
+{
+public:
+    void Load(const std::string& path);
+    void Save(const std::string& path);
+    const ScannedFile& Get(const std::string *path);
+    const std::string *Intern(const std::string& path) { return m_paths.Intern(path); }
+
+private:
+    struct Entry
+    {
+        std::once_flag checked;
+        bool loaded = false;
+        bool valid = false;
+        ScannedFile file;
+    };
+
+    PathTable m_paths;
+    std::mutex m_mutex;
+    std::unordered_map<const std::string *, std::unique_ptr<Entry>> m_entries;
+    std::atomic<bool> m_dirty{false};
+
+    Entry *GetEntry(const std::string *path);
+    void Check(const std::string *path, Entry *entry);
+};
+
+#endif // DEPENDENCY_CACHE_H
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <atomic>
+#include <queue>
+#include <thread>
+#include <unordered_set>
+#include <sys/stat.h>
+#include "dependency_scanner.h"
+
+DependencyScanner::DependencyScanner(DependencyCache& cache, const std::vector<std::string>& includeDirs)
+    : m_cache(cache), m_includeDirs(includeDirs)
+{
+}
+
+const std::string *DependencyScanner::FindInclude(const std::string *dir, const std::string *include)
+{
+    LookupKey key(dir, include);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_lookups.find(key);
+        if (it != m_lookups.end())
+            return it->second;
+    }
+
+    const std::string *found = nullptr;
+    struct stat st;
+
+    for (std::size_t i = 0; i <= m_includeDirs.size() && found == nullptr; i++)
+    {
+        std::string path((i < m_includeDirs.size() ? m_includeDirs[i] : *dir) + *include);
+        if (stat(path.c_str(), &st) == 0)
+            found = m_cache.Intern(path);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lookups[key] = found;
+    return found;
+}
+
+std::vector<std::string> DependencyScanner::Scan(const std::string& path)
+{
+    std::queue<const std::string *> filesToProcess;
+    std::unordered_set<const std::string *> seen;
+    std::vector<std::string> dependencies;
+
+    filesToProcess.push(m_cache.Intern(path));
+
+    while (!filesToProcess.empty())
+    {
+        const ScannedFile& file = m_cache.Get(filesToProcess.front());
+        filesToProcess.pop();
+
+        for (const std::string *incbin : file.incbins)
+        {
+            if (seen.insert(incbin).second)
+                dependencies.push_back(*incbin);
+        }
+        for (const std::string *include : file.includes)
+        {
+            const std::string *includePath = FindInclude(file.dir, include);
+            if (includePath != nullptr && seen.insert(includePath).second)
+            {
+                dependencies.push_back(*includePath);
+                filesToProcess.push(includePath);
+            }
+        }
+    }
+
+    std::sort(dependencies.begin(), dependencies.end());
+    return dependencies;
+}
+
+// Scans each path on a pool of threads that take the next unscanned path as
+// they become free. The callback is called from the worker threads.
+void DependencyScanner::ScanAll(const std::vector<std::string>& paths, int numThreads,
+                                const std::function<void(const std::string&, const std::vector<std::string>&)>& callback)
+{
+    std::atomic<std::size_t> next(0);
+    std::vector<std::thread> threads;
+
+    auto work = [&]()
+    {
+        std::size_t i;
+        while ((i = next++) < paths.size())
+            callback(paths[i], Scan(paths[i]));
+    };
+
+    for (int i = 1; i < numThreads; i++)
+        threads.emplace_back(work);
+
+    work();
+
+    for (std::thread& thread : threads)
+        thread.join();
+}
@@ -0,0 +1,43 @@
+#ifndef DEPENDENCY_SCANNER_H
+#define DEPENDENCY_SCANNER_H
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "dependency_cache.h"
+
+// Finds everything a file includes or incbins, directly or not. Includes are
+// looked up in the include dirs and then in the including file's own dir, and
+// the result of each (dir, include) lookup is remembered. Scan() may be called
+// from several threads at once.
+class DependencyScanner
+{
+public:
+    DependencyScanner(DependencyCache& cache, const std::vector<std::string>& includeDirs);
+    std::vector<std::string> Scan(const std::string& path);
+    void ScanAll(const std::vector<std::string>& paths, int numThreads,
+                 const std::function<void(const std::string&, const std::vector<std::string>&)>& callback);
+
+private:
+    typedef std::pair<const std::string *, const std::string *> LookupKey;
+
+    struct LookupKeyHash
+    {
+        std::size_t operator()(const LookupKey& key) const
+        {
+            return std::hash<const void *>()(key.first) * 31 + std::hash<const void *>()(key.second);
+        }
+    };
+
+    DependencyCache& m_cache;
+    std::vector<std::string> m_includeDirs;
+    std::mutex m_mutex;
+    std::unordered_map<LookupKey, const std::string *, LookupKeyHash> m_lookups;
+
+    const std::string *FindInclude(const std::string *dir, const std::string *include);
+};
+
+#endif // DEPENDENCY_SCANNER_H
@@ -18,39 +18,118 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
-#include <list>
-#include <queue>
-#include <set>
+#include <fstream>
+#include <iterator>
 #include <string>
+#include <thread>
+#include <vector>
 #include "scaninc.h"
-#include "source_file.h"
+#include "dependency_cache.h"
+#include "dependency_scanner.h"
 
-bool CanOpenFile(std::string path)
+const char *const USAGE = "Usage: scaninc [-I INCLUDE_PATH] FILE_PATH\n"
+                          "       scaninc [-I INCLUDE_PATH] [-c CACHE_PATH] [-j THREADS] -d OBJ_DIR FILE_PATH...\n"
+                          "       scaninc [-I INCLUDE_PATH] [-j THREADS] -bench FILE_PATH...\n";
+
+// Writes OBJ_DIR/NAME.d, declaring the dependencies of OBJ_DIR/NAME.o, unless
+// it already has exactly that contents.
+void WriteDepFile(const std::string& objDir, const std::string& srcPath, const std::vector<std::string>& dependencies)
 {
-    FILE *fp = std::fopen(path.c_str(), "rb");
+    std::string name = srcPath.substr(srcPath.rfind('/') + 1);
+    name = name.substr(0, name.rfind('.'));
 
-    if (fp == NULL)
-        return false;
+    std::string contents = objDir + name + ".o:";
+    for (const std::string& path : dependencies)
+    {
+        contents += " \\\n ";
+        for (char c : path)
+        {
+            if (c == ' ' || c == '#')
+                contents += '\\';
+            else if (c == '$')
+                contents += '$';
+            contents += c;
+        }
+    }
+    contents += '\n';
+
+    std::string depPath = objDir + name + ".d";
+    std::ifstream existing(depPath, std::ios::binary);
+    if (existing && std::string(std::istreambuf_iterator<char>(existing), std::istreambuf_iterator<char>()) == contents)
+        return;
+    existing.close();
 
-    std::fclose(fp);
-    return true;
+    std::ofstream stream(depPath, std::ios::binary);
+    stream << contents;
+    stream.close();
+    if (!stream)
+        FATAL_ERROR("Failed to write \"%s\".\n", depPath.c_str());
 }
 
-const char *const USAGE = "Usage: scaninc [-I INCLUDE_PATH] FILE_PATH\n";
+// Times three ways of scanning every file: with a fresh cache for each file,
+// as separate scaninc processes did, with one shared cache on one thread, and
+// with one shared cache on numThreads threads. All three must agree.
+void RunBenchmark(const std::vector<std::string>& paths, const std::vector<std::string>& includeDirs, int numThreads)
+{
+    typedef std::chrono::steady_clock Clock;
+    std::vector<std::vector<std::string>> expected(paths.size());
+    std::size_t numDependencies = 0;
+
+    Clock::time_point start = Clock::now();
+    for (std::size_t i = 0; i < paths.size(); i++)
+    {
+        DependencyCache cache;
+        DependencyScanner scanner(cache, includeDirs);
+        expected[i] = scanner.Scan(paths[i]);
+        numDependencies += expected[i].size();
+    }
+    double separateTime = std::chrono::duration<double>(Clock::now() - start).count();
+
+    double sharedTimes[2];
+    int threadCounts[2] = { 1, numThreads };
+    for (int run = 0; run < 2; run++)
+    {
+        DependencyCache cache;
+        DependencyScanner scanner(cache, includeDirs);
+        std::vector<std::vector<std::string>> results(paths.size());
+
+        start = Clock::now();
+        scanner.ScanAll(paths, threadCounts[run], [&](const std::string& path, const std::vector<std::string>& dependencies)
+        {
+            results[&path - &paths[0]] = dependencies;
+        });
+        sharedTimes[run] = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (results != expected)
+            FATAL_ERROR("Shared cache scan with %d threads gave different results.\n", threadCounts[run]);
+    }
+
+    std::printf("%zu files, %zu dependencies\n", paths.size(), numDependencies);
+    std::printf("separate caches:           %8.3f s\n", separateTime);
+    std::printf("shared cache, 1 thread:    %8.3f s\n", sharedTimes[0]);
+    std::printf("shared cache, %2d threads:  %8.3f s\n", numThreads, sharedTimes[1]);
+}
 
 int main(int argc, char **argv)
 {
-    std::queue<std::string> filesToProcess;
-    std::set<std::string> dependencies;
-
     std::vector<std::string> includeDirs;
+    std::vector<std::string> paths;
+    std::string cachePath;
+    std::string objDir;
+    bool depFileMode = false;
+    bool benchmark = false;
+    int numThreads = std::thread::hardware_concurrency();
+
+    if (numThreads < 1)
+        numThreads = 1;
 
     argc--;
     argv++;
 
-    while (argc > 1)
+    while (argc > 0)
     {
         std::string arg(argv[0]);
         if (arg.substr(0, 2) == "-I")
@@ -58,6 +137,8 @@ int main(int argc, char **argv)
             std::string includeDir = arg.substr(2);
             if (includeDir.empty())
             {
+                if (argc < 2)
+                    FATAL_ERROR(USAGE);
                 argc--;
                 argv++;
                 includeDir = std::string(argv[0]);
@@ -68,54 +149,78 @@ int main(int argc, char **argv)
             }
             includeDirs.push_back(includeDir);
         }
-        else
+        else if (arg == "-bench")
+        {
+            benchmark = true;
+        }
+        else if ((arg == "-c" || arg == "-d" || arg == "-j") && argc >= 2)
+        {
+            argc--;
+            argv++;
+            if (arg == "-c")
+            {
+                cachePath = argv[0];
+            }
+            else if (arg == "-j")
+            {
+                numThreads = std::atoi(argv[0]);
+                if (numThreads < 1)
+                    FATAL_ERROR("Thread count must be positive.\n");
+            }
+            else
+            {
+                objDir = argv[0];
+                if (!objDir.empty() && objDir.back() != '/')
+                {
+                    objDir += '/';
+                }
+                depFileMode = true;
+            }
+        }
+        else if (arg[0] == '-')
         {
             FATAL_ERROR(USAGE);
         }
+        else
+        {
+            paths.push_back(arg);
+        }
         argc--;
         argv++;
     }
 
-    if (argc != 1) {
+    if (paths.empty() || (!depFileMode && !benchmark && paths.size() != 1)) {
         FATAL_ERROR(USAGE);
     }
 
-    std::string initialPath(argv[0]);
+    if (benchmark)
+    {
+        RunBenchmark(paths, includeDirs, numThreads);
+        return 0;
+    }
+
+    DependencyCache cache;
+    DependencyScanner scanner(cache, includeDirs);
 
-    filesToProcess.push(initialPath);
+    if (!cachePath.empty())
+        cache.Load(cachePath);
 
-    while (!filesToProcess.empty())
+    if (depFileMode)
     {
-        std::string filePath = filesToProcess.front();
-        SourceFile file(filePath);
-        filesToProcess.pop();
-
-        includeDirs.push_back(file.GetSrcDir());
-        for (auto incbin : file.GetIncbins())
+        // Scan every file in one run, sharing the parsed headers between them.
+        scanner.ScanAll(paths, numThreads, [&](const std::string& path, const std::vector<std::string>& dependencies)
         {
-            dependencies.insert(incbin);
-        }
-        for (auto include : file.GetIncludes())
+            WriteDepFile(objDir, path, dependencies);
+        });
+    }
+    else
+    {
+        for (const std::string &path : scanner.Scan(paths[0]))
         {
-            for (auto includeDir : includeDirs)
-            {
-                std::string path(includeDir + include);
-                if (CanOpenFile(path))
-                {
-                    bool inserted = dependencies.insert(path).second;
-                    if (inserted)
-                    {
-                        filesToProcess.push(path);
-                    }
-                    break;
-                }
-            }
+            std::printf("%s\n", path.c_str());
         }
-        includeDirs.pop_back();
     }
 
-    for (const std::string &path : dependencies)
-    {
-        std::printf("%s\n", path.c_str());
-    }
+    if (!cachePath.empty())
+        cache.Save(cachePath);
 }